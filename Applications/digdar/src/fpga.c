@@ -345,21 +345,51 @@ int osc_fpga_update_params(int trig_imm, int trig_source, int trig_edge,
     }
 
        // Update digdar registers
+       osc_fpga_update_digdar_params(trig_excite, trig_relax, digdar_trig_delay, trig_latency,
+                                     acp_excite, acp_relax, acp_latency,
+                                     arp_excite, arp_relax, arp_latency,
+                                     acps_per_arp);
+    return 0;
+}
+
 
-       g_digdar_fpga_reg_mem->trig_thresh_excite = trig_excite * (1 << (c_osc_fpga_adc_bits - 1));
-       g_digdar_fpga_reg_mem->trig_thresh_relax  = trig_relax  * (1 << (c_osc_fpga_adc_bits - 1));
-       g_digdar_fpga_reg_mem->trig_delay   = digdar_trig_delay;
-       g_digdar_fpga_reg_mem->trig_latency = trig_latency;
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Setup digdar FPGA module, without disturbing the acquisition
+ *
+ * @param[in] trig_excite        digdar trigger excitation threshold; unit: relative to ADC full range; [-1 ... 1]
+ * @param[in] trig_relax         digdar trigger relaxation threshold; unit: relative to ADC full range; [-1 ... 1]
+ * @param[in] digdar_trig_delay  digdar trigger delay (traditional meaning: how long after trigger does digitizing start)
+ * @param[in] trig_latency       digdar trigger latency: min delay between relaxation and excitation; unit: ADC clocks
+ * @param[in] acp_excite         digdar acp excitation threshold; unit: relative to ADC full range; [-1 ... 1]
+ * @param[in] acp_relax          digdar acp relaxation threshold; unit: relative to ADC full range; [-1 ... 1]
+ * @param[in] acp_latency        digdar acp latency: min delay between relaxation and excitation; unit: ADC clocks
+ * @param[in] arp_excite         digdar arp excitation threshold; unit: relative to ADC full range; [-1 ... 1]
+ * @param[in] arp_relax          digdar arp relaxation threshold; unit: relative to ADC full range; [-1 ... 1]
+ * @param[in] arp_latency        digdar arp latency: min delay between relaxation and excitation; unit: ADC clocks
+ * @param[in] acps_per_arp       digdar number of acps per arp
+ *
+ * @retval 0 Success, never fails
+ */
+int osc_fpga_update_digdar_params(float trig_excite, float trig_relax, float digdar_trig_delay, float trig_latency,
+                                  float acp_excite, float acp_relax, float acp_latency,
+                                  float arp_excite, float arp_relax, float arp_latency,
+                                  float acps_per_arp)
+{
+    g_digdar_fpga_reg_mem->trig_thresh_excite = trig_excite * (1 << (c_osc_fpga_adc_bits - 1));
+    g_digdar_fpga_reg_mem->trig_thresh_relax  = trig_relax  * (1 << (c_osc_fpga_adc_bits - 1));
+    g_digdar_fpga_reg_mem->trig_delay   = digdar_trig_delay;
+    g_digdar_fpga_reg_mem->trig_latency = trig_latency;
 
-       g_digdar_fpga_reg_mem->acp_thresh_excite = acp_excite * (1 << (c_osc_fpga_xadc_bits - 1));
-       g_digdar_fpga_reg_mem->acp_thresh_relax  = acp_relax  * (1 << (c_osc_fpga_xadc_bits - 1));
-       g_digdar_fpga_reg_mem->acp_latency       = acp_latency;
+    g_digdar_fpga_reg_mem->acp_thresh_excite = acp_excite * (1 << (c_osc_fpga_xadc_bits - 1));
+    g_digdar_fpga_reg_mem->acp_thresh_relax  = acp_relax  * (1 << (c_osc_fpga_xadc_bits - 1));
+    g_digdar_fpga_reg_mem->acp_latency       = acp_latency;
 
-       g_digdar_fpga_reg_mem->arp_thresh_excite = arp_excite * (1 << (c_osc_fpga_xadc_bits - 1));
-       g_digdar_fpga_reg_mem->arp_thresh_relax  = arp_relax  * (1 << (c_osc_fpga_xadc_bits - 1));
-       g_digdar_fpga_reg_mem->arp_latency       = arp_latency;
+    g_digdar_fpga_reg_mem->arp_thresh_excite = arp_excite * (1 << (c_osc_fpga_xadc_bits - 1));
+    g_digdar_fpga_reg_mem->arp_thresh_relax  = arp_relax  * (1 << (c_osc_fpga_xadc_bits - 1));
+    g_digdar_fpga_reg_mem->arp_latency       = arp_latency;
 
-       g_digdar_acp_per_arp = acps_per_arp;
+    g_digdar_acp_per_arp = acps_per_arp;
     return 0;
 }
 
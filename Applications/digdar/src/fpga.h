@@ -526,6 +526,10 @@ int   osc_fpga_update_params(int trig_imm, int trig_source, int trig_edge,
                              float arp_excite, float arp_relax, float arp_latency,
                              float acps_per_arp
 );
+int   osc_fpga_update_digdar_params(float trig_excite, float trig_relax, float digdar_trig_delay, float trig_latency,
+                                    float acp_excite, float acp_relax, float acp_latency,
+                                    float arp_excite, float arp_relax, float arp_latency,
+                                    float acps_per_arp);
 int   osc_fpga_reset(void);
 int   osc_fpga_arm_trigger(void);
 int   osc_fpga_set_trigger(uint32_t trig_source);
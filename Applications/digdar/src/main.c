@@ -30,6 +30,7 @@
 #include "worker.h"
 #include "fpga.h"
 #include "calib.h"
+#include "pulses.h"
 
 /* Describe app. parameters with some info/limitations */
 pthread_mutex_t rp_main_params_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -522,7 +523,8 @@ void transform_from_iface_units(rp_app_params_t *p)
 int rp_set_params(rp_app_params_t *p, int len)
 {
     int i;
-    int fpga_update = 1;
+    /* the first call after loading or auto-set writes all of the FPGA */
+    int fpga_update = params_init ? 0 : RP_OSC_FPGA_UPDATE_ALL;
     int params_change = 0;
     
     TRACE("%s()\n", __FUNCTION__);
@@ -533,6 +535,13 @@ int rp_set_params(rp_app_params_t *p, int len)
     }
 
     pthread_mutex_lock(&rp_main_params_mutex);
+    /* Clients see xmin & xmax as their public copy and may send only the
+     * parameters they changed, so start from the public copy.
+     */
+    if(p != rp_main_params) {
+        rp_main_params[MIN_GUI_PARAM].value = rp_main_params[GUI_XMIN].value;
+        rp_main_params[MAX_GUI_PARAM].value = rp_main_params[GUI_XMAX].value;
+    }
     for(i = 0; i < len || p[i].name != NULL; i++) {
         int p_idx = -1;
         int j = 0;
@@ -561,8 +570,13 @@ int rp_set_params(rp_app_params_t *p, int len)
 
         if(rp_main_params[p_idx].value != p[i].value) {
           params_change = 1;
-          if(rp_main_params[p_idx].fpga_update)
-            fpga_update = 1;
+          /* digdar thresholds need not stop the acquisition */
+          if((p_idx >= DIGDAR_TRIG_EXCITE_PARAM) &&
+             (p_idx <= DIGDAR_ACPS_PER_ARP_PARAM))
+            fpga_update |= RP_OSC_FPGA_UPDATE_DIGDAR;
+          else if(rp_main_params[p_idx].fpga_update ||
+                  (p_idx == TIME_UNIT_PARAM))
+            fpga_update |= RP_OSC_FPGA_UPDATE_ALL;
         }
         if(rp_main_params[p_idx].min_val > p[i].value) {
             fprintf(stderr, "Incorrect parameters value: %f (min:%f), "
@@ -584,8 +598,8 @@ int rp_set_params(rp_app_params_t *p, int len)
 
         pthread_mutex_lock(&rp_main_params_mutex);
         /* Xmin & Xmax public copy to be served to clients */
-        rp_main_params[GUI_XMIN].value = p[MIN_GUI_PARAM].value;
-        rp_main_params[GUI_XMAX].value = p[MAX_GUI_PARAM].value;
+        rp_main_params[GUI_XMIN].value = rp_main_params[MIN_GUI_PARAM].value;
+        rp_main_params[GUI_XMAX].value = rp_main_params[MAX_GUI_PARAM].value;
         transform_acq_params(rp_main_params);
         pthread_mutex_unlock(&rp_main_params_mutex);
 
@@ -805,12 +819,26 @@ int rp_get_params(rp_app_params_t **p)
 
 int rp_get_signals(float ***s, int *sig_num, int *sig_len)
 {
-    int ret_val;
-    int sig_idx;
+    float **frame;
+    int ret_val, i;
 
     if(*s == NULL)
         return -1;
 
+    ret_val = rp_get_signals_frame(&frame, sig_num, sig_len);
+    if(ret_val != -1) {
+        for(i = 0; i < SIGNALS_NUM; i++)
+            memcpy(&(*s)[i][0], &frame[i][0], sizeof(float)*SIGNAL_LENGTH);
+    }
+
+    return ret_val;
+}
+
+int rp_get_signals_frame(float ***s, int *sig_num, int *sig_len)
+{
+    int ret_val;
+    int sig_idx;
+
     *sig_num = SIGNALS_NUM;
     *sig_len = SIGNAL_LENGTH;
 
@@ -828,6 +856,11 @@ int rp_get_signals(float ***s, int *sig_num, int *sig_len)
     return 0;
 }
 
+rp_app_pulses_t *rp_get_pulses(void)
+{
+    return rp_osc_pulses_get();
+}
+
 int rp_create_signals(float ***a_signals)
 {
     int i;
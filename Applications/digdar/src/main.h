@@ -38,6 +38,25 @@ typedef struct rp_app_params_s {
     float  max_val;
 } rp_app_params_t;
 
+/* Ring of the most recently captured pulses, grouped into sweeps (from one
+ * ARP to the next), which the web server streams in place - must be the
+ * same as in rp_bazaar_app.h.  The application only ever adds to it; a
+ * reader finds its data overwritten once head has moved on by slots.
+ */
+#define RP_APP_PULSES_SWEEPS 16
+typedef struct rp_app_pulses_s {
+    uint8_t           *buf;         /* slots pulses of slot_size bytes */
+    uint32_t           slot_size;
+    uint32_t           slots;       /* 2^n */
+    /* pulses added; pulse n is in slot n % slots */
+    volatile uint32_t  head;
+    /* sweeps started; sweep n starts with pulse
+     * sweep_start[n % RP_APP_PULSES_SWEEPS] and is complete once sweep n+1
+     * has started */
+    volatile uint32_t  sweeps;
+    volatile uint32_t  sweep_start[RP_APP_PULSES_SWEEPS];
+} rp_app_pulses_t;
+
 /* Signal measurement results structure - filled in worker and updated when
  * also measurement signal is stored from worker 
  */
@@ -130,6 +149,12 @@ int rp_app_exit(void);
 int rp_set_params(rp_app_params_t *p, int len);
 int rp_get_params(rp_app_params_t **p);
 int rp_get_signals(float ***s, int *sig_num, int *sig_len);
+/* optional entry point - ring of captured pulses */
+rp_app_pulses_t *rp_get_pulses(void);
+/* optional entry point - as rp_get_signals(), but points *s at the signals,
+ * which stay as they are until the next call
+ */
+int rp_get_signals_frame(float ***s, int *sig_num, int *sig_len);
 
 /* Internal helper functions */
 int  rp_create_signals(float ***a_signals);
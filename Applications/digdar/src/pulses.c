@@ -0,0 +1,121 @@
+/**
+ * digdar - marine radar digitizer
+ *
+ * @brief Ring of captured pulses, grouped into sweeps.
+ *
+ * Each pulse the worker captures is added to a ring with the digdar
+ * counters saved at its trigger.  A sweep starts with the first pulse
+ * seen after the ARP count changes.  The web server reads the ring in
+ * place (see rp_get_pulses()); nothing here waits for it.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pulses.h"
+#include "fpga.h"
+
+static rp_app_pulses_t rp_osc_pulses;
+/* ARP count of the previous pulse, once there is one */
+static int             rp_osc_pulses_have_arp = 0;
+static uint32_t        rp_osc_pulses_last_arp;
+
+#define DIGDAR_REG(BYTE_OFFSET) (*(uint32_t *) (((uint8_t *) digdar_regs) + BYTE_OFFSET))
+#define DIGDAR_CLOCK(LOW, HIGH) (((uint64_t)DIGDAR_REG(HIGH) << 32) + DIGDAR_REG(LOW))
+
+
+/*----------------------------------------------------------------------------*/
+int rp_osc_pulses_init(void)
+{
+    rp_osc_pulses_exit();
+
+    rp_osc_pulses.slot_size = sizeof(rp_osc_pulse_hdr_t) +
+        PULSE_SAMPLES * sizeof(int16_t);
+    rp_osc_pulses.slots = PULSE_SLOTS;
+    rp_osc_pulses.buf = (uint8_t *)malloc(rp_osc_pulses.slot_size *
+                                          rp_osc_pulses.slots);
+    if(rp_osc_pulses.buf == NULL)
+        return -1;
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_osc_pulses_exit(void)
+{
+    if(rp_osc_pulses.buf)
+        free(rp_osc_pulses.buf);
+    memset(&rp_osc_pulses, 0, sizeof(rp_osc_pulses));
+    rp_osc_pulses_have_arp = 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Adds the pulse just captured to the ring.
+ *
+ * @param[in] cha_signal   Channel A buffer in the FPGA memory
+ * @param[in] wr_ptr_trig  Write pointer at the trigger
+ * @param[in] digdar_regs  Digdar registers in the FPGA memory
+ */
+void rp_osc_pulses_add(int *cha_signal, int wr_ptr_trig,
+                       uint32_t *digdar_regs)
+{
+    rp_app_pulses_t *ring = &rp_osc_pulses;
+    uint32_t n = ring->head;
+    rp_osc_pulse_hdr_t *hdr;
+    int16_t *smpl;
+    const int sign = 1 << (c_osc_fpga_adc_bits - 1);
+    int i, cnts;
+
+    if(ring->buf == NULL)
+        return;
+
+    hdr = (rp_osc_pulse_hdr_t *)
+        (ring->buf + (n & (ring->slots - 1)) * ring->slot_size);
+    hdr->trig_count  = DIGDAR_REG(OFFSET_SAVED_TRIG_COUNT);
+    hdr->acp_count   = DIGDAR_REG(OFFSET_SAVED_ACP_COUNT);
+    hdr->arp_count   = DIGDAR_REG(OFFSET_SAVED_ARP_COUNT);
+    hdr->num_samples = PULSE_SAMPLES;
+    hdr->trig_clock  = DIGDAR_CLOCK(OFFSET_SAVED_TRIG_CLOCK_LOW,
+                                    OFFSET_SAVED_TRIG_CLOCK_HIGH);
+    hdr->acp_clock   = DIGDAR_CLOCK(OFFSET_SAVED_ACP_CLOCK_LOW,
+                                    OFFSET_SAVED_ACP_CLOCK_HIGH);
+    hdr->arp_clock   = DIGDAR_CLOCK(OFFSET_SAVED_ARP_CLOCK_LOW,
+                                    OFFSET_SAVED_ARP_CLOCK_HIGH);
+
+    smpl = (int16_t *)(hdr + 1);
+    for(i = 0; i < PULSE_SAMPLES; i++) {
+        cnts = cha_signal[(wr_ptr_trig + i) % OSC_FPGA_SIG_LEN] &
+            ((1 << c_osc_fpga_adc_bits) - 1);
+        /* sign extend the ADC count */
+        smpl[i] = (cnts ^ sign) - sign;
+    }
+
+    /* readers must see the whole pulse before the new head */
+    __sync_synchronize();
+    ring->head = n + 1;
+
+    if(rp_osc_pulses_have_arp && (hdr->arp_count != rp_osc_pulses_last_arp)) {
+        ring->sweep_start[ring->sweeps % RP_APP_PULSES_SWEEPS] = n;
+        __sync_synchronize();
+        ring->sweeps++;
+    }
+    rp_osc_pulses_last_arp = hdr->arp_count;
+    rp_osc_pulses_have_arp = 1;
+}
+
+
+/*----------------------------------------------------------------------------*/
+rp_app_pulses_t *rp_osc_pulses_get(void)
+{
+    if(rp_osc_pulses.buf == NULL)
+        return NULL;
+    return &rp_osc_pulses;
+}
@@ -0,0 +1,49 @@
+/**
+ * digdar - marine radar digitizer
+ *
+ * @brief Ring of captured pulses, grouped into sweeps.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __PULSES_H
+#define __PULSES_H
+
+#include <stdint.h>
+
+#include "main.h"
+
+/* Samples of channel A kept from each pulse, from its trigger on */
+#define PULSE_SAMPLES 2048
+/* Pulses in the ring (2^n) - a few sweeps at typical capture rates.  The
+ * web server streams only sweeps of up to 7/8 of this, and counts longer
+ * ones in /metrics as rp_sweeps_dropped_total{reason="too_long"} */
+#define PULSE_SLOTS   4096
+
+/* A pulse in the ring is this header, then num_samples int16 ADC counts.
+ * Counts and clocks (125 MHz) are the digdar registers saved at the
+ * pulse's trigger.  Everything is little-endian.
+ */
+typedef struct rp_osc_pulse_hdr_s {
+    uint32_t trig_count;
+    uint32_t acp_count;
+    uint32_t arp_count;
+    uint32_t num_samples;
+    uint64_t trig_clock;
+    uint64_t acp_clock;
+    uint64_t arp_clock;
+} __attribute__((packed)) rp_osc_pulse_hdr_t;
+
+int rp_osc_pulses_init(void);
+void rp_osc_pulses_exit(void);
+/* Adds the pulse just captured - only from the worker thread */
+void rp_osc_pulses_add(int *cha_signal, int wr_ptr_trig,
+                       uint32_t *digdar_regs);
+/* The ring, NULL when not initialized */
+rp_app_pulses_t *rp_osc_pulses_get(void);
+
+#endif /* __PULSES_H */
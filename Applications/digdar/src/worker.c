@@ -23,6 +23,7 @@
 
 #include "worker.h"
 #include "fpga.h"
+#include "pulses.h"
 
 pthread_t *rp_osc_thread_handler = NULL;
 void *rp_osc_worker_thread(void *args);
@@ -33,10 +34,19 @@ rp_app_params_t       *rp_osc_params = NULL;
 int                   rp_osc_params_dirty;
 int                   rp_osc_params_fpga_update;
 
-pthread_mutex_t       rp_osc_sig_mutex = PTHREAD_MUTEX_INITIALIZER;
-float               **rp_osc_signals;
-int                   rp_osc_signals_dirty = 0;
-int                   rp_osc_sig_last_idx = 0;
+/* Signals are handed to the web server in three frames, without a lock:
+ * the worker fills frame rp_osc_sig_back and swaps it for the middle one,
+ * the reader swaps its frame rp_osc_sig_front for the middle one once that
+ * is newer and reads it in place until its next call.
+ */
+#define RP_OSC_SIG_FRAMES 3
+/* flag in rp_osc_sig_middle: frame not taken by the reader yet */
+#define RP_OSC_SIG_NEW    4
+float               **rp_osc_sig_frames[RP_OSC_SIG_FRAMES];
+int                   rp_osc_sig_frame_idx[RP_OSC_SIG_FRAMES];
+int                   rp_osc_sig_back;     /* only from worker */
+int                   rp_osc_sig_front;    /* only from the reader */
+volatile int          rp_osc_sig_middle;
 float               **rp_tmp_signals; /* used for calculation, only from worker */
 
 /* Signals directly pointing at the FPGA mem space */
@@ -49,6 +59,36 @@ int                  *rp_fpga_xcha_signal, *rp_fpga_xchb_signal;
 rp_calib_params_t *rp_calib_params = NULL;
 
 
+/*----------------------------------------------------------------------------------*/
+static void rp_osc_sig_frames_cleanup(void)
+{
+    int i;
+
+    for(i = 0; i < RP_OSC_SIG_FRAMES; i++)
+        rp_cleanup_signals(&rp_osc_sig_frames[i]);
+}
+
+
+/*----------------------------------------------------------------------------------*/
+static int rp_osc_sig_frames_create(void)
+{
+    int i;
+
+    rp_osc_sig_frames_cleanup();
+    for(i = 0; i < RP_OSC_SIG_FRAMES; i++) {
+        if(rp_create_signals(&rp_osc_sig_frames[i]) < 0) {
+            rp_osc_sig_frames_cleanup();
+            return -1;
+        }
+        rp_osc_sig_frame_idx[i] = 0;
+    }
+    rp_osc_sig_back   = 0;
+    rp_osc_sig_middle = 1;
+    rp_osc_sig_front  = 2;
+    return 0;
+}
+
+
 /*----------------------------------------------------------------------------------*/
 int rp_osc_worker_init(rp_app_params_t *params, int params_len,
                        rp_calib_params_t *calib_params)
@@ -61,29 +101,35 @@ int rp_osc_worker_init(rp_app_params_t *params, int params_len,
 
     rp_copy_params(params, (rp_app_params_t **)&rp_osc_params);
 
-    rp_cleanup_signals(&rp_osc_signals);
-    if(rp_create_signals(&rp_osc_signals) < 0)
+    if(rp_osc_sig_frames_create() < 0)
         return -1;
 
     rp_cleanup_signals(&rp_tmp_signals);
     if(rp_create_signals(&rp_tmp_signals) < 0) {
-        rp_cleanup_signals(&rp_osc_signals);
+        rp_osc_sig_frames_cleanup();
         return -1;
     }
 
     if(osc_fpga_init() < 0) {
-        rp_cleanup_signals(&rp_osc_signals);
+        rp_osc_sig_frames_cleanup();
         rp_cleanup_signals(&rp_tmp_signals);
         return -1;
     }
 
     rp_calib_params = calib_params;
 
+    if(rp_osc_pulses_init() < 0) {
+        osc_fpga_exit();
+        rp_osc_sig_frames_cleanup();
+        rp_cleanup_signals(&rp_tmp_signals);
+        return -1;
+    }
+
     osc_fpga_get_sig_ptr(&rp_fpga_cha_signal, &rp_fpga_chb_signal, &rp_fpga_xcha_signal, &rp_fpga_xchb_signal);
 
     rp_osc_thread_handler = (pthread_t *)malloc(sizeof(pthread_t));
     if(rp_osc_thread_handler == NULL) {
-        rp_cleanup_signals(&rp_osc_signals);
+        rp_osc_sig_frames_cleanup();
         rp_cleanup_signals(&rp_tmp_signals);
         return -1;
     }
@@ -92,7 +138,7 @@ int rp_osc_worker_init(rp_app_params_t *params, int params_len,
     if(ret_val != 0) {
         osc_fpga_exit();
 
-        rp_cleanup_signals(&rp_osc_signals);
+        rp_osc_sig_frames_cleanup();
         rp_cleanup_signals(&rp_tmp_signals);
         fprintf(stderr, "pthread_create() failed: %s\n", 
                 strerror(errno));
@@ -119,8 +165,9 @@ int rp_osc_worker_exit(void)
                 strerror(errno));
     }
     osc_fpga_exit();
+    rp_osc_pulses_exit();
 
-    rp_cleanup_signals(&rp_osc_signals);
+    rp_osc_sig_frames_cleanup();
     rp_cleanup_signals(&rp_tmp_signals);
 
     rp_clean_params(rp_osc_params);
@@ -157,7 +204,8 @@ int rp_osc_worker_update_params(rp_app_params_t *params, int fpga_update)
     pthread_mutex_lock(&rp_osc_ctrl_mutex);
     rp_copy_params(params, (rp_app_params_t **)&rp_osc_params);
     rp_osc_params_dirty       = 1;
-    rp_osc_params_fpga_update = fpga_update;
+    /* the worker may not have taken the previous update yet */
+    rp_osc_params_fpga_update |= fpga_update;
     rp_osc_params[PARAMS_NUM].name = NULL;
     rp_osc_params[PARAMS_NUM].value = -1;
 
@@ -169,9 +217,7 @@ int rp_osc_worker_update_params(rp_app_params_t *params, int fpga_update)
 /*----------------------------------------------------------------------------------*/
 int rp_osc_clean_signals(void)
 {
-    pthread_mutex_lock(&rp_osc_sig_mutex);
-    rp_osc_signals_dirty = 0;
-    pthread_mutex_unlock(&rp_osc_sig_mutex);
+    __sync_fetch_and_and(&rp_osc_sig_middle, ~RP_OSC_SIG_NEW);
     return 0;
 }
 
@@ -179,42 +225,40 @@ int rp_osc_clean_signals(void)
 /*----------------------------------------------------------------------------------*/
 int rp_osc_get_signals(float ***signals, int *sig_idx)
 {
-    float **s = *signals;
-    pthread_mutex_lock(&rp_osc_sig_mutex);
-    if(rp_osc_signals_dirty == 0) {
-        *sig_idx = rp_osc_sig_last_idx;
-        pthread_mutex_unlock(&rp_osc_sig_mutex);
-        return -1;
+    int ret_val = -1;
+
+    if(rp_osc_sig_middle & RP_OSC_SIG_NEW) {
+        /* take the newest frame, giving ours back to the worker */
+        rp_osc_sig_front =
+            __sync_lock_test_and_set(&rp_osc_sig_middle, rp_osc_sig_front) &
+            ~RP_OSC_SIG_NEW;
+        ret_val = 0;
     }
 
-    memcpy(&s[0][0], &rp_osc_signals[0][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&s[1][0], &rp_osc_signals[1][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&s[2][0], &rp_osc_signals[2][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&s[3][0], &rp_osc_signals[3][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&s[4][0], &rp_osc_signals[4][0], sizeof(float)*SIGNAL_LENGTH);
-
-    *sig_idx = rp_osc_sig_last_idx;
-
-    rp_osc_signals_dirty = 0;
-    pthread_mutex_unlock(&rp_osc_sig_mutex);
-    return 0;
+    *signals = rp_osc_sig_frames[rp_osc_sig_front];
+    *sig_idx = rp_osc_sig_frame_idx[rp_osc_sig_front];
+    return ret_val;
 }
 
 
 /*----------------------------------------------------------------------------------*/
 int rp_osc_set_signals(float **source, int index)
 {
-    pthread_mutex_lock(&rp_osc_sig_mutex);
-
-    memcpy(&rp_osc_signals[0][0], &source[0][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&rp_osc_signals[1][0], &source[1][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&rp_osc_signals[2][0], &source[2][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&rp_osc_signals[3][0], &source[3][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&rp_osc_signals[4][0], &source[4][0], sizeof(float)*SIGNAL_LENGTH);
-    rp_osc_sig_last_idx = index;
-
-    rp_osc_signals_dirty = 1;
-    pthread_mutex_unlock(&rp_osc_sig_mutex);
+    float **s = rp_osc_sig_frames[rp_osc_sig_back];
+
+    memcpy(&s[0][0], &source[0][0], sizeof(float)*SIGNAL_LENGTH);
+    memcpy(&s[1][0], &source[1][0], sizeof(float)*SIGNAL_LENGTH);
+    memcpy(&s[2][0], &source[2][0], sizeof(float)*SIGNAL_LENGTH);
+    memcpy(&s[3][0], &source[3][0], sizeof(float)*SIGNAL_LENGTH);
+    memcpy(&s[4][0], &source[4][0], sizeof(float)*SIGNAL_LENGTH);
+    rp_osc_sig_frame_idx[rp_osc_sig_back] = index;
+
+    /* the reader must see the whole frame before it is published */
+    __sync_synchronize();
+    rp_osc_sig_back =
+        __sync_lock_test_and_set(&rp_osc_sig_middle,
+                                 rp_osc_sig_back | RP_OSC_SIG_NEW) &
+        ~RP_OSC_SIG_NEW;
 
     return 0;
 }
@@ -267,7 +311,8 @@ void *rp_osc_worker_thread(void *args)
         state = rp_osc_ctrl;
         if(rp_osc_params_dirty) {
             rp_copy_params(rp_osc_params, (rp_app_params_t **)&curr_params);
-            fpga_update = rp_osc_params_fpga_update;
+            fpga_update |= rp_osc_params_fpga_update;
+            rp_osc_params_fpga_update = 0;
 
             rp_osc_params_dirty = 0;
             dec_factor = 
@@ -308,7 +353,7 @@ void *rp_osc_worker_thread(void *args)
             rp_update_main_params(curr_params);
             continue;
         }
-        if(fpga_update) {
+        if(fpga_update & RP_OSC_FPGA_UPDATE_ALL) {
             osc_fpga_reset();
             if(osc_fpga_update_params((curr_params[TRIG_MODE_PARAM].value == 0),
                                       curr_params[TRIG_SRC_PARAM].value, 
@@ -358,6 +403,21 @@ void *rp_osc_worker_thread(void *args)
                                      curr_params[TRIG_EDGE_PARAM].value);
 
             fpga_update = 0;
+        } else if(fpga_update & RP_OSC_FPGA_UPDATE_DIGDAR) {
+            /* the acquisition goes on, only the thresholds change */
+            osc_fpga_update_digdar_params(
+                                      curr_params[DIGDAR_TRIG_EXCITE_PARAM].value,
+                                      curr_params[DIGDAR_TRIG_RELAX_PARAM].value,
+                                      curr_params[DIGDAR_TRIG_DELAY_PARAM].value,
+                                      curr_params[DIGDAR_TRIG_LATENCY_PARAM].value,
+                                      curr_params[DIGDAR_ACP_EXCITE_PARAM].value,
+                                      curr_params[DIGDAR_ACP_RELAX_PARAM].value,
+                                      curr_params[DIGDAR_ACP_LATENCY_PARAM].value,
+                                      curr_params[DIGDAR_ARP_EXCITE_PARAM].value,
+                                      curr_params[DIGDAR_ARP_RELAX_PARAM].value,
+                                      curr_params[DIGDAR_ARP_LATENCY_PARAM].value,
+                                      curr_params[DIGDAR_ACPS_PER_ARP_PARAM].value);
+            fpga_update = 0;
         }
 
         if(state == rp_osc_idle_state) {
@@ -539,6 +599,16 @@ void *rp_osc_worker_thread(void *args)
                             &ch1_meas, &ch2_meas, ch1_max_adc_v, ch2_max_adc_v,
                             curr_params[GEN_DC_OFFS_1].value,
                             curr_params[GEN_DC_OFFS_2].value);
+
+            /* keep the pulse for the sweep streams */
+            {
+                int wr_ptr_trig;
+                uint32_t *digdar_ptr;
+                osc_fpga_get_wr_ptr(NULL, &wr_ptr_trig);
+                osc_fpga_get_digdar_ptr(&digdar_ptr);
+                rp_osc_pulses_add(&rp_fpga_cha_signal[0], wr_ptr_trig,
+                                  digdar_ptr);
+            }
         } else {
             long_acq_idx = rp_osc_decimate_partial((float **)&rp_tmp_signals[1], 
                                              &rp_fpga_cha_signal[0], 
@@ -34,17 +34,21 @@ int rp_osc_worker_init(rp_app_params_t *params, int params_len,
 int rp_osc_worker_exit(void);
 int rp_osc_worker_change_state(rp_osc_worker_state_t new_state);
 int rp_osc_worker_get_state(rp_osc_worker_state_t *state);
+/* fpga_update of rp_osc_worker_update_params() */
+#define RP_OSC_FPGA_UPDATE_DIGDAR 0x1 /* digdar registers only */
+#define RP_OSC_FPGA_UPDATE_ALL    0x2 /* reset and write all registers */
 int rp_osc_worker_update_params(rp_app_params_t *params, int fpga_update);
 
 /* removes 'dirty' flags */
 int rp_osc_clean_signals(void);
-/* Returns:
- *  0 - new signals (dirty signal) are copied to the output 
- *  1 - no new signals available (dirty signal was not set - we need to wait)
+/* Points *signals at the newest frame, which the worker leaves alone until
+ * the next call - only from one thread. Returns:
+ *  0 - new signals (dirty signal)
+ * -1 - no new signals available (the previous frame - we need to wait)
  */
 int rp_osc_get_signals(float ***signals, int *sig_idx);
-/* Fills the output signal structure from temp one after calculation is done 
- * and marks it dirty 
+/* Fills a free frame from temp one after calculation is done and publishes
+ * it as dirty - only from worker
  */
 int rp_osc_set_signals(float **source, int index);
 /* Fills the output measuremenet data with last measurements
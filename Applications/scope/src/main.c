@@ -624,6 +624,13 @@ int rp_set_params(rp_app_params_t *p, int len)
     }
 
     pthread_mutex_lock(&rp_main_params_mutex);
+    /* Clients see xmin & xmax as their public copy and may send only the
+     * parameters they changed, so start from the public copy.
+     */
+    if(p != rp_main_params) {
+        rp_main_params[MIN_GUI_PARAM].value = rp_main_params[GUI_XMIN].value;
+        rp_main_params[MAX_GUI_PARAM].value = rp_main_params[GUI_XMAX].value;
+    }
     for(i = 0; i < len || p[i].name != NULL; i++) {
         int p_idx = -1;
         int j = 0;
@@ -680,8 +687,8 @@ int rp_set_params(rp_app_params_t *p, int len)
 
         pthread_mutex_lock(&rp_main_params_mutex);
         /* Xmin & Xmax public copy to be served to clients */
-        rp_main_params[GUI_XMIN].value = p[MIN_GUI_PARAM].value;
-        rp_main_params[GUI_XMAX].value = p[MAX_GUI_PARAM].value;
+        rp_main_params[GUI_XMIN].value = rp_main_params[MIN_GUI_PARAM].value;
+        rp_main_params[GUI_XMAX].value = rp_main_params[MAX_GUI_PARAM].value;
         transform_acq_params(rp_main_params);
         pthread_mutex_unlock(&rp_main_params_mutex);
 
@@ -919,12 +926,26 @@ int rp_get_params(rp_app_params_t **p)
 
 int rp_get_signals(float ***s, int *sig_num, int *sig_len)
 {
-    int ret_val;
-    int sig_idx;
+    float **frame;
+    int ret_val, i;
 
     if(*s == NULL)
         return -1;
 
+    ret_val = rp_get_signals_frame(&frame, sig_num, sig_len);
+    if(ret_val != -1) {
+        for(i = 0; i < SIGNALS_NUM; i++)
+            memcpy(&(*s)[i][0], &frame[i][0], sizeof(float)*SIGNAL_LENGTH);
+    }
+
+    return ret_val;
+}
+
+int rp_get_signals_frame(float ***s, int *sig_num, int *sig_len)
+{
+    int ret_val;
+    int sig_idx;
+
     *sig_num = SIGNALS_NUM;
     *sig_len = SIGNAL_LENGTH;
 
@@ -150,6 +150,10 @@ int rp_app_exit(void);
 int rp_set_params(rp_app_params_t *p, int len);
 int rp_get_params(rp_app_params_t **p);
 int rp_get_signals(float ***s, int *sig_num, int *sig_len);
+/* optional entry point - as rp_get_signals(), but points *s at the signals,
+ * which stay as they are until the next call
+ */
+int rp_get_signals_frame(float ***s, int *sig_num, int *sig_len);
 
 /* Internal helper functions */
 int  rp_create_signals(float ***a_signals);
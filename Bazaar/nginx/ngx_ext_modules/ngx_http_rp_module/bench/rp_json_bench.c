@@ -0,0 +1,304 @@
+/**
+ * $Id$
+ *
+ * @brief Benchmark of the rp_module JSON writer against cJSON.
+ *
+ * Checks that rp_json_float4() prints the same text as cJSON's
+ * print_number_2d() for a sample of all float bit patterns and for
+ * rounding corner cases, then times printing signal arrays with
+ * rp_json_2dfloat_array() and with cJSON's print_2dfloat_array().
+ *
+ * The cJSON code below is print_number_2d() and print_2dfloat_array() as
+ * they were before rp_json.c, with the nginx pool replaced by an arena
+ * which, like the pool, only bumps a pointer.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+
+#include "rp_json.h"
+
+/* Signals and their length, as in GET /data */
+#define SIG_NUM 4
+#define SIG_LEN 1024
+
+static char  *arena = NULL;
+static size_t arena_size, arena_used;
+
+static void *arena_alloc(size_t sz)
+{
+    void *p;
+
+    sz = (sz + 7) & ~(size_t)7;
+    if(arena_used + sz > arena_size)
+        return NULL;
+    p = arena + arena_used;
+    arena_used += sz;
+    return p;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* cJSON's print_number_2d() for one value */
+static char *cjson_number(char *str, double d)
+{
+    if (fabs(floor(d)-d)<=DBL_EPSILON && fabs(d)<1.0e60)
+        sprintf(str,"%.04f",d);
+    else if (fabs(d)<1.0e-2 || fabs(d)>1.0e9)
+        sprintf(str,"%.04e",d);
+    else
+        sprintf(str,"%.04f",d);
+    return str;
+}
+
+
+/*----------------------------------------------------------------------------*/
+static char *cjson_print_number_2d(const float *v1, const float *v2, int i)
+{
+    char *str;
+
+    str=(char*)arena_alloc(64+64);
+    if (str) {
+        cjson_number(str, v1[i]);
+        strcat(str, ",");
+        cjson_number(str + strlen(str), v2[i]);
+    }
+    return str;
+}
+
+
+/*----------------------------------------------------------------------------*/
+static char *cjson_print_2dfloat_array(const float *v1, const float *v2, int n)
+{
+    char **entries;
+    char *out=0,*ptr;int len=5;
+    int i;
+
+    if (!n) {
+        out=(char*)arena_alloc(3);
+        if (out) strcpy(out,"[]");
+        return out;
+    }
+    entries=(char**)arena_alloc(n*sizeof(char*));
+    if (!entries)
+        return 0;
+    memset(entries,0,n*sizeof(char*));
+    for(i = 0; i < n; i++) {
+        entries[i]=cjson_print_number_2d(v1, v2, i);
+        if(!entries[i])
+            return 0;
+        len+=strlen(entries[i])+4;
+    }
+    out=(char*)arena_alloc(len);
+    if (!out)
+        return 0;
+
+    *out='[';
+    ptr=out+1;*ptr=0;
+    for (i=0;i<n;i++) {
+        *ptr++='[';
+        strcpy(ptr,entries[i]);ptr+=strlen(entries[i]);
+        *ptr++=']';
+        if (i!=n-1)
+            *ptr++=',';
+        *ptr=0;
+    }
+    *ptr++=']';*ptr++=0;
+    return out;
+}
+
+
+/*----------------------------------------------------------------------------*/
+static int check_float(float f)
+{
+    char ref[RP_JSON_FLOAT4_LEN + 16], out[RP_JSON_FLOAT4_LEN + 1];
+    char *end;
+
+    cjson_number(ref, f);
+    end = rp_json_float4(out, f);
+    *end = 0;
+    if(strcmp(ref, out)) {
+        fprintf(stderr, "%a: cJSON \"%s\", rp_json \"%s\"\n", f, ref, out);
+        return -1;
+    }
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+static int check(uint32_t stride)
+{
+    static const float corner[] = {
+        0.0f, 1.0f, 0.5f, 0.03125f, 0.00005f, 0.00015f, 0.99995f, 9.99995f,
+        0.01f, 0.0099999f, 0.0099995f, 1.0e9f, 16777216.0f, 16777217.0f,
+        3.0e38f, FLT_MAX, FLT_MIN, 1.0e-45f, 1.0e-40f, 1.0e-7f, 9.99995e-5f
+    };
+    uint64_t u;
+    int n, s, errors = 0;
+    unsigned i;
+
+    for(i = 0; i < sizeof(corner) / sizeof(corner[0]); i++) {
+        errors += check_float(corner[i]) < 0;
+        errors += check_float(-corner[i]) < 0;
+    }
+
+    /* every binary fraction with up to 20 bits, around the 5th digit */
+    for(s = 1; s <= 20; s++) {
+        for(n = 1; n < (1 << s); n += 2) {
+            errors += check_float((float)n / (1 << s)) < 0;
+            errors += check_float((float)n / (1 << s) / 1000) < 0;
+        }
+    }
+
+    for(u = 0; u < 0x100000000ULL; u += stride) {
+        union { uint32_t u; float f; } v;
+        v.u = (uint32_t)u;
+        errors += check_float(v.f) < 0;
+        if(errors > 20)
+            break;
+    }
+
+    return errors ? -1 : 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+static double now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+/*----------------------------------------------------------------------------*/
+static int bench(int iterations)
+{
+    static float sig[SIG_NUM + 1][SIG_LEN];
+    double t, t_cjson, t_rp_json;
+    size_t len = 0;
+    int i, j, k;
+
+    /* time axis, two sines, a small noisy signal and a step */
+    for(i = 0; i < SIG_LEN; i++) {
+        sig[0][i] = i * 0.001f;
+        sig[1][i] = sinf(i * 0.01f) * 1000.123f;
+        sig[2][i] = cosf(i * 0.03f) * 0.2f;
+        sig[3][i] = (rand() / (float)RAND_MAX - 0.5f) * 0.01f;
+        sig[4][i] = (i < SIG_LEN / 2) ? 0.0f : 2048.0f;
+    }
+
+    arena_size = (size_t)SIG_NUM * SIG_LEN * (128 + 16 + 48) + 4096;
+    arena = malloc(arena_size);
+    if(arena == NULL)
+        return -1;
+
+    /* both must print the same arrays */
+    for(j = 0; j < SIG_NUM; j++) {
+        char *out = malloc(RP_JSON_2DFLOAT_ARRAY_LEN(SIG_LEN) + 1);
+        char *ref;
+
+        arena_used = 0;
+        ref = cjson_print_2dfloat_array(sig[0], sig[j + 1], SIG_LEN);
+        if((out == NULL) || (ref == NULL))
+            return -1;
+        *rp_json_2dfloat_array(out, sig[0], sig[j + 1], SIG_LEN, 0) = 0;
+        if(strcmp(out, ref)) {
+            fprintf(stderr, "signal %d: arrays differ\n", j + 1);
+            return -1;
+        }
+        len += strlen(out);
+        free(out);
+    }
+
+    t = now();
+    for(k = 0; k < iterations; k++) {
+        arena_used = 0;
+        for(j = 0; j < SIG_NUM; j++) {
+            if(cjson_print_2dfloat_array(sig[0], sig[j + 1], SIG_LEN) == NULL)
+                return -1;
+        }
+    }
+    t_cjson = (now() - t) / iterations;
+
+    t = now();
+    for(k = 0; k < iterations; k++) {
+        /* one buffer for the response, as rp_data_cmd.c does */
+        char *buf = malloc(SIG_NUM * RP_JSON_2DFLOAT_ARRAY_LEN(SIG_LEN));
+        char *p = buf;
+
+        if(buf == NULL)
+            return -1;
+        for(j = 0; j < SIG_NUM; j++)
+            p = rp_json_2dfloat_array(p, sig[0], sig[j + 1], SIG_LEN, 0);
+        free(buf);
+    }
+    t_rp_json = (now() - t) / iterations;
+
+    printf("%d signals of %d pairs, %zu bytes of JSON:\n",
+           SIG_NUM, SIG_LEN, len);
+    printf("  print_2dfloat_array    %9.1f us\n", t_cjson * 1e6);
+    printf("  rp_json_2dfloat_array  %9.1f us  (%.1fx)\n", t_rp_json * 1e6,
+           t_cjson / t_rp_json);
+
+    free(arena);
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-s stride] [-n iterations]\n"
+            "  -s  check every stride-th float bit pattern (default 997,\n"
+            "      1 checks all of them)\n"
+            "  -n  iterations of the timed loops (default 200)\n", name);
+}
+
+
+int main(int argc, char *argv[])
+{
+    uint32_t stride = 997;
+    int iterations = 200;
+    int opt;
+
+    while((opt = getopt(argc, argv, "s:n:h")) != -1) {
+        switch(opt) {
+        case 's':
+            stride = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if((stride == 0) || (iterations <= 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(check(stride) < 0) {
+        fprintf(stderr, "rp_json_float4() differs from cJSON\n");
+        return 1;
+    }
+    printf("rp_json_float4() matches cJSON (stride %u)\n", stride);
+
+    return (bench(iterations) < 0) ? 1 : 0;
+}
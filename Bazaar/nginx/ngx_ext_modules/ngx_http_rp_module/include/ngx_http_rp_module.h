@@ -30,6 +30,11 @@
     ngx_log_error(NGX_LOG_ERR, log, 0, args);
 
 extern const char *json_content_str;
+extern const char *bin_content_str;
+extern const char *c_bazaar_uri;
+extern const char *c_data_uri;
+extern const char *c_metrics_uri;
+extern const char *c_sweeps_uri;
 
 typedef int (*rp_parse_body_func)(ngx_http_request_t *r);
 
@@ -91,8 +96,14 @@ int rp_module_cmd_error(cJSON **json_root, const char *reason,
 int rp_module_cmd_ok(cJSON **json_root, ngx_pool_t *pool);
 int rp_module_cmd_again(cJSON **json_root, ngx_pool_t *pool);
 
+/* Content handler of the locations with rp_module_cmd */
+ngx_int_t ngx_http_rp_bazaar_cmd_handler(ngx_http_request_t *r);
+
 ngx_int_t rp_module_redirect(ngx_http_request_t *r, const char *location);
 ngx_int_t rp_module_send_response(ngx_http_request_t *r, cJSON **json_root);
+/* Sends a response of len bytes held in the chain out */
+ngx_int_t rp_module_send_chain(ngx_http_request_t *r, const char *content_type,
+                               ngx_chain_t *out, off_t len);
 
 extern ngx_module_t ngx_http_rp_module;
 
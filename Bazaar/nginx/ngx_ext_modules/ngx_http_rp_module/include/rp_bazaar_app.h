@@ -42,6 +42,29 @@ typedef struct rp_app_params_s {
     float  max_val;
 } rp_app_params_t;
 
+/** Ring of the most recently captured pulses, grouped into sweeps, which
+ * an application may provide (see rp_get_pulses_func) for streaming:
+ *    - buf - slots pulses of slot_size bytes each, in an application
+ *            specific layout
+ *    - head - number of pulses added; pulse n is in slot n % slots (2^n)
+ *    - sweeps - number of sweeps started; sweep n starts with pulse
+ *               sweep_start[n % RP_APP_PULSES_SWEEPS] and is complete once
+ *               sweep n+1 has started
+ *
+ * The application only adds pulses, never waiting for readers; a reader
+ * must check that head has not moved on by slots past the pulses it uses.
+ * Must be the same as in the application.
+ **/
+#define RP_APP_PULSES_SWEEPS 16
+typedef struct rp_app_pulses_s {
+    uint8_t           *buf;
+    uint32_t           slot_size;
+    uint32_t           slots;
+    volatile uint32_t  head;
+    volatile uint32_t  sweeps;
+    volatile uint32_t  sweep_start[RP_APP_PULSES_SWEEPS];
+} rp_app_pulses_t;
+
 /* Functions & Structure which defines the application interface.
  * In application function with the same name and the same declaration must
  * be provided. For example: int rp_app_init(void);
@@ -54,6 +77,13 @@ typedef int          (*rp_set_params_func)(rp_app_params_t *p, int len);
 typedef int          (*rp_get_params_func)(rp_app_params_t **p);
 typedef int          (*rp_get_signals_func)(float ***s, int *sig_num, 
                                             int *sig_len);
+/* Optional functions: */
+typedef rp_app_pulses_t *(*rp_get_pulses_func)(void);
+/* As rp_get_signals_func, but *s is pointed at the application's own copy
+ * of the signals, which it leaves alone until the next call.
+ */
+typedef int          (*rp_get_signals_frame_func)(float ***s, int *sig_num,
+                                                  int *sig_len);
 
 typedef struct rp_bazaar_app_s {
     /* Initialization function - called when app. is loaded */
@@ -73,6 +103,10 @@ typedef struct rp_bazaar_app_s {
     rp_get_params_func       get_params_func;
     /* Retrieves last good signals from the application */
     rp_get_signals_func      get_signals_func;
+    /* Retrieves the ring of captured pulses, NULL if not provided */
+    rp_get_pulses_func       get_pulses_func;
+    /* Retrieves last good signals in place, NULL if not provided */
+    rp_get_signals_frame_func get_signals_frame_func;
 
     /* Dynamic library handle */
     void            *handle;
@@ -100,7 +134,10 @@ int rp_bazaar_app_get_local_list(const char *dir, cJSON **json_root,
                                  ngx_pool_t *pool, int verbose);
 int rp_bazaar_app_load_module(const char *app_file, rp_bazaar_app_t *app);
 int rp_bazaar_app_unload_module(rp_bazaar_app_t *app);
+/* Loads the FPGA, unless the same bitstream is already loaded */
 int rp_bazaar_app_load_fpga(const char *fpga_file);
+/* Adds the zone remembering the loaded bitstream, from postconfiguration */
+ngx_int_t rp_bazaar_fpga_init(ngx_conf_t *cf);
 int rp_bazaar_get_mac(const char* nic, char *mac);
 int rp_bazaar_get_dna(unsigned long long *dna);
 int get_info(cJSON **info, const char *dir, const char *app_id, ngx_pool_t *pool);
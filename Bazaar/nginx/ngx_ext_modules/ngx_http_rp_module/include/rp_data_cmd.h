@@ -22,6 +22,32 @@
 #include "ngx_http_rp_module.h"
 #include "cJSON.h"
 
+/* Binary signals, returned by GET /data?format=bin (float32 samples) or
+ * /data?format=bin16 (int16 samples, each signal with a float32 scale).
+ * The response is an rp_data_bin_header_t, then (with RP_DATA_BIN_INT16)
+ * sig_num float32 scales, then sig_num signals of sig_len samples each:
+ * the time axis, followed by the datasets.  Everything is little-endian.
+ * A sample's value is its int16 count times the scale of its signal.
+ */
+#define RP_DATA_BIN_MAGIC   0x42445052 /* "RPDB" read as bytes */
+#define RP_DATA_BIN_VERSION 1
+
+#define RP_DATA_BIN_INT16   0x0001     /* samples are int16, with scales */
+
+#define RP_DATA_BIN_OK      0          /* new signals */
+#define RP_DATA_BIN_AGAIN   1          /* no new signals; these are the previous ones */
+
+typedef struct rp_data_bin_header_s {
+    uint32_t magic;        /* RP_DATA_BIN_MAGIC */
+    uint16_t version;      /* RP_DATA_BIN_VERSION */
+    uint16_t header_size;  /* bytes before the first signal, including any scales */
+    uint16_t flags;        /* RP_DATA_BIN_... */
+    uint16_t status;       /* RP_DATA_BIN_OK or RP_DATA_BIN_AGAIN */
+    uint16_t sig_num;      /* number of signals */
+    uint16_t reserved;
+    uint32_t sig_len;      /* samples per signal */
+} __attribute__((packed)) rp_data_bin_header_t;
+
 /* Main handler */
 ngx_int_t rp_data_cmd_handler(ngx_http_request_t *r);
 
@@ -39,10 +65,23 @@ int rp_data_get_signals_list(ngx_http_request_t *r,
 int rp_data_get_params(ngx_http_request_t *r, cJSON **json_root);
 int rp_data_set_signals(ngx_http_request_t *r, cJSON **json_root);
 int rp_data_get_signals(ngx_http_request_t *r, cJSON **json_root);
+/* GET /data?format=bin and ?format=bin16 */
+ngx_int_t rp_data_send_bin_signals(ngx_http_request_t *r, int int16,
+                                   int ret_val);
+/* parks GET /data until new signals arrive or it times out */
+ngx_int_t rp_data_wait_signals(ngx_http_request_t *r, int format);
+void rp_data_poll_start(void);
+/* binary signals as for GET /data?format=bin, copied to dst */
+size_t rp_data_bin_signals_len(int int16);
+int rp_data_bin_signals_write(u_char *dst, int int16, int ret_val);
+/* JSON answer to a parameters update */
+char *rp_data_params_json(ngx_pool_t *pool);
 /* Clear dirty flag in case of re-send */
 void rp_data_clear_signals_dirty();
+/* Drops the application's signals, before it is unloaded */
+void rp_data_release_signals(void);
 
 /* Helper functions */
-int rp_data_parse_and_set_params(cJSON *params_root);
+int rp_data_parse_and_set_params(const u_char *text, size_t len);
 
 #endif /* __RP_DATA_CMD_H */
@@ -0,0 +1,28 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Nginx module - JSON writer for signal arrays.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_JSON_H
+#define __RP_JSON_H
+
+/* Longest number written by rp_json_float4() ("-3.4e38" as "%.04f") */
+#define RP_JSON_FLOAT4_LEN 48
+
+/* Longest array written by rp_json_2dfloat_array() for n pairs */
+#define RP_JSON_2DFLOAT_ARRAY_LEN(n) (2 + (n) * (2 * RP_JSON_FLOAT4_LEN + 5))
+
+/* Writes a float like cJSON does ("%.04f" or "%.04e"), returns its end */
+char *rp_json_float4(char *p, float f);
+/* Writes [[x,y],...] of n pairs; x or y may be NULL, returns its end */
+char *rp_json_2dfloat_array(char *p, const float *x, const float *y, int n,
+                            int fmt);
+
+#endif /* __RP_JSON_H */
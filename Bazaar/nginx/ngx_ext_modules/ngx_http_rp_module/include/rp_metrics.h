@@ -0,0 +1,60 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Nginx module - performance metrics.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_METRICS_H
+#define __RP_METRICS_H
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+/* Endpoints, each with its own requests, latency and bytes */
+#define RP_METRICS_EP_BAZAAR     0   /* /bazaar */
+#define RP_METRICS_EP_DATA_JSON  1   /* GET /data */
+#define RP_METRICS_EP_DATA_BIN   2   /* GET /data?format=bin or bin16 */
+#define RP_METRICS_EP_DATA_POST  3   /* POST /data */
+#define RP_METRICS_EP_DATA_WS    4   /* WebSocket on /data */
+#define RP_METRICS_EP_METRICS    5   /* /metrics */
+#define RP_METRICS_EP_SWEEPS     6   /* /sweeps */
+#define RP_METRICS_EP_NUM        7
+
+/* Formats the signals are served in */
+#define RP_METRICS_FMT_JSON      0
+#define RP_METRICS_FMT_BIN       1
+#define RP_METRICS_FMT_BIN16     2
+#define RP_METRICS_FMT_NUM       3
+
+/* Why a complete sweep wasn't sent to a /sweeps client */
+#define RP_METRICS_SWEEP_TOO_LONG     0   /* longer than the ring can hold safely */
+#define RP_METRICS_SWEEP_OVERWRITTEN  1   /* being overwritten before it was started */
+#define RP_METRICS_SWEEP_NUM          2
+
+/* Adds the shared memory zone and the log phase handler, from the
+ * postconfiguration of the module */
+ngx_int_t rp_metrics_init(ngx_conf_t *cf);
+
+/* Handler of /metrics */
+ngx_int_t rp_metrics_handler(ngx_http_request_t *r);
+
+/* Microseconds from an arbitrary start, for the timings below */
+uint64_t rp_metrics_now_us(void);
+
+/* A call of the application's rp_get_signals(), which returned ret_val */
+void rp_metrics_get_signals(uint64_t us, int ret_val);
+/* Serializing one frame of signals in a format */
+void rp_metrics_serialize(int format, uint64_t us);
+/* Frames sent in a format, to HTTP or WebSocket clients */
+void rp_metrics_frames_served(int format, ngx_uint_t n);
+/* A complete sweep not sent to a /sweeps client, for a reason above */
+void rp_metrics_sweep_dropped(int reason);
+
+#endif /* __RP_METRICS_H */
@@ -0,0 +1,42 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Nginx module - application parameters table.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_PARAMS_H
+#define __RP_PARAMS_H
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+#include "rp_bazaar_app.h"
+
+/* Most parameters of an application the table holds */
+#define RP_PARAMS_MAX      128
+/* Slots of the name index, a power of 2 well above RP_PARAMS_MAX */
+#define RP_PARAMS_HASH     256
+/* Longest parameter name */
+#define RP_PARAMS_NAME_MAX 64
+
+/* Errors of rp_params_parse() */
+#define RP_PARAMS_ERR_JSON   -1   /* not JSON */
+#define RP_PARAMS_ERR_DATA   -2   /* no "datasets" */
+#define RP_PARAMS_ERR_PARAMS -3   /* no "params" in "datasets" */
+/* Error of rp_data_parse_and_set_params() */
+#define RP_PARAMS_ERR_SET    -4   /* the application failed to set them */
+
+/* Reads the names and values of the parameters from the application */
+int rp_params_load(void);
+/* Parses {"datasets":{"params":{...}}}, returns the number of changed
+ * parameters, listed in *changed, or an RP_PARAMS_ERR_ code */
+int rp_params_parse(const u_char *text, size_t len,
+                    rp_app_params_t **changed);
+
+#endif /* __RP_PARAMS_H */
@@ -0,0 +1,47 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Nginx module - streaming of captured sweeps.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_SWEEP_H
+#define __RP_SWEEP_H
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+/* GET /sweeps streams the complete sweeps in the application's pulse ring,
+ * one HTTP chunk each: an rp_sweep_header_t, then pulses pulses of
+ * pulse_size bytes each, as the application stores them.  Everything is
+ * little-endian.
+ */
+#define RP_SWEEP_MAGIC   0x57535052 /* "RPSW" read as bytes */
+#define RP_SWEEP_VERSION 1
+
+typedef struct rp_sweep_header_s {
+    uint32_t magic;        /* RP_SWEEP_MAGIC */
+    uint16_t version;      /* RP_SWEEP_VERSION */
+    uint16_t header_size;  /* bytes before the first pulse */
+    uint32_t sweep;        /* sweep number, counted by the application */
+    uint32_t skipped;      /* sweeps not sent since the previous chunk */
+    uint32_t pulses;       /* number of pulses */
+    uint32_t pulse_size;   /* bytes per pulse */
+} __attribute__((packed)) rp_sweep_header_t;
+
+/* Starts streaming sweeps to GET /sweeps */
+ngx_int_t rp_sweep_handler(ngx_http_request_t *r);
+/* Number of connected clients */
+ngx_uint_t rp_sweep_clients(void);
+/* Sends newly completed sweeps to the clients ready for them */
+void rp_sweep_send(void);
+/* Closes all clients, before the application and its ring go away */
+void rp_sweep_close_all(void);
+
+#endif /* __RP_SWEEP_H */
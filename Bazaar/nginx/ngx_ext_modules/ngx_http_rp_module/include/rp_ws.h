@@ -0,0 +1,34 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Nginx module - WebSocket push channel.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_WS_H
+#define __RP_WS_H
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+/* Largest message accepted from a client */
+#define RP_WS_MAX_IN_MSG  8192
+/* Most control and text messages queued for a client before it is dropped */
+#define RP_WS_MAX_CTL     16
+
+/* Upgrades GET /data to a WebSocket */
+ngx_int_t rp_ws_handler(ngx_http_request_t *r, int int16);
+/* Number of connected WebSocket clients */
+ngx_uint_t rp_ws_clients(void);
+/* Pushes the new signals in the data module to all clients */
+void rp_ws_send_signals(void);
+/* Closes all clients */
+void rp_ws_close_all(void);
+
+#endif /* __RP_WS_H */
@@ -31,6 +31,7 @@
 #include <limits.h>
 #include <ctype.h>
 #include "cJSON.h"
+#include "rp_json.h"
 
 static const char *ep;
 
@@ -125,51 +126,6 @@ static const char *parse_number(cJSON *item,const char *num)
 	return num;
 }
 
-/* Render the number nicely from the given item into a string. */
-static char *print_number_2d(cJSON *item, int sample, ngx_pool_t *pool)
-{
-    char *str;
-    double d1 = 0,d2 = 0;
-    
-    if(sample >= item->d2_len)
-        return NULL;
-
-    if(item->d2_val1)
-        d1 = item->d2_val1[sample];
-    if(item->d2_val2)
-        d2 = item->d2_val2[sample];
-
-    /* This is a nice tradeoff. */
-    str=(char*)cJSON_malloc(pool, 64+64);
-    if (str) {
-        if(item->d2_val1) {
-            if (fabs(floor(d1)-d1)<=DBL_EPSILON && fabs(d1)<1.0e60)
-                sprintf(str,"%.04f",d1);
-            else if (fabs(d1)<1.0e-2 || fabs(d1)>1.0e9)
-                sprintf(str,"%.04e",d1);
-            else 
-                sprintf(str,"%.04f",d1);
-        }
-        if(item->d2_val1 && item->d2_val2) {
-            if (fabs(floor(d2)-d2)<=DBL_EPSILON && fabs(d2)<1.0e60)
-                sprintf(str,"%s,%.04f",str, d2);
-            else if (fabs(d2)<1.0e-2 || fabs(d2)>1.0e9)
-                sprintf(str,"%s,%.04e",str, d2);
-            else 
-                sprintf(str,"%s,%.04f",str, d2);
-        } else if(item->d2_val2) {
-            if (fabs(floor(d2)-d2)<=DBL_EPSILON && fabs(d2)<1.0e60)
-                sprintf(str,"%.04f",d2);
-            else if (fabs(d2)<1.0e-2 || fabs(d2)>1.0e9)
-                sprintf(str,"%.04e",d2);
-            else 
-                sprintf(str,"%.04f",d2);
-        }        
-    }
-
-    return str;
-}
-
 static char *print_number(cJSON *item, ngx_pool_t *pool)
 {
 	char *str;
@@ -469,73 +425,18 @@ static char *print_array(cJSON *item,int depth,int fmt, ngx_pool_t *pool)
 	return out;	
 }
 
-/* Render an array to text */
+/* Render a 2d float array to text, in one buffer sized for the worst case */
 static char *print_2dfloat_array(cJSON *item,int fmt, ngx_pool_t *pool)
 {
-    char **entries;
-    char *out=0,*ptr,*ret;int len=5;
-    int i=0,fail=0;
-    /* 2d Array has no children!*/
-
-    /* How many entries in the array? */
-    if (!item->d2_len) {
-        out=(char*)cJSON_malloc(pool, 3);
-        if (out) strcpy(out,"[]");
-        return out;
-    }
+    char *out,*ptr;
 
-    /* Allocate an array to hold the values for each */
-    entries=(char**)cJSON_malloc(pool, item->d2_len*sizeof(char*));
-    if (!entries) 
+    out=(char*)cJSON_malloc(pool, RP_JSON_2DFLOAT_ARRAY_LEN(item->d2_len)+1);
+    if (!out)
         return 0;
-    memset(entries,0,item->d2_len*sizeof(char*));
-
-    /* Retrieve all the results: */
-    for(i = 0; i < item->d2_len; i++) {
-        ret=print_number_2d(item, i, pool);
-        entries[i]=ret;
-        if(ret)
-            len+=strlen(ret)+4+(fmt?1:0);
-        else {
-            fail = 1;
-            break;
-        }
-    }
-	
-    /* If we didn't fail, try to malloc the output string */
-    if (!fail) 
-        out=(char*)cJSON_malloc(pool, len);
-    /* If that fails, we fail. */
-    if (!out) 
-        fail=1;
-
-    /* Handle failure. */
-    if (fail) {
-        for (i=0;i<item->d2_len;i++) 
-            if (entries[i]) 
-                cJSON_free(pool, entries[i]);
-        cJSON_free(pool, entries);
-        return 0;
-    }
-	
-    /* Compose the output array. */
-    *out='[';
-    ptr=out+1;*ptr=0;
-    for (i=0;i<item->d2_len;i++) {
-        *ptr++='[';
-        strcpy(ptr,entries[i]);ptr+=strlen(entries[i]);
-        *ptr++=']';
-        if (i!=item->d2_len-1) {
-            *ptr++=',';
-            if(fmt)
-                *ptr++=' ';
-            *ptr=0;
-        }
-        cJSON_free(pool, entries[i]);
-    }
-    cJSON_free(pool, entries);
-    *ptr++=']';*ptr++=0;
-    return out;	
+    ptr=rp_json_2dfloat_array(out, item->d2_val1, item->d2_val2,
+                              item->d2_len, fmt);
+    *ptr=0;
+    return out;
 }
 
 /* Build an object from the text. */
@@ -19,6 +19,8 @@
 #include "ngx_http_rp_module.h"
 #include "rp_bazaar_cmd.h"
 #include "rp_data_cmd.h"
+#include "rp_metrics.h"
+#include "rp_sweep.h"
 
 /* Be careful not to include system headers before Nginx ones!!! */
 #include <ctype.h>
@@ -40,17 +42,21 @@
 
 /* constants */
 const char *json_content_str = "application/json";
+const char *bin_content_str  = "application/octet-stream";
 const char *c_bazaar_dir     = "/opt/www/apps";
 const char *c_bazaar_server  = "http://bazaar.redpitaya.com";
 const char *c_tmp_dir        = "/tmp";
 
 const char *c_bazaar_uri = "/bazaar";
 const char *c_data_uri   = "/data";
+const char *c_metrics_uri = "/metrics";
+const char *c_sweeps_uri  = "/sweeps";
 
 ngx_http_rp_module_ctx_t rp_module_ctx;
 
 /* internal callbacks */
 ngx_int_t ngx_http_rp_init_module(ngx_cycle_t *cycle);
+ngx_int_t ngx_http_rp_postconfiguration(ngx_conf_t *cf);
 void     *ngx_http_rp_create_loc_conf(ngx_conf_t *cf);
 char     *ngx_http_rp_merge_loc_conf(ngx_conf_t *cf, void *parent, 
                                      void *child);
@@ -92,7 +98,7 @@ ngx_command_t ngx_http_rp_commands[] = {
 
 ngx_http_module_t ngx_http_rp_ctx = {
     NULL,                          /* preconfiguration */
-    NULL,                          /* postconfiguration */
+    ngx_http_rp_postconfiguration, /* postconfiguration */
  
     NULL,                          /* create main configuration */
     NULL,                          /* init main configuration */
@@ -133,6 +139,18 @@ ngx_int_t ngx_http_rp_init_module(ngx_cycle_t *cycle)
 }
 
 
+/*----------------------------------------------------------------------------*/
+ngx_int_t ngx_http_rp_postconfiguration(ngx_conf_t *cf)
+{
+    /* the bitstream in the FPGA, shared by all worker processes */
+    if(rp_bazaar_fpga_init(cf) != NGX_OK)
+        return NGX_ERROR;
+
+    /* performance metrics, shared by all worker processes */
+    return rp_metrics_init(cf);
+}
+
+
 /*----------------------------------------------------------------------------*/
 void *ngx_http_rp_create_loc_conf(ngx_conf_t *cf)
 {
@@ -210,6 +228,18 @@ ngx_int_t ngx_http_rp_bazaar_cmd_handler(ngx_http_request_t *r)
         return rp_data_cmd_handler(r);
     }
 
+    /* Metrics endpoint */
+    if((r->uri.len >= strlen(c_metrics_uri)) &&
+       (ngx_strncmp(r->uri.data, c_metrics_uri, strlen(c_metrics_uri)) == 0)) {
+        return rp_metrics_handler(r);
+    }
+
+    /* Sweeps stream */
+    if((r->uri.len >= strlen(c_sweeps_uri)) &&
+       (ngx_strncmp(r->uri.data, c_sweeps_uri, strlen(c_sweeps_uri)) == 0)) {
+        return rp_sweep_handler(r);
+    }
+
     return NGX_HTTP_NOT_ALLOWED;
 }
 
@@ -326,6 +356,44 @@ ngx_int_t rp_module_redirect(ngx_http_request_t *r, const char *loc)
 }
 
 
+/*----------------------------------------------------------------------------*/
+ngx_int_t rp_module_send_chain(ngx_http_request_t *r, const char *content_type,
+                               ngx_chain_t *out, off_t len)
+{
+    ngx_int_t rc;
+
+    r->headers_out.content_type_len = strlen(content_type);
+    r->headers_out.content_type.len = strlen(content_type);
+    r->headers_out.content_type.data = (u_char *)content_type;
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = len;
+
+    rc = ngx_http_send_header(r);
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    /* TODO: Be sure that outputting is always flushed! Had some problems
+     * at this part.
+     */
+
+    /* send the buffer chain of your response */
+    /* Temp, got from ruby-forum.com - put socket to blocking */
+    ngx_blocking(r->connection->fd);
+    rc = ngx_http_output_filter(r, out);
+    while(rc == NGX_AGAIN) {
+        r->connection->write->ready = 1;
+        rc = ngx_http_output_filter(r, out);
+        if(rc == NGX_ERROR)
+            break;
+    }
+    ngx_nonblocking(r->connection->fd);
+    rc = ngx_http_output_filter(r, NULL);
+
+    return NGX_DONE;
+}
+
+
 /*----------------------------------------------------------------------------*/
 ngx_int_t rp_module_send_response(ngx_http_request_t *r, cJSON **json_root)
 {
@@ -344,9 +412,6 @@ ngx_int_t rp_module_send_response(ngx_http_request_t *r, cJSON **json_root)
     }
     out.buf = b;
     out.next = NULL;
-    r->headers_out.content_type_len = strlen(json_content_str);
-    r->headers_out.content_type.len = strlen(json_content_str);
-    r->headers_out.content_type.data = (u_char *)json_content_str;
 
     out_buffer = cJSON_PrintUnformatted(*json_root, r->pool);
     if(out_buffer == NULL) {
@@ -363,9 +428,6 @@ ngx_int_t rp_module_send_response(ngx_http_request_t *r, cJSON **json_root)
     b->last_buf = b->last_in_chain = 1;
     b->sync     = b->flush = 1;
 
-    r->headers_out.status = NGX_HTTP_OK;
-    r->headers_out.content_length_n = out_buffer_len;
-
     /* Debug purpopses - output params & status */
     j_params = cJSON_GetObjectItem(*json_root, "params");
     if(j_params != NULL) {
@@ -386,34 +448,12 @@ ngx_int_t rp_module_send_response(ngx_http_request_t *r, cJSON **json_root)
 
     cJSON_Delete(*json_root, r->pool);
     
-    rc = ngx_http_send_header(r);
+    rc = rp_module_send_chain(r, json_content_str, &out, out_buffer_len);
 
     /* If error while sending OK output we re-send it */
     if((rc == NGX_ERROR) && (r->method == NGX_HTTP_GET) && j_status && 
        (j_status->valuestring[0] = 'O') && (j_status->valuestring[1] == 'K')) {
         rp_data_clear_signals_dirty();
     }
-    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
-        return rc;
-    }
-         
-    /* TODO: Be sure that outputting is always flushed! Had some problems
-     * at this part.
-     */
-
-    /* send the buffer chain of your response */
-    /* Temp, got from ruby-forum.com - put socket to blocking */
-    ngx_blocking(r->connection->fd);
-    rc = ngx_http_output_filter(r, &out);
-    while(rc == NGX_AGAIN) {
-        r->connection->write->ready = 1;
-        rc = ngx_http_output_filter(r, &out);        
-        if(rc == NGX_ERROR)
-            break;
-    }
-    ngx_nonblocking(r->connection->fd);
-    rc = ngx_http_output_filter(r, NULL);
-
-    return NGX_DONE;
+    return rc;
 }
-
@@ -22,6 +22,8 @@
 #include <dlfcn.h>
 #include <errno.h>
 
+#include <ngx_md5.h>
+
 #include "rp_bazaar_cmd.h"
 #include "rp_bazaar_app.h"
 
@@ -34,6 +36,8 @@ const char *c_rp_set_params_str   = "rp_set_params";
 const char *c_rp_get_params_str   = "rp_get_params";
 const char *c_rp_set_signals_str  = "rp_set_signals";
 const char *c_rp_get_signals_str  = "rp_get_signals";
+const char *c_rp_get_pulses_str   = "rp_get_pulses";
+const char *c_rp_get_signals_frame_str = "rp_get_signals_frame";
 
 
 /** Get MAC address of a specific NIC via sysfs */
@@ -372,6 +376,10 @@ int rp_bazaar_app_load_module(const char *app_file, rp_bazaar_app_t *app)
     if(!app->get_signals_func)
         return -1;
 
+    /* optional */
+    app->get_pulses_func = dlsym(app->handle, c_rp_get_pulses_str);
+    app->get_signals_frame_func = dlsym(app->handle, c_rp_get_signals_frame_str);
+
     app->file_name = (char *)malloc(strlen(app_file)+1);
     if(app->file_name == NULL)
         return -1;
@@ -402,53 +410,243 @@ int rp_bazaar_app_unload_module(rp_bazaar_app_t *app)
     return 0;
 }
 
-/* Use xdevcfg to load the data - using 32k buffers */
-#define RP_FPGA_CONF_BUF_LEN (32*1024)
-int rp_bazaar_app_load_fpga(const char *fpga_file)
+/* Bitstreams kept in memory by each worker, with their MD5 */
+#define RP_FPGA_CACHE_LEN 4
+
+typedef struct rp_bazaar_fpga_image_s {
+    char   *file_name;
+    time_t  mtime;
+    off_t   size;
+    u_char *data;
+    u_char  md5[16];
+} rp_bazaar_fpga_image_t;
+
+/* Bitstream in the FPGA, shared by all worker processes */
+typedef struct rp_bazaar_fpga_loaded_s {
+    int     valid;      /* md5 is that of the bitstream in the FPGA */
+    u_char  md5[16];
+} rp_bazaar_fpga_loaded_t;
+
+static rp_bazaar_fpga_image_t   rp_fpga_cache[RP_FPGA_CACHE_LEN];
+static ngx_uint_t               rp_fpga_cache_next = 0;
+static ngx_slab_pool_t         *rp_fpga_pool = NULL;
+static rp_bazaar_fpga_loaded_t *rp_fpga_loaded = NULL;
+
+static ngx_str_t rp_fpga_zone_name = ngx_string("rp_fpga");
+
+static ngx_int_t rp_bazaar_fpga_init_zone(ngx_shm_zone_t *shm_zone, void *data);
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Adds the shared memory zone remembering the loaded bitstream.
+ *
+ * @param[in]  cf       configuration being parsed
+ * @retval     NGX_OK   success
+ * @retval     NGX_ERROR failure while allocating
+ */
+ngx_int_t rp_bazaar_fpga_init(ngx_conf_t *cf)
 {
-    unsigned char buff[RP_FPGA_CONF_BUF_LEN];
-    int fo, fi;
-    int ret_val = 0;
+    ngx_shm_zone_t *shm_zone;
 
-    fo = open("/dev/xdevcfg", O_WRONLY);
-    if(fo < 0) {
-        fprintf(stderr, "rp_bazaar_app_load_fpga() failed to open xdevcfg: %s\n",
-                strerror(errno));
-        return -1;
+    shm_zone = ngx_shared_memory_add(cf, &rp_fpga_zone_name,
+                                     2 * ngx_pagesize, &ngx_http_rp_module);
+    if(shm_zone == NULL)
+        return NGX_ERROR;
+    shm_zone->init = rp_bazaar_fpga_init_zone;
+
+    return NGX_OK;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Sets up the zone, or keeps that of the previous configuration -
+ * the FPGA doesn't change with it.
+ */
+static ngx_int_t rp_bazaar_fpga_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_slab_pool_t *shpool = (ngx_slab_pool_t *)shm_zone->shm.addr;
+
+    rp_fpga_pool = shpool;
+
+    if(data) {
+        shm_zone->data = data;
+        rp_fpga_loaded = data;
+        return NGX_OK;
+    }
+    if(shm_zone->shm.exists) {
+        shm_zone->data = shpool->data;
+        rp_fpga_loaded = shpool->data;
+        return NGX_OK;
     }
 
+    /* the bitstream loaded at boot is not known */
+    rp_fpga_loaded = ngx_slab_alloc(shpool, sizeof(rp_bazaar_fpga_loaded_t));
+    if(rp_fpga_loaded == NULL)
+        return NGX_ERROR;
+    ngx_memzero(rp_fpga_loaded, sizeof(rp_bazaar_fpga_loaded_t));
+
+    shpool->data = rp_fpga_loaded;
+    shm_zone->data = rp_fpga_loaded;
+    return NGX_OK;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Returns the bitstream in a file, from the cache if the file has
+ * not changed since it was read, or NULL on failure.
+ */
+static rp_bazaar_fpga_image_t *rp_bazaar_fpga_get_image(const char *fpga_file)
+{
+    rp_bazaar_fpga_image_t *img;
+    struct stat stat_buf;
+    ngx_md5_t md5;
+    ssize_t n;
+    off_t off;
+    int fi;
+    ngx_uint_t i;
+
     fi = open(fpga_file, O_RDONLY);
     if(fi < 0) {
         fprintf(stderr, "rp_bazaar_app_load_fpga() failed to open FPGA file: %s\n",
                 strerror(errno));
-        return -1;
+        return NULL;
+    }
+    if(fstat(fi, &stat_buf) < 0) {
+        fprintf(stderr, "rp_bazaar_app_load_fpga() stat failed: %s\n",
+                strerror(errno));
+        close(fi);
+        return NULL;
+    }
+    /* writing nothing to xdevcfg would still reset the FPGA */
+    if(stat_buf.st_size == 0) {
+        fprintf(stderr, "rp_bazaar_app_load_fpga() FPGA file is empty: %s\n",
+                fpga_file);
+        close(fi);
+        return NULL;
     }
 
-    while(1) {
-        int ret_w;
-        int ret_r = read(fi, &buff[0], RP_FPGA_CONF_BUF_LEN);
-        if(ret_r < 0) {
-            fprintf(stderr, "rp_bazaar_app_load_fpga() read failed: %s\n", 
-                    strerror(errno));
-            ret_val = -1;
-            break;
+    for(i = 0; i < RP_FPGA_CACHE_LEN; i++) {
+        img = &rp_fpga_cache[i];
+        if(img->file_name && !strcmp(img->file_name, fpga_file) &&
+           (img->mtime == stat_buf.st_mtime) &&
+           (img->size == stat_buf.st_size)) {
+            close(fi);
+            return img;
         }
-        if(ret_r == 0) {
-            /* finished loading */
-            break;
+    }
+
+    /* replace the oldest */
+    img = &rp_fpga_cache[rp_fpga_cache_next];
+    rp_fpga_cache_next = (rp_fpga_cache_next + 1) % RP_FPGA_CACHE_LEN;
+    free(img->file_name);
+    free(img->data);
+    ngx_memzero(img, sizeof(rp_bazaar_fpga_image_t));
+
+    img->data = (u_char *)malloc(stat_buf.st_size);
+    img->file_name = strdup(fpga_file);
+    if((img->data == NULL) || (img->file_name == NULL)) {
+        fprintf(stderr, "rp_bazaar_app_load_fpga() can not allocate memory\n");
+        goto failed;
+    }
+
+    for(off = 0; off < stat_buf.st_size; off += n) {
+        n = read(fi, img->data + off, stat_buf.st_size - off);
+        if(n <= 0) {
+            fprintf(stderr, "rp_bazaar_app_load_fpga() read failed: %s\n",
+                    n ? strerror(errno) : "file truncated");
+            goto failed;
         }
-        
-        ret_w = write(fo, &buff[0], ret_r);
-        if(ret_w < 0) {
+    }
+    close(fi);
+
+    img->mtime = stat_buf.st_mtime;
+    img->size = stat_buf.st_size;
+    ngx_md5_init(&md5);
+    ngx_md5_update(&md5, img->data, img->size);
+    ngx_md5_final(img->md5, &md5);
+    return img;
+
+failed:
+    close(fi);
+    free(img->file_name);
+    free(img->data);
+    ngx_memzero(img, sizeof(rp_bazaar_fpga_image_t));
+    return NULL;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Loads a bitstream into the FPGA through xdevcfg, unless it is
+ * already there.
+ *
+ * The bitstream is read once into memory, where each worker keeps the last
+ * few, and written with one write().  The MD5 of the one in the FPGA is
+ * shared by all workers, so that switching between applications using the
+ * same bitstream doesn't reprogram the FPGA.
+ *
+ * @param[in]  fpga_file  bitstream file
+ * @retval     0          success, or the bitstream was already loaded
+ * @retval    -1          failure, error message is put on stderr
+ */
+int rp_bazaar_app_load_fpga(const char *fpga_file)
+{
+    rp_bazaar_fpga_image_t *img;
+    ssize_t n;
+    off_t off;
+    int fo;
+    int ret_val = 0;
+
+    img = rp_bazaar_fpga_get_image(fpga_file);
+    if(img == NULL)
+        return -1;
+
+    if(rp_fpga_pool)
+        ngx_shmtx_lock(&rp_fpga_pool->mutex);
+
+    if(rp_fpga_loaded && rp_fpga_loaded->valid &&
+       !ngx_memcmp(rp_fpga_loaded->md5, img->md5, sizeof(img->md5)))
+        goto done;
+
+    fo = open("/dev/xdevcfg", O_WRONLY);
+    if(fo < 0) {
+        fprintf(stderr, "rp_bazaar_app_load_fpga() failed to open xdevcfg: %s\n",
+                strerror(errno));
+        ret_val = -1;
+        goto done;
+    }
+
+    /* whatever was in the FPGA is being replaced */
+    if(rp_fpga_loaded)
+        rp_fpga_loaded->valid = 0;
+
+    for(off = 0; off < img->size; off += n) {
+        n = write(fo, img->data + off, img->size - off);
+        if(n <= 0) {
             fprintf(stderr, "rp_bazaar_app_load_fpga() write failed: %s\n",
-                    strerror(errno));
+                    n ? strerror(errno) : "nothing written");
             ret_val = -1;
             break;
         }
     }
 
-    close(fo);
-    close(fi);
+    if((close(fo) < 0) && (ret_val == 0)) {
+        fprintf(stderr, "rp_bazaar_app_load_fpga() close failed: %s\n",
+                strerror(errno));
+        ret_val = -1;
+    }
+
+    if((ret_val == 0) && rp_fpga_loaded) {
+        ngx_memcpy(rp_fpga_loaded->md5, img->md5, sizeof(img->md5));
+        rp_fpga_loaded->valid = 1;
+    }
+
+done:
+    if(rp_fpga_pool)
+        ngx_shmtx_unlock(&rp_fpga_pool->mutex);
 
     return ret_val;
 }
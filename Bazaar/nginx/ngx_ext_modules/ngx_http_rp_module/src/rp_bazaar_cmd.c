@@ -22,6 +22,8 @@
 #include "ngx_http_rp_module.h"
 #include "rp_bazaar_cmd.h"
 #include "rp_bazaar_app.h"
+#include "rp_data_cmd.h"
+#include "rp_sweep.h"
 #include "cJSON.h"
 
 #include <stdlib.h>
@@ -397,6 +399,7 @@ int rp_bazaar_start(ngx_http_request_t *r,
     char *app_name  = NULL;
     char *fpga_name = NULL;
     int   app_id_len, app_name_len, fpga_name_len;
+    struct stat fpga_stat;
     ngx_http_rp_loc_conf_t *lc = 
         ngx_http_get_module_loc_conf(r, ngx_http_rp_module);
 
@@ -408,6 +411,9 @@ int rp_bazaar_start(ngx_http_request_t *r,
 
     /* Check if application is already running and unload it if so. */
     if(rp_module_ctx.app.handle != NULL) {
+        /* the sweeps clients send from its pulse ring */
+        rp_sweep_close_all();
+        rp_data_release_signals();
         if(rp_bazaar_app_unload_module(&rp_module_ctx.app)) {
             return rp_module_cmd_error(json_root, 
                                        "Can not unload existing application.", 
@@ -455,23 +461,25 @@ int rp_bazaar_start(ngx_http_request_t *r,
     fpga_name[fpga_name_len-1]='\0';
     
 
-    /* Load FPGA */
-    // FPGA loading disabled.
-    // Nginx seems to have the /dev/xdevcfg device file already opened
-    // and rp_bazaar_app_load_fpga() always fails.
-    // The correct FPGA is already loaded at boot time for T&M apps.
-#if 0
-    /* Here we do not have application running anymore - load new FPGA */
-    rp_debug(r->connection->log, "Loading FPGA from file: '%s'\n", fpga_name);
-    if(rp_bazaar_app_load_fpga(fpga_name) < 0) {
-        if(app_name)
-            free(app_name);
-        if(fpga_name)
-            free(fpga_name);
-        return rp_module_cmd_error(json_root, "Can not load FPGA.", 
-                                   NULL, r->pool);
+    /* Here we do not have application running anymore - load new FPGA,
+     * which is skipped when it is already there. An application without
+     * fpga.bit runs with the bitstream loaded at boot, as does one with an
+     * empty fpga.bit (the placeholder most application Makefiles install).
+     */
+    if((stat(fpga_name, &fpga_stat) == 0) && (fpga_stat.st_size > 0)) {
+        rp_debug(r->connection->log, "Loading FPGA from file: '%s'\n",
+                 fpga_name);
+        if(rp_bazaar_app_load_fpga(fpga_name) < 0) {
+            free(rp_module_ctx.app.id);
+            rp_module_ctx.app.id = NULL;
+            if(app_name)
+                free(app_name);
+            if(fpga_name)
+                free(fpga_name);
+            return rp_module_cmd_error(json_root, "Can not load FPGA.", 
+                                       NULL, r->pool);
+        }
     }
-#endif
 
     /* Load new application. */
     rp_debug(r->connection->log, "Loading application: '%s'\n", app_name);
@@ -521,6 +529,9 @@ int rp_bazaar_stop(ngx_http_request_t *r,
         /* Ignore requests to unload the application controller, if none is loaded. */
         return rp_module_cmd_ok(json_root, r->pool);
     }
+    /* the sweeps clients send from its pulse ring */
+    rp_sweep_close_all();
+    rp_data_release_signals();
     if(rp_bazaar_app_unload_module(&rp_module_ctx.app) < 0) {
         return rp_module_cmd_error(json_root, 
                                    "Can not unload application.", NULL, r->pool);
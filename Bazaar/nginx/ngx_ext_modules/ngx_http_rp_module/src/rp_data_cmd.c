@@ -19,14 +19,67 @@
 
 #include "ngx_http_rp_module.h"
 #include "rp_data_cmd.h"
+#include "rp_ws.h"
+#include "rp_sweep.h"
+#include "rp_json.h"
+#include "rp_params.h"
+#include "rp_metrics.h"
 #include "cJSON.h"
 
-/* last good result container */
-static float **rp_signals = NULL;
-static int     rp_signals_dirty = 0;
+#include <math.h>
 
 #define TRACE(args...) fprintf(stderr, args)
 #define NUM_DATASETS 4
+/* Samples allocated per signal in rp_signals */
+#define RP_SIGNAL_MAX_LEN 2048
+
+/* last good result container - rp_signals_lent when the application lends
+ * its own frame (rp_get_signals_frame), otherwise rp_signals_buf
+ */
+static float **rp_signals = NULL;
+static float **rp_signals_buf = NULL;
+/* the application's signals, then rp_signals_buf for those it lacks */
+static float  *rp_signals_lent[NUM_DATASETS + 1];
+static int     rp_signals_dirty = 0;
+static int     rp_signals_len = 0;
+/* int16 copy of the signals for /data?format=bin16, and its scales */
+static int16_t *rp_signals_int16 = NULL;
+static float    rp_signals_scales[NUM_DATASETS + 1];
+static uint32_t rp_signals_int16_seq = 0;
+/* sequence number of the signals in rp_signals; 0 before the first */
+static uint32_t rp_signals_seq = 0;
+/* incremented whenever the parameters are set */
+static uint32_t rp_params_ver = 0;
+
+/* The JSON answer for the signals in rp_signals, without its status, so
+ * that clients asking for the same signals get the same bytes rather than
+ * a fresh serialization each.  Its closing brace is sent after the status.
+ */
+typedef struct rp_data_json_cache_s {
+    u_char   *buf;
+    size_t    len;
+    size_t    size;         /* allocated */
+    uint32_t  seq;          /* rp_signals_seq it was made from */
+    uint32_t  params_ver;   /* rp_params_ver it was made from */
+} rp_data_json_cache_t;
+
+static rp_data_json_cache_t rp_data_json_cache = { NULL, 0, 0, 0, 0 };
+
+static const char rp_data_status_ok[]    = ",\"status\":\"OK\"}";
+static const char rp_data_status_again[] = ",\"status\":\"AGAIN\"}";
+
+/* Longest ETag, with its quotes */
+#define RP_DATA_ETAG_LEN (sizeof("\"s-p\"") - 1 + 2 * NGX_INT32_LEN)
+
+/* GET /data waits this long for new signals before sending the previous ones */
+#define RP_DATA_WAIT_MS 200
+/* and checks the application for them this often */
+#define RP_DATA_POLL_MS 1
+
+/* Signal formats for GET /data */
+#define RP_DATA_FORMAT_JSON  0
+#define RP_DATA_FORMAT_BIN   1
+#define RP_DATA_FORMAT_BIN16 2
 
 /*----------------------------------------------------------------------------*/
 /* request private context, used to shared data between different callback functions
@@ -34,9 +87,33 @@ static int     rp_signals_dirty = 0;
  */
 typedef struct rp_data_ctx_s {
     cJSON *json_root;
-    int    finalize_on_post_handler;
+    /* GET requests waiting for new signals */
+    ngx_queue_t         queue;     /* link in rp_data_waiting */
+    ngx_http_request_t *r;
+    int                 format;    /* RP_DATA_FORMAT_... */
+    ngx_msec_t          deadline;  /* when to give up and send the previous signals */
 } rp_data_ctx_t;
 
+/* GET requests waiting for new signals, oldest first */
+static ngx_queue_t  rp_data_waiting;
+static int          rp_data_waiting_init = 0;
+/* polls the application for the waiting requests */
+static ngx_event_t  rp_data_wait_ev;
+static ngx_event_t *rp_data_wait_ev_p = NULL;
+
+static void rp_data_wait_handler(ngx_event_t *ev);
+static void rp_data_wait_cleanup(void *data);
+static int rp_data_poll_signals(void);
+static int rp_data_get_params_pool(cJSON **json_root, ngx_pool_t *pool);
+static int rp_data_get_signals_pool(cJSON **json_root, ngx_pool_t *pool);
+static int rp_data_etag_match(ngx_http_request_t *r, int format);
+static ngx_int_t rp_data_send_signals(ngx_http_request_t *r, int format,
+                                      int ret_val);
+static ngx_int_t rp_data_send_error(ngx_http_request_t *r, const char *reason);
+static ngx_int_t rp_data_send_not_modified(ngx_http_request_t *r, int format);
+static int rp_data_cache_json(void);
+static ngx_int_t rp_data_set_etag(ngx_http_request_t *r, int format);
+
 
 /*----------------------------------------------------------------------------*/
 /**
@@ -47,7 +124,8 @@ typedef struct rp_data_ctx_s {
  *
  * @retval NGX_HTTP_NOT_ALLOWED            The required operation is not allowed
  * @retval NGX_HTTP_INTERNAL_SERVER_ERROR  Failure while allocating JSON package
- * @retval other                           GET: returned value from rp_module_send_response() function
+ * @retval other                           GET: returned value from rp_data_send_signals(), or NGX_DONE
+ *                                         while waiting for new signals in rp_data_wait_signals()
  *                                         POST: returned value from ngx_http_read_client_request_body() or NGX_DONE
  */
 
@@ -55,6 +133,7 @@ ngx_int_t rp_data_cmd_handler(ngx_http_request_t *r)
 {
     cJSON *json_root, *data_root, *app_root;
     int ret_val = 0;
+    ngx_str_t format;
 
     if(!(r->method & (NGX_HTTP_GET|NGX_HTTP_POST))) {
         return NGX_HTTP_NOT_ALLOWED;
@@ -63,6 +142,38 @@ ngx_int_t rp_data_cmd_handler(ngx_http_request_t *r)
     rp_debug(r->connection->log, "%s: %s", __FUNCTION__,
              (r->method & NGX_HTTP_GET) ? "GET" : "POST");
 
+    if(r->method & NGX_HTTP_GET) {
+        int fmt = RP_DATA_FORMAT_JSON;
+
+        /* Binary signals - no JSON at all */
+        if(ngx_http_arg(r, (u_char *)"format", 6, &format) == NGX_OK) {
+            if((format.len == 3) && !ngx_strncmp(format.data, "bin", 3))
+                fmt = RP_DATA_FORMAT_BIN;
+            else if((format.len == 5) && !ngx_strncmp(format.data, "bin16", 5))
+                fmt = RP_DATA_FORMAT_BIN16;
+            else
+                return NGX_HTTP_BAD_REQUEST;
+        }
+        /* WebSocket clients get each new frame pushed to them */
+        if(r->headers_in.upgrade)
+            return rp_ws_handler(r, fmt == RP_DATA_FORMAT_BIN16);
+
+        if(!rp_module_ctx.app.handle)
+            return rp_data_send_signals(r, fmt, 0);
+
+        ret_val = rp_data_poll_signals();
+        if(ret_val != -1)
+            return rp_data_send_signals(r, fmt, ret_val);
+
+        /* A client which names a frame other than the current one gets the
+         * current one at once */
+        if(rp_signals_seq && (rp_data_etag_match(r, fmt) == 0))
+            return rp_data_send_signals(r, fmt, 0);
+
+        /* No new signals yet - wait for them without blocking the worker */
+        return rp_data_wait_signals(r, fmt);
+    }
+
     json_root = cJSON_CreateObject(r->pool);
     if(json_root == NULL) {
         rp_error(r->connection->log, "Can not allocate cJSON object");
@@ -110,26 +221,452 @@ ngx_int_t rp_data_cmd_handler(ngx_http_request_t *r)
               return NGX_ERROR;
         }
         ctx->json_root = json_root;
-        ctx->finalize_on_post_handler = 0;
         ngx_http_set_ctx(r, ctx, ngx_http_rp_module);
 
         rc = ngx_http_read_client_request_body(r, rp_data_post_read);
+        if(rc >= NGX_HTTP_SPECIAL_RESPONSE) {
+            return rc;
+        }
+        /* rp_data_post_read() finalizes the request, now or once the
+         * body is read */
+        return NGX_DONE;
+    }
+
+    return NGX_HTTP_NOT_ALLOWED;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Sends the signals in rp_signals in answer to GET /data.
+ *
+ * The JSON answer is serialized once for each frame of signals, into
+ * rp_data_json_cache, and sent from there to every client.
+ *
+ * @param[in]  r        HTTP request as defined by NGINX framework
+ * @param[in]  format   RP_DATA_FORMAT_...
+ * @param[in]  ret_val  result of fetching the signals: 0 new, -1 none new,
+ *                      -2 application error
+ * @retval     other    returned value from rp_module_send_chain() or
+ *                      rp_data_send_bin_signals()
+ */
+static ngx_int_t rp_data_send_signals(ngx_http_request_t *r, int format,
+                                      int ret_val)
+{
+    ngx_chain_t *out;
+    ngx_buf_t *b, *st;
+    const char *status;
+    ngx_int_t rc;
+
+    /* In case we are repeating the transmission */
+    if((rp_signals_dirty == 0) && (ret_val == -1))
+        ret_val = 0;
+    rp_signals_dirty = 1;
+
+    if(format != RP_DATA_FORMAT_JSON)
+        return rp_data_send_bin_signals(r, format == RP_DATA_FORMAT_BIN16,
+                                        ret_val);
+
+    if(!rp_module_ctx.app.handle) {
+        rp_error(r->connection->log, "Application not loaded");
+        return rp_data_send_error(r, "Application not loaded");
+    }
+    if(rp_data_cache_json() < 0) {
+        return rp_data_send_error(r, "Can not retrieve parameters.");
+    }
+
+    /* the cached answer, then its status; the cache can't change while
+     * rp_module_send_chain() is sending it */
+    status = (ret_val == 0) ? rp_data_status_ok : rp_data_status_again;
+    out = ngx_alloc_chain_link(r->pool);
+    b = ngx_calloc_buf(r->pool);
+    st = ngx_calloc_buf(r->pool);
+    if((out == NULL) || (b == NULL) || (st == NULL) ||
+       (rp_data_set_etag(r, format) != NGX_OK))
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    out->next = ngx_alloc_chain_link(r->pool);
+    if(out->next == NULL)
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+
+    b->pos = rp_data_json_cache.buf;
+    b->last = b->pos + rp_data_json_cache.len;
+    b->memory = 1;
+    out->buf = b;
+
+    st->pos = (u_char *)status;
+    st->last = st->pos + strlen(status);
+    st->memory = 1;
+    st->last_buf = st->last_in_chain = 1;
+    st->sync = st->flush = 1;
+    out->next->buf = st;
+    out->next->next = NULL;
+
+    rp_metrics_frames_served(RP_METRICS_FMT_JSON, 1);
+    rc = rp_module_send_chain(r, json_content_str, out,
+                              rp_data_json_cache.len + strlen(status));
+
+    /* If error while sending OK output we re-send it */
+    if((rc == NGX_ERROR) && (ret_val == 0))
+        rp_data_clear_signals_dirty();
+    return rc;
+}
 
-        if(rc == NGX_AGAIN) {
-            ctx->finalize_on_post_handler = 1;
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Sends a JSON error answer to GET /data.
+ */
+static ngx_int_t rp_data_send_error(ngx_http_request_t *r, const char *reason)
+{
+    cJSON *json_root, *app_root;
+    char *app_id = rp_module_ctx.app.id;
+
+    json_root = cJSON_CreateObject(r->pool);
+    if(json_root == NULL) {
+        rp_error(r->connection->log, "Can not allocate cJSON object");
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    cJSON_AddItemToObject(json_root, "app",
+                          app_root=cJSON_CreateObject(r->pool), r->pool);
+    cJSON_AddItemToObject(json_root, "datasets", cJSON_CreateObject(r->pool),
+                          r->pool);
+    if(app_root && rp_module_ctx.app.handle) {
+        if (!app_id) {
+            app_id = "unknown";
         }
-        return rc;
+        cJSON_AddItemToObject(app_root, "id",
+                              cJSON_CreateString(app_id, r->pool), r->pool);
     }
+    rp_module_cmd_error(&json_root, reason, NULL, r->pool);
+    return rp_module_send_response(r, &json_root);
+}
 
-    ret_val = rp_data_get_signals(r, &json_root);
-    rp_data_get_params(r, &json_root);
 
-    if(ret_val == 0) {
-        rp_module_cmd_ok(&json_root, r->pool);
-    } else {
-        rp_module_cmd_again(&json_root, r->pool);
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Makes rp_data_json_cache hold the answer for the current signals
+ * and parameters, unless it already does.
+ *
+ * @retval  0  success
+ * @retval -1  failure
+ */
+static int rp_data_cache_json(void)
+{
+    static const char g1_open[] = ",\"datasets\":{\"g1\":[";
+    static const char data_open[] = "{\"data\":";
+    static const char params_open[] = "],\"params\":";
+    rp_data_json_cache_t *c = &rp_data_json_cache;
+    cJSON *json_root, *app_root, *data_root;
+    ngx_pool_t *pool;
+    char *app_id = rp_module_ctx.app.id;
+    char *app_text, *params_text, *p;
+    size_t app_len, params_len, size;
+    uint64_t t0;
+    int i, ret_val = -1;
+
+    if(c->buf && (c->seq == rp_signals_seq) &&
+       (c->params_ver == rp_params_ver))
+        return 0;
+
+    t0 = rp_metrics_now_us();
+
+    /* the app and parameters trees and their text are only needed until
+     * written to the cache; the signals are written there directly */
+    pool = ngx_create_pool(4096, ngx_cycle->log);
+    if(pool == NULL)
+        return -1;
+
+    json_root = cJSON_CreateObject(pool);
+    if(json_root == NULL)
+        goto done;
+    cJSON_AddItemToObject(json_root, "app",
+                          app_root=cJSON_CreateObject(pool), pool);
+    cJSON_AddItemToObject(json_root, "datasets",
+                          data_root=cJSON_CreateObject(pool), pool);
+    if((app_root == NULL) || (data_root == NULL))
+        goto done;
+    if (!app_id) {
+        app_id = "unknown";
+    }
+    cJSON_AddItemToObject(app_root, "id", cJSON_CreateString(app_id, pool),
+                          pool);
+
+    if(rp_data_get_params_pool(&json_root, pool) < 0)
+        goto done;
+    app_text = cJSON_PrintUnformatted(app_root, pool);
+    params_text = cJSON_PrintUnformatted(cJSON_GetObjectItem(data_root,
+                                                             "params"), pool);
+    if((app_text == NULL) || (params_text == NULL))
+        goto done;
+    app_len = strlen(app_text);
+    params_len = strlen(params_text);
+
+    /* the same text as cJSON_PrintUnformatted() of the whole tree with
+     * rp_data_get_signals_pool(), less the closing brace, which follows
+     * the status */
+    size = sizeof("{\"app\":") - 1 + app_len + sizeof(g1_open) - 1 +
+        NUM_DATASETS * (sizeof(data_open) - 1 +
+                        RP_JSON_2DFLOAT_ARRAY_LEN(rp_signals_len) + 2) +
+        sizeof(params_open) - 1 + params_len + 1;
+    if(size > c->size) {
+        u_char *buf = (u_char *)realloc(c->buf, size);
+        if(buf == NULL)
+            goto done;
+        c->buf = buf;
+        c->size = size;
+    }
+
+    p = (char *)ngx_cpymem(c->buf, "{\"app\":", sizeof("{\"app\":") - 1);
+    p = (char *)ngx_cpymem(p, app_text, app_len);
+    p = (char *)ngx_cpymem(p, g1_open, sizeof(g1_open) - 1);
+    for(i = 0; i < NUM_DATASETS; i++) {
+        if(i)
+            *p++ = ',';
+        p = (char *)ngx_cpymem(p, data_open, sizeof(data_open) - 1);
+        p = rp_json_2dfloat_array(p, rp_signals[0], rp_signals[i + 1],
+                                  rp_signals_len, 0);
+        *p++ = '}';
+    }
+    p = (char *)ngx_cpymem(p, params_open, sizeof(params_open) - 1);
+    p = (char *)ngx_cpymem(p, params_text, params_len);
+    *p++ = '}';
+
+    c->len = (u_char *)p - c->buf;
+    c->seq = rp_signals_seq;
+    c->params_ver = rp_params_ver;
+    ret_val = 0;
+    rp_metrics_serialize(RP_METRICS_FMT_JSON, rp_metrics_now_us() - t0);
+
+done:
+    ngx_destroy_pool(pool);
+    return ret_val;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Writes the ETag of the current signals in a format.
+ *
+ * The ETag changes with each new frame of signals, and for JSON also with
+ * each change of the parameters, which the JSON answer includes.
+ *
+ * @param[out] buf  at least RP_DATA_ETAG_LEN bytes
+ * @retval     end of the ETag in buf
+ */
+static u_char *rp_data_etag(u_char *buf, int format)
+{
+    if(format == RP_DATA_FORMAT_JSON)
+        return ngx_sprintf(buf, "\"s%uDp%uD\"", rp_signals_seq, rp_params_ver);
+    return ngx_sprintf(buf, "\"s%uD\"", rp_signals_seq);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Adds the ETag of the current signals to the response.
+ */
+static ngx_int_t rp_data_set_etag(ngx_http_request_t *r, int format)
+{
+    ngx_table_elt_t *etag;
+    u_char *buf;
+
+    buf = ngx_pnalloc(r->pool, RP_DATA_ETAG_LEN);
+    etag = ngx_list_push(&r->headers_out.headers);
+    if((buf == NULL) || (etag == NULL))
+        return NGX_ERROR;
+
+    etag->hash = 1;
+    ngx_str_set(&etag->key, "ETag");
+    etag->value.data = buf;
+    etag->value.len = rp_data_etag(buf, format) - buf;
+    r->headers_out.etag = etag;
+
+    return NGX_OK;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Compares the request's If-None-Match with the current ETag.
+ *
+ * @retval -1  no If-None-Match
+ * @retval  0  If-None-Match names other signals
+ * @retval  1  If-None-Match names the current signals
+ */
+static int rp_data_etag_match(ngx_http_request_t *r, int format)
+{
+    u_char buf[RP_DATA_ETAG_LEN];
+    ngx_str_t *inm;
+    size_t len;
+
+    if(r->headers_in.if_none_match == NULL)
+        return -1;
+    inm = &r->headers_in.if_none_match->value;
+    len = rp_data_etag(buf, format) - buf;
+
+    return (inm->len == len) && !ngx_strncmp(inm->data, buf, len);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Answers GET /data with "304 Not Modified" and the current ETag.
+ */
+static ngx_int_t rp_data_send_not_modified(ngx_http_request_t *r, int format)
+{
+    if(rp_data_set_etag(r, format) != NGX_OK)
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+
+    r->headers_out.status = NGX_HTTP_NOT_MODIFIED;
+    r->headers_out.content_length_n = -1;
+    r->header_only = 1;
+
+    return ngx_http_send_header(r);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Parks a GET /data request until the application has new signals.
+ *
+ * The request is queued on rp_data_waiting and answered from
+ * rp_data_wait_handler(), which polls the application from an NGINX
+ * timer, so the worker keeps serving other requests meanwhile.  A request
+ * still waiting after RP_DATA_WAIT_MS is answered with the previous
+ * signals.
+ *
+ * @param[in]  r        HTTP request as defined by NGINX framework
+ * @param[in]  format   RP_DATA_FORMAT_...
+ * @retval     NGX_DONE                        request is parked
+ * @retval     NGX_HTTP_INTERNAL_SERVER_ERROR  failure while allocating
+ */
+ngx_int_t rp_data_wait_signals(ngx_http_request_t *r, int format)
+{
+    rp_data_ctx_t *ctx;
+    ngx_pool_cleanup_t *cln;
+
+    ctx = ngx_pcalloc(r->pool, sizeof(rp_data_ctx_t));
+    cln = ngx_pool_cleanup_add(r->pool, 0);
+    if((ctx == NULL) || (cln == NULL)) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    ctx->r = r;
+    ctx->format = format;
+    ctx->deadline = ngx_current_msec + RP_DATA_WAIT_MS;
+    ngx_http_set_ctx(r, ctx, ngx_http_rp_module);
+
+    /* the request may be closed while waiting, e.g. at shutdown */
+    cln->handler = rp_data_wait_cleanup;
+    cln->data = ctx;
+
+    rp_data_poll_start();
+    ngx_queue_insert_tail(&rp_data_waiting, &ctx->queue);
+
+    /* keep the request alive until rp_data_wait_handler() finalizes it */
+    r->main->count++;
+    return NGX_DONE;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Starts polling the application for new signals.
+ *
+ * Polling continues while requests wait in rp_data_waiting or WebSocket
+ * or sweeps clients are connected.
+ */
+void rp_data_poll_start(void)
+{
+    if(!rp_data_waiting_init) {
+        ngx_queue_init(&rp_data_waiting);
+        rp_data_waiting_init = 1;
+    }
+    if(rp_data_wait_ev_p == NULL) {
+        rp_data_wait_ev_p = &rp_data_wait_ev;
+        ngx_memzero(rp_data_wait_ev_p, sizeof(ngx_event_t));
+        rp_data_wait_ev_p->handler = rp_data_wait_handler;
+        rp_data_wait_ev_p->log = ngx_cycle->log;
+        rp_data_wait_ev_p->data = rp_data_wait_ev_p;
+    }
+    if(!rp_data_wait_ev_p->timer_set)
+        ngx_add_timer(rp_data_wait_ev_p, RP_DATA_POLL_MS);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Removes a request from rp_data_waiting when its pool is destroyed.
+ */
+static void rp_data_wait_cleanup(void *data)
+{
+    rp_data_ctx_t *ctx = (rp_data_ctx_t *)data;
+
+    if(ctx->r) {
+        ngx_queue_remove(&ctx->queue);
+        ctx->r = NULL;
     }
-    return rp_module_send_response(r,  &json_root);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Timer handler answering the GET /data requests in rp_data_waiting.
+ *
+ * All waiting requests are answered as soon as the application has new
+ * signals, or fails; otherwise only those whose deadline has passed are
+ * answered, with the previous signals, or "304 Not Modified" if their
+ * If-None-Match names them.  New signals are also pushed to
+ * the WebSocket clients, and completed sweeps to the sweeps clients.  The
+ * timer is re-armed while any request is still waiting or any WebSocket or
+ * sweeps client is connected.
+ */
+static void rp_data_wait_handler(ngx_event_t *ev)
+{
+    ngx_queue_t *q;
+    rp_data_ctx_t *ctx;
+    ngx_http_request_t *r;
+    ngx_connection_t *c;
+    int ret_val = -1;
+
+    if(rp_module_ctx.app.handle)
+        ret_val = rp_data_poll_signals();
+
+    if(ret_val == 0)
+        rp_ws_send_signals();
+    rp_sweep_send();
+    /* let an exiting worker finish */
+    if(ngx_exiting) {
+        rp_ws_close_all();
+        rp_sweep_close_all();
+    }
+
+    while(!ngx_queue_empty(&rp_data_waiting)) {
+        q = ngx_queue_head(&rp_data_waiting);
+        ctx = ngx_queue_data(q, rp_data_ctx_t, queue);
+
+        /* the queue is in deadline order */
+        if((ret_val == -1) && rp_module_ctx.app.handle &&
+           ((ngx_msec_int_t)(ctx->deadline - ngx_current_msec) > 0))
+            break;
+
+        r = ctx->r;
+        c = r->connection;
+        ngx_queue_remove(q);
+        ctx->r = NULL;
+
+        /* a client which already has the current frame is told so */
+        if((ret_val == -1) && (rp_data_etag_match(r, ctx->format) == 1))
+            ngx_http_finalize_request(r, rp_data_send_not_modified(r,
+                                                                ctx->format));
+        else
+            ngx_http_finalize_request(r, rp_data_send_signals(r, ctx->format,
+                                                              ret_val));
+        ngx_http_run_posted_requests(c);
+    }
+
+    if(!ngx_queue_empty(&rp_data_waiting) || rp_ws_clients() ||
+       rp_sweep_clients())
+        ngx_add_timer(ev, RP_DATA_POLL_MS);
 }
 
 
@@ -138,19 +675,20 @@ ngx_int_t rp_data_cmd_handler(ngx_http_request_t *r)
  * @brief Invoke application specific parameter set operation.
  *
  * Function parses the POST request, which is defined by JSON packet. This packet
- * must contain "params" request, embedded within "datasets" entity. After the
- * request packet is successfully parsed, the request action is passed to the
- * rp_data_parse_and_set_params() function
+ * must contain "params" request, embedded within "datasets" entity. The
+ * request is passed to the rp_data_parse_and_set_params() function
  *
  * @param[in]  r          HTTP request as defined by NGINX framework
  * @param[in]  json_root  pointer to JSON root node, to which in case of error the reason description is appended
- * @param[in]  in_buffer  already parsed json package
+ * @param[in]  in_buffer  body of the request
+ * @param[in]  len        length of the body
  * @retval     0          successful operation
  * @retval     <0         failure, error code is defined by rp_module_cmd_error()
  */
-static int rp_data_set_params(ngx_http_request_t *r, cJSON **json_root, char *in_buffer)
+static int rp_data_set_params(ngx_http_request_t *r, cJSON **json_root,
+                              char *in_buffer, size_t len)
 {
-    cJSON *req_body, *j_params, *j_data;
+    const char *reason;
 
     /* check if this is a POST operation */
     if(!(r->method & NGX_HTTP_POST)) {
@@ -166,44 +704,24 @@ static int rp_data_set_params(ngx_http_request_t *r, cJSON **json_root, char *in
 
     rp_debug(r->connection->log, "Received body: %s", in_buffer);
 
-    /* parse incoming body to cJSON and search for 'params' */
-    req_body = cJSON_Parse((const char *)in_buffer, r->pool);
-    if(req_body == NULL) {
-        return rp_module_cmd_error(json_root,
-                                   "Can not parse incoming body to JSON", NULL,
-                                   r->pool);
-    }
-
-    /* pull out "datasets" object */
-    j_data = cJSON_GetObjectItem(req_body, "datasets");
-    if(j_data == NULL) {
-        cJSON_Delete(req_body, r->pool);
-        return rp_module_cmd_error(json_root,
-                                   "Can not find 'data' in req body", NULL,
-                                   r->pool);
-    }
-
-    /* and refer to its child object "params" */
-    j_params = cJSON_GetObjectItem(j_data, "params");
-    if(j_params == NULL) {
-        cJSON_Delete(req_body, r->pool);
-        return rp_module_cmd_error(json_root,
-                                   "Can not find 'params' in req body", NULL,
-                                   r->pool);
+    switch(rp_data_parse_and_set_params((u_char *)in_buffer, len)) {
+    case RP_PARAMS_ERR_JSON:
+        reason = "Can not parse incoming body to JSON";
+        break;
+    case RP_PARAMS_ERR_DATA:
+        reason = "Can not find 'data' in req body";
+        break;
+    case RP_PARAMS_ERR_PARAMS:
+        reason = "Can not find 'params' in req body";
+        break;
+    case RP_PARAMS_ERR_SET:
+        reason = "Setting new parameters failed";
+        break;
+    default:
+        return 0;
     }
 
-    /* parse the "params" JSON object and execute the request */
-    if(rp_data_parse_and_set_params(j_params) < 0) {
-        cJSON_Delete(req_body, r->pool);
-        return rp_module_cmd_error(json_root,
-                                   "Setting new parameters failed", NULL,
-                                   r->pool);
-    }
-
-    /* release our resources */
-    cJSON_Delete(req_body, r->pool);
-
-    return 0;
+    return rp_module_cmd_error(json_root, reason, NULL, r->pool);
 }
 
 
@@ -216,6 +734,7 @@ static int rp_data_set_params(ngx_http_request_t *r, cJSON **json_root, char *in
  */
 void rp_data_post_read(ngx_http_request_t *r)
 {
+    ngx_int_t rc = NGX_HTTP_INTERNAL_SERVER_ERROR;
     int len = 0, buffers = 0;
     char *msg_pos;
     ngx_chain_t *chain_link;
@@ -234,6 +753,7 @@ void rp_data_post_read(ngx_http_request_t *r)
     if((r->request_body == NULL) || (r->request_body->bufs == NULL)) {
         rp_error(r->connection->log, 
                  "rp_data_post_read() body is empty");
+        rc = NGX_HTTP_BAD_REQUEST;
         goto done;
     }
     
@@ -275,8 +795,10 @@ void rp_data_post_read(ngx_http_request_t *r)
     }
     in_buffer[len] = '\0';
 
-    if(rp_data_set_params(r, &ctx->json_root, in_buffer) < 0) {
+    if(rp_data_set_params(r, &ctx->json_root, in_buffer, len) < 0) {
         rp_error(r->connection->log, "rp_data_set_params() failed");
+        /* the answer holds the reason */
+        rc = rp_module_send_response(r, &ctx->json_root);
         goto done;
     }
 
@@ -287,88 +809,96 @@ void rp_data_post_read(ngx_http_request_t *r)
     rp_module_cmd_ok(&ctx->json_root, r->pool);
 
     /* and send the response to the client */
-    rp_module_send_response(r, &ctx->json_root);
+    rc = rp_module_send_response(r, &ctx->json_root);
 done:
-    if (ctx->finalize_on_post_handler) {
-        ngx_http_finalize_request(r, NGX_DONE);
-    }
+    ngx_http_finalize_request(r, rc);
     return;
 }
 
 
 /*----------------------------------------------------------------------------*/
 /**
- * @brief Handler function for POST operation.
+ * @brief Applies a parameters update, as sent by the clients.
  *
- * Function copies the specified list of parameters into temporary
- * allocated list of parameters and calls the application specific POST operation
+ * The update is parsed straight into the module's parameters table, and
+ * only the parameters it changes are passed to the application specific
+ * POST operation, if any.  The table is read from the application first,
+ * since the application changes parameters too (e.g. auto-set).
  *
- * @param[in]  params_root  pointer to JSON object, holding a list of parameters to be applied
- * @retval     0            success
- * @retval    -1            failure
+ * @param[in]  text  JSON object holding "params" within "datasets"
+ * @param[in]  len   length of text
+ * @retval     >=0   number of parameters changed
+ * @retval     <0    RP_PARAMS_ERR_JSON, _DATA, _PARAMS or _SET
  */
-int rp_data_parse_and_set_params(cJSON *params_root)
+int rp_data_parse_and_set_params(const u_char *text, size_t len)
 {
-    int rp_params_cnt = 0, i, ret_val;
-    rp_app_params_t *rp_params;
-    struct cJSON *j_params;
+    rp_app_params_t *changed;
+    int n;
 
-    if(params_root == NULL)
-        return -1;
+    if(rp_params_load() < 0)
+        return RP_PARAMS_ERR_SET;
 
-    /* count the number of specified parameters to be set */
-    j_params = params_root->child;
-    while(j_params != NULL) {
-        if(j_params->type != cJSON_Number)
-            continue;
-        j_params = j_params->next;
-        rp_params_cnt++;
-    }
+    n = rp_params_parse(text, len, &changed);
+    if(n <= 0)
+        return n;
 
-    /* allocate temporary storage as an array of sequential parameters */
-    rp_params = (rp_app_params_t *)malloc((rp_params_cnt+1) * sizeof(rp_app_params_t));
-    if(rp_params == NULL)
-        return -1;
+    /* call application specific function for handling POST requests */
+    if(rp_module_ctx.app.set_params_func(changed, n) < 0)
+        return RP_PARAMS_ERR_SET;
 
-    /* scan the specified JSON object and copy request parameters in our temporary storage */
-    j_params = params_root->child;
-    for(i = 0; i < rp_params_cnt || j_params != NULL; i++) {
-        if((j_params->string == NULL) || (j_params->type != cJSON_Number)) {
-            j_params = j_params->next;
-            continue;
-        }
+    /* answers made with the old parameters are out of date */
+    rp_params_ver++;
 
-        rp_params[i].name = (char *)malloc(strlen(j_params->string)+1);
-        strncpy(&rp_params[i].name[0], &j_params->string[0],
-                strlen(j_params->string));
-        rp_params[i].name[strlen(j_params->string)] = '\0';
-        rp_params[i].value = (float)j_params->valuedouble;
+    return n;
+}
 
-        j_params = j_params->next;
-    }
-    rp_params[rp_params_cnt].name = NULL;
 
-    /* call application specific function for handling POST requests */
-    ret_val = 0;
-    if(rp_module_ctx.app.set_params_func(rp_params, rp_params_cnt) < 0) {
-        ret_val = -1;
-    }
+/*----------------------------------------------------------------------------*/
+int rp_data_get_params(ngx_http_request_t *r, cJSON **json_root)
+{
+    return rp_data_get_params_pool(json_root, r->pool);
+}
 
-    /* deallocate temporary storage */
-    for(i = 0; i < rp_params_cnt; i++) {
-        if(rp_params[i].name)
-            free(rp_params[i].name);
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Returns the JSON answer to a parameters update, as for POST /data.
+ *
+ * @param[in]  pool   pool from which the JSON text is allocated
+ * @retval     NULL   failure while allocating
+ * @retval     other  JSON text
+ */
+char *rp_data_params_json(ngx_pool_t *pool)
+{
+    cJSON *json_root, *app_root;
+    char *app_id = rp_module_ctx.app.id;
+
+    json_root = cJSON_CreateObject(pool);
+    if(json_root == NULL)
+        return NULL;
+    cJSON_AddItemToObject(json_root, "app",
+                          app_root=cJSON_CreateObject(pool), pool);
+    cJSON_AddItemToObject(json_root, "datasets", cJSON_CreateObject(pool),
+                          pool);
+    if(app_root == NULL)
+        return NULL;
+    if (!app_id) {
+        app_id = "unknown";
     }
-    if(rp_params)
-        free(rp_params);
+    cJSON_AddItemToObject(app_root, "id", cJSON_CreateString(app_id, pool),
+                          pool);
 
-    /* ... and return the success or failure code */
-    return ret_val;
+    if(!rp_module_ctx.app.handle)
+        rp_module_cmd_error(&json_root, "Application not loaded", NULL, pool);
+    else if(rp_data_get_params_pool(&json_root, pool) == 0)
+        rp_module_cmd_ok(&json_root, pool);
+
+    return cJSON_PrintUnformatted(json_root, pool);
 }
 
 
 /*----------------------------------------------------------------------------*/
-int rp_data_get_params(ngx_http_request_t *r, cJSON **json_root)
+static int rp_data_get_params_pool(cJSON **json_root, ngx_pool_t *pool)
 {
     rp_app_params_t *rp_params = NULL;
     int rp_params_cnt;
@@ -379,23 +909,23 @@ int rp_data_get_params(ngx_http_request_t *r, cJSON **json_root)
     if(data_root == NULL) {
         return rp_module_cmd_error(json_root, 
                                    "Can not find 'data'", NULL, 
-                                   r->pool);
+                                   pool);
     }
 
     /* Now prepare the answer with set parameters */
     rp_params_cnt = rp_module_ctx.app.get_params_func(&rp_params);
     if(rp_params == NULL) {
         return rp_module_cmd_error(json_root, "Can not retrieve parameters.",
-                                   NULL, r->pool);
+                                   NULL, pool);
     }
 
     cJSON_AddItemToObject(data_root, "params",
-                          j_params=cJSON_CreateObject(r->pool), r->pool);
+                          j_params=cJSON_CreateObject(pool), pool);
 
     for(i = 0; i < rp_params_cnt; i++) {
         cJSON_AddItemToObject(j_params, rp_params[i].name,
-                              cJSON_CreateNumber(rp_params[i].value, r->pool), 
-                              r->pool);
+                              cJSON_CreateNumber(rp_params[i].value, pool), 
+                              pool);
     }
 
     for(i = 0; i < rp_params_cnt; i++) {
@@ -410,78 +940,288 @@ int rp_data_get_params(ngx_http_request_t *r, cJSON **json_root)
 
 
 /*----------------------------------------------------------------------------*/
-int rp_data_get_signals(ngx_http_request_t *r, cJSON **json_root)
+/**
+ * @brief Checks the application once for new signals, into rp_signals.
+ *
+ * @retval     0        new signals
+ * @retval    -1        no new signals (previous ones are in rp_signals)
+ * @retval    -2        application error, or an unfinished frame; either
+ *                      way rp_signals has changed
+ */
+static int rp_data_poll_signals(void)
 {
-    int rp_sig_num, rp_sig_len, ret_val;
-    cJSON *data_root, *sig_root, /* *d1, */ *d2, *g1;
-    /* TODO: Make it configurable */
-    int retries = 200; /* Approx in [ms] */
-    int i;
+    int rp_sig_num, rp_sig_len, ret_val, i;
+    uint64_t t0;
 
-    if(rp_signals == NULL) {
-        int i;
-        rp_signals = (float **)malloc((NUM_DATASETS + 1) * sizeof(float *));
+    if(rp_signals_buf == NULL) {
+        rp_signals_buf = (float **)malloc((NUM_DATASETS + 1) * sizeof(float *));
         for(i = 0; i < NUM_DATASETS + 1; i++) {
-            rp_signals[i] = (float *)malloc(2048 * sizeof(float));
+            rp_signals_buf[i] = (float *)malloc(RP_SIGNAL_MAX_LEN * sizeof(float));
         }
+        rp_signals = rp_signals_buf;
+    }
+
+    t0 = rp_metrics_now_us();
+    if(rp_module_ctx.app.get_signals_frame_func) {
+        /* the application's frame is read in place, nothing is copied */
+        float **frame = NULL;
+        ret_val =
+            rp_module_ctx.app.get_signals_frame_func((float ***)&frame,
+                                                     &rp_sig_num, &rp_sig_len);
+        if((ret_val != -1) && frame) {
+            for(i = 0; i < NUM_DATASETS + 1; i++)
+                rp_signals_lent[i] = (i < rp_sig_num) ? frame[i]
+                    : rp_signals_buf[i];
+            rp_signals = rp_signals_lent;
+        }
+    } else {
+        rp_signals = rp_signals_buf;
+        ret_val =
+            rp_module_ctx.app.get_signals_func((float ***)&rp_signals,
+                                               &rp_sig_num, &rp_sig_len);
+    }
+    rp_metrics_get_signals(rp_metrics_now_us() - t0, ret_val);
+    /* Unless the answer is -1, rp_signals has changed: -2 still comes
+     * with the application's (unfinished) frame, so what was cached or
+     * tagged for the previous signals must not be used for it.
+     */
+    if(ret_val != -1) {
+        rp_signals_len = (rp_sig_len > RP_SIGNAL_MAX_LEN) ? RP_SIGNAL_MAX_LEN
+            : rp_sig_len;
+        /* never 0, which means no signals yet */
+        if(++rp_signals_seq == 0)
+            rp_signals_seq = 1;
     }
 
+    return ret_val;
+}
+
+
+/*----------------------------------------------------------------------------*/
+int rp_data_get_signals(ngx_http_request_t *r, cJSON **json_root)
+{
+    return rp_data_get_signals_pool(json_root, r->pool);
+}
+
+
+/*----------------------------------------------------------------------------*/
+static int rp_data_get_signals_pool(cJSON **json_root, ngx_pool_t *pool)
+{
+    int rp_sig_len = rp_signals_len;
+    cJSON *data_root, *sig_root, /* *d1, */ *d2, *g1;
+    int i;
+
     data_root = cJSON_GetObjectItem(*json_root, "datasets");
     if(data_root == NULL) {
         return rp_module_cmd_error(json_root, 
                                    "Can not find 'data'", NULL, 
-                                   r->pool);
+                                   pool);
     }
     
-    ret_val =
-        rp_module_ctx.app.get_signals_func((float ***)&rp_signals, &rp_sig_num, 
-                                           &rp_sig_len);
-
-    while(ret_val == -1) {
-        ret_val =
-            rp_module_ctx.app.get_signals_func((float ***)&rp_signals, 
-                                               &rp_sig_num, &rp_sig_len);
-
-        if(ret_val == -2) 
-            break;
-        if(retries-- <= 0) {
-            /* Use old signals */
-            break;
-        } else {
-            usleep(1000);
-        }
-    }
-    ret_val = ret_val;
-    /* In case we are repeating the transmission */
-    if((rp_signals_dirty == 0) && (ret_val == -1))
-        ret_val = 0;
-    rp_signals_dirty = 1;
-
     cJSON_AddItemToObject(data_root, "g1",
-                          g1=cJSON_CreateArray(r->pool), r->pool);
+                          g1=cJSON_CreateArray(pool), pool);
 
     /* cJSON_AddItemToObject(g1, "g1",  */
-    /*                       sig_root=cJSON_CreateObject(r->pool), r->pool); */
+    /*                       sig_root=cJSON_CreateObject(pool), pool); */
     /* cJSON_AddItemToObject(sig_root, "data", */
     /*                d1=cJSON_Create2dFloatArray(&rp_signals[0][0], &rp_signals[1][0], */
-    /*                                            rp_sig_len, r->pool), */
-    /*                       r->pool); */
+    /*                                            rp_sig_len, pool), */
+    /*                       pool); */
     /* cJSON_AddItemToObject(g1, "g1",  */
-    /*                       sig_root=cJSON_CreateObject(r->pool), r->pool); */
+    /*                       sig_root=cJSON_CreateObject(pool), pool); */
     /* cJSON_AddItemToObject(sig_root, "data", */
     /*                d2=cJSON_Create2dFloatArray(&rp_signals[0][0], &rp_signals[2][0], */
-    /*                                            rp_sig_len, r->pool), */
-    /*                       r->pool); */
+    /*                                            rp_sig_len, pool), */
+    /*                       pool); */
 
     for (i = 0; i < NUM_DATASETS; ++i) {
       cJSON_AddItemToObject(g1, "g1", 
-                            sig_root=cJSON_CreateObject(r->pool), r->pool);
+                            sig_root=cJSON_CreateObject(pool), pool);
       cJSON_AddItemToObject(sig_root, "data",
                             d2=cJSON_Create2dFloatArray(&rp_signals[0][0], &rp_signals[i+1][0],
-                                                        rp_sig_len, r->pool),
-                          r->pool);
+                                                        rp_sig_len, pool),
+                          pool);
     }
-    return ret_val;
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Returns the size of the binary signals header, including any scales.
+ */
+static size_t rp_data_bin_header_len(int int16)
+{
+    return sizeof(rp_data_bin_header_t) +
+        (int16 ? (NUM_DATASETS + 1) * sizeof(float) : 0);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Prepares the signals in rp_signals for sending in binary.
+ *
+ * @param[out] hdr        binary header, of rp_data_bin_header_len() bytes,
+ *                        filled in along with any scales
+ * @param[in]  int16      convert the samples to int16 with scales
+ * @param[in]  ret_val    0 for new signals, -1 for the previous ones
+ * @param[out] data       the NUM_DATASETS + 1 sample arrays to send
+ * @param[out] sig_bytes  size of each sample array
+ * @retval     0          success
+ * @retval    -1          failure while allocating
+ */
+static int rp_data_bin_prepare(rp_data_bin_header_t *hdr, int int16,
+                               int ret_val, u_char **data, size_t *sig_bytes)
+{
+    float *scales = (float *)(hdr + 1);
+    int rp_sig_len = rp_signals_len, i, j;
+    int sig_num = NUM_DATASETS + 1;
+    uint64_t t0 = rp_metrics_now_us();
+
+    if(int16 && rp_signals_int16 == NULL) {
+        rp_signals_int16 = (int16_t *)malloc((NUM_DATASETS + 1) * RP_SIGNAL_MAX_LEN * sizeof(int16_t));
+        if(rp_signals_int16 == NULL)
+            return -1;
+    }
+
+    hdr->magic       = RP_DATA_BIN_MAGIC;
+    hdr->version     = RP_DATA_BIN_VERSION;
+    hdr->header_size = rp_data_bin_header_len(int16);
+    hdr->flags       = int16 ? RP_DATA_BIN_INT16 : 0;
+    hdr->status      = (ret_val == 0) ? RP_DATA_BIN_OK : RP_DATA_BIN_AGAIN;
+    hdr->sig_num     = sig_num;
+    hdr->reserved    = 0;
+    hdr->sig_len     = rp_sig_len;
+    *sig_bytes = rp_sig_len * (int16 ? sizeof(int16_t) : sizeof(float));
+
+    for(i = 0; i < sig_num; i++) {
+        data[i] = (u_char *)rp_signals[i];
+        if(int16) {
+            int16_t *q = rp_signals_int16 + i * RP_SIGNAL_MAX_LEN;
+            /* converted once for each frame */
+            if(rp_signals_int16_seq != rp_signals_seq) {
+                /* scale so the largest magnitude uses the full int16 range */
+                float max = 0, inv;
+                for(j = 0; j < rp_sig_len; j++) {
+                    float a = fabsf(rp_signals[i][j]);
+                    if(a > max)
+                        max = a;
+                }
+                rp_signals_scales[i] = (max > 0) ? max / 32767.0f : 1.0f;
+                inv = 1.0f / rp_signals_scales[i];
+                for(j = 0; j < rp_sig_len; j++)
+                    q[j] = (int16_t)lrintf(rp_signals[i][j] * inv);
+            }
+            scales[i] = rp_signals_scales[i];
+            data[i] = (u_char *)q;
+        }
+    }
+    if(int16 && (rp_signals_int16_seq != rp_signals_seq)) {
+        rp_signals_int16_seq = rp_signals_seq;
+        rp_metrics_serialize(RP_METRICS_FMT_BIN16, rp_metrics_now_us() - t0);
+    }
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+size_t rp_data_bin_signals_len(int int16)
+{
+    return rp_data_bin_header_len(int16) + (NUM_DATASETS + 1) * rp_signals_len
+        * (int16 ? sizeof(int16_t) : sizeof(float));
+}
+
+
+/*----------------------------------------------------------------------------*/
+int rp_data_bin_signals_write(u_char *dst, int int16, int ret_val)
+{
+    u_char *data[NUM_DATASETS + 1];
+    size_t sig_bytes;
+    int i;
+
+    if(rp_data_bin_prepare((rp_data_bin_header_t *)dst, int16, ret_val, data,
+                           &sig_bytes) < 0)
+        return -1;
+    dst += rp_data_bin_header_len(int16);
+    for(i = 0; i < NUM_DATASETS + 1; i++)
+        dst = ngx_cpymem(dst, data[i], sig_bytes);
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Handler for GET /data?format=bin and /data?format=bin16.
+ *
+ * Sends the time axis and the NUM_DATASETS signals as packed arrays
+ * after an rp_data_bin_header_t, without formatting them as text.  With
+ * format=bin, the arrays are float32, and are sent straight from
+ * rp_signals; with format=bin16, they are int16, each with a float32
+ * scale giving the value of one count.
+ *
+ * @param[in]  r        HTTP request as defined by NGINX framework
+ * @param[in]  int16    send int16 samples with scales rather than float32
+ * @param[in]  ret_val  0 for new signals, -1 for the previous ones, -2
+ *                      for an application error
+ * @retval     other    returned value from rp_module_send_chain()
+ */
+ngx_int_t rp_data_send_bin_signals(ngx_http_request_t *r, int int16,
+                                   int ret_val)
+{
+    rp_data_bin_header_t *hdr;
+    ngx_buf_t *b;
+    ngx_chain_t *out, **last;
+    u_char *data[NUM_DATASETS + 1];
+    size_t hdr_len = rp_data_bin_header_len(int16);
+    size_t sig_bytes;
+    off_t len;
+    int i;
+
+    if(!rp_module_ctx.app.handle) {
+        rp_error(r->connection->log, "Application not loaded");
+        return NGX_HTTP_SERVICE_UNAVAILABLE;
+    }
+
+    if(ret_val == -2)
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+
+    /* header (and scales) in one pool buffer, then one buffer per signal */
+    hdr = ngx_pcalloc(r->pool, hdr_len);
+    out = ngx_alloc_chain_link(r->pool);
+    b = ngx_calloc_buf(r->pool);
+    if(hdr == NULL || out == NULL || b == NULL)
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    if(rp_data_bin_prepare(hdr, int16, ret_val, data, &sig_bytes) < 0)
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    if(rp_data_set_etag(r, int16 ? RP_DATA_FORMAT_BIN16 : RP_DATA_FORMAT_BIN)
+       != NGX_OK)
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    b->pos = (u_char *)hdr;
+    b->last = b->pos + hdr_len;
+    b->memory = 1;
+    out->buf = b;
+    last = &out->next;
+    len = hdr_len;
+
+    for(i = 0; i < NUM_DATASETS + 1; i++) {
+        *last = ngx_alloc_chain_link(r->pool);
+        b = ngx_calloc_buf(r->pool);
+        if(*last == NULL || b == NULL)
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        b->pos = data[i];
+        b->last = data[i] + sig_bytes;
+        b->memory = 1;
+        (*last)->buf = b;
+        last = &(*last)->next;
+        len += sig_bytes;
+    }
+    *last = NULL;
+    b->last_buf = b->last_in_chain = 1;
+    b->sync = b->flush = 1;
+
+    rp_metrics_frames_served(int16 ? RP_METRICS_FMT_BIN16 : RP_METRICS_FMT_BIN,
+                             1);
+    return rp_module_send_chain(r, bin_content_str, out, len);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -492,3 +1232,19 @@ void rp_data_clear_signals_dirty()
 {
     rp_signals_dirty = 0;
 }
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Drops the signals, which may be the application's own frame, before
+ * the application is unloaded.
+ */
+void rp_data_release_signals(void)
+{
+    if(rp_signals != rp_signals_lent)
+        return;
+    rp_signals = rp_signals_buf;
+    rp_signals_len = 0;
+    /* what was made from the application's frame is stale as well */
+    if(++rp_signals_seq == 0)
+        rp_signals_seq = 1;
+}
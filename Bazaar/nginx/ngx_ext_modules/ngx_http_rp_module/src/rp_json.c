@@ -0,0 +1,402 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Nginx module - JSON writer for signal arrays.
+ *
+ * Signals are sent to the browser as JSON arrays of [x,y] pairs, each
+ * float printed by cJSON's rule: "%.04e" for numbers below 1e-2 (or above
+ * 1e9) which are not whole, "%.04f" for all others.  The writer here
+ * prints exactly the same text as that rule does with glibc's sprintf(),
+ * straight into a buffer the caller sized with RP_JSON_2DFLOAT_ARRAY_LEN().
+ *
+ * Floats are decoded into an integer mantissa m and a binary exponent e,
+ * so that a float is exactly m * 2^e.  The four decimals are then scaled
+ * and rounded with integer arithmetic only, rounding ties to even on the
+ * exact value, as glibc does.  Numbers too small or too large for 64 bits
+ * (below 1e-7 in "%.04e", or whole above 2^24) use a short fixed-size
+ * integer of RP_JSON_BIG_LIMBS limbs.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "rp_json.h"
+
+/* 32-bit limbs of the wide integer: m * 10^49 and m * 2^104 need 187 and
+ * 128 bits */
+#define RP_JSON_BIG_LIMBS 8
+
+/* Powers of ten that m * 10^p fits in 64 bits for */
+#define RP_JSON_POW10_MAX 11
+
+typedef struct rp_json_big_s {
+    uint32_t l[RP_JSON_BIG_LIMBS];    /* least significant first */
+} rp_json_big_t;
+
+static const uint64_t rp_json_pow10[RP_JSON_POW10_MAX + 1] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL
+};
+
+static const char rp_json_digits2[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Multiplies a wide integer by x.
+ */
+static void rp_json_big_mul(rp_json_big_t *b, uint32_t x)
+{
+    uint64_t c = 0;
+    int i;
+
+    for(i = 0; i < RP_JSON_BIG_LIMBS; i++) {
+        c += (uint64_t)b->l[i] * x;
+        b->l[i] = (uint32_t)c;
+        c >>= 32;
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Divides a wide integer by d.
+ *
+ * @retval  the remainder
+ */
+static uint32_t rp_json_big_div(rp_json_big_t *b, uint32_t d)
+{
+    uint64_t r = 0;
+    int i;
+
+    for(i = RP_JSON_BIG_LIMBS - 1; i >= 0; i--) {
+        r = (r << 32) | b->l[i];
+        b->l[i] = (uint32_t)(r / d);
+        r %= d;
+    }
+    return (uint32_t)r;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Returns bits pos to pos + 31 of a wide integer.
+ */
+static uint32_t rp_json_big_bits(const rp_json_big_t *b, int pos)
+{
+    int i = pos >> 5, s = pos & 31;
+    uint32_t lo = (i < RP_JSON_BIG_LIMBS) ? b->l[i] : 0;
+    uint32_t hi = (i + 1 < RP_JSON_BIG_LIMBS) ? b->l[i + 1] : 0;
+
+    return s ? ((lo >> s) | (hi << (32 - s))) : lo;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Tells whether any bit of a wide integer below pos is set.
+ */
+static int rp_json_big_sticky(const rp_json_big_t *b, int pos)
+{
+    int i;
+
+    for(i = 0; i < (pos >> 5); i++) {
+        if(b->l[i])
+            return 1;
+    }
+    return (pos & 31) && (b->l[pos >> 5] & ((1U << (pos & 31)) - 1));
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Writes an unsigned integer in decimal.
+ */
+static char *rp_json_u32(char *p, uint32_t v)
+{
+    char tmp[10];
+    char *t = tmp + sizeof(tmp);
+
+    while(v >= 100) {
+        uint32_t i = (v % 100) * 2;
+        v /= 100;
+        *--t = rp_json_digits2[i + 1];
+        *--t = rp_json_digits2[i];
+    }
+    if(v >= 10) {
+        *--t = rp_json_digits2[v * 2 + 1];
+        *--t = rp_json_digits2[v * 2];
+    } else {
+        *--t = '0' + v;
+    }
+
+    memcpy(p, t, tmp + sizeof(tmp) - t);
+    return p + (tmp + sizeof(tmp) - t);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Writes the 4 digits of v < 10000, with leading zeros.
+ */
+static char *rp_json_4digits(char *p, uint32_t v)
+{
+    memcpy(p, &rp_json_digits2[(v / 100) * 2], 2);
+    memcpy(p + 2, &rp_json_digits2[(v % 100) * 2], 2);
+    return p + 4;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Writes the whole number m * 2^e, e >= 0, in decimal.
+ */
+static char *rp_json_whole(char *p, uint32_t m, int e)
+{
+    rp_json_big_t b;
+    uint32_t chunks[RP_JSON_BIG_LIMBS * 10 / 9 + 1];
+    int n = 0, s = e & 31;
+
+    if(e < 8)
+        return rp_json_u32(p, m << e);
+
+    memset(&b, 0, sizeof(b));
+    b.l[e >> 5] = m << s;
+    if(s && ((e >> 5) + 1 < RP_JSON_BIG_LIMBS))
+        b.l[(e >> 5) + 1] = m >> (32 - s);
+
+    /* in chunks of 9 digits, least significant first */
+    do {
+        int i;
+        chunks[n++] = rp_json_big_div(&b, 1000000000);
+        for(i = 0; (i < RP_JSON_BIG_LIMBS) && !b.l[i]; i++)
+            ;
+        if(i == RP_JSON_BIG_LIMBS)
+            break;
+    } while(1);
+
+    p = rp_json_u32(p, chunks[--n]);
+    while(n--) {
+        uint32_t c = chunks[n];
+        p[0] = '0' + c / 100000000;
+        p = rp_json_4digits(p + 1, (c / 10000) % 10000);
+        p = rp_json_4digits(p, c % 10000);
+    }
+    return p;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Writes m * 2^e like "%.04f".
+ */
+static char *rp_json_fixed4(char *p, uint32_t m, int e)
+{
+    uint32_t ip, f;
+    int k = -e;
+
+    if(e >= 0) {
+        p = rp_json_whole(p, m, e);
+        memcpy(p, ".0000", 5);
+        return p + 5;
+    }
+
+    if(k > 40) {
+        /* m * 10^4 < 2^38, so below half of the last decimal */
+        ip = f = 0;
+    } else {
+        uint64_t mask = ((uint64_t)1 << k) - 1;
+        uint64_t half = (uint64_t)1 << (k - 1);
+        uint64_t r = (m & mask) * 10000ULL;
+        uint64_t rem = r & mask;
+
+        ip = (k < 32) ? (m >> k) : 0;
+        f = (uint32_t)(r >> k);
+        /* 10^4 is even, so the last decimal decides a tie */
+        if((rem > half) || ((rem == half) && (f & 1)))
+            f++;
+        if(f == 10000) {
+            ip++;
+            f = 0;
+        }
+    }
+
+    p = rp_json_u32(p, ip);
+    *p++ = '.';
+    return rp_json_4digits(p, f);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Scales m * 2^-k by 10^d, d >= 0.
+ *
+ * @param[out] up  whether the result rounds up to the next integer
+ * @retval         the integer part of the result (only its low 32 bits)
+ */
+static uint32_t rp_json_scale(uint32_t m, int d, int k, int *up)
+{
+    if((d <= RP_JSON_POW10_MAX) && (k < 64)) {
+        uint64_t n = m * rp_json_pow10[d];
+        uint64_t q = k ? (n >> k) : n;
+        uint64_t mask = k ? (((uint64_t)1 << k) - 1) : 0;
+        uint64_t half = k ? ((uint64_t)1 << (k - 1)) : 1;
+
+        *up = ((n & mask) > half) || (((n & mask) == half) && (q & 1));
+        return (uint32_t)q;
+    } else {
+        rp_json_big_t b;
+        uint32_t q;
+
+        memset(&b, 0, sizeof(b));
+        b.l[0] = m;
+        for(; d >= 9; d -= 9)
+            rp_json_big_mul(&b, 1000000000);
+        rp_json_big_mul(&b, (uint32_t)rp_json_pow10[d]);
+
+        q = rp_json_big_bits(&b, k);
+        *up = k && (rp_json_big_bits(&b, k - 1) & 1) &&
+            (rp_json_big_sticky(&b, k - 1) || (q & 1));
+        return q;
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Writes m * 2^-k, 0 < m * 2^-k < 1, like "%.04e".
+ */
+static char *rp_json_exp4(char *p, uint32_t m, int k)
+{
+    /* m * 2^-k is in [2^(b-1), 2^b) */
+    int b = 32 - __builtin_clz(m) - k;
+    /* and 10^x <= m * 2^-k < 10^(x+2) */
+    int x = (int)floor((b - 1) * 0.30102999566398120);
+    uint32_t q;
+    int up;
+
+    /* 10^4 <= q < 10^5 picks the exponent x */
+    while(1) {
+        q = rp_json_scale(m, 4 - x, k, &up);
+        if(q >= 100000)
+            x++;
+        else if(q < 10000)
+            x--;
+        else
+            break;
+    }
+    if(up && (++q == 100000)) {
+        q = 10000;
+        x++;
+    }
+
+    *p++ = '0' + q / 10000;
+    *p++ = '.';
+    p = rp_json_4digits(p, q % 10000);
+    *p++ = 'e';
+    *p++ = (x < 0) ? '-' : '+';
+    if(x < 0)
+        x = -x;
+    memcpy(p, &rp_json_digits2[x * 2], 2);
+    return p + 2;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Writes a float as cJSON does.
+ *
+ * The text is that of sprintf() with "%.04f", or "%.04e" for numbers
+ * below 1e-2 or above 1e9 which are not whole.  At most
+ * RP_JSON_FLOAT4_LEN bytes are written, with no terminating zero.
+ *
+ * @param[in] p  where to write
+ * @param[in] f  the number
+ * @retval       end of the written text
+ */
+char *rp_json_float4(char *p, float f)
+{
+    union { float f; uint32_t u; } v;
+    double d = f;
+    uint32_t m;
+    int be, e;
+
+    v.f = f;
+    m = v.u & 0x7fffff;
+    be = (v.u >> 23) & 0xff;
+
+    if(v.u >> 31)
+        *p++ = '-';
+    if(be == 0xff) {
+        memcpy(p, m ? "nan" : "inf", 3);
+        return p + 3;
+    }
+    if(be) {
+        m |= 0x800000;
+        e = be - 150;
+    } else {
+        e = -149;
+    }
+
+    /* the rule of cJSON's print_number_2d(), on the same double */
+    if(fabs(floor(d) - d) <= DBL_EPSILON && fabs(d) < 1.0e60)
+        return rp_json_fixed4(p, m, e);
+    /* finite floats above 1e9 are whole, so only small ones get here */
+    if((fabs(d) < 1.0e-2 || fabs(d) > 1.0e9) && (e < 0))
+        return rp_json_exp4(p, m, -e);
+    return rp_json_fixed4(p, m, e);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Writes a JSON array of [x,y] pairs, as cJSON prints a
+ * cJSON_2dFloatArray.
+ *
+ * The buffer must hold RP_JSON_2DFLOAT_ARRAY_LEN(n) bytes.  No terminating
+ * zero is written.
+ *
+ * @param[in] p    where to write
+ * @param[in] x    first values of the pairs, or NULL to leave them out
+ * @param[in] y    second values of the pairs, or NULL to leave them out
+ * @param[in] n    number of pairs
+ * @param[in] fmt  whether to put a space after each pair's comma
+ * @retval         end of the written text
+ */
+char *rp_json_2dfloat_array(char *p, const float *x, const float *y, int n,
+                            int fmt)
+{
+    int i;
+
+    *p++ = '[';
+    for(i = 0; i < n; i++) {
+        if(i) {
+            *p++ = ',';
+            if(fmt)
+                *p++ = ' ';
+        }
+        *p++ = '[';
+        if(x)
+            p = rp_json_float4(p, x[i]);
+        if(x && y)
+            *p++ = ',';
+        if(y)
+            p = rp_json_float4(p, y[i]);
+        *p++ = ']';
+    }
+    *p++ = ']';
+
+    return p;
+}
@@ -0,0 +1,482 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Nginx module - performance metrics.
+ *
+ * Counts the requests to each endpoint of the module, with their latency
+ * and the bytes sent, the time spent in the application's rp_get_signals()
+ * and in serializing the signals, the frames of signals produced and
+ * served, and the sweeps /sweeps couldn't send.  The counters are kept in a shared memory zone, so that all
+ * worker processes add to them, and they survive a reload.  GET /metrics
+ * returns them in the Prometheus text format.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_rp_module.h"
+#include "rp_metrics.h"
+
+/* Upper bounds of the latency buckets in ms, less the last one, +Inf */
+static const ngx_uint_t rp_metrics_buckets_ms[] = {
+    1, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000
+};
+#define RP_METRICS_BUCKETS \
+    (sizeof(rp_metrics_buckets_ms) / sizeof(rp_metrics_buckets_ms[0]))
+
+/* Results of rp_get_signals() */
+#define RP_METRICS_SIG_NEW    0
+#define RP_METRICS_SIG_NONE   1
+#define RP_METRICS_SIG_ERROR  2
+#define RP_METRICS_SIG_NUM    3
+
+typedef struct rp_metrics_ep_s {
+    uint64_t requests;
+    uint64_t bytes_out;
+    uint64_t latency_ms;
+    /* requests in each bucket alone; printed cumulative */
+    uint64_t buckets[RP_METRICS_BUCKETS + 1];
+} rp_metrics_ep_t;
+
+typedef struct rp_metrics_s {
+    rp_metrics_ep_t ep[RP_METRICS_EP_NUM];
+    uint64_t get_signals[RP_METRICS_SIG_NUM];
+    uint64_t get_signals_us;
+    uint64_t serialize[RP_METRICS_FMT_NUM];
+    uint64_t serialize_us[RP_METRICS_FMT_NUM];
+    uint64_t frames_served[RP_METRICS_FMT_NUM];
+    uint64_t sweeps_dropped[RP_METRICS_SWEEP_NUM];
+} rp_metrics_t;
+
+static const char *rp_metrics_ep_names[RP_METRICS_EP_NUM] = {
+    "bazaar", "data", "data_bin", "data_post", "data_ws", "metrics", "sweeps"
+};
+static const char *rp_metrics_fmt_names[RP_METRICS_FMT_NUM] = {
+    "json", "bin", "bin16"
+};
+static const char *rp_metrics_sig_names[RP_METRICS_SIG_NUM] = {
+    "new", "none", "error"
+};
+static const char *rp_metrics_sweep_names[RP_METRICS_SWEEP_NUM] = {
+    "too_long", "overwritten"
+};
+
+static const char *rp_metrics_content_str = "text/plain; version=0.0.4";
+
+/* The zone holds only rp_metrics_t, but the slab allocator needs pages */
+#define RP_METRICS_ZONE_SIZE  (8 * ngx_pagesize)
+
+static ngx_str_t        rp_metrics_zone_name = ngx_string("rp_metrics");
+static ngx_slab_pool_t *rp_metrics_pool = NULL;
+/* in the zone; NULL if it could not be set up */
+static rp_metrics_t    *rp_metrics = NULL;
+
+/* Enough for the text of all the metrics */
+#define RP_METRICS_TEXT_LEN   16384
+
+static ngx_int_t rp_metrics_init_zone(ngx_shm_zone_t *shm_zone, void *data);
+static ngx_int_t rp_metrics_log_handler(ngx_http_request_t *r);
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Adds the shared memory zone and the log phase handler.
+ *
+ * @param[in]  cf       configuration being parsed
+ * @retval     NGX_OK   success
+ * @retval     NGX_ERROR failure while allocating
+ */
+ngx_int_t rp_metrics_init(ngx_conf_t *cf)
+{
+    ngx_shm_zone_t *shm_zone;
+    ngx_http_core_main_conf_t *cmcf;
+    ngx_http_handler_pt *h;
+
+    shm_zone = ngx_shared_memory_add(cf, &rp_metrics_zone_name,
+                                     RP_METRICS_ZONE_SIZE, &ngx_http_rp_module);
+    if(shm_zone == NULL)
+        return NGX_ERROR;
+    shm_zone->init = rp_metrics_init_zone;
+
+    cmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_core_module);
+    h = ngx_array_push(&cmcf->phases[NGX_HTTP_LOG_PHASE].handlers);
+    if(h == NULL)
+        return NGX_ERROR;
+    *h = rp_metrics_log_handler;
+
+    return NGX_OK;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Sets up the counters in the zone, or keeps those of the previous
+ * configuration.
+ */
+static ngx_int_t rp_metrics_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_slab_pool_t *shpool = (ngx_slab_pool_t *)shm_zone->shm.addr;
+
+    rp_metrics_pool = shpool;
+
+    /* reload - keep counting */
+    if(data) {
+        shm_zone->data = data;
+        rp_metrics = data;
+        return NGX_OK;
+    }
+    if(shm_zone->shm.exists) {
+        shm_zone->data = shpool->data;
+        rp_metrics = shpool->data;
+        return NGX_OK;
+    }
+
+    rp_metrics = ngx_slab_alloc(shpool, sizeof(rp_metrics_t));
+    if(rp_metrics == NULL)
+        return NGX_ERROR;
+    ngx_memzero(rp_metrics, sizeof(rp_metrics_t));
+
+    shpool->data = rp_metrics;
+    shm_zone->data = rp_metrics;
+    return NGX_OK;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Returns the endpoint of a request, or -1 if not one of ours.
+ */
+static int rp_metrics_endpoint(ngx_http_request_t *r)
+{
+    ngx_http_core_loc_conf_t *clcf;
+    ngx_str_t format;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+    if(clcf->handler != ngx_http_rp_bazaar_cmd_handler)
+        return -1;
+
+    if((r->uri.len >= strlen(c_bazaar_uri)) &&
+       (ngx_strncmp(r->uri.data, c_bazaar_uri, strlen(c_bazaar_uri)) == 0))
+        return RP_METRICS_EP_BAZAAR;
+
+    if((r->uri.len >= strlen(c_metrics_uri)) &&
+       (ngx_strncmp(r->uri.data, c_metrics_uri, strlen(c_metrics_uri)) == 0))
+        return RP_METRICS_EP_METRICS;
+
+    if((r->uri.len >= strlen(c_sweeps_uri)) &&
+       (ngx_strncmp(r->uri.data, c_sweeps_uri, strlen(c_sweeps_uri)) == 0))
+        return RP_METRICS_EP_SWEEPS;
+
+    if((r->uri.len >= strlen(c_data_uri)) &&
+       (ngx_strncmp(r->uri.data, c_data_uri, strlen(c_data_uri)) == 0)) {
+        if(r->method & NGX_HTTP_POST)
+            return RP_METRICS_EP_DATA_POST;
+        if(r->headers_out.status == NGX_HTTP_SWITCHING_PROTOCOLS)
+            return RP_METRICS_EP_DATA_WS;
+        if(ngx_http_arg(r, (u_char *)"format", 6, &format) == NGX_OK)
+            return RP_METRICS_EP_DATA_BIN;
+        return RP_METRICS_EP_DATA_JSON;
+    }
+
+    return -1;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Log phase handler, counting each request to the module.
+ *
+ * The latency is measured as for $request_time, from reading the request
+ * until logging it, so for WebSocket it is the lifetime of the connection.
+ */
+static ngx_int_t rp_metrics_log_handler(ngx_http_request_t *r)
+{
+    rp_metrics_ep_t *ep;
+    ngx_time_t *tp;
+    ngx_msec_int_t ms;
+    ngx_uint_t i;
+    int n;
+
+    if(rp_metrics == NULL)
+        return NGX_OK;
+
+    n = rp_metrics_endpoint(r);
+    if(n < 0)
+        return NGX_OK;
+
+    tp = ngx_timeofday();
+    ms = (ngx_msec_int_t)((tp->sec - r->start_sec) * 1000 +
+                          (tp->msec - r->start_msec));
+    ms = ngx_max(ms, 0);
+
+    for(i = 0; i < RP_METRICS_BUCKETS; i++) {
+        if((ngx_uint_t)ms <= rp_metrics_buckets_ms[i])
+            break;
+    }
+
+    ngx_shmtx_lock(&rp_metrics_pool->mutex);
+    ep = &rp_metrics->ep[n];
+    ep->requests++;
+    ep->bytes_out += r->connection->sent;
+    ep->latency_ms += ms;
+    ep->buckets[i]++;
+    ngx_shmtx_unlock(&rp_metrics_pool->mutex);
+
+    return NGX_OK;
+}
+
+
+/*----------------------------------------------------------------------------*/
+uint64_t rp_metrics_now_us(void)
+{
+    struct timeval tv;
+
+    ngx_gettimeofday(&tv);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_metrics_get_signals(uint64_t us, int ret_val)
+{
+    int i;
+
+    if(rp_metrics == NULL)
+        return;
+
+    if(ret_val == 0)
+        i = RP_METRICS_SIG_NEW;
+    else if(ret_val == -1)
+        i = RP_METRICS_SIG_NONE;
+    else
+        i = RP_METRICS_SIG_ERROR;
+
+    ngx_shmtx_lock(&rp_metrics_pool->mutex);
+    rp_metrics->get_signals[i]++;
+    rp_metrics->get_signals_us += us;
+    ngx_shmtx_unlock(&rp_metrics_pool->mutex);
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_metrics_serialize(int format, uint64_t us)
+{
+    if(rp_metrics == NULL)
+        return;
+
+    ngx_shmtx_lock(&rp_metrics_pool->mutex);
+    rp_metrics->serialize[format]++;
+    rp_metrics->serialize_us[format] += us;
+    ngx_shmtx_unlock(&rp_metrics_pool->mutex);
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_metrics_frames_served(int format, ngx_uint_t n)
+{
+    if(rp_metrics == NULL)
+        return;
+
+    ngx_shmtx_lock(&rp_metrics_pool->mutex);
+    rp_metrics->frames_served[format] += n;
+    ngx_shmtx_unlock(&rp_metrics_pool->mutex);
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_metrics_sweep_dropped(int reason)
+{
+    if(rp_metrics == NULL)
+        return;
+
+    ngx_shmtx_lock(&rp_metrics_pool->mutex);
+    rp_metrics->sweeps_dropped[reason]++;
+    ngx_shmtx_unlock(&rp_metrics_pool->mutex);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Prints microseconds as seconds.
+ */
+static u_char *rp_metrics_seconds(u_char *p, u_char *end, uint64_t us)
+{
+    return ngx_slprintf(p, end, "%uL.%06uL\n", us / 1000000, us % 1000000);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Prints the metrics in the Prometheus text format.
+ *
+ * @param[out] buf  output, of RP_METRICS_TEXT_LEN bytes
+ * @param[in]  m    copy of the counters
+ * @retval     end of the text
+ */
+static u_char *rp_metrics_print(u_char *buf, const rp_metrics_t *m)
+{
+    u_char *p = buf, *end = buf + RP_METRICS_TEXT_LEN;
+    const rp_metrics_ep_t *ep;
+    uint64_t cum;
+    ngx_uint_t i;
+    int n;
+
+    p = ngx_slprintf(p, end,
+        "# HELP rp_http_requests_total Requests handled, by endpoint.\n"
+        "# TYPE rp_http_requests_total counter\n");
+    for(n = 0; n < RP_METRICS_EP_NUM; n++) {
+        p = ngx_slprintf(p, end, "rp_http_requests_total{endpoint=\"%s\"} %uL\n",
+                         rp_metrics_ep_names[n], m->ep[n].requests);
+    }
+
+    p = ngx_slprintf(p, end,
+        "# HELP rp_http_response_bytes_total Bytes sent, headers included.\n"
+        "# TYPE rp_http_response_bytes_total counter\n");
+    for(n = 0; n < RP_METRICS_EP_NUM; n++) {
+        p = ngx_slprintf(p, end,
+                         "rp_http_response_bytes_total{endpoint=\"%s\"} %uL\n",
+                         rp_metrics_ep_names[n], m->ep[n].bytes_out);
+    }
+
+    p = ngx_slprintf(p, end,
+        "# HELP rp_http_request_duration_seconds Time from reading a request "
+        "to logging it; for WebSocket, the connection's lifetime.\n"
+        "# TYPE rp_http_request_duration_seconds histogram\n");
+    for(n = 0; n < RP_METRICS_EP_NUM; n++) {
+        ep = &m->ep[n];
+        cum = 0;
+        for(i = 0; i < RP_METRICS_BUCKETS; i++) {
+            cum += ep->buckets[i];
+            p = ngx_slprintf(p, end,
+                             "rp_http_request_duration_seconds_bucket"
+                             "{endpoint=\"%s\",le=\"%ui.%03ui\"} %uL\n",
+                             rp_metrics_ep_names[n],
+                             rp_metrics_buckets_ms[i] / 1000,
+                             rp_metrics_buckets_ms[i] % 1000, cum);
+        }
+        p = ngx_slprintf(p, end,
+                         "rp_http_request_duration_seconds_bucket"
+                         "{endpoint=\"%s\",le=\"+Inf\"} %uL\n",
+                         rp_metrics_ep_names[n], ep->requests);
+        p = ngx_slprintf(p, end,
+                         "rp_http_request_duration_seconds_sum"
+                         "{endpoint=\"%s\"} ", rp_metrics_ep_names[n]);
+        p = rp_metrics_seconds(p, end, ep->latency_ms * 1000);
+        p = ngx_slprintf(p, end,
+                         "rp_http_request_duration_seconds_count"
+                         "{endpoint=\"%s\"} %uL\n",
+                         rp_metrics_ep_names[n], ep->requests);
+    }
+
+    p = ngx_slprintf(p, end,
+        "# HELP rp_get_signals_calls_total Calls of the application's "
+        "rp_get_signals(), by result.\n"
+        "# TYPE rp_get_signals_calls_total counter\n");
+    for(n = 0; n < RP_METRICS_SIG_NUM; n++) {
+        p = ngx_slprintf(p, end, "rp_get_signals_calls_total{result=\"%s\"} "
+                         "%uL\n", rp_metrics_sig_names[n], m->get_signals[n]);
+    }
+    p = ngx_slprintf(p, end,
+        "# HELP rp_get_signals_seconds_total Time spent in rp_get_signals().\n"
+        "# TYPE rp_get_signals_seconds_total counter\n"
+        "rp_get_signals_seconds_total ");
+    p = rp_metrics_seconds(p, end, m->get_signals_us);
+
+    p = ngx_slprintf(p, end,
+        "# HELP rp_serialize_total Frames of signals serialized, by format.\n"
+        "# TYPE rp_serialize_total counter\n");
+    for(n = 0; n < RP_METRICS_FMT_NUM; n++) {
+        p = ngx_slprintf(p, end, "rp_serialize_total{format=\"%s\"} %uL\n",
+                         rp_metrics_fmt_names[n], m->serialize[n]);
+    }
+    p = ngx_slprintf(p, end,
+        "# HELP rp_serialize_seconds_total Time spent serializing signals, "
+        "by format.\n"
+        "# TYPE rp_serialize_seconds_total counter\n");
+    for(n = 0; n < RP_METRICS_FMT_NUM; n++) {
+        p = ngx_slprintf(p, end, "rp_serialize_seconds_total{format=\"%s\"} ",
+                         rp_metrics_fmt_names[n]);
+        p = rp_metrics_seconds(p, end, m->serialize_us[n]);
+    }
+
+    p = ngx_slprintf(p, end,
+        "# HELP rp_frames_produced_total Frames of new signals from the "
+        "application.\n"
+        "# TYPE rp_frames_produced_total counter\n"
+        "rp_frames_produced_total %uL\n", m->get_signals[RP_METRICS_SIG_NEW]);
+    p = ngx_slprintf(p, end,
+        "# HELP rp_frames_served_total Frames of signals sent to clients, "
+        "by format.\n"
+        "# TYPE rp_frames_served_total counter\n");
+    for(n = 0; n < RP_METRICS_FMT_NUM; n++) {
+        p = ngx_slprintf(p, end, "rp_frames_served_total{format=\"%s\"} %uL\n",
+                         rp_metrics_fmt_names[n], m->frames_served[n]);
+    }
+    p = ngx_slprintf(p, end,
+        "# HELP rp_sweeps_dropped_total Complete sweeps not sent to a /sweeps "
+        "client, by reason.\n"
+        "# TYPE rp_sweeps_dropped_total counter\n");
+    for(n = 0; n < RP_METRICS_SWEEP_NUM; n++) {
+        p = ngx_slprintf(p, end, "rp_sweeps_dropped_total{reason=\"%s\"} %uL\n",
+                         rp_metrics_sweep_names[n], m->sweeps_dropped[n]);
+    }
+
+    return p;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Handler of GET /metrics.
+ *
+ * @retval NGX_HTTP_NOT_ALLOWED            not GET or HEAD
+ * @retval NGX_HTTP_SERVICE_UNAVAILABLE    no shared memory zone
+ * @retval NGX_HTTP_INTERNAL_SERVER_ERROR  failure while allocating
+ * @retval other                           returned value from
+ *                                         rp_module_send_chain()
+ */
+ngx_int_t rp_metrics_handler(ngx_http_request_t *r)
+{
+    rp_metrics_t m;
+    ngx_chain_t *out;
+    ngx_buf_t *b;
+    u_char *text;
+
+    if(!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD)))
+        return NGX_HTTP_NOT_ALLOWED;
+
+    if(rp_metrics == NULL)
+        return NGX_HTTP_SERVICE_UNAVAILABLE;
+
+    if(ngx_http_discard_request_body(r) != NGX_OK)
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+
+    /* a consistent copy, printed without holding the lock */
+    ngx_shmtx_lock(&rp_metrics_pool->mutex);
+    ngx_memcpy(&m, rp_metrics, sizeof(rp_metrics_t));
+    ngx_shmtx_unlock(&rp_metrics_pool->mutex);
+
+    text = ngx_palloc(r->pool, RP_METRICS_TEXT_LEN);
+    out = ngx_alloc_chain_link(r->pool);
+    b = ngx_calloc_buf(r->pool);
+    if((text == NULL) || (out == NULL) || (b == NULL))
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+
+    b->pos = text;
+    b->last = rp_metrics_print(text, &m);
+    b->memory = 1;
+    b->last_buf = b->last_in_chain = 1;
+    b->sync = b->flush = 1;
+    out->buf = b;
+    out->next = NULL;
+
+    return rp_module_send_chain(r, rp_metrics_content_str, out,
+                                b->last - b->pos);
+}
@@ -0,0 +1,434 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Nginx module - application parameters table.
+ *
+ * The module keeps the names and last known values of the application's
+ * parameters, with the names indexed by hash.  Parameter updates, as sent
+ * in the body of POST /data or in a WebSocket text message, are parsed in
+ * a single pass straight into the table, without building a cJSON tree,
+ * and only the parameters whose values differ from the application's are
+ * passed on to its rp_set_params().
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_rp_module.h"
+#include "rp_params.h"
+
+#include <stdlib.h>
+
+typedef struct rp_param_s {
+    char     *name;         /* as allocated by the application */
+    size_t    len;
+    int       pos;          /* in the application's parameters */
+    float     value;        /* as last read from the application */
+    float     new_value;    /* from the update being parsed */
+    int       set;          /* new_value was given */
+} rp_param_t;
+
+/* Position of the parser in the text */
+typedef struct rp_params_tok_s {
+    const u_char *p;
+    const u_char *end;
+} rp_params_tok_t;
+
+static rp_param_t      rp_params[RP_PARAMS_MAX];
+static int             rp_params_num = 0;
+/* number of parameters the application gave, duplicates included */
+static int             rp_params_app_num = 0;
+/* 1 + index in rp_params of the name hashed to each slot, 0 when free */
+static uint8_t         rp_params_index[RP_PARAMS_HASH];
+/* The changed parameters passed to the application, ended by a NULL name */
+static rp_app_params_t rp_params_changed[RP_PARAMS_MAX + 1];
+
+/* Keys of the objects leading to the parameters */
+static const char *rp_params_keys[] = { "datasets", "params" };
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Looks a parameter up by name.
+ *
+ * @retval  the parameter, or NULL if the application has none of that name
+ */
+static rp_param_t *rp_params_find(const u_char *name, size_t len)
+{
+    ngx_uint_t i = ngx_hash_key((u_char *)name, len) & (RP_PARAMS_HASH - 1);
+
+    /* the index is never full, so a free slot ends the search */
+    while(rp_params_index[i]) {
+        rp_param_t *prm = &rp_params[rp_params_index[i] - 1];
+
+        if((prm->len == len) && !ngx_memcmp(prm->name, name, len))
+            return prm;
+        i = (i + 1) & (RP_PARAMS_HASH - 1);
+    }
+    return NULL;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Reads the names and values of the parameters from the application.
+ *
+ * The names are indexed again only if they differ from the last ones, as
+ * when another application was loaded.
+ *
+ * @retval  0  success
+ * @retval -1  the application gave no parameters
+ */
+int rp_params_load(void)
+{
+    rp_app_params_t *p = NULL;
+    int i, n, cnt, same;
+
+    cnt = rp_module_ctx.app.get_params_func(&p);
+    if(p == NULL)
+        return -1;
+
+    n = (cnt > RP_PARAMS_MAX) ? RP_PARAMS_MAX : cnt;
+    if(cnt > RP_PARAMS_MAX) {
+        rp_error(ngx_cycle->log, "Too many parameters (%d), using %d",
+                 cnt, RP_PARAMS_MAX);
+    }
+
+    same = (n == rp_params_app_num);
+    for(i = 0; same && (i < rp_params_num); i++) {
+        const char *name = p[rp_params[i].pos].name;
+        same = name && !strcmp(name, rp_params[i].name);
+    }
+
+    if(same) {
+        for(i = 0; i < rp_params_num; i++)
+            rp_params[i].value = p[rp_params[i].pos].value;
+    } else {
+        for(i = 0; i < rp_params_num; i++)
+            free(rp_params[i].name);
+        ngx_memzero(rp_params_index, sizeof(rp_params_index));
+        rp_params_num = 0;
+        rp_params_app_num = n;
+
+        /* of parameters named alike, the application sets the first */
+        for(i = 0; i < n; i++) {
+            rp_param_t *prm = &rp_params[rp_params_num];
+            ngx_uint_t h;
+
+            if((p[i].name == NULL) ||
+               rp_params_find((u_char *)p[i].name, strlen(p[i].name)))
+                continue;
+
+            /* the table keeps the name the application allocated */
+            prm->name = p[i].name;
+            prm->len = strlen(p[i].name);
+            prm->pos = i;
+            prm->value = p[i].value;
+            prm->set = 0;
+            p[i].name = NULL;
+
+            h = ngx_hash_key((u_char *)prm->name, prm->len);
+            while(rp_params_index[h & (RP_PARAMS_HASH - 1)])
+                h++;
+            rp_params_index[h & (RP_PARAMS_HASH - 1)] = ++rp_params_num;
+        }
+    }
+
+    for(i = 0; i < cnt; i++) {
+        if(p[i].name)
+            free(p[i].name);
+    }
+    free(p);
+
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Skips white space, as cJSON does.
+ */
+static void rp_params_ws(rp_params_tok_t *t)
+{
+    while((t->p < t->end) && (*t->p <= ' '))
+        t->p++;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Reads a string.
+ *
+ * @param[out] buf   where the string goes, or NULL to skip it
+ * @param[in]  size  bytes in buf
+ * @param[out] len   length of the string, above size if it did not fit
+ *                   (or held a \u escape, which no name of ours does)
+ * @retval     0     success
+ * @retval    -1     no valid string
+ */
+static int rp_params_string(rp_params_tok_t *t, u_char *buf, size_t size,
+                            size_t *len)
+{
+    size_t n = 0;
+    int fits = 1;
+
+    if((t->p >= t->end) || (*t->p != '"'))
+        return -1;
+    t->p++;
+
+    while(t->p < t->end) {
+        u_char c = *t->p++;
+
+        if(c == '"') {
+            if(len)
+                *len = fits ? n : size + 1;
+            return 0;
+        }
+        if(c == '\\') {
+            if(t->p >= t->end)
+                return -1;
+            c = *t->p++;
+            switch(c) {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u':
+                if(t->end - t->p < 4)
+                    return -1;
+                t->p += 4;
+                fits = 0;
+                break;
+            }
+        }
+        if(n < size) {
+            if(buf)
+                buf[n] = c;
+        } else {
+            fits = 0;
+        }
+        n++;
+    }
+    return -1;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Reads a number.
+ *
+ * @retval  0  success
+ * @retval -1  no valid number
+ */
+static int rp_params_number(rp_params_tok_t *t, double *d)
+{
+    u_char buf[64];
+    char *end;
+    size_t n = 0;
+
+    while((t->p < t->end) && (n < sizeof(buf) - 1) &&
+          ((*t->p >= '0' && *t->p <= '9') || (*t->p == '-') ||
+           (*t->p == '+') || (*t->p == '.') || (*t->p == 'e') ||
+           (*t->p == 'E')))
+        buf[n++] = *t->p++;
+    buf[n] = '\0';
+
+    *d = strtod((char *)buf, &end);
+    return ((n == 0) || (end != (char *)buf + n)) ? -1 : 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Skips a value of any type, checking only that brackets match.
+ *
+ * @retval  0  success
+ * @retval -1  no valid value
+ */
+static int rp_params_skip(rp_params_tok_t *t)
+{
+    int depth = 0;
+
+    do {
+        rp_params_ws(t);
+        if(t->p >= t->end)
+            return -1;
+
+        switch(*t->p) {
+        case '"':
+            if(rp_params_string(t, NULL, 0, NULL) < 0)
+                return -1;
+            break;
+        case '{':
+        case '[':
+            depth++;
+            t->p++;
+            break;
+        case '}':
+        case ']':
+            if(--depth < 0)
+                return -1;
+            t->p++;
+            break;
+        case ',':
+        case ':':
+            if(depth == 0)
+                return -1;
+            t->p++;
+            break;
+        default: {
+            /* numbers, true, false and null */
+            const u_char *start = t->p;
+            while((t->p < t->end) &&
+                  (((*t->p | 0x20) >= 'a' && (*t->p | 0x20) <= 'z') ||
+                   (*t->p >= '0' && *t->p <= '9') || (*t->p == '-') ||
+                   (*t->p == '+') || (*t->p == '.')))
+                t->p++;
+            if(t->p == start)
+                return -1;
+        }
+        }
+    } while(depth > 0);
+
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Parses an object: the root (level 0), "datasets" (1) or "params"
+ * (2), whose numbers are stored in the table.
+ *
+ * Only the first "datasets" and "params" count; their names are matched
+ * regardless of case, and parameter names exactly, as before.
+ *
+ * @param[in,out] found  levels found so far
+ * @retval         0     success
+ * @retval        -1     invalid JSON
+ */
+static int rp_params_object(rp_params_tok_t *t, int level, int *found)
+{
+    u_char key[RP_PARAMS_NAME_MAX];
+    size_t len;
+
+    rp_params_ws(t);
+    if((t->p >= t->end) || (*t->p != '{'))
+        return -1;
+    t->p++;
+    rp_params_ws(t);
+    if((t->p < t->end) && (*t->p == '}')) {
+        t->p++;
+        return 0;
+    }
+
+    while(1) {
+        rp_params_ws(t);
+        if(rp_params_string(t, key, sizeof(key), &len) < 0)
+            return -1;
+        rp_params_ws(t);
+        if((t->p >= t->end) || (*t->p++ != ':'))
+            return -1;
+        rp_params_ws(t);
+        if(t->p >= t->end)
+            return -1;
+
+        if((level < 2) && (*found == level) &&
+           (len == ngx_strlen(rp_params_keys[level])) &&
+           !ngx_strncasecmp(key, (u_char *)rp_params_keys[level], len)) {
+            (*found)++;
+            if(*t->p == '{') {
+                if(rp_params_object(t, level + 1, found) < 0)
+                    return -1;
+            } else if(rp_params_skip(t) < 0) {
+                return -1;
+            }
+        } else if((level == 2) &&
+                  ((*t->p == '-') || (*t->p >= '0' && *t->p <= '9'))) {
+            rp_param_t *prm;
+            double d;
+
+            if(rp_params_number(t, &d) < 0)
+                return -1;
+            prm = (len <= sizeof(key)) ? rp_params_find(key, len) : NULL;
+            if(prm) {
+                prm->new_value = (float)d;
+                prm->set = 1;
+            } else {
+                rp_debug(ngx_cycle->log, "Parameter %*s not found, ignoring it",
+                         ngx_min(len, sizeof(key)), key);
+            }
+        } else if(rp_params_skip(t) < 0) {
+            /* other values are not parameters */
+            return -1;
+        }
+
+        rp_params_ws(t);
+        if(t->p >= t->end)
+            return -1;
+        if(*t->p == '}') {
+            t->p++;
+            return 0;
+        }
+        if(*t->p++ != ',')
+            return -1;
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Parses a parameters update and lists the parameters it changes.
+ *
+ * The text holds the same JSON as the body of POST /data, e.g.
+ * {"datasets":{"params":{"xmin":0,"xmax":10}}}.  Parameters the
+ * application does not have, or whose values are not numbers, are ignored,
+ * as are those given the value they already have (as of rp_params_load()).
+ *
+ * @param[in]  text     the JSON, not necessarily zero terminated
+ * @param[in]  len      its length
+ * @param[out] changed  the changed parameters, as for rp_set_params(),
+ *                      valid until the next call
+ * @retval     >=0      number of changed parameters
+ * @retval     <0       one of RP_PARAMS_ERR_JSON, _DATA or _PARAMS
+ */
+int rp_params_parse(const u_char *text, size_t len,
+                    rp_app_params_t **changed)
+{
+    rp_params_tok_t t;
+    int i, n = 0, found = 0, rc;
+
+    t.p = text;
+    t.end = text + len;
+    rc = rp_params_object(&t, 0, &found);
+
+    for(i = 0; i < rp_params_num; i++) {
+        rp_param_t *prm = &rp_params[i];
+
+        if(prm->set && (rc == 0) && (prm->new_value != prm->value)) {
+            rp_app_params_t *c = &rp_params_changed[n++];
+
+            ngx_memzero(c, sizeof(*c));
+            c->name = prm->name;
+            c->value = prm->new_value;
+        }
+        prm->set = 0;
+    }
+    rp_params_changed[n].name = NULL;
+    *changed = rp_params_changed;
+
+    if(rc < 0)
+        return RP_PARAMS_ERR_JSON;
+    if(found < 1)
+        return RP_PARAMS_ERR_DATA;
+    if(found < 2)
+        return RP_PARAMS_ERR_PARAMS;
+    return n;
+}
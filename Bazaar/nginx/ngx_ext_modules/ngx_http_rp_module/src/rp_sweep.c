@@ -0,0 +1,413 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Nginx module - streaming of captured sweeps.
+ *
+ * GET /sweeps keeps the response open and sends each sweep the
+ * application completes in its pulse ring (see rp_app_pulses_t) as one
+ * chunk of a chunked response.  The chunk's data are NGINX buffers
+ * pointing into the ring, so the pulses are copied only into the socket.
+ *
+ * The application never waits for the clients.  A client still sending
+ * a sweep isn't given another; once done, it gets the newest complete
+ * sweep, the ones in between being counted as skipped.  A client so slow
+ * that the application is about to overwrite what it hasn't sent yet is
+ * closed.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_rp_module.h"
+#include "rp_data_cmd.h"
+#include "rp_metrics.h"
+#include "rp_sweep.h"
+
+/* Pulses kept between the oldest one a client has yet to send and the
+ * one the application writes next; closer than this the client is closed.
+ * A sweep starting closer than twice this isn't sent at all, so one longer
+ * than the ring less twice this never is; both are counted in /metrics.
+ */
+#define RP_SWEEP_MARGIN(ring) ((ring)->slots / 16)
+
+typedef struct rp_sweep_client_s {
+    ngx_queue_t         queue;    /* link in rp_sweep_clients_queue */
+    ngx_http_request_t *r;
+    int                 closed;   /* no longer in rp_sweep_clients_queue */
+    rp_app_pulses_t    *ring;
+    uint32_t            next;     /* first sweep not sent or skipped */
+    uint32_t            skipped;  /* sweeps skipped since the last one sent */
+    uint32_t            first;    /* first pulse of the sweep being sent */
+    /* the sweep being sent: its header, and the pulses in one or, where
+     * the ring wraps, two pieces */
+    rp_sweep_header_t  *hdr;
+    ngx_buf_t           buf[3];
+    ngx_chain_t         out[3];
+} rp_sweep_client_t;
+
+static ngx_queue_t rp_sweep_clients_queue;
+static ngx_uint_t  rp_sweep_n_clients = 0;
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Removes a client when its request is closed.
+ */
+static void rp_sweep_cleanup(void *data)
+{
+    rp_sweep_client_t *cl = (rp_sweep_client_t *)data;
+
+    if(!cl->closed) {
+        ngx_queue_remove(&cl->queue);
+        rp_sweep_n_clients--;
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Closes a client.
+ *
+ * As for rp_ws_close(), NGINX closes the request from an event of its
+ * connection, which is posted.
+ */
+static void rp_sweep_close(rp_sweep_client_t *cl)
+{
+    ngx_connection_t *c = cl->r->connection;
+
+    if(cl->closed)
+        return;
+    cl->closed = 1;
+    ngx_queue_remove(&cl->queue);
+    rp_sweep_n_clients--;
+
+    ngx_http_finalize_request(cl->r, NGX_HTTP_CLOSE);
+    ngx_post_event(c->write, &ngx_posted_events);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Returns the oldest pulse of the sweep being sent not yet sent.
+ */
+static uint32_t rp_sweep_unsent(rp_sweep_client_t *cl)
+{
+    uint32_t n = cl->first;
+    ngx_buf_t *b;
+    int i;
+
+    for(i = 1; i < 3; i++) {
+        b = &cl->buf[i];
+        if(b->pos < b->last)
+            return n + (b->pos - b->start) / cl->ring->slot_size;
+        n += (b->last - b->start) / cl->ring->slot_size;
+    }
+    return n;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Passes the chain to the output filters, or just sends what they
+ * still hold if it is NULL.
+ *
+ * @retval  0  success, or the rest waits for the socket
+ * @retval -1  failure, the client having been closed
+ */
+static int rp_sweep_output(rp_sweep_client_t *cl, ngx_chain_t *in)
+{
+    ngx_http_request_t *r = cl->r;
+    ngx_connection_t *c = r->connection;
+    ngx_http_core_loc_conf_t *clcf;
+
+    if(ngx_http_output_filter(r, in) == NGX_ERROR)
+        goto failed;
+
+    if(r->out) {
+        if(ngx_handle_write_event(c->write, 0) != NGX_OK)
+            goto failed;
+        clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+        ngx_add_timer(c->write, clcf->send_timeout);
+    } else if(c->write->timer_set) {
+        ngx_del_timer(c->write);
+    }
+    return 0;
+
+failed:
+    rp_sweep_close(cl);
+    return -1;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Points a buffer at len bytes of the ring.
+ */
+static void rp_sweep_set_buf(ngx_buf_t *b, u_char *p, size_t len)
+{
+    b->start = b->pos = p;
+    b->end = b->last = p + len;
+    b->memory = 1;
+    b->flush = 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Sends the newest complete sweep, if the client hasn't had it.
+ *
+ * @retval  0  success, or nothing to send
+ * @retval -1  failure, the client having been closed
+ */
+static int rp_sweep_next(rp_sweep_client_t *cl)
+{
+    rp_app_pulses_t *ring = cl->ring;
+    uint32_t sweeps, k, a, b, n, n1, i;
+    ngx_chain_t *ln;
+
+    sweeps = ring->sweeps;
+    __sync_synchronize();
+    if((int32_t)(sweeps - cl->next) < 2)
+        return 0;
+
+    k = sweeps - 2;
+    cl->skipped += k - cl->next;
+    cl->next = k + 1;
+
+    a = ring->sweep_start[k % RP_APP_PULSES_SWEEPS];
+    b = ring->sweep_start[(k + 1) % RP_APP_PULSES_SWEEPS];
+    __sync_synchronize();
+
+    /* the starts may have been reused meanwhile, or the pulses be about to
+     * be overwritten */
+    n = b - a;
+    if(((uint32_t)(ring->sweeps - k) >= RP_APP_PULSES_SWEEPS) ||
+       (ring->head - a > ring->slots - 2 * RP_SWEEP_MARGIN(ring))) {
+        rp_metrics_sweep_dropped(
+            ((uint32_t)(ring->sweeps - k) < RP_APP_PULSES_SWEEPS) &&
+            (n > ring->slots - 2 * RP_SWEEP_MARGIN(ring))
+            ? RP_METRICS_SWEEP_TOO_LONG : RP_METRICS_SWEEP_OVERWRITTEN);
+        cl->skipped++;
+        return 0;
+    }
+
+    cl->hdr->magic       = RP_SWEEP_MAGIC;
+    cl->hdr->version     = RP_SWEEP_VERSION;
+    cl->hdr->header_size = sizeof(rp_sweep_header_t);
+    cl->hdr->sweep       = k;
+    cl->hdr->skipped     = cl->skipped;
+    cl->hdr->pulses      = n;
+    cl->hdr->pulse_size  = ring->slot_size;
+    cl->skipped = 0;
+    cl->first = a;
+
+    i = a & (ring->slots - 1);
+    n1 = ngx_min(n, ring->slots - i);
+    rp_sweep_set_buf(&cl->buf[0], (u_char *)cl->hdr, sizeof(rp_sweep_header_t));
+    rp_sweep_set_buf(&cl->buf[1], ring->buf + i * ring->slot_size,
+                     n1 * ring->slot_size);
+    rp_sweep_set_buf(&cl->buf[2], ring->buf, (n - n1) * ring->slot_size);
+
+    ln = &cl->out[1];
+    cl->out[0].next = &cl->out[1];
+    cl->out[1].next = NULL;
+    if(n > n1) {
+        ln = &cl->out[2];
+        cl->out[1].next = &cl->out[2];
+        cl->out[2].next = NULL;
+    }
+    ln->buf->flush = 1;
+
+    return rp_sweep_output(cl, cl->out);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Closes the client if it would send pulses being overwritten.
+ *
+ * @retval  0  success
+ * @retval -1  the client was closed
+ */
+static int rp_sweep_check(rp_sweep_client_t *cl)
+{
+    rp_app_pulses_t *ring = cl->ring;
+
+    /* only the response header is being sent */
+    if(cl->buf[1].start == NULL)
+        return 0;
+
+    if(cl->r->out && (ring->head - rp_sweep_unsent(cl) >
+                      ring->slots - RP_SWEEP_MARGIN(ring))) {
+        rp_error(cl->r->connection->log, "Sweeps client too slow, closing");
+        rp_sweep_close(cl);
+        return -1;
+    }
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+static void rp_sweep_write_handler(ngx_http_request_t *r)
+{
+    rp_sweep_client_t *cl = ngx_http_get_module_ctx(r, ngx_http_rp_module);
+    ngx_connection_t *c = r->connection;
+
+    if(c->write->timedout) {
+        c->timedout = 1;
+        rp_sweep_close(cl);
+        return;
+    }
+
+    if(rp_sweep_check(cl) < 0)
+        return;
+    if(r->out && (rp_sweep_output(cl, NULL) < 0))
+        return;
+    if(r->out == NULL)
+        rp_sweep_next(cl);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Handler for GET /sweeps.
+ *
+ * Sends the response header and keeps the connection as a client which
+ * is sent each sweep the application completes.
+ *
+ * @param[in]  r  HTTP request as defined by NGINX framework
+ * @retval     NGX_DONE                        the sweeps are being streamed
+ * @retval     NGX_HTTP_SERVICE_UNAVAILABLE    no application with pulses
+ * @retval     NGX_HTTP_INTERNAL_SERVER_ERROR  failure while allocating
+ * @retval     other                           returned value from ngx_http_send_header()
+ */
+ngx_int_t rp_sweep_handler(ngx_http_request_t *r)
+{
+    ngx_connection_t *c = r->connection;
+    ngx_pool_cleanup_t *cln;
+    rp_app_pulses_t *ring = NULL;
+    rp_sweep_client_t *cl;
+    ngx_int_t rc;
+    int i;
+
+    if(!(r->method & NGX_HTTP_GET))
+        return NGX_HTTP_NOT_ALLOWED;
+
+    rc = ngx_http_discard_request_body(r);
+    if(rc != NGX_OK)
+        return rc;
+
+    if(rp_module_ctx.app.handle && rp_module_ctx.app.get_pulses_func)
+        ring = rp_module_ctx.app.get_pulses_func();
+    if(ring == NULL) {
+        rp_error(c->log, "Application provides no pulses");
+        return NGX_HTTP_SERVICE_UNAVAILABLE;
+    }
+
+    cl = ngx_pcalloc(r->pool, sizeof(rp_sweep_client_t));
+    if(cl == NULL)
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    cl->hdr = ngx_palloc(r->pool, sizeof(rp_sweep_header_t));
+    cln = ngx_pool_cleanup_add(r->pool, 0);
+    if((cl->hdr == NULL) || (cln == NULL))
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+
+    /* no length: the chunked filter sends each sweep as a chunk */
+    r->headers_out.content_type_len = strlen(bin_content_str);
+    r->headers_out.content_type.len = strlen(bin_content_str);
+    r->headers_out.content_type.data = (u_char *)bin_content_str;
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = -1;
+
+    rc = ngx_http_send_header(r);
+    if((rc == NGX_ERROR) || (rc > NGX_OK) || r->header_only)
+        return rc;
+    /* rather than with the first sweep */
+    if(ngx_http_send_special(r, NGX_HTTP_FLUSH) == NGX_ERROR)
+        return NGX_ERROR;
+
+    cl->r = r;
+    cl->ring = ring;
+    for(i = 0; i < 3; i++)
+        cl->out[i].buf = &cl->buf[i];
+    /* start with the newest complete sweep */
+    cl->next = (ring->sweeps >= 2) ? ring->sweeps - 2 : 0;
+
+    if(rp_sweep_n_clients == 0) {
+        ngx_queue_init(&rp_sweep_clients_queue);
+    }
+    ngx_queue_insert_tail(&rp_sweep_clients_queue, &cl->queue);
+    rp_sweep_n_clients++;
+    cln->handler = rp_sweep_cleanup;
+    cln->data = cl;
+    ngx_http_set_ctx(r, cl, ngx_http_rp_module);
+
+    r->read_event_handler = ngx_http_test_reading;
+    r->write_event_handler = rp_sweep_write_handler;
+
+    /* the handler may close the request, so run it from the event loop */
+    ngx_post_event(c->write, &ngx_posted_events);
+
+    rp_data_poll_start();
+
+    /* keep the request open until the client goes */
+    r->main->count++;
+    return NGX_DONE;
+}
+
+
+/*----------------------------------------------------------------------------*/
+ngx_uint_t rp_sweep_clients(void)
+{
+    return rp_sweep_n_clients;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Sends newly completed sweeps to the clients done with the
+ * previous ones, closing those too slow to keep up.
+ */
+void rp_sweep_send(void)
+{
+    ngx_queue_t *q, *next;
+    rp_sweep_client_t *cl;
+
+    if(rp_sweep_n_clients == 0)
+        return;
+
+    for(q = ngx_queue_head(&rp_sweep_clients_queue);
+        q != ngx_queue_sentinel(&rp_sweep_clients_queue); q = next) {
+        next = ngx_queue_next(q);
+        cl = ngx_queue_data(q, rp_sweep_client_t, queue);
+
+        if(cl->r->out)
+            rp_sweep_check(cl);
+        else
+            rp_sweep_next(cl);
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Closes all clients, before the application unloads its ring or
+ * so that an exiting worker can finish.
+ */
+void rp_sweep_close_all(void)
+{
+    rp_sweep_client_t *cl;
+
+    while(rp_sweep_n_clients) {
+        cl = ngx_queue_data(ngx_queue_head(&rp_sweep_clients_queue),
+                            rp_sweep_client_t, queue);
+        rp_sweep_close(cl);
+    }
+}
@@ -0,0 +1,840 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Nginx module - WebSocket push channel.
+ *
+ * GET /data with an "Upgrade: websocket" header is turned into a
+ * WebSocket (RFC 6455).  Each new frame of signals from the application
+ * is serialized once, in the binary layout of GET /data?format=bin (or
+ * ?format=bin16), and pushed to every client as a binary message.  A
+ * client still busy receiving an earlier frame only gets the newest one
+ * once it is done, so slow clients skip frames rather than queue them.
+ *
+ * Clients change parameters by sending text messages holding the same
+ * JSON as the body of POST /data.  The resulting parameters, in the JSON
+ * answer to POST /data, are sent to every client as a text message, and
+ * to each client when it connects.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_rp_module.h"
+#include "rp_data_cmd.h"
+#include "rp_ws.h"
+#include "rp_params.h"
+#include "rp_metrics.h"
+#include "cJSON.h"
+
+#define RP_WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+#define RP_WS_OP_CONT    0x0
+#define RP_WS_OP_TEXT    0x1
+#define RP_WS_OP_BINARY  0x2
+#define RP_WS_OP_CLOSE   0x8
+#define RP_WS_OP_PING    0x9
+#define RP_WS_OP_PONG    0xa
+
+/* Close status codes */
+#define RP_WS_CLOSE_NORMAL       1000
+#define RP_WS_CLOSE_PROTOCOL     1002
+#define RP_WS_CLOSE_UNSUPPORTED  1003
+#define RP_WS_CLOSE_TOO_BIG      1009
+#define RP_WS_CLOSE_ERROR        1011
+
+/* Receive buffer: the largest message and its frame header */
+#define RP_WS_IN_SIZE (RP_WS_MAX_IN_MSG + 14)
+
+/* A message with its frame header, ready to send, shared between clients */
+typedef struct rp_ws_msg_s {
+    ngx_uint_t  refs;
+    size_t      len;      /* bytes in data */
+    u_char      data[1];
+} rp_ws_msg_t;
+
+typedef struct rp_ws_client_s {
+    ngx_queue_t         queue;    /* link in rp_ws_clients_queue */
+    ngx_http_request_t *r;
+    int                 closed;   /* no longer in rp_ws_clients_queue */
+    int                 int16;    /* signals as for ?format=bin16 */
+    /* received bytes not yet parsed */
+    u_char             *in;
+    size_t              in_len;
+    /* message being sent, and how much of it has been */
+    rp_ws_msg_t        *out;
+    size_t              out_sent;
+    /* control and text messages to send, oldest first */
+    rp_ws_msg_t        *ctl[RP_WS_MAX_CTL];
+    ngx_uint_t          n_ctl;
+    /* newest signals to send; replaced if newer ones arrive first */
+    rp_ws_msg_t        *signals;
+} rp_ws_client_t;
+
+static ngx_queue_t rp_ws_clients_queue;
+static ngx_uint_t  rp_ws_n_clients = 0;
+
+
+/*----------------------------------------------------------------------------*/
+#define RP_WS_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void rp_ws_sha1_block(uint32_t *h, const u_char *b)
+{
+    uint32_t w[80], a, bb, c, d, e, f, k, t;
+    int i;
+
+    for(i = 0; i < 16; i++)
+        w[i] = ((uint32_t)b[4*i] << 24) | ((uint32_t)b[4*i+1] << 16) |
+            ((uint32_t)b[4*i+2] << 8) | b[4*i+3];
+    for(i = 16; i < 80; i++)
+        w[i] = RP_WS_ROL(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+    a = h[0]; bb = h[1]; c = h[2]; d = h[3]; e = h[4];
+    for(i = 0; i < 80; i++) {
+        if(i < 20) {
+            f = (bb & c) | (~bb & d);
+            k = 0x5a827999;
+        } else if(i < 40) {
+            f = bb ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if(i < 60) {
+            f = (bb & c) | (bb & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = bb ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        t = RP_WS_ROL(a, 5) + f + e + k + w[i];
+        e = d; d = c; c = RP_WS_ROL(bb, 30); bb = a; a = t;
+    }
+    h[0] += a; h[1] += bb; h[2] += c; h[3] += d; h[4] += e;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Computes the SHA-1 digest needed for the handshake.
+ *
+ * NGINX only provides SHA-1 through OpenSSL, which isn't part of the
+ * Red Pitaya build.
+ */
+static void rp_ws_sha1(const u_char *data, size_t len, u_char *digest)
+{
+    uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476,
+                      0xc3d2e1f0 };
+    uint64_t bits = (uint64_t)len * 8;
+    /* message, 0x80, zero padding, and the length in bits */
+    size_t total = ((len + 8) / 64 + 1) * 64;
+    size_t off, i, j;
+    u_char block[64];
+
+    for(off = 0; off < total; off += 64) {
+        for(i = 0; i < 64; i++) {
+            j = off + i;
+            if(j < len)
+                block[i] = data[j];
+            else if(j == len)
+                block[i] = 0x80;
+            else if(j >= total - 8)
+                block[i] = (u_char)(bits >> (8 * (total - 1 - j)));
+            else
+                block[i] = 0;
+        }
+        rp_ws_sha1_block(h, block);
+    }
+    for(i = 0; i < 20; i++)
+        digest[i] = (u_char)(h[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Allocates a message of len payload bytes, with one reference.
+ *
+ * @param[in]  opcode   RP_WS_OP_...
+ * @param[in]  len      payload length
+ * @param[out] payload  where to write the payload
+ * @retval     NULL     failure while allocating
+ */
+static rp_ws_msg_t *rp_ws_msg_alloc(int opcode, size_t len, u_char **payload)
+{
+    size_t hdr_len = (len < 126) ? 2 : (len < 65536) ? 4 : 10;
+    rp_ws_msg_t *m;
+    u_char *p;
+    int i;
+
+    m = (rp_ws_msg_t *)malloc(sizeof(rp_ws_msg_t) + hdr_len + len);
+    if(m == NULL)
+        return NULL;
+    m->refs = 1;
+    m->len = hdr_len + len;
+
+    /* server messages are sent unfragmented and unmasked */
+    p = m->data;
+    *p++ = 0x80 | opcode;
+    if(len < 126) {
+        *p++ = (u_char)len;
+    } else if(len < 65536) {
+        *p++ = 126;
+        *p++ = (u_char)(len >> 8);
+        *p++ = (u_char)len;
+    } else {
+        *p++ = 127;
+        for(i = 7; i >= 0; i--)
+            *p++ = (u_char)((uint64_t)len >> (8 * i));
+    }
+    *payload = p;
+    return m;
+}
+
+
+/*----------------------------------------------------------------------------*/
+static void rp_ws_msg_unref(rp_ws_msg_t *m)
+{
+    if(m && (--m->refs == 0))
+        free(m);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Removes a client when its request is closed.
+ */
+static void rp_ws_cleanup(void *data)
+{
+    rp_ws_client_t *cl = (rp_ws_client_t *)data;
+    ngx_uint_t i;
+
+    if(!cl->closed) {
+        ngx_queue_remove(&cl->queue);
+        rp_ws_n_clients--;
+    }
+
+    rp_ws_msg_unref(cl->out);
+    rp_ws_msg_unref(cl->signals);
+    for(i = 0; i < cl->n_ctl; i++)
+        rp_ws_msg_unref(cl->ctl[i]);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Closes a client.
+ *
+ * NGINX only posts the closing of the request, to be run from an event of
+ * its connection, so the client is removed from the clients at once and
+ * such an event is posted - it may be another connection's event, or a
+ * timer, which got here.
+ */
+static void rp_ws_close(rp_ws_client_t *cl)
+{
+    ngx_connection_t *c = cl->r->connection;
+
+    if(cl->closed)
+        return;
+    cl->closed = 1;
+    ngx_queue_remove(&cl->queue);
+    rp_ws_n_clients--;
+
+    ngx_http_finalize_request(cl->r, NGX_HTTP_CLOSE);
+    ngx_post_event(c->write, &ngx_posted_events);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Sends a close message, if that can be done without cutting into
+ * another, and closes the client.
+ *
+ * @retval -1 always, the client having been closed
+ */
+static int rp_ws_fail(rp_ws_client_t *cl, int code)
+{
+    ngx_connection_t *c = cl->r->connection;
+    u_char frame[4];
+
+    if((cl->out == NULL) && (cl->r->out == NULL)) {
+        frame[0] = 0x80 | RP_WS_OP_CLOSE;
+        frame[1] = 2;
+        frame[2] = (u_char)(code >> 8);
+        frame[3] = (u_char)code;
+        (void)c->send(c, frame, sizeof(frame));
+    }
+    rp_ws_close(cl);
+    return -1;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Sends as much of the client's waiting messages as the socket takes.
+ *
+ * Control and text messages go first, then the newest signals.
+ *
+ * @retval  0  success, or the rest waits for the socket
+ * @retval -1  failure, the client having been closed
+ */
+static int rp_ws_flush(rp_ws_client_t *cl)
+{
+    ngx_http_request_t *r = cl->r;
+    ngx_connection_t *c = r->connection;
+    ssize_t n;
+
+    /* the rest of the handshake response goes first */
+    if(r->out) {
+        if(ngx_http_output_filter(r, NULL) == NGX_ERROR)
+            goto failed;
+        if(r->out) {
+            if(ngx_handle_write_event(c->write, 0) != NGX_OK)
+                goto failed;
+            return 0;
+        }
+    }
+
+    for( ;; ) {
+        if(cl->out == NULL) {
+            if(cl->n_ctl) {
+                cl->out = cl->ctl[0];
+                cl->n_ctl--;
+                ngx_memmove(cl->ctl, cl->ctl + 1,
+                            cl->n_ctl * sizeof(rp_ws_msg_t *));
+            } else if(cl->signals) {
+                cl->out = cl->signals;
+                cl->signals = NULL;
+            } else {
+                break;
+            }
+            cl->out_sent = 0;
+        }
+
+        n = c->send(c, cl->out->data + cl->out_sent,
+                    cl->out->len - cl->out_sent);
+        if(n == NGX_ERROR)
+            goto failed;
+        if(n == NGX_AGAIN) {
+            if(ngx_handle_write_event(c->write, 0) != NGX_OK)
+                goto failed;
+            return 0;
+        }
+        cl->out_sent += n;
+        if(cl->out_sent == cl->out->len) {
+            rp_ws_msg_unref(cl->out);
+            cl->out = NULL;
+        }
+    }
+    return 0;
+
+failed:
+    rp_ws_close(cl);
+    return -1;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Queues a control or text message for a client and sends it.
+ *
+ * A client which has stopped reading, so that RP_WS_MAX_CTL of these are
+ * already waiting, is closed.
+ *
+ * @retval  0  success
+ * @retval -1  failure, the client having been closed
+ */
+static int rp_ws_send_ctl(rp_ws_client_t *cl, rp_ws_msg_t *m)
+{
+    if(cl->n_ctl == RP_WS_MAX_CTL) {
+        rp_error(cl->r->connection->log, "WebSocket client not reading, "
+                 "closing it");
+        rp_ws_close(cl);
+        return -1;
+    }
+    m->refs++;
+    cl->ctl[cl->n_ctl++] = m;
+    return rp_ws_flush(cl);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Sends a text message to one client, or to all of them if to_all.
+ *
+ * @retval  0  success
+ * @retval -1  failure, with cl closed
+ */
+static int rp_ws_send_text(rp_ws_client_t *cl, const char *text, int to_all)
+{
+    ngx_queue_t *q, *next;
+    rp_ws_client_t *other;
+    rp_ws_msg_t *m;
+    u_char *p;
+    size_t len = ngx_strlen(text);
+    int ret_val = 0;
+
+    m = rp_ws_msg_alloc(RP_WS_OP_TEXT, len, &p);
+    if(m == NULL)
+        return rp_ws_fail(cl, RP_WS_CLOSE_ERROR);
+    ngx_memcpy(p, text, len);
+
+    if(!to_all) {
+        ret_val = rp_ws_send_ctl(cl, m);
+    } else {
+        for(q = ngx_queue_head(&rp_ws_clients_queue);
+            q != ngx_queue_sentinel(&rp_ws_clients_queue); q = next) {
+            next = ngx_queue_next(q);
+            other = ngx_queue_data(q, rp_ws_client_t, queue);
+            if((rp_ws_send_ctl(other, m) < 0) && (other == cl))
+                ret_val = -1;
+        }
+    }
+    rp_ws_msg_unref(m);
+    return ret_val;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Applies the parameters in a text message from a client.
+ *
+ * @retval  0  success
+ * @retval -1  failure, the client having been closed
+ */
+static int rp_ws_set_params(rp_ws_client_t *cl, u_char *text, size_t len)
+{
+    ngx_pool_t *pool;
+    cJSON *json_root;
+    const char *reason = NULL;
+    char *answer;
+    int ret_val;
+
+    /* the request's pool lasts as long as the socket, so use our own */
+    pool = ngx_create_pool(4096, cl->r->connection->log);
+    if(pool == NULL)
+        return rp_ws_fail(cl, RP_WS_CLOSE_ERROR);
+
+    rp_debug(cl->r->connection->log, "Received message: %*s", len, text);
+
+    if(!rp_module_ctx.app.handle) {
+        reason = "Application not loaded";
+    } else {
+        switch(rp_data_parse_and_set_params(text, len)) {
+        case RP_PARAMS_ERR_JSON:
+        case RP_PARAMS_ERR_DATA:
+        case RP_PARAMS_ERR_PARAMS:
+            reason = "Can not find 'params' in message";
+            break;
+        case RP_PARAMS_ERR_SET:
+            reason = "Setting new parameters failed";
+            break;
+        }
+    }
+
+    if(reason) {
+        /* only the sender hears about its mistake */
+        json_root = cJSON_CreateObject(pool);
+        if(json_root)
+            rp_module_cmd_error(&json_root, reason, NULL, pool);
+        answer = json_root ? cJSON_PrintUnformatted(json_root, pool) : NULL;
+    } else {
+        answer = rp_data_params_json(pool);
+    }
+
+    if(answer)
+        ret_val = rp_ws_send_text(cl, answer, reason == NULL);
+    else
+        ret_val = rp_ws_fail(cl, RP_WS_CLOSE_ERROR);
+
+    ngx_destroy_pool(pool);
+    return ret_val;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Handles one complete message from a client.
+ *
+ * @retval  0  success
+ * @retval -1  the client has been closed
+ */
+static int rp_ws_message(rp_ws_client_t *cl, int opcode, u_char *payload,
+                         size_t len)
+{
+    rp_ws_msg_t *m;
+    u_char *p;
+    int ret_val;
+
+    switch(opcode) {
+    case RP_WS_OP_TEXT:
+        return rp_ws_set_params(cl, payload, len);
+
+    case RP_WS_OP_CLOSE:
+        return rp_ws_fail(cl, RP_WS_CLOSE_NORMAL);
+
+    case RP_WS_OP_PING:
+        if(len > 125)
+            return rp_ws_fail(cl, RP_WS_CLOSE_PROTOCOL);
+        m = rp_ws_msg_alloc(RP_WS_OP_PONG, len, &p);
+        if(m == NULL)
+            return rp_ws_fail(cl, RP_WS_CLOSE_ERROR);
+        ngx_memcpy(p, payload, len);
+        ret_val = rp_ws_send_ctl(cl, m);
+        rp_ws_msg_unref(m);
+        return ret_val;
+
+    default:
+        /* binary messages and pongs are ignored */
+        return 0;
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Handles the complete messages received from a client.
+ *
+ * @retval  0  success, with any incomplete message kept
+ * @retval -1  the client has been closed
+ */
+static int rp_ws_parse(rp_ws_client_t *cl)
+{
+    u_char *p, *mask;
+    uint64_t len;
+    size_t hdr_len, i;
+    int opcode;
+
+    while(cl->in_len >= 2) {
+        p = cl->in;
+        opcode = p[0] & 0x0f;
+        len = p[1] & 0x7f;
+        hdr_len = 2;
+        if(len == 126) {
+            if(cl->in_len < 4)
+                break;
+            len = ((uint64_t)p[2] << 8) | p[3];
+            hdr_len = 4;
+        } else if(len == 127) {
+            if(cl->in_len < 10)
+                break;
+            len = 0;
+            for(i = 2; i < 10; i++)
+                len = (len << 8) | p[i];
+            hdr_len = 10;
+        }
+
+        /* clients must mask what they send */
+        if(!(p[1] & 0x80))
+            return rp_ws_fail(cl, RP_WS_CLOSE_PROTOCOL);
+        /* the parameters fit in one small, unfragmented message */
+        if(!(p[0] & 0x80) || (opcode == RP_WS_OP_CONT))
+            return rp_ws_fail(cl, RP_WS_CLOSE_UNSUPPORTED);
+        if(len > RP_WS_MAX_IN_MSG)
+            return rp_ws_fail(cl, RP_WS_CLOSE_TOO_BIG);
+
+        hdr_len += 4;
+        if(cl->in_len < hdr_len + len)
+            break;
+
+        mask = p + hdr_len - 4;
+        p += hdr_len;
+        for(i = 0; i < len; i++)
+            p[i] ^= mask[i & 3];
+
+        if(rp_ws_message(cl, opcode, p, len) < 0)
+            return -1;
+
+        cl->in_len -= hdr_len + len;
+        ngx_memmove(cl->in, p + len, cl->in_len);
+    }
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+static void rp_ws_read_handler(ngx_http_request_t *r)
+{
+    rp_ws_client_t *cl = ngx_http_get_module_ctx(r, ngx_http_rp_module);
+    ngx_connection_t *c = r->connection;
+    ssize_t n;
+
+    /* closing is pending */
+    if(cl->closed)
+        return;
+
+    /* anything received with the handshake */
+    if(rp_ws_parse(cl) < 0)
+        return;
+
+    for( ;; ) {
+        n = c->recv(c, cl->in + cl->in_len, RP_WS_IN_SIZE - cl->in_len);
+        if(n == NGX_AGAIN)
+            break;
+        if((n == 0) || (n == NGX_ERROR)) {
+            rp_ws_close(cl);
+            return;
+        }
+        cl->in_len += n;
+        if(rp_ws_parse(cl) < 0)
+            return;
+    }
+
+    if(ngx_handle_read_event(c->read, 0) != NGX_OK)
+        rp_ws_close(cl);
+}
+
+
+/*----------------------------------------------------------------------------*/
+static void rp_ws_write_handler(ngx_http_request_t *r)
+{
+    rp_ws_client_t *cl = ngx_http_get_module_ctx(r, ngx_http_rp_module);
+
+    rp_ws_flush(cl);
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Finds a request header not parsed by NGINX itself.
+ */
+static ngx_table_elt_t *rp_ws_find_header(ngx_http_request_t *r,
+                                          const char *name)
+{
+    ngx_list_part_t *part = &r->headers_in.headers.part;
+    ngx_table_elt_t *h = part->elts;
+    ngx_uint_t i;
+
+    for(i = 0; /* void */; i++) {
+        if(i >= part->nelts) {
+            if(part->next == NULL)
+                return NULL;
+            part = part->next;
+            h = part->elts;
+            i = 0;
+        }
+        if(!ngx_strcasecmp(h[i].key.data, (u_char *)name))
+            return &h[i];
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Handler for GET /data with "Upgrade: websocket".
+ *
+ * Completes the WebSocket handshake and keeps the connection as a client
+ * which is pushed each new frame of signals.
+ *
+ * @param[in]  r      HTTP request as defined by NGINX framework
+ * @param[in]  int16  send signals as for ?format=bin16 rather than ?format=bin
+ * @retval     NGX_DONE                        the connection is now a WebSocket
+ * @retval     NGX_HTTP_BAD_REQUEST            not a valid WebSocket handshake
+ * @retval     NGX_HTTP_INTERNAL_SERVER_ERROR  failure while allocating
+ * @retval     other                           returned value from ngx_http_send_header()
+ */
+ngx_int_t rp_ws_handler(ngx_http_request_t *r, int int16)
+{
+    ngx_table_elt_t *key, *version, *h;
+    ngx_pool_cleanup_t *cln;
+    ngx_connection_t *c = r->connection;
+    rp_ws_client_t *cl;
+    ngx_pool_t *pool;
+    ngx_str_t digest_str, accept;
+    u_char *buf, digest[20];
+    char *params;
+    size_t len;
+    ngx_int_t rc;
+
+    key = rp_ws_find_header(r, "Sec-WebSocket-Key");
+    version = rp_ws_find_header(r, "Sec-WebSocket-Version");
+    if(!(r->method & NGX_HTTP_GET) || (r->headers_in.upgrade == NULL) ||
+       ngx_strcasecmp(r->headers_in.upgrade->value.data,
+                      (u_char *)"websocket") ||
+       (key == NULL) || (version == NULL) ||
+       ngx_strcmp(version->value.data, "13")) {
+        rp_error(c->log, "Invalid WebSocket handshake");
+        return NGX_HTTP_BAD_REQUEST;
+    }
+
+    /* Sec-WebSocket-Accept is base64(SHA-1(key GUID)) */
+    len = key->value.len + sizeof(RP_WS_GUID) - 1;
+    buf = ngx_pnalloc(r->pool, len);
+    accept.data = ngx_pnalloc(r->pool, ngx_base64_encoded_length(20));
+    if((buf == NULL) || (accept.data == NULL))
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    ngx_memcpy(ngx_cpymem(buf, key->value.data, key->value.len),
+               RP_WS_GUID, sizeof(RP_WS_GUID) - 1);
+    rp_ws_sha1(buf, len, digest);
+    digest_str.data = digest;
+    digest_str.len = sizeof(digest);
+    ngx_encode_base64(&accept, &digest_str);
+
+    h = ngx_list_push(&r->headers_out.headers);
+    if(h == NULL)
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    h->hash = 1;
+    ngx_str_set(&h->key, "Upgrade");
+    ngx_str_set(&h->value, "websocket");
+
+    h = ngx_list_push(&r->headers_out.headers);
+    if(h == NULL)
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    h->hash = 1;
+    ngx_str_set(&h->key, "Sec-WebSocket-Accept");
+    h->value = accept;
+
+    cl = ngx_pcalloc(r->pool, sizeof(rp_ws_client_t));
+    if(cl == NULL)
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    cl->in = ngx_palloc(r->pool, RP_WS_IN_SIZE);
+    cln = ngx_pool_cleanup_add(r->pool, 0);
+    if((cl->in == NULL) || (cln == NULL))
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+
+    /* "Connection: upgrade" is added by NGINX for this status */
+    r->headers_out.status = NGX_HTTP_SWITCHING_PROTOCOLS;
+    ngx_str_set(&r->headers_out.status_line, "101 Switching Protocols");
+    r->header_only = 1;
+    r->keepalive = 0;
+
+    rc = ngx_http_send_header(r);
+    if((rc == NGX_ERROR) || (rc > NGX_OK))
+        return rc;
+
+    cl->r = r;
+    cl->int16 = int16;
+    if(rp_ws_n_clients == 0) {
+        ngx_queue_init(&rp_ws_clients_queue);
+    }
+    ngx_queue_insert_tail(&rp_ws_clients_queue, &cl->queue);
+    rp_ws_n_clients++;
+    cln->handler = rp_ws_cleanup;
+    cln->data = cl;
+    ngx_http_set_ctx(r, cl, ngx_http_rp_module);
+
+    /* anything the client sent after the handshake */
+    len = r->header_in->last - r->header_in->pos;
+    if(len > RP_WS_IN_SIZE)
+        len = RP_WS_IN_SIZE;
+    ngx_memcpy(cl->in, r->header_in->pos, len);
+    cl->in_len = len;
+    r->header_in->pos += len;
+
+    r->read_event_handler = rp_ws_read_handler;
+    r->write_event_handler = rp_ws_write_handler;
+
+    /* greet the client with the current parameters */
+    pool = ngx_create_pool(4096, c->log);
+    if(pool) {
+        params = rp_data_params_json(pool);
+        if(params) {
+            rp_ws_msg_t *m;
+            u_char *p;
+            len = ngx_strlen(params);
+            m = rp_ws_msg_alloc(RP_WS_OP_TEXT, len, &p);
+            if(m) {
+                ngx_memcpy(p, params, len);
+                m->refs++;
+                cl->ctl[cl->n_ctl++] = m;
+                rp_ws_msg_unref(m);
+            }
+        }
+        ngx_destroy_pool(pool);
+    }
+
+    /* the handlers may close the request, so run them from the event loop */
+    ngx_post_event(c->read, &ngx_posted_events);
+    ngx_post_event(c->write, &ngx_posted_events);
+
+    rp_data_poll_start();
+
+    /* keep the request open until the client goes */
+    r->main->count++;
+    return NGX_DONE;
+}
+
+
+/*----------------------------------------------------------------------------*/
+ngx_uint_t rp_ws_clients(void)
+{
+    return rp_ws_n_clients;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Closes all clients, e.g. so that an exiting worker can finish.
+ */
+void rp_ws_close_all(void)
+{
+    rp_ws_client_t *cl;
+
+    while(rp_ws_n_clients) {
+        cl = ngx_queue_data(ngx_queue_head(&rp_ws_clients_queue),
+                            rp_ws_client_t, queue);
+        rp_ws_fail(cl, RP_WS_CLOSE_NORMAL);
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/**
+ * @brief Pushes the new signals in the data module to all clients.
+ *
+ * The signals are serialized once for each format in use.  A client still
+ * sending an earlier frame has that replaced by this one.
+ */
+void rp_ws_send_signals(void)
+{
+    rp_ws_msg_t *msg[2] = { NULL, NULL };
+    ngx_queue_t *q, *next;
+    rp_ws_client_t *cl;
+    ngx_uint_t served[2] = { 0, 0 };
+    uint64_t t0;
+    u_char *p;
+    int i;
+
+    if(rp_ws_n_clients == 0)
+        return;
+
+    for(q = ngx_queue_head(&rp_ws_clients_queue);
+        q != ngx_queue_sentinel(&rp_ws_clients_queue); q = next) {
+        next = ngx_queue_next(q);
+        cl = ngx_queue_data(q, rp_ws_client_t, queue);
+
+        i = cl->int16 ? 1 : 0;
+        if(msg[i] == NULL) {
+            t0 = rp_metrics_now_us();
+            msg[i] = rp_ws_msg_alloc(RP_WS_OP_BINARY,
+                                     rp_data_bin_signals_len(i), &p);
+            if(msg[i] && (rp_data_bin_signals_write(p, i, 0) < 0)) {
+                rp_ws_msg_unref(msg[i]);
+                msg[i] = NULL;
+            }
+            if(msg[i] == NULL) {
+                rp_error(cl->r->connection->log, "Can not allocate "
+                         "WebSocket message");
+                break;
+            }
+            /* converting to int16 is counted by rp_data_bin_signals_write() */
+            if(i == 0)
+                rp_metrics_serialize(RP_METRICS_FMT_BIN,
+                                     rp_metrics_now_us() - t0);
+        }
+
+        rp_ws_msg_unref(cl->signals);
+        msg[i]->refs++;
+        cl->signals = msg[i];
+        served[i]++;
+        rp_ws_flush(cl);
+    }
+
+    rp_metrics_frames_served(RP_METRICS_FMT_BIN, served[0]);
+    rp_metrics_frames_served(RP_METRICS_FMT_BIN16, served[1]);
+
+    rp_ws_msg_unref(msg[0]);
+    rp_ws_msg_unref(msg[1]);
+}
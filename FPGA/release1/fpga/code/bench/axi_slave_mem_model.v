@@ -0,0 +1,155 @@
+/**
+ *
+ * @brief Red Pitaya AXI slave memory model.
+ *
+ * @Author John Brzustowski
+ *
+ * (c) John Brzustowski https://radr-project.org
+ *
+ * This part of code is written in Verilog hardware description language (HDL).
+ * Please visit http://en.wikipedia.org/wiki/Verilog
+ * for more details on the language used herein.
+ */
+
+
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * AXI3 slave memory model used for simulation; the counterpart of
+ * axi_master_model, standing in for DDR behind a PS high-performance port.
+ *
+ * Only the write channels are modelled.  One burst is accepted at a time;
+ * address, data and response handshakes are delayed randomly to exercise
+ * the master's flow control.  Each word written is stored in mem[], indexed
+ * from BASE.  Protocol problems (a burst crossing a 4 KB boundary, a
+ * missing or early WLAST, an unsupported size or burst type, or an address
+ * outside the memory) are reported, counted in `errors`, and answered with
+ * SLVERR.
+ *
+ */
+
+
+
+`timescale 1ns / 1ps
+
+module axi_slave_mem_model
+   #(
+    parameter AW    = 32 ,
+    parameter DW    = 64 ,
+    parameter IW    =  6 ,
+    parameter MSZ   = 12 ,          // memory size 2^MSZ words
+    parameter BASE  = 32'h10000000  // address of mem[0]
+  )
+  (
+ // AXI signals
+   input                   aclk_i             ,
+   input                   arstn_i            ,
+
+ // AXI Write Address Channel Signals
+   input      [   IW-1: 0] awid_i             ,
+   input      [    4-1: 0] awlen_i            ,
+   input      [    3-1: 0] awsize_i           ,
+   input      [    2-1: 0] awburst_i          ,
+   input      [   AW-1: 0] awaddr_i           ,
+   input                   awvalid_i          ,
+   output reg              awready_o          ,
+ // AXI Write Data Channel Signals
+   input      [   DW-1: 0] wdata_i            ,
+   input      [ DW/8-1: 0] wstrb_i            ,
+   input                   wlast_i            ,
+   input                   wvalid_i           ,
+   output reg              wready_o           ,
+ // AXI Write Response Channel Signals
+   output reg [   IW-1: 0] bid_o              ,
+   output reg [    2-1: 0] bresp_o            ,
+   output reg              bvalid_o           ,
+   input                   bready_i
+);
+
+localparam BSZ = $clog2(DW/8) ;  // log2 bytes per word
+
+reg     [   DW-1: 0] mem [0:(1<<MSZ)-1] ;
+integer              errors   ;
+integer              bursts   ;
+
+reg     [   AW-1: 0] addr     ;
+reg     [    4-1: 0] len      ;
+reg     [   IW-1: 0] id       ;
+reg                  bad      ;
+integer              beat     ;
+integer              b        ;
+
+initial begin
+   awready_o <= 1'b0 ;
+   wready_o  <= 1'b0 ;
+   bvalid_o  <= 1'b0 ;
+   bid_o     <=  'h0 ;
+   bresp_o   <= 2'h0 ;
+   errors     = 0    ;
+   bursts     = 0    ;
+end
+
+task error;
+   input [8*40-1:0] what ;
+   begin
+      $display ("@%g %m ERROR: %0s (burst at %h)", $time, what, addr);
+      errors = errors + 1;
+      bad    = 1'b1;
+   end
+endtask
+
+always begin
+   @(posedge aclk_i);
+   if (arstn_i === 1'b1 && awvalid_i === 1'b1) begin
+      // address phase
+      repeat ($unsigned($random) % 4) @(posedge aclk_i);
+      awready_o <= 1'b1 ;
+      addr       = awaddr_i ;
+      len        = awlen_i  ;
+      id         = awid_i   ;
+      bad        = 1'b0     ;
+      if (awsize_i != BSZ)
+        error("unsupported burst size");
+      if (awburst_i != 2'b01)
+        error("burst type is not INCR");
+      if (addr[BSZ-1:0] != 0)
+        error("unaligned burst");
+      if ((addr >> 12) != ((addr + ((len + 1) << BSZ) - 1) >> 12))
+        error("burst crosses a 4 KB boundary");
+      if (addr < BASE || addr + ((len + 1) << BSZ) > BASE + (1 << (MSZ + BSZ)))
+        error("burst outside memory");
+      @(posedge aclk_i);
+      awready_o <= 1'b0 ;
+
+      // data phase
+      for (beat = 0; beat <= len; beat = beat + 1) begin
+         repeat ($unsigned($random) % 3) @(posedge aclk_i);
+         wready_o <= 1'b1 ;
+         @(posedge aclk_i);
+         while (wvalid_i !== 1'b1)
+           @(posedge aclk_i);
+         wready_o <= 1'b0 ;
+         if (wlast_i !== (beat == len))
+           error("WLAST on wrong beat");
+         if (addr >= BASE && addr < BASE + (1 << (MSZ + BSZ)))
+           for (b = 0; b < DW/8; b = b + 1)
+             if (wstrb_i[b])
+               mem[(addr - BASE) >> BSZ][8*b +: 8] = wdata_i[8*b +: 8];
+         addr = addr + (1 << BSZ);
+      end
+
+      // response phase
+      repeat ($unsigned($random) % 8) @(posedge aclk_i);
+      bid_o    <= id ;
+      bresp_o  <= bad ? 2'b10 : 2'b00 ;
+      bvalid_o <= 1'b1 ;
+      @(posedge aclk_i);
+      while (bready_i !== 1'b1)
+        @(posedge aclk_i);
+      bvalid_o <= 1'b0 ;
+      bursts    = bursts + 1;
+   end
+end
+
+endmodule
@@ -0,0 +1,439 @@
+/**
+ *
+ * @brief Red Pitaya digdar DMA testbench.
+ *
+ * @Author John Brzustowski
+ *
+ * (c) John Brzustowski https://radr-project.org
+ *
+ * This part of code is written in Verilog hardware description language (HDL).
+ * Please visit http://en.wikipedia.org/wiki/Verilog
+ * for more details on the language used herein.
+ */
+
+
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * Testbench for DMA of pulses from the Red Pitaya digdar module into DDR.
+ *
+ * The digdar module's AXI HP master is connected to axi_slave_mem_model,
+ * standing in for DDR, which stalls each handshake randomly and checks the
+ * bursts.  Radar trigger, ACP and ARP pulses are generated as in
+ * red_pitaya_digdar_tb, and the module is armed once with DMA enabled.
+ *
+ * As each pulse is accepted by the DMA engine, the testbench records its
+ * samples, and predicts its chunk and slot using the same rules as the
+ * digdar program's worker thread (a new chunk when full, or at a new ARP,
+ * skipping the chunk being read by software).  Once enough pulses have
+ * been produced, triggers are stopped, and for the most recent pulses
+ * still in the header ring, the header record and the samples in the
+ * pulse slot are checked against the predictions.  The slot stride is
+ * chosen so that some bursts have to be split at 4 KB boundaries.
+ *
+ * Run with e.g.:
+ *   iverilog -I ../rtl -o digdar_dma_tb ../rtl/red_pitaya_digdar.v red_pitaya_digdar_dma_tb.v \
+ *     axi_slave_mem_model.v sys_bus_model.v ../rtl/red_pitaya_digdar_dma.v ../rtl/trigger_gen.v \
+ *     ../rtl/bus_clk_bridge.v && vvp digdar_dma_tb
+ *
+ */
+
+
+
+`timescale 1ns / 1ps
+
+`include "generated_mmap.v"  // register offsets
+
+module red_pitaya_digdar_dma_tb(
+);
+
+reg   [ 14-1: 0] adc_a           ;
+reg   [ 14-1: 0] adc_b           ;
+reg   [ 12-1: 0] xadc_a          ;
+reg   [ 12-1: 0] xadc_b          ;
+reg              adc_clk         ;
+reg              adc_rstn        ;
+
+reg              sys_clk         ;
+reg              sys_rstn        ;
+wire  [ 32-1: 0] sys_addr        ;
+wire  [ 32-1: 0] sys_wdata       ;
+wire  [  4-1: 0] sys_sel         ;
+wire             sys_wen         ;
+wire             sys_ren         ;
+wire  [ 32-1: 0] sys_rdata       ;
+wire             sys_err         ;
+wire             sys_ack         ;
+wire             negate          ;
+
+wire  [  6-1: 0] awid            ;
+wire  [ 32-1: 0] awaddr          ;
+wire  [  4-1: 0] awlen           ;
+wire  [  3-1: 0] awsize          ;
+wire  [  2-1: 0] awburst         ;
+wire             awvalid         ;
+wire             awready         ;
+wire  [ 64-1: 0] wdata           ;
+wire  [  8-1: 0] wstrb           ;
+wire             wlast           ;
+wire             wvalid          ;
+wire             wready          ;
+wire  [  6-1: 0] bid             ;
+wire  [  2-1: 0] bresp           ;
+wire             bvalid          ;
+wire             bready          ;
+
+
+sys_bus_model i_bus
+(
+  .sys_clk_i      (  sys_clk      ),
+  .sys_rstn_i     (  sys_rstn     ),
+  .sys_addr_o     (  sys_addr     ),
+  .sys_wdata_o    (  sys_wdata    ),
+  .sys_sel_o      (  sys_sel      ),
+  .sys_wen_o      (  sys_wen      ),
+  .sys_ren_o      (  sys_ren      ),
+  .sys_rdata_i    (  sys_rdata    ),
+  .sys_err_i      (  sys_err      ),
+  .sys_ack_i      (  sys_ack      )
+);
+
+
+localparam DDR_BASE = 32'h10000000 ;
+
+axi_slave_mem_model #(
+  .DW     (  64        ),
+  .IW     (  6         ),
+  .MSZ    (  11        ),  // 16 KB
+  .BASE   (  DDR_BASE  )
+) i_ddr (
+  .aclk_i     (  adc_clk   ),
+  .arstn_i    (  adc_rstn  ),
+  .awid_i     (  awid      ),
+  .awlen_i    (  awlen     ),
+  .awsize_i   (  awsize    ),
+  .awburst_i  (  awburst   ),
+  .awaddr_i   (  awaddr    ),
+  .awvalid_i  (  awvalid   ),
+  .awready_o  (  awready   ),
+  .wdata_i    (  wdata     ),
+  .wstrb_i    (  wstrb     ),
+  .wlast_i    (  wlast     ),
+  .wvalid_i   (  wvalid    ),
+  .wready_o   (  wready    ),
+  .bid_o      (  bid       ),
+  .bresp_o    (  bresp     ),
+  .bvalid_o   (  bvalid    ),
+  .bready_i   (  bready    )
+);
+
+
+red_pitaya_digdar i_digdar
+(
+  .adc_clk_i       (  adc_clk       ),  // clock
+  .adc_rstn_i      (  adc_rstn      ),  // reset - active low
+  .adc_a_i         (  adc_a         ),  // video
+  .adc_b_i         (  adc_b         ),  // trigger
+  .xadc_a_i        (  xadc_a        ),  // ACP
+  .xadc_b_i        (  xadc_b        ),  // ARP
+  .xadc_a_strobe_i (  1'b1          ),
+  .xadc_b_strobe_i (  1'b1          ),
+  .negate_o        (  negate        ),
+
+   // System bus
+  .sys_clk_i       (  sys_clk       ),  // clock
+  .sys_rstn_i      (  sys_rstn      ),  // reset - active low
+  .sys_addr_i      (  sys_addr      ),  // address
+  .sys_wdata_i     (  sys_wdata     ),  // write data
+  .sys_sel_i       (  sys_sel       ),  // write byte select
+  .sys_wen_i       (  sys_wen       ),  // write enable
+  .sys_ren_i       (  sys_ren       ),  // read enable
+  .sys_rdata_o     (  sys_rdata     ),  // read data
+  .sys_err_o       (  sys_err       ),  // error indicator
+  .sys_ack_o       (  sys_ack       ),  // acknowledge signal
+
+   // DMA
+  .dma_awid_o      (  awid          ),
+  .dma_awaddr_o    (  awaddr        ),
+  .dma_awlen_o     (  awlen         ),
+  .dma_awsize_o    (  awsize        ),
+  .dma_awburst_o   (  awburst       ),
+  .dma_awlock_o    (                ),
+  .dma_awcache_o   (                ),
+  .dma_awprot_o    (                ),
+  .dma_awqos_o     (                ),
+  .dma_awvalid_o   (  awvalid       ),
+  .dma_awready_i   (  awready       ),
+  .dma_wid_o       (                ),
+  .dma_wdata_o     (  wdata         ),
+  .dma_wstrb_o     (  wstrb         ),
+  .dma_wlast_o     (  wlast         ),
+  .dma_wvalid_o    (  wvalid        ),
+  .dma_wready_i    (  wready        ),
+  .dma_bid_i       (  bid           ),
+  .dma_bresp_i     (  bresp         ),
+  .dma_bvalid_i    (  bvalid        ),
+  .dma_bready_o    (  bready        )
+);
+
+
+
+
+
+//---------------------------------------------------------------------------------
+//
+// signal generation
+
+// system clock & reset
+initial begin
+   sys_clk  <= 1'b0 ;
+   sys_rstn <= 1'b0 ;
+   repeat(10) @(posedge sys_clk);
+      sys_rstn <= 1'b1  ;
+end
+
+always begin
+   #4.9  sys_clk <= !sys_clk ;
+end
+
+
+// ADC clock & reset
+initial begin
+   adc_clk  <= 1'b0  ;
+   adc_rstn <= 1'b0  ;
+   repeat(10) @(posedge adc_clk);
+      adc_rstn <= 1'b1  ;
+end
+
+always begin
+   #4  adc_clk <= !adc_clk ;
+end
+
+
+// The digdar module deliberately doesn't reset these (see the note in
+// its reset block), so give them defined values for simulation.
+initial begin
+   i_digdar.status      = 0 ;
+   i_digdar.clocks      = 0 ;
+   i_digdar.acp_clock   = 0 ;
+   i_digdar.arp_clock   = 0 ;
+   i_digdar.trig_clock  = 0 ;
+   i_digdar.acp_at_arp  = 0 ;
+   i_digdar.trig_at_arp = 0 ;
+   i_digdar.acp_per_arp = 0 ;
+end
+
+
+// Radar signals: a trigger pulse every 2000 ADC clocks, an ACP every
+// 5000, and an ARP every 15000, so that chunks are cut short by ARPs
+// as well as by filling up.  Each pulse is 40 clocks wide.
+reg [ 32-1: 0] tick ;
+
+initial begin
+   tick   <= 32'h0 ;
+   adc_a  <= 14'h0 ;
+   adc_b  <= 14'h0 ;
+   xadc_a <= 12'h0 ;
+   xadc_b <= 12'h0 ;
+end
+
+always @(posedge adc_clk) begin
+   tick   <= tick + 32'h1 ;
+   adc_a  <= adc_a + 14'h17 ;
+   adc_b  <= ((tick % 2000)  < 40) ? 14'd6000 : 14'd0 ;
+   xadc_a <= ((tick % 5000)  < 40) ? 12'd1500 : 12'd0 ;
+   xadc_b <= ((tick % 15000) < 40) ? 12'd1500 : 12'd0 ;
+end
+
+
+
+
+//---------------------------------------------------------------------------------
+//
+// Prediction of where each pulse goes, mirroring the worker thread
+
+localparam NSAMP      = 64 ;
+localparam META       = 24 ;
+localparam STRIDE     = META + 2 * NSAMP ;   // 152 bytes; slots straddle 4 KB boundaries
+localparam CHUNK      = 4  ;
+localparam NCHUNKS    = 8  ;
+localparam READ_CHUNK = 2  ;                 // pretend software is reading this chunk
+localparam HDR_SLOTS  = 16 ;
+localparam HDR_BASE   = DDR_BASE ;
+localparam DATA_BASE  = DDR_BASE + 32'h1000 ;
+localparam MAXP       = 256 ;
+
+reg [ 16-1: 0] exp_samp  [0:MAXP*NSAMP-1] ;  // samples of each accepted pulse
+reg [ 32-1: 0] exp_chunk [0:MAXP-1] ;
+reg [ 32-1: 0] exp_slot  [0:MAXP-1] ;        // slot within chunk
+integer        np = 0 ;                      // pulses accepted
+integer        ns = 0 ;                      // samples of current pulse seen
+integer        m_chunk = -1, m_n = 0 ;
+reg [ 32-1: 0] m_arp ;
+
+always @(posedge adc_clk) begin
+   if (i_digdar.i_dma.accept) begin
+      if (m_chunk < 0) begin
+         m_chunk = 0;
+         m_n     = 0;
+      end
+      else if (m_n == CHUNK || i_digdar.saved_arp_count != m_arp) begin
+         m_chunk = (m_chunk + 1) % NCHUNKS;
+         if (m_chunk == READ_CHUNK)
+           m_chunk = (m_chunk + 1) % NCHUNKS;
+         m_n     = 0;
+      end
+      m_arp = i_digdar.saved_arp_count;
+      if (np < MAXP) begin
+         exp_chunk[np] = m_chunk;
+         exp_slot[np]  = m_n;
+      end
+      m_n = m_n + 1;
+      np  = np + 1;
+      ns  = 0;
+   end
+   if (i_digdar.i_dma.taking && i_digdar.i_dma.samp_we_i) begin
+      if (np <= MAXP)
+        exp_samp[(np - 1) * NSAMP + ns] = i_digdar.i_dma.samp_i;
+      ns = ns + 1;
+   end
+end
+
+
+
+
+//---------------------------------------------------------------------------------
+//
+// State machine programming and DDR checks
+
+reg [ 32-1: 0] val        ;
+reg [ 32-1: 0] prod       ;
+reg [ 32-1: 0] dropped    ;
+reg [ 32-1: 0] dma_errors ;
+reg [ 32-1: 0] dma_chunk  ;
+reg [ 64-1: 0] w          ;
+reg [ 32-1: 0] word       ;
+reg [ 16-1: 0] samp       ;
+integer        p, k, addr, errors ;
+
+task read_reg;
+   input  [32-1: 0] addr  ;
+   output [32-1: 0] value ;
+   begin
+      i_bus.bus_read(addr);
+      value = i_bus.bus_read.rdata;
+   end
+endtask
+
+task check;
+   input             ok   ;
+   input [8*40-1:0]  what ;
+   begin
+      if (!ok) begin
+         $display ("@%g ERROR pulse %0d: %0s", $time, p, what);
+         errors = errors + 1;
+      end
+   end
+endtask
+
+// 32-bit word at DDR byte address a
+function [32-1:0] ddr_word;
+   input integer a;
+   begin
+      w = i_ddr.mem[(a - DDR_BASE) >> 3];
+      ddr_word = a[2] ? w[63:32] : w[31:0];
+   end
+endfunction
+
+// 16-bit sample at DDR byte address a
+function [16-1:0] ddr_samp;
+   input integer a;
+   begin
+      w = i_ddr.mem[(a - DDR_BASE) >> 3];
+      ddr_samp = w[16 * a[2:1] +: 16];
+   end
+endfunction
+
+initial begin
+   errors = 0;
+   wait (sys_rstn && adc_rstn)
+   repeat(10) @(posedge sys_clk);
+
+   i_bus.bus_write(`OFFSET_TrigSource,         32'd2);     // radar trigger pulse
+   i_bus.bus_write(`OFFSET_NumSamp,            NSAMP);     // samples per pulse
+   i_bus.bus_write(`OFFSET_DecRate,            32'd1);     // no decimation
+   i_bus.bus_write(`OFFSET_Options,            32'd0);
+   i_bus.bus_write(`OFFSET_TrigThreshExcite,   32'd3000);
+   i_bus.bus_write(`OFFSET_TrigThreshRelax,    32'd1000);
+   i_bus.bus_write(`OFFSET_TrigDelay,          32'd0);
+   i_bus.bus_write(`OFFSET_TrigLatency,        32'd100);
+   i_bus.bus_write(`OFFSET_ACPThreshExcite,    32'd1000);
+   i_bus.bus_write(`OFFSET_ACPThreshRelax,     32'd500);
+   i_bus.bus_write(`OFFSET_ACPLatency,         32'd100);
+   i_bus.bus_write(`OFFSET_ARPThreshExcite,    32'd1000);
+   i_bus.bus_write(`OFFSET_ARPThreshRelax,     32'd500);
+   i_bus.bus_write(`OFFSET_ARPLatency,         32'd100);
+
+   i_bus.bus_write(`OFFSET_DmaDataBase,        DATA_BASE);
+   i_bus.bus_write(`OFFSET_DmaStride,          STRIDE);
+   i_bus.bus_write(`OFFSET_DmaChunkSize,       CHUNK);
+   i_bus.bus_write(`OFFSET_DmaNumChunks,       NCHUNKS);
+   i_bus.bus_write(`OFFSET_DmaChunkBytes,      CHUNK * STRIDE);
+   i_bus.bus_write(`OFFSET_DmaReadChunk,       READ_CHUNK);
+   i_bus.bus_write(`OFFSET_DmaHdrBase,         HDR_BASE);
+   i_bus.bus_write(`OFFSET_DmaHdrMask,         HDR_SLOTS - 1);
+   i_bus.bus_write(`OFFSET_DmaCtrl,            32'h1);     // enable, last
+   i_bus.bus_write(`OFFSET_Command,            32'h1);     // arm, just once
+
+   // pulses should be written without any further help from software
+   prod = 0;
+   while (prod < 40) begin
+      repeat(1000) @(posedge sys_clk);
+      read_reg(`OFFSET_DmaProd, prod);
+   end
+
+   // stop triggering, and let the last pulse finish
+   i_bus.bus_write(`OFFSET_TrigSource, 32'd0);
+   repeat(2000) @(posedge adc_clk);
+   read_reg(`OFFSET_DmaProd,    prod);
+   read_reg(`OFFSET_DmaDropped, dropped);
+   read_reg(`OFFSET_DmaErrors,  dma_errors);
+   read_reg(`OFFSET_DmaChunk,   dma_chunk);
+   p = prod;
+   check(prod == np, "produced count doesn't match accepted pulses");
+   check(dropped == 0, "pulses dropped");
+   check(dma_errors == 0, "DMA engine reported errors");
+   check(dma_chunk == exp_chunk[np - 1], "current chunk doesn't match last pulse's");
+   check(i_ddr.errors == 0, "AXI protocol errors");
+
+   for (p = prod - HDR_SLOTS; p < prod; p = p + 1) begin
+      addr = HDR_BASE + 128 * (p % HDR_SLOTS);
+      check(ddr_word(addr)      == p + 1,         "header sequence");
+      check(ddr_word(addr + 60) == p + 1,         "header sequence end");
+      check(ddr_word(addr + 64) == exp_chunk[p],  "chunk");
+      check(ddr_word(addr + 68) == exp_slot[p],   "slot in chunk");
+      check(ddr_word(addr + 72) == NSAMP,         "sample count");
+
+      addr = DATA_BASE + exp_chunk[p] * CHUNK * STRIDE + exp_slot[p] * STRIDE + META;
+      for (k = 0; k < NSAMP; k = k + 1) begin
+         samp = ddr_samp(addr + 2 * k);
+         if (samp !== exp_samp[p * NSAMP + k]) begin
+            $display ("@%g ERROR pulse %0d sample %0d: DDR has %h, expected %h", $time, p, k, samp, exp_samp[p * NSAMP + k]);
+            errors = errors + 1;
+         end
+      end
+      $display ("@%g pulse %0d: chunk %0d slot %0d arp %0d", $time, p, exp_chunk[p], exp_slot[p], ddr_word(HDR_BASE + 128 * (p % HDR_SLOTS) + 44));
+   end
+
+   if (errors == 0)
+     $display ("PASS: %0d pulses written to DDR in %0d bursts", prod, i_ddr.bursts);
+   else
+     $display ("FAIL: %0d errors", errors);
+   $finish;
+end
+
+
+
+
+endmodule
@@ -0,0 +1,297 @@
+/**
+ *
+ * @brief Red Pitaya digdar testbench.
+ *
+ * @Author John Brzustowski
+ *
+ * (c) John Brzustowski https://radr-project.org
+ *
+ * This part of code is written in Verilog hardware description language (HDL).
+ * Please visit http://en.wikipedia.org/wiki/Verilog
+ * for more details on the language used herein.
+ */
+
+
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * Testbench for the Red Pitaya digdar module's pulse ring.
+ *
+ * This testbench generates radar trigger pulses on fast ADC channel B, and
+ * ACP and ARP pulses on the slow ADC channels.  The digdar module is set up
+ * with a ring of 8 slots and armed once.  It must then capture 8 pulses on
+ * its own, drop further pulses while software hasn't consumed any, and
+ * resume capturing into freed slots once software advances its consumer
+ * index.  The per-slot pulse headers are checked for consecutive sequence
+ * numbers and increasing trigger counts.
+ *
+ * Run with e.g.:
+ *   iverilog -I ../rtl -o digdar_ring_tb ../rtl/red_pitaya_digdar.v red_pitaya_digdar_ring_tb.v \
+ *     sys_bus_model.v ../rtl/trigger_gen.v ../rtl/bus_clk_bridge.v && vvp digdar_ring_tb
+ *
+ */
+
+
+
+`timescale 1ns / 1ps
+
+`include "generated_mmap.v"  // register offsets
+
+module red_pitaya_digdar_ring_tb(
+);
+
+reg   [ 14-1: 0] adc_a           ;
+reg   [ 14-1: 0] adc_b           ;
+reg   [ 12-1: 0] xadc_a          ;
+reg   [ 12-1: 0] xadc_b          ;
+reg              adc_clk         ;
+reg              adc_rstn        ;
+
+reg              sys_clk         ;
+reg              sys_rstn        ;
+wire  [ 32-1: 0] sys_addr        ;
+wire  [ 32-1: 0] sys_wdata       ;
+wire  [  4-1: 0] sys_sel         ;
+wire             sys_wen         ;
+wire             sys_ren         ;
+wire  [ 32-1: 0] sys_rdata       ;
+wire             sys_err         ;
+wire             sys_ack         ;
+wire             negate          ;
+
+
+sys_bus_model i_bus
+(
+  .sys_clk_i      (  sys_clk      ),
+  .sys_rstn_i     (  sys_rstn     ),
+  .sys_addr_o     (  sys_addr     ),
+  .sys_wdata_o    (  sys_wdata    ),
+  .sys_sel_o      (  sys_sel      ),
+  .sys_wen_o      (  sys_wen      ),
+  .sys_ren_o      (  sys_ren      ),
+  .sys_rdata_i    (  sys_rdata    ),
+  .sys_err_i      (  sys_err      ),
+  .sys_ack_i      (  sys_ack      )
+);
+
+
+
+red_pitaya_digdar i_digdar
+(
+  .adc_clk_i       (  adc_clk       ),  // clock
+  .adc_rstn_i      (  adc_rstn      ),  // reset - active low
+  .adc_a_i         (  adc_a         ),  // video
+  .adc_b_i         (  adc_b         ),  // trigger
+  .xadc_a_i        (  xadc_a        ),  // ACP
+  .xadc_b_i        (  xadc_b        ),  // ARP
+  .xadc_a_strobe_i (  1'b1          ),
+  .xadc_b_strobe_i (  1'b1          ),
+  .negate_o        (  negate        ),
+
+   // System bus
+  .sys_clk_i       (  sys_clk       ),  // clock
+  .sys_rstn_i      (  sys_rstn      ),  // reset - active low
+  .sys_addr_i      (  sys_addr      ),  // address
+  .sys_wdata_i     (  sys_wdata     ),  // write data
+  .sys_sel_i       (  sys_sel       ),  // write byte select
+  .sys_wen_i       (  sys_wen       ),  // write enable
+  .sys_ren_i       (  sys_ren       ),  // read enable
+  .sys_rdata_o     (  sys_rdata     ),  // read data
+  .sys_err_o       (  sys_err       ),  // error indicator
+  .sys_ack_o       (  sys_ack       )   // acknowledge signal
+);
+
+
+
+
+
+//---------------------------------------------------------------------------------
+//
+// signal generation
+
+// system clock & reset
+initial begin
+   sys_clk  <= 1'b0 ;
+   sys_rstn <= 1'b0 ;
+   repeat(10) @(posedge sys_clk);
+      sys_rstn <= 1'b1  ;
+end
+
+always begin
+   #4.9  sys_clk <= !sys_clk ;
+end
+
+
+// ADC clock & reset
+initial begin
+   adc_clk  <= 1'b0  ;
+   adc_rstn <= 1'b0  ;
+   repeat(10) @(posedge adc_clk);
+      adc_rstn <= 1'b1  ;
+end
+
+always begin
+   #4  adc_clk <= !adc_clk ;
+end
+
+
+// The digdar module deliberately doesn't reset these (see the note in
+// its reset block), so give them defined values for simulation.
+initial begin
+   i_digdar.status      = 0 ;
+   i_digdar.clocks      = 0 ;
+   i_digdar.acp_clock   = 0 ;
+   i_digdar.arp_clock   = 0 ;
+   i_digdar.trig_clock  = 0 ;
+   i_digdar.acp_at_arp  = 0 ;
+   i_digdar.trig_at_arp = 0 ;
+   i_digdar.acp_per_arp = 0 ;
+end
+
+
+// Radar signals: a trigger pulse every 2000 ADC clocks, an ACP every
+// 5000, and an ARP every 40000.  Each pulse is 40 clocks wide.
+reg [ 32-1: 0] tick ;
+
+initial begin
+   tick   <= 32'h0 ;
+   adc_a  <= 14'h0 ;
+   adc_b  <= 14'h0 ;
+   xadc_a <= 12'h0 ;
+   xadc_b <= 12'h0 ;
+end
+
+always @(posedge adc_clk) begin
+   tick   <= tick + 32'h1 ;
+   adc_a  <= adc_a + 14'h17 ;
+   adc_b  <= ((tick % 2000)  < 40) ? 14'd6000 : 14'd0 ;
+   xadc_a <= ((tick % 5000)  < 40) ? 12'd1500 : 12'd0 ;
+   xadc_b <= ((tick % 40000) < 40) ? 12'd1500 : 12'd0 ;
+end
+
+
+
+
+//---------------------------------------------------------------------------------
+//
+// State machine programming and ring checks
+
+localparam SLOTS = 8  ;
+localparam NSAMP = 64 ;
+
+reg [ 32-1: 0] val        ;
+reg [ 32-1: 0] prod       ;
+reg [ 32-1: 0] dropped    ;
+reg [ 32-1: 0] seq        ;
+reg [ 32-1: 0] seq_end    ;
+reg [ 32-1: 0] trig       ;
+reg [ 32-1: 0] prev_seq   ;
+reg [ 32-1: 0] prev_trig  ;
+integer        s, errors  ;
+
+task read_reg;
+   input  [32-1: 0] addr  ;
+   output [32-1: 0] value ;
+   begin
+      i_bus.bus_read(addr);
+      value = i_bus.bus_read.rdata;
+   end
+endtask
+
+task check;
+   input             ok   ;
+   input [8*32-1:0]  what ;
+   begin
+      if (!ok) begin
+         $display ("@%g ERROR %0s", $time, what);
+         errors = errors + 1;
+      end
+   end
+endtask
+
+// check headers of the slots holding pulses first..last-1
+task check_slots;
+   input [32-1: 0] first ;
+   input [32-1: 0] last  ;
+   reg   [32-1: 0] p     ;
+   begin
+      for (p = first; p < last; p = p + 1) begin
+         s = p % SLOTS;
+         read_reg(32'h60000 + 64 * s     , seq);
+         read_reg(32'h60000 + 64 * s +  4, trig);
+         read_reg(32'h60000 + 64 * s + 60, seq_end);
+         read_reg(32'h10000 + 4 * NSAMP * s, val);
+         $display ("@%g pulse %0d in slot %0d: seq %0d trig %0d sample %h", $time, p, s, seq, trig, val);
+         check(seq === seq_end, "slot header sequence torn");
+         check(p == first || seq === prev_seq + 1, "slot sequence not consecutive");
+         check(p == first || trig > prev_trig, "slot trigger count not increasing");
+         check(^val !== 1'bx, "slot samples not written");
+         prev_seq  = seq;
+         prev_trig = trig;
+      end
+   end
+endtask
+
+initial begin
+   errors = 0;
+   wait (sys_rstn && adc_rstn)
+   repeat(10) @(posedge sys_clk);
+
+   i_bus.bus_write(`OFFSET_TrigSource,         32'd2);     // radar trigger pulse
+   i_bus.bus_write(`OFFSET_NumSamp,            NSAMP);     // samples per pulse, and per slot
+   i_bus.bus_write(`OFFSET_DecRate,            32'd1);     // no decimation
+   i_bus.bus_write(`OFFSET_Options,            32'd0);
+   i_bus.bus_write(`OFFSET_TrigThreshExcite,   32'd3000);
+   i_bus.bus_write(`OFFSET_TrigThreshRelax,    32'd1000);
+   i_bus.bus_write(`OFFSET_TrigDelay,          32'd0);
+   i_bus.bus_write(`OFFSET_TrigLatency,        32'd100);
+   i_bus.bus_write(`OFFSET_ACPThreshExcite,    32'd1000);
+   i_bus.bus_write(`OFFSET_ACPThreshRelax,     32'd500);
+   i_bus.bus_write(`OFFSET_ACPLatency,         32'd100);
+   i_bus.bus_write(`OFFSET_ARPThreshExcite,    32'd1000);
+   i_bus.bus_write(`OFFSET_ARPThreshRelax,     32'd500);
+   i_bus.bus_write(`OFFSET_ARPLatency,         32'd100);
+
+   i_bus.bus_write(`OFFSET_RingCons,           32'd0);
+   i_bus.bus_write(`OFFSET_RingSlots,          SLOTS);
+   i_bus.bus_write(`OFFSET_Command,            32'h1);     // arm, just once
+
+   // the ring should fill without any further help from software
+   prod = 0;
+   while (prod < SLOTS) begin
+      repeat(1000) @(posedge sys_clk);
+      read_reg(`OFFSET_RingProd, prod);
+   end
+
+   // with nothing consumed, further pulses must be dropped
+   repeat(3 * 2000) @(posedge adc_clk);
+   read_reg(`OFFSET_RingProd, prod);
+   read_reg(`OFFSET_RingDropped, dropped);
+   read_reg(`OFFSET_Status, val);
+   check(prod == SLOTS, "ring overwrote unconsumed slots");
+   check(dropped > 0, "full ring didn't report dropped pulses");
+   check(val == 1, "module not armed while ring full");
+
+   check_slots(0, SLOTS);
+
+   // free half the ring; capture should resume into the freed slots
+   i_bus.bus_write(`OFFSET_RingCons, SLOTS / 2);
+   while (prod < SLOTS + SLOTS / 2) begin
+      repeat(1000) @(posedge sys_clk);
+      read_reg(`OFFSET_RingProd, prod);
+   end
+   check(prod == SLOTS + SLOTS / 2, "ring produced into unfreed slots");
+   check_slots(SLOTS / 2, SLOTS + SLOTS / 2);
+
+   if (errors == 0)
+     $display ("PASS: ring captured %0d pulses and dropped %0d while full", prod, dropped);
+   else
+     $display ("FAIL: %0d errors", errors);
+   $finish;
+end
+
+
+
+
+endmodule
@@ -0,0 +1,272 @@
+/**
+ *
+ * @brief Red Pitaya digdar testbench.
+ *
+ * @Author John Brzustowski
+ *
+ * (c) John Brzustowski https://radr-project.org
+ *
+ * This part of code is written in Verilog hardware description language (HDL).
+ * Please visit http://en.wikipedia.org/wiki/Verilog
+ * for more details on the language used herein.
+ */
+
+
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * Testbench for the Red Pitaya digdar module's pulse header block.
+ *
+ * This testbench generates radar trigger pulses on fast ADC channel B, and
+ * ACP and ARP pulses on the slow ADC channels.  The digdar module is armed
+ * repeatedly, and after each capture, the pulse header block is read and
+ * checked against the saved_* registers, which are latched at the same
+ * time, and its sequence number is checked for consistency and for
+ * advancing by one per capture.
+ *
+ * Run with e.g.:
+ *   iverilog -I ../rtl -o digdar_tb red_pitaya_digdar_tb.v sys_bus_model.v \
+ *     ../rtl/red_pitaya_digdar.v ../rtl/trigger_gen.v ../rtl/bus_clk_bridge.v && vvp digdar_tb
+ *
+ */
+
+
+
+`timescale 1ns / 1ps
+
+`include "generated_mmap.v"  // register offsets
+
+module red_pitaya_digdar_tb(
+);
+
+reg   [ 14-1: 0] adc_a           ;
+reg   [ 14-1: 0] adc_b           ;
+reg   [ 12-1: 0] xadc_a          ;
+reg   [ 12-1: 0] xadc_b          ;
+reg              adc_clk         ;
+reg              adc_rstn        ;
+
+reg              sys_clk         ;
+reg              sys_rstn        ;
+wire  [ 32-1: 0] sys_addr        ;
+wire  [ 32-1: 0] sys_wdata       ;
+wire  [  4-1: 0] sys_sel         ;
+wire             sys_wen         ;
+wire             sys_ren         ;
+wire  [ 32-1: 0] sys_rdata       ;
+wire             sys_err         ;
+wire             sys_ack         ;
+wire             negate          ;
+
+
+sys_bus_model i_bus
+(
+  .sys_clk_i      (  sys_clk      ),
+  .sys_rstn_i     (  sys_rstn     ),
+  .sys_addr_o     (  sys_addr     ),
+  .sys_wdata_o    (  sys_wdata    ),
+  .sys_sel_o      (  sys_sel      ),
+  .sys_wen_o      (  sys_wen      ),
+  .sys_ren_o      (  sys_ren      ),
+  .sys_rdata_i    (  sys_rdata    ),
+  .sys_err_i      (  sys_err      ),
+  .sys_ack_i      (  sys_ack      )
+);
+
+
+
+red_pitaya_digdar i_digdar
+(
+  .adc_clk_i       (  adc_clk       ),  // clock
+  .adc_rstn_i      (  adc_rstn      ),  // reset - active low
+  .adc_a_i         (  adc_a         ),  // video
+  .adc_b_i         (  adc_b         ),  // trigger
+  .xadc_a_i        (  xadc_a        ),  // ACP
+  .xadc_b_i        (  xadc_b        ),  // ARP
+  .xadc_a_strobe_i (  1'b1          ),
+  .xadc_b_strobe_i (  1'b1          ),
+  .negate_o        (  negate        ),
+
+   // System bus
+  .sys_clk_i       (  sys_clk       ),  // clock
+  .sys_rstn_i      (  sys_rstn      ),  // reset - active low
+  .sys_addr_i      (  sys_addr      ),  // address
+  .sys_wdata_i     (  sys_wdata     ),  // write data
+  .sys_sel_i       (  sys_sel       ),  // write byte select
+  .sys_wen_i       (  sys_wen       ),  // write enable
+  .sys_ren_i       (  sys_ren       ),  // read enable
+  .sys_rdata_o     (  sys_rdata     ),  // read data
+  .sys_err_o       (  sys_err       ),  // error indicator
+  .sys_ack_o       (  sys_ack       )   // acknowledge signal
+);
+
+
+
+
+
+//---------------------------------------------------------------------------------
+//
+// signal generation
+
+// system clock & reset
+initial begin
+   sys_clk  <= 1'b0 ;
+   sys_rstn <= 1'b0 ;
+   repeat(10) @(posedge sys_clk);
+      sys_rstn <= 1'b1  ;
+end
+
+always begin
+   #4.9  sys_clk <= !sys_clk ;
+end
+
+
+// ADC clock & reset
+initial begin
+   adc_clk  <= 1'b0  ;
+   adc_rstn <= 1'b0  ;
+   repeat(10) @(posedge adc_clk);
+      adc_rstn <= 1'b1  ;
+end
+
+always begin
+   #4  adc_clk <= !adc_clk ;
+end
+
+
+// The digdar module deliberately doesn't reset these (see the note in
+// its reset block), so give them defined values for simulation.
+initial begin
+   i_digdar.status      = 0 ;
+   i_digdar.clocks      = 0 ;
+   i_digdar.acp_clock   = 0 ;
+   i_digdar.arp_clock   = 0 ;
+   i_digdar.trig_clock  = 0 ;
+   i_digdar.acp_at_arp  = 0 ;
+   i_digdar.trig_at_arp = 0 ;
+   i_digdar.acp_per_arp = 0 ;
+end
+
+
+// Radar signals: a trigger pulse every 2000 ADC clocks, an ACP every
+// 5000, and an ARP every 40000.  Each pulse is 40 clocks wide.
+reg [ 32-1: 0] tick ;
+
+initial begin
+   tick   <= 32'h0 ;
+   adc_a  <= 14'h0 ;
+   adc_b  <= 14'h0 ;
+   xadc_a <= 12'h0 ;
+   xadc_b <= 12'h0 ;
+end
+
+always @(posedge adc_clk) begin
+   tick   <= tick + 32'h1 ;
+   adc_a  <= adc_a + 14'h17 ;
+   adc_b  <= ((tick % 2000)  < 40) ? 14'd6000 : 14'd0 ;
+   xadc_a <= ((tick % 5000)  < 40) ? 12'd1500 : 12'd0 ;
+   xadc_b <= ((tick % 40000) < 40) ? 12'd1500 : 12'd0 ;
+end
+
+
+
+
+//---------------------------------------------------------------------------------
+//
+// State machine programming and header checks
+
+reg [ 32-1: 0] hdr [0:15] ;  // copy of pulse header block
+reg [ 32-1: 0] prev_seq   ;
+reg [ 32-1: 0] val        ;
+integer        i, n, errors ;
+
+task read_reg;
+   input  [32-1: 0] addr  ;
+   output [32-1: 0] value ;
+   begin
+      i_bus.bus_read(addr);
+      value = i_bus.bus_read.rdata;
+   end
+endtask
+
+task check;
+   input [32-1: 0] got  ;
+   input [32-1: 0] want ;
+   input [8*24-1:0] what ;
+   begin
+      if (got !== want) begin
+         $display ("@%g ERROR %0s: header has %h, expected %h", $time, what, got, want);
+         errors = errors + 1;
+      end
+   end
+endtask
+
+initial begin
+   errors = 0;
+   wait (sys_rstn && adc_rstn)
+   repeat(10) @(posedge sys_clk);
+
+   i_bus.bus_write(`OFFSET_TrigSource,         32'd2);     // radar trigger pulse
+   i_bus.bus_write(`OFFSET_NumSamp,            32'd64);    // samples per pulse
+   i_bus.bus_write(`OFFSET_DecRate,            32'd1);     // no decimation
+   i_bus.bus_write(`OFFSET_Options,            32'd0);
+   i_bus.bus_write(`OFFSET_TrigThreshExcite,   32'd3000);
+   i_bus.bus_write(`OFFSET_TrigThreshRelax,    32'd1000);
+   i_bus.bus_write(`OFFSET_TrigDelay,          32'd0);
+   i_bus.bus_write(`OFFSET_TrigLatency,        32'd100);
+   i_bus.bus_write(`OFFSET_ACPThreshExcite,    32'd1000);
+   i_bus.bus_write(`OFFSET_ACPThreshRelax,     32'd500);
+   i_bus.bus_write(`OFFSET_ACPLatency,         32'd100);
+   i_bus.bus_write(`OFFSET_ARPThreshExcite,    32'd1000);
+   i_bus.bus_write(`OFFSET_ARPThreshRelax,     32'd500);
+   i_bus.bus_write(`OFFSET_ARPLatency,         32'd100);
+
+   prev_seq = 0;
+   for (n = 0; n < 30; n = n + 1) begin
+      i_bus.bus_write(`OFFSET_Command, 32'h1);  // arm
+
+      // wait for capture to complete
+      val = 0;
+      while (val !== 3) begin
+         repeat(100) @(posedge sys_clk);
+         read_reg(`OFFSET_Status, val);
+      end
+
+      // read the whole header block
+      for (i = 0; i < 16; i = i + 1)
+        read_reg(32'h50000 + 4 * i, hdr[i]);
+
+      check(hdr[15], hdr[0], "sequence end");
+      check(hdr[0], prev_seq + 1, "sequence");
+      prev_seq = hdr[0];
+
+      read_reg(`OFFSET_SavedTrigCount, val);      check(hdr[ 1], val, "trig count");
+      read_reg(`OFFSET_SavedTrigAtARP, val);      check(hdr[ 2], val, "trig at arp");
+      read_reg(`OFFSET_SavedTrigClock_LO, val);   check(hdr[ 3], val, "trig clock lo");
+      read_reg(`OFFSET_SavedTrigClock_HI, val);   check(hdr[ 4], val, "trig clock hi");
+      read_reg(`OFFSET_SavedTrigPrevClock_LO, val); check(hdr[ 5], val, "trig prev clock lo");
+      read_reg(`OFFSET_SavedTrigPrevClock_HI, val); check(hdr[ 6], val, "trig prev clock hi");
+      read_reg(`OFFSET_SavedACPCount, val);       check(hdr[ 7], val, "acp count");
+      read_reg(`OFFSET_SavedACPAtARP, val);       check(hdr[ 8], val, "acp at arp");
+      read_reg(`OFFSET_SavedACPClock_LO, val);    check(hdr[ 9], val, "acp clock lo");
+      read_reg(`OFFSET_SavedACPClock_HI, val);    check(hdr[10], val, "acp clock hi");
+      read_reg(`OFFSET_SavedARPCount, val);       check(hdr[11], val, "arp count");
+      read_reg(`OFFSET_SavedARPClock_LO, val);    check(hdr[12], val, "arp clock lo");
+      read_reg(`OFFSET_SavedARPClock_HI, val);    check(hdr[13], val, "arp clock hi");
+      read_reg(`OFFSET_SavedACPPerARP, val);      check(hdr[14], val, "acp per arp");
+
+      $display ("@%g pulse %0d: seq %0d trig %0d acp %0d arp %0d", $time, n, hdr[0], hdr[1], hdr[7], hdr[11]);
+   end
+
+   if (errors == 0)
+     $display ("PASS: pulse header block matches saved registers for %0d pulses", n);
+   else
+     $display ("FAIL: %0d errors", errors);
+   $finish;
+end
+
+
+
+
+endmodule
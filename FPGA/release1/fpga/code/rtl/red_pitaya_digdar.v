@@ -38,7 +38,30 @@ module red_pitaya_digdar
    input             sys_ren_i , //!< bus read enable
    output [ 32-1: 0] sys_rdata_o , //!< bus read data
    output            sys_err_o , //!< bus error indicator
-   output            sys_ack_o     //!< bus acknowledge signal
+   output            sys_ack_o , //!< bus acknowledge signal
+
+   // DMA to DDR over AXI HP port (write only)
+   output [  6-1: 0] dma_awid_o , //!< write address ID
+   output [ 32-1: 0] dma_awaddr_o , //!< write address
+   output [  4-1: 0] dma_awlen_o , //!< write burst length
+   output [  3-1: 0] dma_awsize_o , //!< write burst size
+   output [  2-1: 0] dma_awburst_o , //!< write burst type
+   output [  2-1: 0] dma_awlock_o , //!< write lock type
+   output [  4-1: 0] dma_awcache_o , //!< write cache type
+   output [  3-1: 0] dma_awprot_o , //!< write protection type
+   output [  4-1: 0] dma_awqos_o , //!< write quality of service
+   output            dma_awvalid_o , //!< write address valid
+   input             dma_awready_i , //!< write address ready
+   output [  6-1: 0] dma_wid_o , //!< write data ID
+   output [ 64-1: 0] dma_wdata_o , //!< write data
+   output [  8-1: 0] dma_wstrb_o , //!< write strobes
+   output            dma_wlast_o , //!< write last
+   output            dma_wvalid_o , //!< write valid
+   input             dma_wready_i , //!< write ready
+   input  [  6-1: 0] dma_bid_i , //!< write response ID
+   input  [  2-1: 0] dma_bresp_i , //!< write response
+   input             dma_bvalid_i , //!< write response valid
+   output            dma_bready_o   //!< write response ready
 
    );
 
@@ -256,9 +279,13 @@ module red_pitaya_digdar
                 `set_armed;
            end
          else if (`is_armed) begin
-            if (adc_trig) begin
+            if (adc_trig && ring_full_q) begin
+               // no free slot; drop this pulse and keep waiting
+               ring_dropped <= ring_dropped + 32'h1;
+            end
+            else if (adc_trig) begin
                `set_capturing;
-               adc_wp <= 'h0;
+               adc_wp <= ring_on ? ring_base : 'h0;
                samp_countdown <= num_samp;
                adc_counter <= 'h0;
                adc_dec_cnt <= 17'h0;
@@ -269,7 +296,23 @@ module red_pitaya_digdar
          else if (`is_capturing) begin
             if (samp_countdown == 32'h0) // capture complete
               begin
-                 `set_fired;
+                 if (ring_on) begin
+                    // slot is ready; move to the next one and re-arm without waiting for software
+                    `set_armed;
+                    ring_prod <= ring_prod + 32'h1;
+                    if (ring_wslot == ring_slots[RING_SSZ-1:0] - 1'b1) begin
+                       ring_wslot <= 'h0;
+                       ring_base  <= 'h0;
+                    end
+                    else begin
+                       ring_wslot <= ring_wslot + 1'b1;
+                       ring_base  <= ring_base + num_samp[RSZ-1:0];
+                    end
+                 end
+                 else if (dma_on)
+                   `set_armed; // the DMA engine has the pulse; no need to wait for software
+                 else
+                   `set_fired;
               end
             else if (dec_done) // decimation done
               begin
@@ -325,6 +368,14 @@ module red_pitaya_digdar
                  end
               end // if (`is_capturing)
          end
+
+         ring_full_q <= ring_full;
+         if (ring_rst_do) begin
+            ring_prod    <= 'h0;
+            ring_wslot   <= 'h0;
+            ring_base    <= 'h0;
+            ring_dropped <= 'h0;
+         end
       end // if (! reset)
    end
 
@@ -351,9 +402,180 @@ module red_pitaya_digdar
    reg [ RSZ-1: 0] xadc_a_raddr              ;
    reg [ RSZ-1: 0] xadc_b_raddr              ;
    reg [   4-1: 0] adc_rval                  ;
+   reg [  32-1: 0] hdr_rd                    ;
    wire            adc_rd_dv                 ;
    reg             adc_trig                  ;
 
+   //---------------------------------------------------------------------------------
+   //  Pulse header block
+   //
+   // When a trigger is detected while armed, the metadata for that pulse are
+   // latched, in a single clock, into this small block alongside the sample
+   // buffers, at the same time as the saved_* registers.  Software can then
+   // read the whole block with one burst, instead of reading the saved_*
+   // registers one at a time, and gets values which all belong to the same
+   // pulse.  The first and last words hold the same capture sequence number;
+   // if they differ, another trigger was latched during the read.
+   // Word layout must match digdar_pulse_hdr_t in fpga_digdar.h
+
+   localparam HSZ = 4 ;  // header block size 2^HSZ words
+
+`define HDR_SEQ            0 // capture sequence number, incremented at each latch
+`define HDR_TRIG_COUNT     1 // trigger count
+`define HDR_TRIG_AT_ARP    2 // trigger count at most recent ARP
+`define HDR_TRIG_CLOCK_LO  3 // clock at this trigger (low 32 bits)
+`define HDR_TRIG_CLOCK_HI  4 // clock at this trigger (high 32 bits)
+`define HDR_TRIG_PREV_LO   5 // clock at previous trigger (low 32 bits)
+`define HDR_TRIG_PREV_HI   6 // clock at previous trigger (high 32 bits)
+`define HDR_ACP_COUNT      7 // ACP count
+`define HDR_ACP_AT_ARP     8 // ACP count at most recent ARP
+`define HDR_ACP_CLOCK_LO   9 // clock at most recent ACP (low 32 bits)
+`define HDR_ACP_CLOCK_HI  10 // clock at most recent ACP (high 32 bits)
+`define HDR_ARP_COUNT     11 // ARP count
+`define HDR_ARP_CLOCK_LO  12 // clock at most recent ARP (low 32 bits)
+`define HDR_ARP_CLOCK_HI  13 // clock at most recent ARP (high 32 bits)
+`define HDR_ACP_PER_ARP   14 // count of ACP between two most recent ARP
+`define HDR_SEQ_END       15 // copy of HDR_SEQ
+
+   reg [  32-1: 0] hdr_buf [0:(1<<HSZ)-1]   ;
+   reg [  32-1: 0] hdr_seq = 32'h0          ;
+
+   //---------------------------------------------------------------------------------
+   //  Pulse ring
+   //
+   // When ring_slots is non-zero, the sample buffers are divided into that many
+   // slots of num_samp samples, and after each capture the module re-arms
+   // itself and writes the next pulse into the next slot, without waiting for
+   // software.  ring_prod counts completed captures; software polls it, copies
+   // the ready slots, and writes its own count of copied pulses to ring_cons.
+   // If every slot is full when a trigger arrives, the pulse is dropped and
+   // counted in ring_dropped.  Writing ring_slots resets ring_prod and
+   // ring_dropped, and starts again at slot 0.
+   //
+   // The pulse header for each slot is copied from hdr_buf into ring_hdr_buf
+   // over the 16 clocks after the trigger, so num_samp * dec_rate must be at
+   // least 16 for the header to be complete when the slot is.
+   //
+   // Requires ring_slots * num_samp <= 16384, and num_samp even.
+   // Register layout must match OSC_FPGA_RING_* in fpga_digdar.h
+
+`define OFFSET_RingSlots                     20'h000100 // Ring Slots: number of pulse slots in the sample buffers; 0 means single-shot capture. 0...64
+`define OFFSET_RingProd                      20'h000104 // Ring Produced: number of pulses captured into the ring since it was reset (read-only)
+`define OFFSET_RingCons                      20'h000108 // Ring Consumed: number of pulses software has copied out of the ring
+`define OFFSET_RingDropped                   20'h00010c // Ring Dropped: number of pulses dropped because the ring was full (read-only)
+
+   localparam RING_SSZ = 6 ;  // maximum number of slots 2^RING_SSZ
+
+   reg [  32-1: 0] ring_slots   = 32'h0     ;
+   reg [  32-1: 0] ring_prod    = 32'h0     ;
+   reg [  32-1: 0] ring_cons    = 32'h0     ;
+   reg [  32-1: 0] ring_dropped = 32'h0     ;
+   reg [RING_SSZ-1: 0] ring_wslot = 'h0     ; // slot being written
+   reg [ RSZ-1: 0] ring_base    = 'h0       ; // index of first sample in ring_wslot
+   reg             ring_rst_do  = 1'b0      ; // asserted for one clock when ring_slots is written
+   reg             ring_full_q  = 1'b0      ; // ring_full, delayed to line up with adc_trig
+   wire            ring_on      = (ring_slots != 32'h0) ;
+   wire            ring_full    = ring_on && ((ring_prod - ring_cons) >= ring_slots) ;
+
+   reg [  32-1: 0] ring_hdr_buf [0:(1<<(RING_SSZ+HSZ))-1] ; // pulse header for each slot
+   reg [  32-1: 0] ring_hdr_rd                ;
+   reg [ HSZ+1-1: 0] hdr_copy_cnt = 1 << HSZ   ; // next header word to copy; idle when 1 << HSZ
+   reg [RING_SSZ-1: 0] hdr_copy_slot = 'h0    ; // slot whose header is being copied
+
+   //---------------------------------------------------------------------------------
+   //  DMA to DDR
+   //
+   // When DmaCtrl bit 0 is set, channel A samples and the pulse header of each
+   // capture are also written into a ring in DDR memory by the DMA engine
+   // (see red_pitaya_digdar_dma.v), and the module re-arms itself after each
+   // capture.  Writing DmaCtrl restarts the engine at the first chunk, and
+   // resets its counters, so the other Dma registers must be written first.
+   // Register layout must match OSC_FPGA_DMA_* in fpga_digdar.h
+
+`define OFFSET_DmaCtrl                       20'h000110 // DMA Control: bit 0 enables DMA of each pulse to DDR
+`define OFFSET_DmaDataBase                   20'h000114 // DMA Data Base: physical address of the pulse slot ring
+`define OFFSET_DmaStride                     20'h000118 // DMA Stride: bytes per pulse slot; a multiple of 8
+`define OFFSET_DmaChunkSize                  20'h00011c // DMA Chunk Size: pulse slots per chunk
+`define OFFSET_DmaNumChunks                  20'h000120 // DMA Num Chunks: chunks in the pulse slot ring
+`define OFFSET_DmaChunkBytes                 20'h000124 // DMA Chunk Bytes: DmaChunkSize * DmaStride
+`define OFFSET_DmaReadChunk                  20'h000128 // DMA Read Chunk: chunk being read by software, which is skipped
+`define OFFSET_DmaHdrBase                    20'h00012c // DMA Header Base: physical address of the header record ring
+`define OFFSET_DmaHdrMask                    20'h000130 // DMA Header Mask: header record slots - 1; slots must be a power of 2
+`define OFFSET_DmaProd                       20'h000134 // DMA Produced: pulses completely written to DDR since restart (read-only)
+`define OFFSET_DmaDropped                    20'h000138 // DMA Dropped: pulses dropped because the previous one was still being written (read-only)
+`define OFFSET_DmaErrors                     20'h00013c // DMA Errors: AXI write errors and FIFO overflows (read-only)
+`define OFFSET_DmaChunk                      20'h000140 // DMA Chunk: chunk being written, or last written (read-only)
+
+   reg [  32-1: 0] dma_ctrl        = 32'h0  ;
+   reg [  32-1: 0] dma_data_base   = 32'h0  ;
+   reg [  32-1: 0] dma_stride      = 32'h0  ;
+   reg [  32-1: 0] dma_chunk_size  = 32'h0  ;
+   reg [  32-1: 0] dma_num_chunks  = 32'h0  ;
+   reg [  32-1: 0] dma_chunk_bytes = 32'h0  ;
+   reg [  32-1: 0] dma_read_chunk  = 32'hffffffff ;
+   reg [  32-1: 0] dma_hdr_base    = 32'h0  ;
+   reg [  32-1: 0] dma_hdr_mask    = 32'h0  ;
+   reg             dma_rst_do      = 1'b0   ; // asserted for one clock when dma_ctrl is written
+   wire [ 32-1: 0] dma_prod                 ;
+   wire [ 32-1: 0] dma_dropped              ;
+   wire [ 32-1: 0] dma_errors               ;
+   wire [ 32-1: 0] dma_chunk                ;
+   wire [HSZ-1: 0] dma_hdr_raddr            ;
+   wire            dma_on = dma_ctrl[0]     ;
+
+   red_pitaya_digdar_dma #(
+     .HSZ            (  HSZ                 )
+   ) i_dma (
+     .clk_i          (  adc_clk_i           ),
+     .rstn_i         (  adc_rstn_i          ),
+
+     .enable_i       (  dma_on              ),
+     .restart_i      (  dma_rst_do          ),
+     .data_base_i    (  dma_data_base       ),
+     .stride_i       (  dma_stride          ),
+     .chunk_size_i   (  dma_chunk_size      ),
+     .num_chunks_i   (  dma_num_chunks      ),
+     .chunk_bytes_i  (  dma_chunk_bytes     ),
+     .read_chunk_i   (  dma_read_chunk      ),
+     .hdr_base_i     (  dma_hdr_base        ),
+     .hdr_mask_i     (  dma_hdr_mask        ),
+     .num_samp_i     (  num_samp            ),
+
+     .pulse_start_i  (  `is_armed && adc_trig && ! ring_full_q  ),
+     .arp_count_i    (  saved_arp_count     ),
+     .samp_we_i      (  `is_capturing && samp_countdown != 32'h0 && dec_done  ),
+     .samp_i         (  adc_a_dat           ),
+     .hdr_raddr_o    (  dma_hdr_raddr       ),
+     .hdr_rdata_i    (  hdr_buf[dma_hdr_raddr]  ),
+
+     .prod_o         (  dma_prod            ),
+     .dropped_o      (  dma_dropped         ),
+     .errors_o       (  dma_errors          ),
+     .chunk_o        (  dma_chunk           ),
+
+     .axi_awid_o     (  dma_awid_o          ),
+     .axi_awaddr_o   (  dma_awaddr_o        ),
+     .axi_awlen_o    (  dma_awlen_o         ),
+     .axi_awsize_o   (  dma_awsize_o        ),
+     .axi_awburst_o  (  dma_awburst_o       ),
+     .axi_awlock_o   (  dma_awlock_o        ),
+     .axi_awcache_o  (  dma_awcache_o       ),
+     .axi_awprot_o   (  dma_awprot_o        ),
+     .axi_awqos_o    (  dma_awqos_o         ),
+     .axi_awvalid_o  (  dma_awvalid_o       ),
+     .axi_awready_i  (  dma_awready_i       ),
+     .axi_wid_o      (  dma_wid_o           ),
+     .axi_wdata_o    (  dma_wdata_o         ),
+     .axi_wstrb_o    (  dma_wstrb_o         ),
+     .axi_wlast_o    (  dma_wlast_o         ),
+     .axi_wvalid_o   (  dma_wvalid_o        ),
+     .axi_wready_i   (  dma_wready_i        ),
+     .axi_bid_i      (  dma_bid_i           ),
+     .axi_bresp_i    (  dma_bresp_i         ),
+     .axi_bvalid_i   (  dma_bvalid_i        ),
+     .axi_bready_o   (  dma_bready_o        )
+   );
+
    // Return value from buffer and return to processing system.
    // I don't understand the logic whereby we only reply on the 4th clock
    // after the read request comes in.
@@ -375,6 +597,8 @@ module red_pitaya_digdar
       adc_b_rd       <= adc_b_buf[adc_b_raddr] ;
       xadc_a_rd      <= xadc_a_buf[xadc_a_raddr] ;
       xadc_b_rd      <= xadc_b_buf[xadc_b_raddr] ;
+      hdr_rd         <= hdr_buf[adc_a_raddr[HSZ-1:0]] ;
+      ring_hdr_rd    <= ring_hdr_buf[adc_a_raddr[RING_SSZ+HSZ-1:0]] ;
    end
 
    //---------------------------------------------------------------------------------
@@ -413,8 +637,21 @@ module red_pitaya_digdar
          if (wen) begin
             casez (addr[19:0])
 `include "generated_setters.v"  // import setter logic generated by ogdar
+              `OFFSET_RingSlots : ring_slots <= wdata;
+              `OFFSET_RingCons  : ring_cons  <= wdata;
+              `OFFSET_DmaCtrl       : dma_ctrl        <= wdata;
+              `OFFSET_DmaDataBase   : dma_data_base   <= wdata;
+              `OFFSET_DmaStride     : dma_stride      <= wdata;
+              `OFFSET_DmaChunkSize  : dma_chunk_size  <= wdata;
+              `OFFSET_DmaNumChunks  : dma_num_chunks  <= wdata;
+              `OFFSET_DmaChunkBytes : dma_chunk_bytes <= wdata;
+              `OFFSET_DmaReadChunk  : dma_read_chunk  <= wdata;
+              `OFFSET_DmaHdrBase    : dma_hdr_base    <= wdata;
+              `OFFSET_DmaHdrMask    : dma_hdr_mask    <= wdata;
             endcase // casez (addr[19:0])
          end // if (wen)
+         ring_rst_do <= wen && addr[19:0] == `OFFSET_RingSlots;
+         dma_rst_do  <= wen && addr[19:0] == `OFFSET_DmaCtrl;
 `include "generated_pulsers.v" // import pulser (one-shot) logic generated by ogdar
       end // ! reset
 
@@ -446,7 +683,7 @@ module red_pitaya_digdar
             trig_clock           <= clocks;
             trig_prev_clock      <= trig_clock;
 
-            if (`is_armed) begin
+            if (`is_armed && ! ring_full) begin
                // we've been triggered but are not already capturing a
                // previous pulse so save copies of metadata registers
                // for this pulse.  (If trig_trig is true but we are
@@ -465,8 +702,35 @@ module red_pitaya_digdar
                saved_trig_count             <=  trig_count             ;
                saved_trig_clock             <=  clocks                 ; // NB: not trig_clock, since that's not valid until the next tick.
                saved_trig_prev_clock        <=  trig_clock             ;
+
+               hdr_seq                      <=  hdr_seq + 32'h1        ;
+               hdr_buf[`HDR_SEQ          ]  <=  hdr_seq + 32'h1        ;
+               hdr_buf[`HDR_TRIG_COUNT   ]  <=  trig_count             ;
+               hdr_buf[`HDR_TRIG_AT_ARP  ]  <=  trig_at_arp            ;
+               hdr_buf[`HDR_TRIG_CLOCK_LO]  <=  clocks[32-1: 0]        ;
+               hdr_buf[`HDR_TRIG_CLOCK_HI]  <=  clocks[64-1:32]        ;
+               hdr_buf[`HDR_TRIG_PREV_LO ]  <=  trig_clock[32-1: 0]    ;
+               hdr_buf[`HDR_TRIG_PREV_HI ]  <=  trig_clock[64-1:32]    ;
+               hdr_buf[`HDR_ACP_COUNT    ]  <=  acp_count              ;
+               hdr_buf[`HDR_ACP_AT_ARP   ]  <=  acp_at_arp             ;
+               hdr_buf[`HDR_ACP_CLOCK_LO ]  <=  acp_clock[32-1: 0]     ;
+               hdr_buf[`HDR_ACP_CLOCK_HI ]  <=  acp_clock[64-1:32]     ;
+               hdr_buf[`HDR_ARP_COUNT    ]  <=  arp_count              ;
+               hdr_buf[`HDR_ARP_CLOCK_LO ]  <=  arp_clock[32-1: 0]     ;
+               hdr_buf[`HDR_ARP_CLOCK_HI ]  <=  arp_clock[64-1:32]     ;
+               hdr_buf[`HDR_ACP_PER_ARP  ]  <=  acp_per_arp            ;
+               hdr_buf[`HDR_SEQ_END      ]  <=  hdr_seq + 32'h1        ;
+               hdr_copy_slot                <=  ring_wslot             ;
             end
          end // if(trig_trig)
+
+         // copy the latched pulse header into its ring slot, one word per clock
+         if (! hdr_copy_cnt[HSZ]) begin
+            ring_hdr_buf[{hdr_copy_slot, hdr_copy_cnt[HSZ-1:0]}] <= hdr_buf[hdr_copy_cnt[HSZ-1:0]];
+            hdr_copy_cnt <= hdr_copy_cnt + 1'b1;
+         end
+         if (trig_trig && `is_armed && ! ring_full)
+           hdr_copy_cnt <= 'h0;
       end // if (! reset)
    end
 
@@ -475,12 +739,31 @@ module red_pitaya_digdar
 
       casez (addr[19:0])
 `include "generated_getters.v"  // import getter logic generated by ogdar
+        `OFFSET_RingSlots   : begin ack <= 1'b1;  rdata <= ring_slots                    [32-1: 0]; end
+        `OFFSET_RingProd    : begin ack <= 1'b1;  rdata <= ring_prod                     [32-1: 0]; end
+        `OFFSET_RingCons    : begin ack <= 1'b1;  rdata <= ring_cons                     [32-1: 0]; end
+        `OFFSET_RingDropped : begin ack <= 1'b1;  rdata <= ring_dropped                  [32-1: 0]; end
+        `OFFSET_DmaCtrl       : begin ack <= 1'b1;  rdata <= dma_ctrl                    [32-1: 0]; end
+        `OFFSET_DmaDataBase   : begin ack <= 1'b1;  rdata <= dma_data_base               [32-1: 0]; end
+        `OFFSET_DmaStride     : begin ack <= 1'b1;  rdata <= dma_stride                  [32-1: 0]; end
+        `OFFSET_DmaChunkSize  : begin ack <= 1'b1;  rdata <= dma_chunk_size              [32-1: 0]; end
+        `OFFSET_DmaNumChunks  : begin ack <= 1'b1;  rdata <= dma_num_chunks              [32-1: 0]; end
+        `OFFSET_DmaChunkBytes : begin ack <= 1'b1;  rdata <= dma_chunk_bytes             [32-1: 0]; end
+        `OFFSET_DmaReadChunk  : begin ack <= 1'b1;  rdata <= dma_read_chunk              [32-1: 0]; end
+        `OFFSET_DmaHdrBase    : begin ack <= 1'b1;  rdata <= dma_hdr_base                [32-1: 0]; end
+        `OFFSET_DmaHdrMask    : begin ack <= 1'b1;  rdata <= dma_hdr_mask                [32-1: 0]; end
+        `OFFSET_DmaProd       : begin ack <= 1'b1;  rdata <= dma_prod                    [32-1: 0]; end
+        `OFFSET_DmaDropped    : begin ack <= 1'b1;  rdata <= dma_dropped                 [32-1: 0]; end
+        `OFFSET_DmaErrors     : begin ack <= 1'b1;  rdata <= dma_errors                  [32-1: 0]; end
+        `OFFSET_DmaChunk      : begin ack <= 1'b1;  rdata <= dma_chunk                   [32-1: 0]; end
         // reads from buffers
         20'h1???? : begin ack <= adc_rd_dv;     rdata <= adc_a_rd                           ; end // 32 bit register
         20'h2???? : begin ack <= adc_rd_dv;     rdata <= {16'h0, 2'h0, adc_b_rd}            ; end
 
         20'h3???? : begin ack <= adc_rd_dv;     rdata <= {16'h0, 4'h0, xadc_a_rd}           ; end
         20'h4???? : begin ack <= adc_rd_dv;     rdata <= {16'h0, 4'h0, xadc_b_rd}           ; end
+        20'h5???? : begin ack <= adc_rd_dv;     rdata <= hdr_rd                             ; end // pulse header block
+        20'h6???? : begin ack <= adc_rd_dv;     rdata <= ring_hdr_rd                        ; end // pulse header for each ring slot
         default   : begin ack <= 1'b1;          rdata <= 32'h0                              ; end
       endcase
    end
@@ -0,0 +1,394 @@
+/**
+ *
+ * @brief Red Pitaya DIGDAR DMA engine.  Writes captured pulses into a ring
+ *        in DDR memory over an AXI high-performance port.
+ *
+ * @Author John Brzustowski
+ *
+ * (c) John Brzustowski https://radr-project.org
+ *
+ */
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * Rather than have the ARM copy each pulse out of the sample buffers over
+ * the general purpose AXI port, this module takes channel A samples as the
+ * digdar module captures them, packs four to a 64-bit word, and writes them
+ * in bursts straight into a ring of pulse slots in DDR memory which has
+ * been reserved from Linux.  The ring has the same layout as the pulse
+ * buffer in the digdar program: slots of `stride` bytes, each beginning with
+ * META bytes of pulse metadata (filled in by software) followed by the
+ * samples, grouped into chunks of `chunk_size` slots.  As in the program's
+ * worker thread, a new chunk is begun when the current one is full, or at
+ * a new ARP, and the chunk being read by software (`read_chunk`) is
+ * skipped over.
+ *
+ * Once all of a pulse's samples have been written, its header (copied from
+ * the digdar module's pulse header block when the capture began) is
+ * written as a 128-byte record into a separate header ring at
+ * hdr_base + 128 * (sequence & hdr_mask), followed by the chunk and slot
+ * within the chunk where the samples went.  When every write for the pulse
+ * has been acknowledged, `prod` is incremented.  Software polls `prod`,
+ * reads header records, and hands the slots over as pulse buffer contents
+ * without copying samples.
+ *
+ * A pulse which begins while the previous one is still being written is
+ * dropped and counted in `dropped`.  Write errors and sample FIFO overflows
+ * are counted in `errors`.
+ *
+ * Requires num_samp to be a multiple of 4 and stride a multiple of 8, so
+ * that every burst is 64-bit aligned, and num_samp * dec_rate >= 16 so that
+ * the header is copied before the next capture can begin.
+ *
+ * Bursts never cross a 4 KB boundary.
+ *
+ * Header record layout must match digdar_dma_hdr_t in fpga_digdar.h
+ */
+
+module red_pitaya_digdar_dma
+  #(
+    parameter AXI_DW   = 64 , //!< data width
+    parameter AXI_AW   = 32 , //!< address width
+    parameter AXI_IW   =  6 , //!< ID width
+    parameter HSZ      =  4 , //!< pulse header block size 2^HSZ words
+    parameter META     = 24 , //!< bytes of software metadata at the start of each slot
+    parameter FSZ      =  6   //!< sample FIFO size 2^FSZ words
+    )
+  (
+   input                   clk_i          , //!< clock (ADC clock)
+   input                   rstn_i         , //!< reset - active low
+
+   // configuration
+   input                   enable_i       , //!< accept pulses
+   input                   restart_i      , //!< asserted for one clock to reset counters and restart at chunk 0
+   input  [  32-1: 0]      data_base_i    , //!< physical address of the first slot
+   input  [  32-1: 0]      stride_i       , //!< bytes per slot
+   input  [  32-1: 0]      chunk_size_i   , //!< slots per chunk
+   input  [  32-1: 0]      num_chunks_i   , //!< chunks in the ring
+   input  [  32-1: 0]      chunk_bytes_i  , //!< chunk_size * stride
+   input  [  32-1: 0]      read_chunk_i   , //!< chunk being read by software; not written
+   input  [  32-1: 0]      hdr_base_i     , //!< physical address of the header ring
+   input  [  32-1: 0]      hdr_mask_i     , //!< header ring slots - 1; a power of 2 minus 1
+   input  [  32-1: 0]      num_samp_i     , //!< samples per pulse
+
+   // capture stream from digdar module
+   input                   pulse_start_i  , //!< a capture is beginning
+   input  [  32-1: 0]      arp_count_i    , //!< ARP count for the pulse beginning
+   input                   samp_we_i      , //!< samp_i is the next sample of the pulse
+   input  [  16-1: 0]      samp_i         , //!< sample value
+   output [ HSZ-1: 0]      hdr_raddr_o    , //!< pulse header block read address
+   input  [  32-1: 0]      hdr_rdata_i    , //!< pulse header block word at hdr_raddr_o
+
+   // status
+   output reg [ 32-1: 0]   prod_o         , //!< pulses completely written
+   output reg [ 32-1: 0]   dropped_o      , //!< pulses dropped because the previous one was still being written
+   output reg [ 32-1: 0]   errors_o       , //!< write errors and FIFO overflows
+   output     [ 32-1: 0]   chunk_o        , //!< chunk being written, or last written
+
+   // AXI write address channel
+   output     [ AXI_IW-1: 0] axi_awid_o   , //!< write address ID
+   output reg [ AXI_AW-1: 0] axi_awaddr_o , //!< write address
+   output reg [      4-1: 0] axi_awlen_o  , //!< write burst length
+   output     [      3-1: 0] axi_awsize_o , //!< write burst size
+   output     [      2-1: 0] axi_awburst_o, //!< write burst type
+   output     [      2-1: 0] axi_awlock_o , //!< write lock type
+   output     [      4-1: 0] axi_awcache_o, //!< write cache type
+   output     [      3-1: 0] axi_awprot_o , //!< write protection type
+   output     [      4-1: 0] axi_awqos_o  , //!< write quality of service
+   output reg                axi_awvalid_o, //!< write address valid
+   input                     axi_awready_i, //!< write address ready
+
+   // AXI write data channel
+   output     [ AXI_IW-1: 0] axi_wid_o    , //!< write data ID
+   output     [ AXI_DW-1: 0] axi_wdata_o  , //!< write data
+   output     [ AXI_DW/8-1: 0] axi_wstrb_o, //!< write strobes
+   output                    axi_wlast_o  , //!< write last
+   output                    axi_wvalid_o , //!< write valid
+   input                     axi_wready_i , //!< write ready
+
+   // AXI write response channel
+   input      [ AXI_IW-1: 0] axi_bid_i    , //!< write response ID
+   input      [      2-1: 0] axi_bresp_i  , //!< write response
+   input                     axi_bvalid_i , //!< write response valid
+   output                    axi_bready_o   //!< write response ready
+   );
+
+   localparam HDR_WORDS = 32 ;  // words in a header record: pulse header, chunk, slot in chunk, samples, padding
+   localparam HDR_BEATS = HDR_WORDS / 2 ;
+
+   // fixed AXI attributes: 64-bit incrementing bursts, bufferable and modifiable
+   assign axi_awid_o    = 'h0    ;
+   assign axi_awsize_o  = 3'h3   ;
+   assign axi_awburst_o = 2'b01  ;
+   assign axi_awlock_o  = 2'b00  ;
+   assign axi_awcache_o = 4'b0011;
+   assign axi_awprot_o  = 3'b000 ;
+   assign axi_awqos_o   = 4'h0   ;
+   assign axi_wid_o     = 'h0    ;
+   assign axi_wstrb_o   = {AXI_DW/8{1'b1}};
+   assign axi_bready_o  = 1'b1   ;
+
+   //---------------------------------------------------------------------------------
+   //  Slot assignment
+   //
+   // Chunks are advanced exactly as in the digdar program's worker thread.
+
+   reg              first       = 1'b1  ; // no pulse since restart
+   reg              busy        = 1'b0  ; // a pulse is being written
+   reg [  32-1: 0]  prev_arp    = 32'h0 ;
+   reg [  16-1: 0]  chunk_idx   = 16'h0 ; // chunk of current pulse
+   reg [  32-1: 0]  chunk_addr  = 32'h0 ; // address of chunk_idx
+   reg [  32-1: 0]  chunk_n     = 32'h0 ; // pulses in chunk_idx, including current
+   reg [  32-1: 0]  slot_addr   = 32'h0 ; // address of current pulse's slot
+   reg [  32-1: 0]  hdr_seq     = 32'h0 ; // pulses accepted since restart
+
+   wire             last1       = (chunk_idx == num_chunks_i - 1'b1) ;
+   wire [  16-1: 0] chunk_idx1  = last1 ? 16'h0 : chunk_idx + 1'b1 ;
+   wire [  32-1: 0] chunk_addr1 = last1 ? data_base_i : chunk_addr + chunk_bytes_i ;
+   wire             last2       = (chunk_idx1 == num_chunks_i - 1'b1) ;
+   wire [  16-1: 0] chunk_idx2  = last2 ? 16'h0 : chunk_idx1 + 1'b1 ;
+   wire [  32-1: 0] chunk_addr2 = last2 ? data_base_i : chunk_addr1 + chunk_bytes_i ;
+   wire             skip_read   = (chunk_idx1 == read_chunk_i[16-1:0]) ;
+   wire             new_chunk   = first || (chunk_n == chunk_size_i) || (arp_count_i != prev_arp) ;
+   wire             accept      = pulse_start_i && enable_i && ! busy ;
+
+   // chunk_idx changes in the same clock as read_chunk_i is sampled, so once
+   // software has written read_chunk, a read of chunk_o shows whether the
+   // engine had already moved into that chunk
+   assign chunk_o = {16'h0, chunk_idx} ;
+
+   //---------------------------------------------------------------------------------
+   //  Pulse header copy
+   //
+   // The digdar module's header block is only stable until the next capture
+   // begins, so it is copied here, one word per clock, as this one begins.
+
+   reg [  32-1: 0]  hdr_store [0:(1<<HSZ)-1] ;
+   reg [ HSZ+1-1: 0] hdr_cnt    = 1 << HSZ ; // next word to copy; idle when 1 << HSZ
+
+   assign hdr_raddr_o = hdr_cnt[HSZ-1:0] ;
+
+   always @(posedge clk_i) begin
+      if (! hdr_cnt[HSZ]) begin
+         hdr_store[hdr_cnt[HSZ-1:0]] <= hdr_rdata_i ;
+         hdr_cnt <= hdr_cnt + 1'b1 ;
+      end
+      if (accept)
+        hdr_cnt <= 'h0 ;
+   end
+
+   //---------------------------------------------------------------------------------
+   //  Sample packing and FIFO
+
+   reg [  64-1: 0]  pack       ;
+   reg [   2-1: 0]  pack_n     = 2'h0 ;
+   reg              taking     = 1'b0 ; // samples belong to the pulse being written
+   reg [  32-1: 0]  samp_left  = 32'h0 ; // samples still to be taken
+
+   reg [  64-1: 0]  fifo [0:(1<<FSZ)-1] ;
+   reg [ FSZ-1: 0]  fifo_wp    = 'h0 ;
+   reg [ FSZ-1: 0]  fifo_rp    = 'h0 ;
+   reg [ FSZ+1-1: 0] fifo_cnt  = 'h0 ;
+   wire             fifo_push  = taking && samp_we_i && (pack_n == 2'h3) ;
+   wire             fifo_pop   ;
+
+   //---------------------------------------------------------------------------------
+   //  Burst engine
+
+   localparam B_IDLE = 2'd0 ; // waiting for enough data for a burst
+   localparam B_ADDR = 2'd1 ; // address phase
+   localparam B_DATA = 2'd2 ; // data phase
+   localparam B_DONE = 2'd3 ; // waiting for outstanding responses
+
+   reg [   2-1: 0]  bstate     = B_IDLE ;
+   reg              bhdr       = 1'b0  ; // current burst is the header record
+   reg [   5-1: 0]  beat       = 5'h0  ; // beat within current burst
+   reg [  32-1: 0]  wr_addr    = 32'h0 ; // address of next sample word
+   reg [  32-1: 0]  words_left = 32'h0 ; // sample words not yet sent in a burst
+   reg              hdr_sent   = 1'b0  ; // header burst has been sent
+   reg [   8-1: 0]  pending    = 8'h0  ; // bursts without a write response
+
+   wire [ 13-1: 0]  to_4k      = 13'h1000 - {1'b0, wr_addr[12-1:0]} ;
+   wire [ 10-1: 0]  to_4k_w    = to_4k[13-1:3] ;
+   wire [   5-1: 0] blen_w     = (words_left < 16 && words_left < to_4k_w) ? words_left[5-1:0]
+                                 : (to_4k_w < 16) ? to_4k_w[5-1:0] : 5'd16 ;
+   wire             samp_ready = (words_left != 0) && (fifo_cnt >= blen_w) ;
+   wire             hdr_ready  = busy && (words_left == 0) && ! taking && ! hdr_sent && hdr_cnt[HSZ] ;
+
+   wire [   5-1: 0] hdr_word   = {beat[4-1:0], 1'b0} ;
+   reg  [  32-1: 0] hdr_lo, hdr_hi ;
+   always @(*) begin
+      hdr_lo = 32'h0 ;
+      hdr_hi = 32'h0 ;
+      if (hdr_word < (1 << HSZ)) begin
+         hdr_lo = hdr_store[hdr_word[HSZ-1:0]] ;
+         hdr_hi = hdr_store[hdr_word[HSZ-1:0] + 1'b1] ;
+      end
+      else if (hdr_word == (1 << HSZ)) begin
+         hdr_lo = {16'h0, chunk_idx} ;  // chunk holding the pulse
+         hdr_hi = chunk_n - 1'b1 ;      // slot within chunk
+      end
+      else if (hdr_word == (1 << HSZ) + 2)
+        hdr_lo = num_samp_i ;
+   end
+
+   assign axi_wvalid_o = (bstate == B_DATA) ;
+   assign axi_wlast_o  = (bstate == B_DATA) && (beat == axi_awlen_o) ;
+   assign axi_wdata_o  = bhdr ? {hdr_hi, hdr_lo} : fifo[fifo_rp] ;
+   assign fifo_pop     = axi_wvalid_o && axi_wready_i && ! bhdr ;
+
+   wire   aw_done      = axi_awvalid_o && axi_awready_i ;
+   wire   b_done       = axi_bvalid_i ;
+
+   always @(posedge clk_i) begin
+      if (! rstn_i || restart_i) begin
+         first         <= 1'b1  ;
+         busy          <= 1'b0  ;
+         taking        <= 1'b0  ;
+         pack_n        <= 2'h0  ;
+         fifo_wp       <= 'h0   ;
+         fifo_rp       <= 'h0   ;
+         fifo_cnt      <= 'h0   ;
+         bstate        <= B_IDLE ;
+         axi_awvalid_o <= 1'b0  ;
+         words_left    <= 32'h0 ;
+         hdr_sent      <= 1'b0  ;
+         hdr_seq       <= 32'h0 ;
+         prod_o        <= 32'h0 ;
+         dropped_o     <= 32'h0 ;
+         errors_o      <= 32'h0 ;
+         chunk_idx     <= 16'h0 ;
+         chunk_addr    <= data_base_i ;
+         chunk_n       <= 32'h0 ;
+      end
+      else begin
+
+         // accept a new pulse, and choose its slot
+
+         if (pulse_start_i && enable_i && busy)
+           dropped_o <= dropped_o + 32'h1 ;
+
+         if (accept) begin
+            busy       <= 1'b1 ;
+            taking     <= 1'b1 ;
+            samp_left  <= num_samp_i ;
+            pack_n     <= 2'h0 ;
+            words_left <= num_samp_i >> 2 ;
+            hdr_sent   <= 1'b0 ;
+            hdr_seq    <= hdr_seq + 32'h1 ;
+            prev_arp   <= arp_count_i ;
+            first      <= 1'b0 ;
+            if (new_chunk) begin
+               if (first) begin
+                  chunk_idx  <= 16'h0 ;
+                  chunk_addr <= data_base_i ;
+                  slot_addr  <= data_base_i ;
+                  wr_addr    <= data_base_i + META ;
+               end
+               else if (skip_read) begin
+                  chunk_idx  <= chunk_idx2 ;
+                  chunk_addr <= chunk_addr2 ;
+                  slot_addr  <= chunk_addr2 ;
+                  wr_addr    <= chunk_addr2 + META ;
+               end
+               else begin
+                  chunk_idx  <= chunk_idx1 ;
+                  chunk_addr <= chunk_addr1 ;
+                  slot_addr  <= chunk_addr1 ;
+                  wr_addr    <= chunk_addr1 + META ;
+               end
+               chunk_n <= 32'h1 ;
+            end
+            else begin
+               slot_addr <= slot_addr + stride_i ;
+               wr_addr   <= slot_addr + stride_i + META ;
+               chunk_n   <= chunk_n + 32'h1 ;
+            end
+         end
+
+         // pack samples, four to a word, earliest in the low bits
+
+         if (taking && samp_we_i) begin
+            pack[pack_n*16 +: 16] <= samp_i ;
+            pack_n    <= pack_n + 1'b1 ;
+            samp_left <= samp_left - 32'h1 ;
+            if (samp_left == 32'h1)
+              taking <= 1'b0 ;
+         end
+
+         if (fifo_push) begin
+            if (fifo_cnt[FSZ]) begin
+               errors_o <= errors_o + 32'h1 ; // overflow; the pulse will be short
+            end
+            else begin
+               fifo[fifo_wp] <= {samp_i, pack[48-1:0]} ;
+               fifo_wp       <= fifo_wp + 1'b1 ;
+            end
+         end
+         if (fifo_pop)
+           fifo_rp <= fifo_rp + 1'b1 ;
+         fifo_cnt <= fifo_cnt + (fifo_push && ! fifo_cnt[FSZ]) - fifo_pop ;
+
+         // bursts
+
+         case (bstate)
+           B_IDLE : begin
+              if (samp_ready) begin
+                 bhdr          <= 1'b0 ;
+                 axi_awaddr_o  <= wr_addr ;
+                 axi_awlen_o   <= blen_w - 1'b1 ;
+                 axi_awvalid_o <= 1'b1 ;
+                 wr_addr       <= wr_addr + {blen_w, 3'h0} ;
+                 words_left    <= words_left - blen_w ;
+                 bstate        <= B_ADDR ;
+              end
+              else if (hdr_ready) begin
+                 bhdr          <= 1'b1 ;
+                 axi_awaddr_o  <= hdr_base_i + {(hdr_seq - 1'b1) & hdr_mask_i, 7'h0} ;
+                 axi_awlen_o   <= HDR_BEATS - 1 ;
+                 axi_awvalid_o <= 1'b1 ;
+                 hdr_sent      <= 1'b1 ;
+                 bstate        <= B_ADDR ;
+              end
+              else if (busy && hdr_sent) begin
+                 bstate <= B_DONE ;
+              end
+           end
+           B_ADDR : begin
+              if (axi_awready_i) begin
+                 axi_awvalid_o <= 1'b0 ;
+                 beat          <= 5'h0 ;
+                 bstate        <= B_DATA ;
+              end
+           end
+           B_DATA : begin
+              if (axi_wready_i) begin
+                 beat <= beat + 1'b1 ;
+                 if (beat == axi_awlen_o)
+                   bstate <= B_IDLE ;
+              end
+           end
+           B_DONE : begin
+              // the pulse is complete once every burst has been acknowledged
+              if (pending == 0) begin
+                 prod_o <= prod_o + 32'h1 ;
+                 busy   <= 1'b0 ;
+                 bstate <= B_IDLE ;
+              end
+           end
+         endcase
+
+         if (b_done && axi_bresp_i != 2'b00)
+           errors_o <= errors_o + 32'h1 ;
+      end
+   end
+
+   always @(posedge clk_i) begin
+      if (! rstn_i || restart_i)
+        pending <= 8'h0 ;
+      else
+        pending <= pending + aw_done - b_done ;
+   end
+
+endmodule // red_pitaya_digdar_dma
@@ -109,6 +109,32 @@ module red_pitaya_ps
    input              sys_err_i          ,  // system error indicator
    input              sys_ack_i          ,  // system acknowledge signal
 
+ `ifdef DIGDAR_DMA
+   // AXI HP0 slave, for DMA from PL into DDR (write only)
+   input              hp0_saxi_aclk_i    ,  // clock
+   input   [  6-1: 0] hp0_saxi_awid_i    ,  // write address ID
+   input   [ 32-1: 0] hp0_saxi_awaddr_i  ,  // write address
+   input   [  4-1: 0] hp0_saxi_awlen_i   ,  // write burst length
+   input   [  3-1: 0] hp0_saxi_awsize_i  ,  // write burst size
+   input   [  2-1: 0] hp0_saxi_awburst_i ,  // write burst type
+   input   [  2-1: 0] hp0_saxi_awlock_i  ,  // write lock type
+   input   [  4-1: 0] hp0_saxi_awcache_i ,  // write cache type
+   input   [  3-1: 0] hp0_saxi_awprot_i  ,  // write protection type
+   input   [  4-1: 0] hp0_saxi_awqos_i   ,  // write quality of service
+   input              hp0_saxi_awvalid_i ,  // write address valid
+   output             hp0_saxi_awready_o ,  // write address ready
+   input   [  6-1: 0] hp0_saxi_wid_i     ,  // write data ID
+   input   [ 64-1: 0] hp0_saxi_wdata_i   ,  // write data
+   input   [  8-1: 0] hp0_saxi_wstrb_i   ,  // write strobes
+   input              hp0_saxi_wlast_i   ,  // write last
+   input              hp0_saxi_wvalid_i  ,  // write valid
+   output             hp0_saxi_wready_o  ,  // write ready
+   output  [  6-1: 0] hp0_saxi_bid_o     ,  // write response ID
+   output  [  2-1: 0] hp0_saxi_bresp_o   ,  // write response
+   output             hp0_saxi_bvalid_o  ,  // write response valid
+   input              hp0_saxi_bready_i  ,  // write response ready
+ `endif
+
    // SPI master
    output             spi_ss_o           ,  // select slave 0
    output             spi_ss1_o          ,  // select slave 1
@@ -363,6 +389,51 @@ BUFG i_fclk3_buf  (.O(fclk_clk_o[3]), .I(fclk_clk[3]));
   .M_AXI_GP0_rresp    (  gp0_maxi_rresp              ),  // in 2
   .M_AXI_GP0_rdata    (  gp0_maxi_rdata              ),  // in 32
 
+`ifdef DIGDAR_DMA
+ // HP0: DMA from the digdar module into DDR.  The block design must have
+ // S_AXI_HP0 enabled (64 bit) and made external, along with its clock.
+  .S_AXI_HP0_ACLK     (  hp0_saxi_aclk_i             ),  // in
+  .S_AXI_HP0_awid     (  hp0_saxi_awid_i             ),  // in 6
+  .S_AXI_HP0_awaddr   (  hp0_saxi_awaddr_i           ),  // in 32
+  .S_AXI_HP0_awlen    (  hp0_saxi_awlen_i            ),  // in 4
+  .S_AXI_HP0_awsize   (  hp0_saxi_awsize_i           ),  // in 3
+  .S_AXI_HP0_awburst  (  hp0_saxi_awburst_i          ),  // in 2
+  .S_AXI_HP0_awlock   (  hp0_saxi_awlock_i           ),  // in 2
+  .S_AXI_HP0_awcache  (  hp0_saxi_awcache_i          ),  // in 4
+  .S_AXI_HP0_awprot   (  hp0_saxi_awprot_i           ),  // in 3
+  .S_AXI_HP0_awqos    (  hp0_saxi_awqos_i            ),  // in 4
+  .S_AXI_HP0_awvalid  (  hp0_saxi_awvalid_i          ),  // in
+  .S_AXI_HP0_awready  (  hp0_saxi_awready_o          ),  // out
+  .S_AXI_HP0_wid      (  hp0_saxi_wid_i              ),  // in 6
+  .S_AXI_HP0_wdata    (  hp0_saxi_wdata_i            ),  // in 64
+  .S_AXI_HP0_wstrb    (  hp0_saxi_wstrb_i            ),  // in 8
+  .S_AXI_HP0_wlast    (  hp0_saxi_wlast_i            ),  // in
+  .S_AXI_HP0_wvalid   (  hp0_saxi_wvalid_i           ),  // in
+  .S_AXI_HP0_wready   (  hp0_saxi_wready_o           ),  // out
+  .S_AXI_HP0_bid      (  hp0_saxi_bid_o              ),  // out 6
+  .S_AXI_HP0_bresp    (  hp0_saxi_bresp_o            ),  // out 2
+  .S_AXI_HP0_bvalid   (  hp0_saxi_bvalid_o           ),  // out
+  .S_AXI_HP0_bready   (  hp0_saxi_bready_i           ),  // in
+  // read channel unused
+  .S_AXI_HP0_arid     (  6'h0                        ),  // in 6
+  .S_AXI_HP0_araddr   (  32'h0                       ),  // in 32
+  .S_AXI_HP0_arlen    (  4'h0                        ),  // in 4
+  .S_AXI_HP0_arsize   (  3'h3                        ),  // in 3
+  .S_AXI_HP0_arburst  (  2'h1                        ),  // in 2
+  .S_AXI_HP0_arlock   (  2'h0                        ),  // in 2
+  .S_AXI_HP0_arcache  (  4'h0                        ),  // in 4
+  .S_AXI_HP0_arprot   (  3'h0                        ),  // in 3
+  .S_AXI_HP0_arqos    (  4'h0                        ),  // in 4
+  .S_AXI_HP0_arvalid  (  1'b0                        ),  // in
+  .S_AXI_HP0_arready  (                              ),  // out
+  .S_AXI_HP0_rid      (                              ),  // out 6
+  .S_AXI_HP0_rdata    (                              ),  // out 64
+  .S_AXI_HP0_rresp    (                              ),  // out 2
+  .S_AXI_HP0_rlast    (                              ),  // out
+  .S_AXI_HP0_rvalid   (                              ),  // out
+  .S_AXI_HP0_rready   (  1'b1                        ),  // in
+`endif
+
  // SPI0
   .SPI0_SS_I          (  spi_ss_i                    ),  // in
   .SPI0_SS_O          (  spi_ss_o                    ),  // out
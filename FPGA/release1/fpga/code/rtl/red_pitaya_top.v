@@ -143,6 +143,39 @@ module red_pitaya_top
    wire             ps_sys_err         ;
    wire             ps_sys_ack         ;
 
+   // AXI HP0 write channels, from the digdar DMA engine
+   wire             hp0_aclk           ;
+   wire [  6-1: 0]  hp0_awid           ;
+   wire [ 32-1: 0]  hp0_awaddr         ;
+   wire [  4-1: 0]  hp0_awlen          ;
+   wire [  3-1: 0]  hp0_awsize         ;
+   wire [  2-1: 0]  hp0_awburst        ;
+   wire [  2-1: 0]  hp0_awlock         ;
+   wire [  4-1: 0]  hp0_awcache        ;
+   wire [  3-1: 0]  hp0_awprot         ;
+   wire [  4-1: 0]  hp0_awqos          ;
+   wire             hp0_awvalid        ;
+   wire             hp0_awready        ;
+   wire [  6-1: 0]  hp0_wid            ;
+   wire [ 64-1: 0]  hp0_wdata          ;
+   wire [  8-1: 0]  hp0_wstrb          ;
+   wire             hp0_wlast          ;
+   wire             hp0_wvalid         ;
+   wire             hp0_wready         ;
+   wire [  6-1: 0]  hp0_bid            ;
+   wire [  2-1: 0]  hp0_bresp          ;
+   wire             hp0_bvalid         ;
+   wire             hp0_bready         ;
+
+`ifndef DIGDAR_DMA
+   // without HP0, the DMA engine never gets a write accepted
+   assign hp0_awready = 1'b0 ;
+   assign hp0_wready  = 1'b0 ;
+   assign hp0_bid     = 6'h0 ;
+   assign hp0_bresp   = 2'h0 ;
+   assign hp0_bvalid  = 1'b0 ;
+`endif
+
 
    red_pitaya_ps i_ps
      (
@@ -208,6 +241,32 @@ module red_pitaya_top
       .sys_err_i       (  ps_sys_err         ),  // system error indicator
       .sys_ack_i       (  ps_sys_ack         ),  // system acknowledge signal
 
+`ifdef DIGDAR_DMA
+      // AXI HP0, for DMA of pulses into DDR
+      .hp0_saxi_aclk_i    (  hp0_aclk        ),
+      .hp0_saxi_awid_i    (  hp0_awid        ),
+      .hp0_saxi_awaddr_i  (  hp0_awaddr      ),
+      .hp0_saxi_awlen_i   (  hp0_awlen       ),
+      .hp0_saxi_awsize_i  (  hp0_awsize      ),
+      .hp0_saxi_awburst_i (  hp0_awburst     ),
+      .hp0_saxi_awlock_i  (  hp0_awlock      ),
+      .hp0_saxi_awcache_i (  hp0_awcache     ),
+      .hp0_saxi_awprot_i  (  hp0_awprot      ),
+      .hp0_saxi_awqos_i   (  hp0_awqos       ),
+      .hp0_saxi_awvalid_i (  hp0_awvalid     ),
+      .hp0_saxi_awready_o (  hp0_awready     ),
+      .hp0_saxi_wid_i     (  hp0_wid         ),
+      .hp0_saxi_wdata_i   (  hp0_wdata       ),
+      .hp0_saxi_wstrb_i   (  hp0_wstrb       ),
+      .hp0_saxi_wlast_i   (  hp0_wlast       ),
+      .hp0_saxi_wvalid_i  (  hp0_wvalid      ),
+      .hp0_saxi_wready_o  (  hp0_wready      ),
+      .hp0_saxi_bid_o     (  hp0_bid         ),
+      .hp0_saxi_bresp_o   (  hp0_bresp       ),
+      .hp0_saxi_bvalid_o  (  hp0_bvalid      ),
+      .hp0_saxi_bready_i  (  hp0_bready      ),
+`endif
+
       // SPI master
       .spi_ss_o        (                     ),  // select slave 0
       .spi_ss1_o       (                     ),  // select slave 1
@@ -473,8 +532,32 @@ module red_pitaya_top
       .sys_ren_i       (  sys_ren[1]                 ),  // read enable
       .sys_rdata_o     (  sys_rdata[ 1*32+31: 1*32]  ),  // read data
       .sys_err_o       (  sys_err[1]                 ),  // error indicator
-      .sys_ack_o       (  sys_ack[1]                 )   // acknowledge signal
-
+      .sys_ack_o       (  sys_ack[1]                 ),  // acknowledge signal
+
+      // DMA to DDR
+      .dma_awid_o      (  hp0_awid                   ),
+      .dma_awaddr_o    (  hp0_awaddr                 ),
+      .dma_awlen_o     (  hp0_awlen                  ),
+      .dma_awsize_o    (  hp0_awsize                 ),
+      .dma_awburst_o   (  hp0_awburst                ),
+      .dma_awlock_o    (  hp0_awlock                 ),
+      .dma_awcache_o   (  hp0_awcache                ),
+      .dma_awprot_o    (  hp0_awprot                 ),
+      .dma_awqos_o     (  hp0_awqos                  ),
+      .dma_awvalid_o   (  hp0_awvalid                ),
+      .dma_awready_i   (  hp0_awready                ),
+      .dma_wid_o       (  hp0_wid                    ),
+      .dma_wdata_o     (  hp0_wdata                  ),
+      .dma_wstrb_o     (  hp0_wstrb                  ),
+      .dma_wlast_o     (  hp0_wlast                  ),
+      .dma_wvalid_o    (  hp0_wvalid                 ),
+      .dma_wready_i    (  hp0_wready                 ),
+      .dma_bid_i       (  hp0_bid                    ),
+      .dma_bresp_i     (  hp0_bresp                  ),
+      .dma_bvalid_i    (  hp0_bvalid                 ),
+      .dma_bready_o    (  hp0_bready                 )
       );
 
+   assign hp0_aclk = adc_clk ;  // the DMA engine runs in the ADC clock domain
+
 endmodule
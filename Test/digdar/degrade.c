@@ -0,0 +1,192 @@
+/*
+ * Bandwidth-adaptive degradation of digdar output.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "degrade.h"
+#include "worker.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * When the consumer of digdar's output (or the link to it) can't keep up,
+ * the worker thread eventually overwrites chunks the reader hasn't sent,
+ * and clients see random chunks of sweeps disappear.  Instead, the reader
+ * watches how far behind it is, and when under pressure, sends less data
+ * per sweep, stepping down through the configured levels one sweep at a
+ * time, and back up once the pressure has cleared for a few sweeps.
+ *
+ * Pressure is measured by the number of filled chunks waiting to be sent,
+ * and by how many sweeps behind the worker thread the reader is.
+ * Levels only change at the start of a sweep, so each sweep is uniform.
+ */
+
+uint16_t degrade_steps[MAX_DEGRADE_STEPS];
+uint16_t num_degrade_steps = 0;
+int16_t detect_thresh = 1000;
+
+static uint16_t level = 0;       // current degradation level; 0 = full data
+static uint16_t calm_sweeps = 0; // consecutive sweeps without pressure
+static uint32_t drop_phase = 0;  // parity of next pulse, for DEGRADE_DROP_ALTERNATE
+
+/** @brief Parses a comma-separated list of degradation steps.
+ *
+ * Each item is one of "drop", "average", "8bit" or "detect".
+ *
+ * @param [in] spec the list; it is modified
+ *
+ * @retval -1 Failure
+ * @retval 0 Success
+ */
+int degrade_parse_steps(char *spec)
+{
+  for (char *step = strtok(spec, ","); step; step = strtok(0, ",")) {
+    uint16_t flag;
+    if (! strcmp(step, "drop"))
+      flag = DEGRADE_DROP_ALTERNATE;
+    else if (! strcmp(step, "average"))
+      flag = DEGRADE_AVERAGE_RANGE;
+    else if (! strcmp(step, "8bit"))
+      flag = DEGRADE_8BIT_VIDEO;
+    else if (! strcmp(step, "detect"))
+      flag = DEGRADE_DETECTIONS_ONLY;
+    else {
+      fprintf(stderr, "unknown degradation step '%s'\n", step);
+      return -1;
+    }
+    if (num_degrade_steps == MAX_DEGRADE_STEPS) {
+      fprintf(stderr, "Too many degradation steps; max is %d\n", MAX_DEGRADE_STEPS);
+      return -1;
+    }
+    degrade_steps[num_degrade_steps++] = flag;
+  }
+  return 0;
+};
+
+/** @brief Updates the degradation level at the start of a sweep.
+ *
+ * @param [in] chunks_pending number of filled chunks waiting to be sent
+ * @param [in] lag_sweeps number of ARPs seen by the worker since the sweep about to be sent
+ *
+ * @retval the DEGRADE_... flags to use for the sweep
+ */
+uint16_t degrade_update(int chunks_pending, uint32_t lag_sweeps)
+{
+  if (lag_sweeps >= 2 || chunks_pending > num_chunks / 2) {
+    calm_sweeps = 0;
+    if (level < num_degrade_steps)
+      ++level;
+  } else if (lag_sweeps == 0 && chunks_pending <= 1) {
+    if (level > 0 && ++calm_sweeps >= DEGRADE_CALM_SWEEPS) {
+      --level;
+      calm_sweeps = 0;
+    }
+  } else {
+    calm_sweeps = 0;
+  }
+  uint16_t flags = 0;
+  for (int i = 0; i < level; ++i)
+    flags |= degrade_steps[i];
+  return flags;
+};
+
+/** @brief Returns the current degradation level; 0 means full data. */
+uint16_t degrade_level(void)
+{
+  return level;
+};
+
+/** @brief Returns the size of a pulse record with the given reductions. */
+uint32_t degrade_psize(uint16_t flags)
+{
+  uint32_t meta = offsetof(pulse_metadata, data);
+  if (flags & DEGRADE_DETECTIONS_ONLY)
+    return meta + sizeof(uint16_t) * (1 + 2 * MAX_DETECTIONS);
+  uint32_t ns = n_samples_out;
+  if (flags & DEGRADE_AVERAGE_RANGE)
+    ns /= 2;
+  uint32_t bytes = ns * n_channels * ((flags & DEGRADE_8BIT_VIDEO) ? 1 : 2);
+  return meta + ((bytes + 1) & ~1); // keep records 16-bit aligned
+};
+
+/** @brief index of sample j of channel c in a pulse with ns samples per channel */
+static inline uint32_t sample_index(uint16_t c, uint32_t j, uint32_t ns)
+{
+  return channel_layout == CHANNEL_LAYOUT_INTERLEAVED ? j * n_channels + c : c * ns + j;
+};
+
+/** @brief Copies pulse records, applying the given reductions.
+ *
+ * @param [in] flags DEGRADE_... reductions to apply
+ * @param [in] src n pulse records of psize bytes each
+ * @param [in] n number of pulse records in src
+ * @param [out] dst destination for degraded pulse records
+ * @param [out] hdr sweep header whose n_pulses, n_samples and psize fields are filled in
+ *
+ * @retval number of bytes written to dst
+ */
+uint32_t degrade_pulses(uint16_t flags, const char *src, uint32_t n, char *dst, sweep_header *hdr)
+{
+  uint32_t meta = offsetof(pulse_metadata, data);
+  uint32_t out_psize = degrade_psize(flags);
+  uint32_t ns = n_samples_out;
+  uint32_t avg = 1;
+  if ((flags & DEGRADE_AVERAGE_RANGE) && ! (flags & DEGRADE_DETECTIONS_ONLY)) {
+    ns /= 2;
+    avg = 2;
+  }
+  uint32_t m = 0; // pulses written
+  for (uint32_t i = 0; i < n; ++i) {
+    if ((flags & DEGRADE_DROP_ALTERNATE) && (drop_phase++ & 1))
+      continue;
+    const pulse_metadata *p = (const pulse_metadata *) (src + i * psize);
+    pulse_metadata *q = (pulse_metadata *) (dst + m * out_psize);
+    ++m;
+    memcpy(q, p, meta);
+
+    if (flags & DEGRADE_DETECTIONS_ONLY) {
+      uint16_t *det = (uint16_t *) ((char *) q + meta);
+      uint16_t nd = 0;
+      memset(det, 0, out_psize - meta);
+      for (uint32_t j = 0; j < n_samples_out && nd < MAX_DETECTIONS; ++j) {
+        int16_t v = p->data[sample_index(0, j, n_samples_out)];
+        if (v >= detect_thresh) {
+          det[1 + 2 * nd] = j;
+          det[2 + 2 * nd] = v;
+          ++nd;
+        }
+      }
+      det[0] = nd;
+      continue;
+    }
+
+    for (uint16_t c = 0; c < n_channels; ++c) {
+      for (uint32_t j = 0; j < ns; ++j) {
+        int32_t v = (int16_t) p->data[sample_index(c, j * avg, n_samples_out)];
+        if (avg == 2)
+          v = (v + (int16_t) p->data[sample_index(c, j * avg + 1, n_samples_out)]) / 2;
+        if (flags & DEGRADE_8BIT_VIDEO) {
+          v >>= 6; // 14-bit samples to 8-bit
+          if (v > 127)
+            v = 127;
+          else if (v < -128)
+            v = -128;
+          ((int8_t *) q->data)[sample_index(c, j, ns)] = v;
+        } else {
+          q->data[sample_index(c, j, ns)] = v;
+        }
+      }
+    }
+  }
+  hdr->n_pulses = m;
+  hdr->n_samples = (flags & DEGRADE_DETECTIONS_ONLY) ? n_samples_out : ns;
+  hdr->psize = out_psize;
+  return m * out_psize;
+};
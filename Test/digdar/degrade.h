@@ -0,0 +1,39 @@
+/*
+ * Bandwidth-adaptive degradation of digdar output.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#ifndef _DEGRADE_H_
+#define _DEGRADE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pulse_metadata.h"
+#include "stream_header.h"
+
+/** Maximum number of degradation levels */
+#define MAX_DEGRADE_STEPS 4
+
+/** Number of consecutive unpressured sweeps before stepping back up a level */
+#define DEGRADE_CALM_SWEEPS 5
+
+extern uint16_t degrade_steps[MAX_DEGRADE_STEPS]; // DEGRADE_... flag added at each level
+extern uint16_t num_degrade_steps; // 0 means never degrade
+extern int16_t detect_thresh; // minimum sample value for a detection, with DEGRADE_DETECTIONS_ONLY
+
+int degrade_parse_steps(char *spec);
+uint16_t degrade_update(int chunks_pending, uint32_t lag_sweeps);
+uint16_t degrade_level(void);
+uint32_t degrade_psize(uint16_t flags);
+uint32_t degrade_pulses(uint16_t flags, const char *src, uint32_t n, char *dst, sweep_header *hdr);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _DEGRADE_H_ */
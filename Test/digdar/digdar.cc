@@ -22,20 +22,26 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/param.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
-#include <map>
-#include <iostream>
-#include <fstream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <math.h>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include "digdar.h"
-#include "main_digdar.h"
 #include "fpga_digdar.h"
 #include "version.h"
-#include "worker.h"
+#include "libdigdar.h"
+#include "pipeline.h"
 #include "pulse_metadata.h"
+#include "degrade.h"
+#include "pyramid.h"
 
 /**
  * GENERAL DESCRIPTION:
@@ -65,11 +71,6 @@ const char *g_argv0 = NULL;
 /** Minimal number of command line arguments */
 #define MINARGS 0
 
-/** Oscilloscope module parameters as defined in main module
- * @see rp_main_params
- */
-float t_params[PARAMS_NUM] = { 0, 1e6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-
 /** Print usage information */
 void usage() {
 
@@ -78,31 +79,72 @@ void usage() {
     "Usage: %s [OPTION]\n"
     "\n"
     "  --acps -a NACP Number of ACPs per sweep; default: 450, which is appropriate for a Furuno FR radar\n"
+    "  --both -B  Capture channel B as well as channel A for each pulse.  By default, each pulse record holds\n"
+    "             all channel A samples followed by all channel B samples.  Requires --header.\n"
+    "  --cpus -c FILL,OUTPUT  Pin the thread which fills the pulse buffer to core FILL, and output to core\n"
+    "                         OUTPUT, with output running as a pipeline stage.\n"
     "  --cut -C CUT Azimuth (given as a fraction in [0..1] from heading) at which sweeps begin.\n"
     "           Default: 0.  This is used to avoid the ~2.5 second discontinuity in data\n"
     "           from occuring at an inconvenient location in the data field.\n"
     "           NOTE: this option must come *after* --acps, if that option is given.\n"
     "  --decim  -d DECIM   Decimation rate: one of 1, 2, 3, 4, 8, 64, 1024, 8192, or 65536\n"
+    "  --degrade -G STEP[,STEP...]  When output can't keep up, reduce the data sent for each sweep,\n"
+    "                         adding one STEP at a time, and removing them once output has caught up.\n"
+    "                         Each STEP is one of: drop (send alternate pulses), average (average pairs\n"
+    "                         of samples in range), 8bit (send samples as 8 bits), detect (send only\n"
+    "                         samples at or above the --detect_thresh threshold).  Requires --header.\n"
+    "                         e.g. --degrade drop,average,8bit,detect\n"
+    "  --detect_thresh -T THRESH  Minimum sample value sent by the 'detect' degradation step; default: 1000\n"
+    "  --dma -M PHYS:BYTES  Have the FPGA write pulses over DMA straight into the pulse buffer, which is\n"
+    "                   the BYTES bytes of DDR at physical address PHYS (e.g. 0x1e000000:0x2000000).  That\n"
+    "                   memory must be withheld from Linux (reserved-memory node, or mem=).  The FPGA\n"
+    "                   must have been built with DIGDAR_DMA.  Only channel A is captured; SAMPLES must be\n"
+    "                   a multiple of 4 and at least 16.  Not allowed with --ring, --replay, --profile,\n"
+    "                   --both, --remove, --cpus, or --utilization.\n"
     "  --dump_params -D  don't run - just dump current FPGA parameter values as NAME VAL\n"
+    "  --header -H  Begin the output with a stream header describing the pulses, and send each run of\n"
+    "               pulses as a block with a sweep header.  By default, output consists only of pulse records.\n"
+    "  --fast -f  With --replay, replay pulses as fast as output accepts them, rather than at recorded timing.\n"
+    "  --interleave -I  With --both, store samples from the two channels interleaved: A B A B ...\n"
+    "  --ring -k SLOTS  Have the FPGA capture pulses into a ring of SLOTS slots (up to 64), without waiting\n"
+    "                   to be re-armed, and drain them in batches.  SLOTS * SAMPLES must be at most 16384,\n"
+    "                   and SAMPLES must be even and at least 16.  Default: 0, which re-arms the FPGA for\n"
+    "                   each pulse.\n"
     "  --sum   If specified, return the sum (in 16-bits) of samples in the decimation period.\n"
     "          e.g. instead of returning (x[0]+x[1])/2 at decimation rate 2, return x[0]+x[1]\n"
     "          Only valid if the decimation rate is <= 4 so that the sum fits in 16 bits\n"
     "  --samples   -n SAMPLES   Samples per pulse. (Up to 16384; default is 3000)\n"
     "  --pulses -p PULSES Number of pulses to allocate buffer for (default; number that fit in 150MB of RAM)\n"
+    "  --profile -R SPAN:FACTOR[,SPAN:FACTOR...]  Range sampling profile.  Each segment covers SPAN samples\n"
+    "                         (or metres, if SPAN ends in 'm') of range and stores the average of each FACTOR\n"
+    "                         consecutive samples.  The last segment extends to the end of the pulse.\n"
+    "                         e.g. --profile 2000m:1,0:4 keeps full resolution to 2 km and averages by 4 beyond.\n"
+    "                         Requires --header.\n"
     "  --param_file -P FILE File of name value pairs for digitizer fpga parameters\n"
+    "  --pyramid -L PORT  Keep sweeps reduced 2, 4 and 8 times in range and azimuth (by taking maxima, so\n"
+    "                     small targets remain visible) and serve them to viewers connecting to TCP PORT.\n"
+    "                     A viewer is sent the stream header, then sweeps at the level (0 for full\n"
+    "                     resolution, up to %d) given by each line of text it sends; a new level takes\n"
+    "                     effect at the next sweep.  This is in addition to the usual output.\n"
     "  --remove -r START:END  Remove sector.  START and END are portions of the circle in [0, 1]\n"
     "                         where 0 is the start of the ARP pulse, and 1 is the start of the next ARP\n"
     "                         pulse.  Pulses within the sector from START to END are remoted and not output.\n"
     "                         If START > END, the removed sector consists of [START, 1] U [0, END].\n"
     "                         Multiple --remove options may be given.\n"
     "           NOTE: this option must come *after* --acps, if that option is given.\n"
+    "  --replay -y FILE  Instead of capturing from the radar, replay pulses from FILE, which holds digdar output.\n"
+    "                    If FILE begins with a stream header, that sets the samples, range profile, and channels;\n"
+    "                    otherwise it holds raw pulse records with --samples samples each.  Throughput is\n"
+    "                    reported at the end of the replay.\n"
+    "  --utilization -u SECS  Run output as a pipeline stage, and every SECS seconds print to stderr the\n"
+    "                         chunk rate, batching, and busy time of capture and output.\n"
     "  --tcp HOST:PORT instead of writing to stdout, open a TCP socket connection to PORT on HOST and\n"
     "                  write there.\n"
     "  --version       -v    Print version info.\n"
     "  --help          -h    Print this message.\n"
     "\n";
 
-  fprintf( stderr, format, g_argv0);
+  fprintf( stderr, format, g_argv0, PYRAMID_LEVELS);
 }
 
 double now() {
@@ -113,86 +155,21 @@ double now() {
 
 
 
-std::map<std::string, int> name_map;
-
-void set_param (std::string name, uint32_t value) {
-  // set the FPGA parameter given by name to the specified value
-  // All settable FPGA register values are 32 bits.
-  if (name_map.find(name) != name_map.end())
-    * (uint32_t *) (((char *) g_digdar_fpga_reg_mem) + 4 * name_map[name]) = value;
-};
-
-uint32_t get_param (std::string name) {
-  return * (uint32_t *) (((char *) g_digdar_fpga_reg_mem) + 4 * name_map[name]);
-};
-
-void setup_param_name_map() {
-  // names must be in the same order as they are in the definition
-  // of digdar_fpga_reg_mem_t
-  // Not all of these make sense to set!
-  int i = 0;
-  name_map["trig_thresh_excite"]         = i++;
-  name_map["trig_thresh_relax"]          = i++;
-  name_map["trig_delay"]                 = i++;
-  name_map["trig_latency"]               = i++;
-  name_map["trig_count"]                 = i++;
-  name_map["trig_clock_low"]             = i++;
-  name_map["trig_clock_high"]            = i++;
-  name_map["trig_prev_clock_low"]        = i++;
-  name_map["trig_prev_clock_high"]       = i++;
-  name_map["acp_thresh_excite"]          = i++;
-  name_map["acp_thresh_relax"]           = i++;
-  name_map["acp_latency"]                = i++;
-  name_map["acp_count"]                  = i++;
-  name_map["acp_clock_low"]              = i++;
-  name_map["acp_clock_high"]             = i++;
-  name_map["acp_prev_clock_low"]         = i++;
-  name_map["acp_prev_clock_high"]        = i++;
-  name_map["arp_thresh_excite"]          = i++;
-  name_map["arp_thresh_relax"]           = i++;
-  name_map["arp_latency"]                = i++;
-  name_map["arp_count"]                  = i++;
-  name_map["arp_clock_low"]              = i++;
-  name_map["arp_clock_high"]             = i++;
-  name_map["arp_prev_clock_low"]         = i++;
-  name_map["arp_prev_clock_high"]        = i++;
-  name_map["acp_per_arp"]                = i++;
-  name_map["saved_trig_count"]           = i++;
-  name_map["saved_trig_clock_low"]       = i++;
-  name_map["saved_trig_clock_high"]      = i++;
-  name_map["saved_trig_prev_clock_low"]  = i++;
-  name_map["saved_trig_prev_clock_high"] = i++;
-  name_map["saved_acp_count"]            = i++;
-  name_map["saved_acp_clock_low"]        = i++;
-  name_map["saved_acp_clock_high"]       = i++;
-  name_map["saved_acp_prev_clock_low"]   = i++;
-  name_map["saved_acp_prev_clock_high"]  = i++;
-  name_map["saved_arp_count"]            = i++;
-  name_map["saved_arp_clock_low"]        = i++;
-  name_map["saved_arp_clock_high"]       = i++;
-  name_map["saved_arp_prev_clock_low"]   = i++;
-  name_map["saved_arp_prev_clock_high"]  = i++;
-  name_map["saved_acp_per_arp"]          = i++;
-  name_map["clocks_low"]                 = i++;
-  name_map["clocks_high"]                = i++;
-  name_map["acp_raw"]                    = i++;
-  name_map["arp_raw"]                    = i++;
-  name_map["acp_at_arp"]                 = i++;
-  name_map["saved_acp_at_arp"]           = i++;
-  name_map["trig_at_arp"]                = i++;
-  name_map["saved_trig_at_arp"]          = i++;
+int write_fully(int fd, char *buf, int n) {
+  // write n bytes from buf to fd, retrying after partial writes.
+  // Returns 0 on success, -1 on error.
+  int offset = 0;
+  int m;
+  do {
+    m = write(fd, buf + offset, n);
+    if (m < 0)
+      return -1;
+    n -= m;
+    offset += m;
+  } while (n > 0);
+  return 0;
 };
 
-sector removals[MAX_REMOVALS];
-uint16_t num_removals = 0;
-
-uint16_t n_samples = 3000;  // samples to grab per radar pulse
-uint32_t decim = 1; // decimation: 1, 2, 8, etc.
-uint32_t max_pulse_buffer_memory = 150000000; // 150Mb pulse buffer memory
-uint32_t pulse_buff_size = 0; // number of pulses to maintain in ring buffer (filled by worker thread); default 0 means as many as fit in max memory
-uint32_t psize = 0; // actual size of each pulse's storage (metadata + data) - will be set below
-uint16_t use_sum = 0; // if non-zero, return sum of samples rather than truncated average
-uint16_t acps = 450; // number of ACPs per sweep; used in calculating removal
 uint16_t cut = 0; // number of ACPs after heading pulse at which to cut between sweeps
 int outfd = -1; // file descriptor for output; fileno(stdout) by default;
 
@@ -204,13 +181,203 @@ int sfd, s;
 struct sockaddr_storage peer_addr;
 socklen_t peer_addr_len;
 ssize_t nread;
-pulse_metadata *pulse_buffer = 0;
 
 char * host = 0;
 char * port = 0;
 
+digdar::config cfg; // capture settings
 bool dump_params = false; // if true, just dump all digdar FPGA registers as NAME VALUE
-std::string param_file; // if specified, read parameters from this file and set FPGA regs appropriately
+bool raw_output = true; // if true, don't write a stream header (the default; see --header)
+char *degrade_buf = 0; // staging buffer for degraded output; large enough for a chunk at any level
+uint16_t flags = 0; // DEGRADE_... reductions in effect for the sweep being sent
+digdar::pipeline *output_pipeline = 0; // if output runs as a pipeline stage, the pipeline
+int fill_cpu = -1; // core for the thread which fills the pulse buffer; -1 means any
+int output_cpu = -1; // core for output; -1 means any
+double report_secs = 0; // if > 0, seconds between utilization reports
+int pyramid_port = 0; // if non-zero, TCP port on which the sweep pyramid is served to viewers
+
+/** Most bytes queued to a pyramid viewer; further blocks are skipped until it catches up */
+#define VIEWER_MAX_BACKLOG (8 * 1024 * 1024)
+
+struct viewer {
+  int fd;
+  int level;        // pyramid level being sent; -1 until the viewer asks for one
+  int want_level;   // level most recently asked for; takes effect at the next sweep
+  std::string out;  // bytes waiting to be sent
+  size_t sent;      // bytes at the start of out already sent
+  std::string req;  // partial request line
+};
+
+std::mutex viewers_lock; // guards viewers and the pyramid
+std::vector<viewer *> viewers;
+digdar_stream_header viewer_hdr; // stream header sent to each viewer
+
+void pyramid_emit(const sweep_header *hdr, const char *pulses, void *) {
+  // queue a block of the pyramid to the viewers of its level; viewers_lock is held
+  size_t n = (size_t) hdr->n_pulses * hdr->psize;
+  for (size_t i = 0; i < viewers.size(); ++i) {
+    viewer *v = viewers[i];
+    if (v->level != hdr->level || v->out.size() - v->sent + sizeof(*hdr) + n > VIEWER_MAX_BACKLOG)
+      continue;
+    v->out.append((const char *) hdr, sizeof(*hdr));
+    v->out.append(pulses, n);
+  }
+};
+
+void update_pyramid(const digdar::sweep_view &v) {
+  // add a run of pulses to the pyramid, queueing what it produces to viewers
+  std::lock_guard<std::mutex> g(viewers_lock);
+  if (v.new_sweep)
+    for (size_t i = 0; i < viewers.size(); ++i)
+      viewers[i]->level = viewers[i]->want_level;
+  pyramid_update((const char *) v.first, v.n_pulses, v.new_sweep, pyramid_emit, 0);
+};
+
+bool serve_viewer(viewer *v, short revents) {
+  // read level requests from a viewer, and send it what is queued; viewers_lock is held.
+  // Returns false if the viewer has gone.
+  if (revents & POLLIN) {
+    char buf[64];
+    int m = read(v->fd, buf, sizeof(buf));
+    if (m <= 0)
+      return false;
+    v->req.append(buf, m);
+    size_t eol;
+    while ((eol = v->req.find('\n')) != std::string::npos) {
+      int level = atoi(v->req.c_str());
+      if (level >= 0 && level <= PYRAMID_LEVELS)
+        v->want_level = level;
+      v->req.erase(0, eol + 1);
+    }
+    if (v->req.size() > 16)
+      return false;
+  } else if (revents & (POLLERR | POLLHUP)) {
+    return false;
+  }
+  if (v->sent < v->out.size()) {
+    int m = send(v->fd, v->out.data() + v->sent, v->out.size() - v->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (m < 0 && errno != EAGAIN && errno != EINTR)
+      return false;
+    if (m > 0)
+      v->sent += m;
+    if (v->sent == v->out.size()) {
+      v->out.clear();
+      v->sent = 0;
+    }
+  }
+  return true;
+};
+
+void *viewer_thread(void *arg) {
+  // accept viewers of the pyramid, and serve them
+  int lfd = (int) (long) arg;
+  std::vector<struct pollfd> fds;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> g(viewers_lock);
+      fds.resize(viewers.size() + 1);
+      fds[0].fd = lfd;
+      fds[0].events = POLLIN;
+      for (size_t i = 0; i < viewers.size(); ++i) {
+        fds[i + 1].fd = viewers[i]->fd;
+        fds[i + 1].events = POLLIN | (viewers[i]->sent < viewers[i]->out.size() ? POLLOUT : 0);
+      }
+    }
+    // blocks are queued by the output thread, so don't sleep long before sending them
+    poll(&fds[0], fds.size(), 10);
+    std::lock_guard<std::mutex> g(viewers_lock);
+    for (size_t i = fds.size() - 1; i > 0; --i) {
+      viewer *v = viewers[i - 1];
+      if (! serve_viewer(v, fds[i].revents)) {
+        close(v->fd);
+        delete v;
+        viewers.erase(viewers.begin() + i - 1);
+      }
+    }
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(lfd, 0, 0);
+      if (fd >= 0) {
+        viewer *v = new viewer;
+        v->fd = fd;
+        v->level = v->want_level = -1;
+        v->out.assign((const char *) &viewer_hdr, sizeof(viewer_hdr));
+        v->sent = 0;
+        viewers.push_back(v);
+      }
+    }
+  }
+  return 0;
+};
+
+int start_viewers() {
+  // listen for viewers of the pyramid, and start the thread serving them
+  if (pyramid_init(digdar::max_view_pulses()) < 0)
+    return -1;
+  digdar::get_stream_header(&viewer_hdr);
+  int lfd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(pyramid_port);
+  if (lfd < 0 || bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(lfd, 8) < 0) {
+    fprintf(stderr, "couldn't listen for pyramid viewers on port %d\n", pyramid_port);
+    return -1;
+  }
+  pthread_t thread;
+  if (pthread_create(&thread, 0, viewer_thread, (void *) (long) lfd)) {
+    fprintf(stderr, "couldn't start pyramid viewer thread\n");
+    return -1;
+  }
+  pthread_detach(thread);
+  return 0;
+};
+
+int write_sweep(const digdar::sweep_view &v, void *) {
+  // write one run of pulses from a sweep to the output, degrading it
+  // if output is falling behind.  Returns -1 on write error.
+  char *chunk = (char *) v.first;
+  if (pyramid_port)
+    update_pyramid(v);
+  if (raw_output)
+    return write_fully(outfd, chunk, v.n_pulses * v.psize);
+  // chunks never span sweeps, so each is sent as one block
+  sweep_header sh;
+  sh.magic = DIGDAR_SWEEP_MAGIC;
+  sh.num_arp = v.num_arp;
+  if (v.new_sweep) {
+    // only change degradation level at the start of a sweep
+    int backlog = digdar::chunks_pending() + (output_pipeline ? output_pipeline->chunks_queued() : 0);
+    flags = degrade_update(backlog, digdar::latest_arp() - sh.num_arp);
+  }
+  sh.level = degrade_level();
+  sh.flags = flags;
+  uint32_t n = v.n_pulses * v.psize;
+  if (flags) {
+    n = degrade_pulses(flags, chunk, v.n_pulses, degrade_buf, &sh);
+    chunk = degrade_buf;
+  } else {
+    sh.n_pulses = v.n_pulses;
+    sh.n_samples = n_samples_out;
+    sh.psize = v.psize;
+  }
+  if (sh.n_pulses == 0)
+    return 0;
+  if (write_fully(outfd, (char *) &sh, sizeof(sh)) < 0
+      || write_fully(outfd, chunk, n) < 0)
+    return -1;
+  return 0;
+};
+
+int output_stage(digdar::chunk_handle *batch, uint32_t n, void *) {
+  // pipeline stage which writes a batch of chunks to the output
+  for (uint32_t i = 0; i < n; ++i)
+    if (write_sweep(batch[i].view, 0) < 0)
+      return -1;
+  return 0;
+};
 
 /** Acquire pulses main */
 int main(int argc, char *argv[])
@@ -222,25 +389,36 @@ int main(int argc, char *argv[])
     exit ( EXIT_FAILURE );
   }
 
-  setup_param_name_map();
-
   /* Command line options */
   static struct option long_options[] = {
     /* These options set a flag. */
     {"acps", required_argument, 0, 'a'},
+    {"both", no_argument, 0, 'B'},
+    {"cpus", required_argument, 0, 'c'},
     {"decim", required_argument,       0, 'd'},
+    {"degrade", required_argument,       0, 'G'},
+    {"detect_thresh", required_argument, 0, 'T'},
+    {"dma", required_argument, 0, 'M'},
     {"dump_params", no_argument, 0, 'D'},
+    {"fast", no_argument, 0, 'f'},
+    {"header", no_argument, 0, 'H'},
+    {"interleave", no_argument, 0, 'I'},
     {"samples",      required_argument,       0, 'n'},
     {"sum",      no_argument,       0, 's'},
     {"pulses",       required_argument,       0, 'p'},
     {"param_file",   required_argument,       0, 'P'},
+    {"profile",      required_argument,       0, 'R'},
+    {"pyramid",      required_argument,       0, 'L'},
     {"remove",    required_argument,          0, 'r'},
+    {"replay",    required_argument,          0, 'y'},
+    {"ring",      required_argument,          0, 'k'},
     {"tcp",    required_argument,          0, 't'},
+    {"utilization", required_argument,     0, 'u'},
     {"version",      no_argument,       0, 'v'},
     {"help",         no_argument,       0, 'h'},
     {0, 0, 0, 0}
   };
-  const char *optstring = "aC:d:Dhn:p:P:r:st:v";
+  const char *optstring = "aBc:C:d:DfG:hHIk:L:M:n:p:P:r:R:sT:t:u:vy:";
 
   /* getopt_long stores the option index here. */
   int option_index = 0;
@@ -249,41 +427,96 @@ int main(int argc, char *argv[])
   while ( (ch = getopt_long( argc, argv, optstring, long_options, &option_index )) != -1 ) {
     switch ( ch ) {
     case 'a':
-      acps = atoi(optarg);
+      cfg.acps = atoi(optarg);
+      break;
+
+    case 'B':
+      cfg.n_channels = 2;
+      break;
+
+    case 'c':
+      {
+        char *split = strchr(optarg, ',');
+        if (! split) {
+          usage();
+          exit (EXIT_FAILURE );
+        }
+        fill_cpu = atoi(optarg);
+        output_cpu = atoi(split + 1);
+      };
       break;
 
     case 'C':
-      cut = atof(optarg) * acps;
+      cut = atof(optarg) * cfg.acps;
       break;
 
     case 'd':
-      decim = atoi(optarg);
+      cfg.decim = atoi(optarg);
       break;
 
     case 'D':
       dump_params=true;
       break;
 
+    case 'f':
+      cfg.replay_fast = true;
+      break;
+
+    case 'G':
+      if (degrade_parse_steps(optarg) < 0) {
+        usage();
+        exit( EXIT_FAILURE );
+      }
+      break;
+
     case 'h':
       usage();
       exit( EXIT_SUCCESS );
       break;
 
+    case 'H':
+      raw_output = false;
+      break;
+
+    case 'I':
+      cfg.channel_layout = CHANNEL_LAYOUT_INTERLEAVED;
+      break;
+
+    case 'k':
+      cfg.ring_slots = atoi(optarg);
+      break;
+
+    case 'L':
+      pyramid_port = atoi(optarg);
+      break;
+
+    case 'M':
+      {
+        char *split = strchr(optarg, ':');
+        if (! split) {
+          usage();
+          exit (EXIT_FAILURE );
+        }
+        cfg.dma_phys = strtoul(optarg, 0, 0);
+        cfg.dma_bytes = strtoul(split + 1, 0, 0);
+      };
+      break;
+
     case 'n':
-      n_samples = atoi(optarg);
+      cfg.n_samples = atoi(optarg);
       break;
 
     case 'p':
-      pulse_buff_size = atoi(optarg);
+      cfg.pulses = atoi(optarg);
       break;
 
     case 'P':
-      param_file = std::string(optarg);
+      cfg.param_file = optarg;
       break;
 
     case 'r':
       {
-        if (num_removals == MAX_REMOVALS) {
+        if (cfg.num_removals == MAX_REMOVALS) {
           fprintf(stderr, "Too many removals specified; max is %d\n", MAX_REMOVALS);
           exit( EXIT_FAILURE );
         }
@@ -293,14 +526,30 @@ int main(int argc, char *argv[])
           exit (EXIT_FAILURE );
         }
         *split = '\0';
-        removals[num_removals].begin = atof(optarg) * acps;
-        removals[num_removals].end = atof(split + 1) * acps;
-        ++num_removals;
+        cfg.removals[cfg.num_removals].begin = atof(optarg) * cfg.acps;
+        cfg.removals[cfg.num_removals].end = atof(split + 1) * cfg.acps;
+        ++cfg.num_removals;
       };
       break;
 
+    case 'R':
+      cfg.profile_spec = optarg;
+      break;
+
+    case 'y':
+      cfg.replay_filename = optarg;
+      break;
+
     case 's':
-      use_sum = 1;
+      cfg.use_sum = true;
+      break;
+
+    case 'T':
+      detect_thresh = atoi(optarg);
+      break;
+
+    case 'u':
+      report_secs = atof(optarg);
       break;
 
     case 't':
@@ -363,121 +612,80 @@ int main(int argc, char *argv[])
     }
   }
 
-  switch(decim) {
-  case 1:
-  case 2:
-  case 3:
-  case 4:
-  case 8:
-  case 64:
-  case 1024:
-  case 8192:
-  case 65536:
-    break;
-  default:
-    fprintf(stderr, "incorrect value (%d) for decimation; must be 1, 2, 3, 4, 8, 64, 1024, 8192, or 65536\n", decim);
+  // output runs as a pipeline stage, which holds chunks
+  if (cfg.dma_bytes && (fill_cpu >= 0 || output_cpu >= 0 || report_secs > 0)) {
+    fprintf(stderr, "--dma can't be used with --cpus or --utilization, since the DMA engine can only skip the one chunk being read\n");
     return -1;
   }
 
-  t_params[DECIM_FACTOR_PARAM] = decim;
-
-  if (n_samples > 16384 || n_samples < 0) {
-    fprintf(stderr, "incorrect value (%d) for samples per pulse; must be 0..16384\n", n_samples);
+  if (raw_output && cfg.profile_spec) {
+    fprintf(stderr, "--profile requires --header, since clients couldn't otherwise reconstruct range\n");
     return -1;
   }
 
-  if (use_sum && decim > 4) {
-    fprintf(stderr, "warning cannot specify --sum when decimation rate is > 4; ignoring\n");
-    use_sum = false;
-  }
+  if (digdar::open(cfg) < 0)
+    return -1;
 
-  if (outfd == -1) {
-    outfd = fileno(stdout);
+  if (n_channels == 2 && raw_output) {
+    fprintf(stderr, "--both requires --header, since clients couldn't otherwise tell the channels apart\n");
+    return -1;
   }
 
-  /* Standard radar triggering mode */
-  t_params[TRIG_MODE_PARAM] = 1;
-  t_params[TRIG_SRC_PARAM] = 10;
-
-  /* Initialization of Oscilloscope application */
-  if(rp_app_init() < 0) {
-    fprintf(stderr, "rp_app_init() failed!\n");
+  if (num_degrade_steps > 0 && raw_output) {
+    fprintf(stderr, "--degrade requires --header, since there would otherwise be no sweep headers to indicate degradation\n");
     return -1;
   }
 
-  if (param_file.size() > 0) {
-    std::ifstream pin (param_file);
-    std::string name;
-    uint32_t val;
-    for (;;) {
-      if (! (pin >> name))
-        break;
-      if (name[0] == '#') {
-        // comment: skip rest of line
-        pin.ignore(100000, '\n');
-        continue;
-      }
-      pin >> val;
-      set_param(name, val);
-    };
+  if (outfd == -1) {
+    outfd = fileno(stdout);
   }
 
-  if (dump_params) {
-    for (auto i = name_map.begin(); i != name_map.end(); ++i) {
-      std::cout << i->first << ' ' << get_param(i->first) << std::endl;
-    }
+  if (dump_params && ! cfg.replay_filename) {
+    for (int i = 0; i < DIGDAR_NUM_REGS; ++i)
+      printf("%s %llu\n", digdar_regs[i].name, (unsigned long long) digdar::get_param(digdar_regs[i].name));
     exit(0);
   };
 
-
-  /* Setting of parameters in Oscilloscope main module */
-
-  if(rp_set_params((float *)&t_params, PARAMS_NUM) < 0) {
-    fprintf(stderr, "rp_set_params() failed!\n");
-    return -1;
+  if (num_degrade_steps > 0) {
+    degrade_buf = (char *) malloc(digdar::max_view_pulses() * MAX(psize, degrade_psize(DEGRADE_DETECTIONS_ONLY)));
+    if (!degrade_buf) {
+      fprintf(stderr, "couldn't allocate chunk buffers\n");
+      return -1;
+    }
   }
 
-  /* storage for one pulse, in bytes */
-  psize = sizeof(pulse_metadata) + sizeof(uint16_t) * (n_samples - 1);
-
-  /* maximum number of pulses allowed for pulse buffer */
-  uint32_t max_pulses = max_pulse_buffer_memory / psize;
-  if (pulse_buff_size == 0 || pulse_buff_size > max_pulses)
-    pulse_buff_size = max_pulses;
-
-
-  pulse_buffer = (pulse_metadata *) calloc(pulse_buff_size, psize);
-  if (!pulse_buffer) {
-    fprintf(stderr, "couldn't allocate pulse buffer\n");
+  if (pyramid_port && start_viewers() < 0)
     return -1;
-  }
 
-  // start worker thread which captures to pulse buffer
-
-  rp_osc_worker_change_state(rp_osc_start_state);
+  if (! raw_output) {
+    digdar_stream_header hdr;
+    digdar::get_stream_header(&hdr);
+    if (write_fully(outfd, (char *) &hdr, sizeof(hdr)) < 0) {
+      fprintf(stderr, "couldn't write stream header\n");
+      return -1;
+    }
+  }
 
-  uint32_t cur_pulse = 0; // index of first chunk pulse in ring buffer
-  uint32_t num_pulses = 0; // number of pulses availabe in ring buffer (maxes out to max_pulses)
+  if (fill_cpu < 0 && output_cpu < 0 && report_secs <= 0) {
+    digdar::set_sweep_callback(write_sweep, 0);
+    return digdar::run();
+  }
 
-  /* Continuous thread loop (exited only with 'quit' state) */
-  while(1) {
-    if (! rp_osc_get_chunk_for_reader(& cur_pulse, & num_pulses)) {
-      usleep(20);
-      sched_yield();
-      continue;
+  output_pipeline = new digdar::pipeline();
+  output_pipeline->set_capture_cpus(fill_cpu, output_cpu);
+  output_pipeline->add_stage("output", output_stage, 0, output_cpu, 4);
+  if (output_pipeline->start() < 0)
+    return -1;
+  double next_report = now() + report_secs;
+  while (output_pipeline->running()) {
+    usleep(100000);
+    if (report_secs > 0 && now() >= next_report) {
+      output_pipeline->report(stderr);
+      next_report += report_secs;
     }
-    int n = num_pulses * psize;
-    int offset = 0;
-    int m;
-    do {
-      m = write(outfd, ((char *) pulse_buffer) + cur_pulse * psize + offset, n);
-      if (m < 0)
-        break;
-      n -= m;
-      offset += m;
-    } while (n > 0);
-    if (m < 0)
-      break;
   }
+  output_pipeline->stop();
+  if (report_secs > 0)
+    output_pipeline->report(stderr);
   return 0;
 }
@@ -10,6 +10,7 @@
 #define _DIGDAR_H_
 
 #include "pulse_metadata.h"
+#include "stream_header.h"
 
 
 #endif /* _DIGDAR_H_ */
@@ -57,9 +57,6 @@
 /** The FPGA register structure (defined in fpga_osc.h) */
 osc_fpga_reg_mem_t *g_osc_fpga_reg_mem = NULL;
 
-/* @brief Pointer to FPGA digdar control registers. */
-digdar_fpga_reg_mem_t *g_digdar_fpga_reg_mem = NULL;
-
 /** The FPGA input signal buffer pointer for channel A */
 uint32_t           *g_osc_fpga_cha_mem = NULL;
 /** The FPGA input signal buffer pointer for channel B */
@@ -70,6 +67,18 @@ uint32_t           *g_osc_fpga_xcha_mem = NULL;
 /** The FPGA input signal buffer pointer for slow channel B */
 uint32_t           *g_osc_fpga_xchb_mem = NULL;
 
+/** The FPGA pulse header block */
+volatile digdar_pulse_hdr_t *g_osc_fpga_hdr_mem = NULL;
+/** The FPGA pulse headers for each slot of the pulse ring */
+volatile digdar_pulse_hdr_t *g_osc_fpga_ring_hdr_mem = NULL;
+
+/** The DDR region reserved for DMA: the header ring, followed by the pulse slot ring */
+char           *g_osc_fpga_dma_mem = NULL;
+/** Physical address of g_osc_fpga_dma_mem */
+uint32_t        g_osc_fpga_dma_phys = 0;
+/** Size of g_osc_fpga_dma_mem, in bytes */
+uint32_t        g_osc_fpga_dma_bytes = 0;
+
 /** The memory file descriptor used to mmap() the FPGA space */
 int             g_osc_fpga_mem_fd = -1;
 
@@ -115,6 +124,14 @@ int __osc_fpga_cleanup_mem(void)
             g_osc_fpga_xcha_mem = NULL;
         if(g_osc_fpga_xchb_mem)
             g_osc_fpga_xchb_mem = NULL;
+        if(g_osc_fpga_hdr_mem)
+            g_osc_fpga_hdr_mem = NULL;
+        if(g_osc_fpga_ring_hdr_mem)
+            g_osc_fpga_ring_hdr_mem = NULL;
+    }
+    if(g_osc_fpga_dma_mem) {
+        munmap(g_osc_fpga_dma_mem, g_osc_fpga_dma_bytes);
+        g_osc_fpga_dma_mem = NULL;
     }
     if(g_osc_fpga_mem_fd >= 0) {
         close(g_osc_fpga_mem_fd);
@@ -183,18 +200,11 @@ int osc_fpga_init(void)
     g_osc_fpga_xchb_mem = (uint32_t *)g_osc_fpga_reg_mem +
         (OSC_FPGA_XCHB_OFFSET / sizeof(uint32_t));
 
-    page_addr = DIGDAR_FPGA_BASE_ADDR & (~(page_size-1));
-    page_off  = DIGDAR_FPGA_BASE_ADDR - page_addr;
+    g_osc_fpga_hdr_mem = (digdar_pulse_hdr_t *) ((uint32_t *)g_osc_fpga_reg_mem +
+        (OSC_FPGA_HDR_OFFSET / sizeof(uint32_t)));
 
-    page_ptr = mmap(NULL, DIGDAR_FPGA_BASE_SIZE, PROT_READ | PROT_WRITE,
-                          MAP_SHARED, g_osc_fpga_mem_fd, page_addr);
-
-    if((void *)page_ptr == MAP_FAILED) {
-        fprintf(stderr, "mmap() failed: %s\n", strerror(errno));
-        __osc_fpga_cleanup_mem();
-        return -1;
-    }
-    g_digdar_fpga_reg_mem = page_ptr + page_off;
+    g_osc_fpga_ring_hdr_mem = (digdar_pulse_hdr_t *) ((uint32_t *)g_osc_fpga_reg_mem +
+        (OSC_FPGA_RING_HDR_OFFSET / sizeof(uint32_t)));
 
     return 0;
 }
@@ -212,6 +222,8 @@ int osc_fpga_exit(void)
   //    if(g_osc_fpga_reg_mem)
     /* tell FPGA to stop packing slow ADC values into upper 16 bits of CHA, CHB */
       //      *(int *)(OSC_FPGA_SLOW_ADC_OFFSET + (char *) g_osc_fpga_reg_mem) = 0;
+    /* the FPGA re-arms DMA on its own, so stop it before the pulse ring goes away */
+    osc_fpga_dma_stop();
     return __osc_fpga_cleanup_mem();
 }
 
@@ -364,3 +376,275 @@ int osc_fpga_get_wr_ptr(int *wr_ptr_curr, int *wr_ptr_trig)
         *wr_ptr_trig = g_osc_fpga_reg_mem->wr_ptr_trigger;
     return 0;
 }
+
+/** @brief Copies a pulse header out of FPGA memory.
+ *
+ * The header is read a word at a time, in order, so that seq is read
+ * first and seq_end last; memcpy() guarantees no order.  If the two
+ * match, no latch happened during the read.
+ *
+ * @param [in] src the header in FPGA memory
+ * @param [out] hdr destination for the pulse header
+ *
+ * @retval 0 Success
+ * @retval -1 Failure; the header was being rewritten during the read.
+ */
+static int __osc_fpga_copy_pulse_hdr(const volatile digdar_pulse_hdr_t *src,
+                                     digdar_pulse_hdr_t *hdr)
+{
+    const volatile uint32_t *from = (const volatile uint32_t *) src;
+    uint32_t *to = (uint32_t *) hdr;
+    unsigned int i;
+    for (i = 0; i < sizeof(*hdr) / sizeof(uint32_t); ++i)
+        to[i] = from[i];
+    return hdr->seq == hdr->seq_end ? 0 : -1;
+}
+
+/** @brief Copies the pulse header block for the most recently captured pulse.
+ *
+ * The block is read in one pass; if the FPGA latched another pulse's
+ * header during the read, it is read again.
+ *
+ * @param [out] hdr destination for the pulse header
+ *
+ * @retval 0 Success
+ * @retval -1 Failure; the header kept changing during the read.
+ */
+int osc_fpga_get_pulse_hdr(digdar_pulse_hdr_t *hdr)
+{
+    int tries;
+    for (tries = 0; tries < 3; ++tries) {
+        if (__osc_fpga_copy_pulse_hdr(g_osc_fpga_hdr_mem, hdr) == 0)
+            return 0;
+    }
+    return -1;
+}
+
+/** @brief Returns a pointer to the register at a byte offset in the digdar FPGA block.
+ *
+ * @param [in] offset one of the OFFSET_* or OSC_FPGA_*_OFFSET constants
+ */
+volatile uint32_t *osc_fpga_reg(uint32_t offset)
+{
+    return (volatile uint32_t *)((char *)g_osc_fpga_reg_mem + offset);
+}
+
+/** @brief Reads a register described in generated_regmap.h.
+ *
+ * A 64-bit register is read high, low, high, and re-read if the high
+ * half changed, so the halves are consistent.
+ *
+ * @param [in] reg the register
+ *
+ * @retval the register's value
+ */
+uint64_t osc_fpga_get_reg(const digdar_reg_t *reg)
+{
+    volatile uint32_t *p = osc_fpga_reg(reg->offset);
+    if (reg->width == 32)
+        return *p;
+    uint32_t hi, lo;
+    do {
+        hi = p[1];
+        lo = p[0];
+    } while (hi != p[1]);
+    return ((uint64_t) hi << 32) | lo;
+}
+
+/** @brief Writes a register described in generated_regmap.h.
+ *
+ * @param [in] reg the register; must be writable and 32 bits wide
+ * @param [in] value the value to write
+ *
+ * @retval 0 Success
+ * @retval -1 Failure; the register isn't a writable 32-bit register
+ */
+int osc_fpga_set_reg(const digdar_reg_t *reg, uint32_t value)
+{
+    if (reg->width != 32 || ! (reg->access & DIGDAR_REG_WO))
+        return -1;
+    *osc_fpga_reg(reg->offset) = value;
+    return 0;
+}
+
+/** @brief Sets up the FPGA pulse ring.
+ *
+ * Divides the FPGA sample buffers into slots of one pulse each; once armed,
+ * the FPGA captures successive pulses into successive slots, re-arming
+ * itself after each one.  This also resets the produced and dropped counts,
+ * and the consumed count.
+ *
+ * @param [in] slots number of slots, up to OSC_FPGA_RING_MAX_SLOTS; 0 turns
+ *             off the ring, so that each pulse must be armed for by software.
+ *
+ * @retval 0 Success
+ * @retval -1 Failure; too many slots.
+ */
+int osc_fpga_ring_init(uint32_t slots)
+{
+    if (slots > OSC_FPGA_RING_MAX_SLOTS)
+        return -1;
+    *osc_fpga_reg(OSC_FPGA_RING_CONS_OFFSET) = 0;
+    *osc_fpga_reg(OSC_FPGA_RING_SLOTS_OFFSET) = slots;
+    return 0;
+}
+
+/** @brief Returns the number of pulses the FPGA has captured into the ring since it was set up. */
+uint32_t osc_fpga_ring_get_produced(void)
+{
+    return *osc_fpga_reg(OSC_FPGA_RING_PROD_OFFSET);
+}
+
+/** @brief Tells the FPGA how many pulses have been copied out of the ring, freeing their slots.
+ *
+ * @retval 0 Always returns 0.
+ */
+int osc_fpga_ring_set_consumed(uint32_t consumed)
+{
+    *osc_fpga_reg(OSC_FPGA_RING_CONS_OFFSET) = consumed;
+    return 0;
+}
+
+/** @brief Returns the number of pulses the FPGA dropped because the ring was full. */
+uint32_t osc_fpga_ring_get_dropped(void)
+{
+    return *osc_fpga_reg(OSC_FPGA_RING_DROPPED_OFFSET);
+}
+
+/** @brief Copies the pulse header for one slot of the ring.
+ *
+ * @param [in] slot slot number
+ * @param [out] hdr destination for the pulse header
+ *
+ * @retval 0 Success
+ * @retval -1 Failure; the header was being rewritten during the read.
+ */
+int osc_fpga_ring_get_slot_hdr(uint32_t slot, digdar_pulse_hdr_t *hdr)
+{
+    return __osc_fpga_copy_pulse_hdr(&g_osc_fpga_ring_hdr_mem[slot], hdr);
+}
+
+/** @brief Maps the DDR region reserved for DMA of pulses.
+ *
+ * The region must have been withheld from Linux (e.g. with a reserved-memory
+ * node in the device tree, or mem= on the kernel command line), since the
+ * FPGA writes to it without the kernel's knowledge.  It is mapped
+ * uncached, so software always sees what the FPGA has written.  The first
+ * OSC_FPGA_DMA_HDR_SLOTS * sizeof(digdar_dma_hdr_t) bytes hold the header
+ * ring; the rest holds the pulse slots.
+ *
+ * Must be called after osc_fpga_init().
+ *
+ * @param [in] phys physical address of the region; must be page-aligned
+ * @param [in] bytes size of the region
+ *
+ * @retval pointer to the first pulse slot, or NULL on failure
+ */
+void *osc_fpga_dma_map(uint32_t phys, uint32_t bytes)
+{
+    uint32_t hdr_bytes = OSC_FPGA_DMA_HDR_SLOTS * sizeof(digdar_dma_hdr_t);
+    if (g_osc_fpga_mem_fd < 0 || (phys & (sysconf(_SC_PAGESIZE) - 1)) || bytes <= hdr_bytes) {
+        fprintf(stderr, "bad DMA region %08x:%08x\n", phys, bytes);
+        return NULL;
+    }
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, g_osc_fpga_mem_fd, phys);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "mmap() of DMA region failed: %s\n", strerror(errno));
+        return NULL;
+    }
+    g_osc_fpga_dma_mem = p;
+    g_osc_fpga_dma_phys = phys;
+    g_osc_fpga_dma_bytes = bytes;
+    return g_osc_fpga_dma_mem + hdr_bytes;
+}
+
+/** @brief Starts DMA of pulses into the mapped DDR region.
+ *
+ * The pulse slot ring is laid out exactly as the pulse buffer: num_chunks
+ * chunks of chunk_size slots of stride bytes each.  Once armed, the FPGA
+ * writes each pulse into the next slot, starts a new chunk when the
+ * current one is full or at a new ARP, and re-arms itself.
+ *
+ * @param [in] stride bytes per pulse; a multiple of 8
+ * @param [in] chunk_size pulses per chunk
+ * @param [in] num_chunks chunks in the ring
+ *
+ * @retval 0 Success
+ * @retval -1 Failure; the region isn't mapped or is too small.
+ */
+int osc_fpga_dma_init(uint32_t stride, uint32_t chunk_size, uint32_t num_chunks)
+{
+    uint32_t hdr_bytes = OSC_FPGA_DMA_HDR_SLOTS * sizeof(digdar_dma_hdr_t);
+    if (! g_osc_fpga_dma_mem || (stride & 7)
+        || (uint64_t) stride * chunk_size * num_chunks > g_osc_fpga_dma_bytes - hdr_bytes)
+        return -1;
+    *osc_fpga_reg(OSC_FPGA_DMA_DATA_BASE_OFFSET)   = g_osc_fpga_dma_phys + hdr_bytes;
+    *osc_fpga_reg(OSC_FPGA_DMA_STRIDE_OFFSET)      = stride;
+    *osc_fpga_reg(OSC_FPGA_DMA_CHUNK_SIZE_OFFSET)  = chunk_size;
+    *osc_fpga_reg(OSC_FPGA_DMA_NUM_CHUNKS_OFFSET)  = num_chunks;
+    *osc_fpga_reg(OSC_FPGA_DMA_CHUNK_BYTES_OFFSET) = chunk_size * stride;
+    *osc_fpga_reg(OSC_FPGA_DMA_READ_CHUNK_OFFSET)  = 0xffffffff;
+    *osc_fpga_reg(OSC_FPGA_DMA_HDR_BASE_OFFSET)    = g_osc_fpga_dma_phys;
+    *osc_fpga_reg(OSC_FPGA_DMA_HDR_MASK_OFFSET)    = OSC_FPGA_DMA_HDR_SLOTS - 1;
+    // enabling restarts the engine, so this must come last
+    *osc_fpga_reg(OSC_FPGA_DMA_CTRL_OFFSET)        = 1;
+    return 0;
+}
+
+/** @brief Stops DMA of pulses.
+ *
+ * Safe to call when DMA was never started, or the registers aren't mapped.
+ *
+ * @retval 0 Always returns 0.
+ */
+int osc_fpga_dma_stop(void)
+{
+    if (g_osc_fpga_reg_mem)
+        *osc_fpga_reg(OSC_FPGA_DMA_CTRL_OFFSET) = 0;
+    return 0;
+}
+
+/** @brief Returns the number of pulses completely written to DDR since DMA was started. */
+uint32_t osc_fpga_dma_get_produced(void)
+{
+    return *osc_fpga_reg(OSC_FPGA_DMA_PROD_OFFSET);
+}
+
+/** @brief Returns the number of pulses the DMA engine dropped because it was still writing the previous one. */
+uint32_t osc_fpga_dma_get_dropped(void)
+{
+    return *osc_fpga_reg(OSC_FPGA_DMA_DROPPED_OFFSET);
+}
+
+/** @brief Returns the number of AXI write errors and FIFO overflows seen by the DMA engine. */
+uint32_t osc_fpga_dma_get_errors(void)
+{
+    return *osc_fpga_reg(OSC_FPGA_DMA_ERRORS_OFFSET);
+}
+
+/** @brief Returns the chunk the DMA engine is writing pulses into, or last wrote one into. */
+int16_t osc_fpga_dma_get_chunk(void)
+{
+    return (int16_t) *osc_fpga_reg(OSC_FPGA_DMA_CHUNK_OFFSET);
+}
+
+/** @brief Tells the DMA engine which chunk is being read, so it isn't overwritten.
+ *
+ * @param [in] chunk the chunk; -1 means none
+ *
+ * @retval 0 Always returns 0.
+ */
+int osc_fpga_dma_set_read_chunk(int16_t chunk)
+{
+    *osc_fpga_reg(OSC_FPGA_DMA_READ_CHUNK_OFFSET) = (uint32_t) (int32_t) chunk;
+    return 0;
+}
+
+/** @brief Returns the header record for the nth pulse written since DMA was started.
+ *
+ * Only the most recent OSC_FPGA_DMA_HDR_SLOTS records are kept.
+ */
+const volatile digdar_dma_hdr_t *osc_fpga_dma_get_hdr(uint32_t n)
+{
+    return ((const volatile digdar_dma_hdr_t *) g_osc_fpga_dma_mem) + (n & (OSC_FPGA_DMA_HDR_SLOTS - 1));
+}
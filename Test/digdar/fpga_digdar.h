@@ -27,7 +27,7 @@
 /** Starting address of FPGA registers handling Oscilloscope module. */
 #define OSC_FPGA_BASE_ADDR 	0x40100000
 /** The size of FPGA registers handling Oscilloscope module. */
-#define OSC_FPGA_BASE_SIZE 0x50000
+#define OSC_FPGA_BASE_SIZE 0x61000
 /** Size of data buffer into which input signal is captured , must be 2^n!. */
 #define OSC_FPGA_SIG_LEN   (16*1024)
 
@@ -55,35 +55,48 @@
 #define OSC_FPGA_XCHA_OFFSET   0x30000
 /** Offset to the memory buffer where signal on slow channel B is captured. */
 #define OSC_FPGA_XCHB_OFFSET   0x40000
+/** Offset to the pulse header block, latched by the FPGA for each captured pulse. */
+#define OSC_FPGA_HDR_OFFSET    0x50000
+/** Offset to the pulse headers for each slot of the pulse ring; each is a digdar_pulse_hdr_t. */
+#define OSC_FPGA_RING_HDR_OFFSET 0x60000
 
-
-/** Starting address of FPGA registers handling the Digdar module. */
-#define DIGDAR_FPGA_BASE_ADDR 	0x40600000
-/** The size of FPGA register block handling the Digdar module. */
-#define DIGDAR_FPGA_BASE_SIZE 0x0000B8
-
-/** The offsets to the metadata (read-only-by client) in the FPGA register block
-    Must match values in red_pitaya_digdar.v from FPGA project
+/** Offsets to the pulse ring registers.
+    Must match OFFSET_Ring* in red_pitaya_digdar.v from FPGA project
  */
-
-#define OFFSET_SAVED_TRIG_COUNT           0x00068 // (saved) TRIG count since reset (32 bits; wraps)
-#define OFFSET_SAVED_TRIG_CLOCK_LOW       0x0006C // (saved) clock at most recent TRIG (low 32 bits)
-#define OFFSET_SAVED_TRIG_CLOCK_HIGH      0x00070 // (saved) clock at most recent TRIG (high 32 bits)
-#define OFFSET_SAVED_TRIG_PREV_CLOCK_LOW  0x00074 // (saved) clock at previous TRIG (low 32 bits)
-#define OFFSET_SAVED_TRIG_PREV_CLOCK_HIGH 0x00078 // (saved) clock at previous TRIG (high 32 bits)
-#define OFFSET_SAVED_ACP_COUNT            0x0007C // (saved) ACP count since reset (32 bits; wraps)
-#define OFFSET_SAVED_ACP_CLOCK_LOW        0x00080 // (saved) clock at most recent ACP (low 32 bits)
-#define OFFSET_SAVED_ACP_CLOCK_HIGH       0x00084 // (saved) clock at most recent ACP (high 32 bits)
-#define OFFSET_SAVED_ACP_PREV_CLOCK_LOW   0x00088 // (saved) clock at previous ACP (low 32 bits)
-#define OFFSET_SAVED_ACP_PREV_CLOCK_HIGH  0x0008C // (saved) clock at previous ACP (high 32 bits)
-#define OFFSET_SAVED_ARP_COUNT            0x00090 // (saved) ARP count since reset (32 bits; wraps)
-#define OFFSET_SAVED_ARP_CLOCK_LOW        0x00094 // (saved) clock at most recent ARP (low 32 bits)
-#define OFFSET_SAVED_ARP_CLOCK_HIGH       0x00098 // (saved) clock at most recent ARP (high 32 bits)
-#define OFFSET_SAVED_ARP_PREV_CLOCK_LOW   0x0009C // (saved) clock at previous ARP (low 32 bits)
-#define OFFSET_SAVED_ARP_PREV_CLOCK_HIGH  0x000A0 // (saved) clock at previous ARP (high 32 bits)
-#define OFFSET_SAVED_ACP_PER_ARP          0x000A4 // (saved) count of ACP pulses between two most recent ARP pulses
-#define OFFSET_ACP_AT_ARP                 0x000B8 // most recent ACP count at ARP pulse
-#define OFFSET_SAVED_ACP_AT_ARP           0x000BC // (saved) most recent ACP count at ARP pulse
+#define OSC_FPGA_RING_SLOTS_OFFSET   0x00100 // number of pulse slots in the sample buffers; 0 means single-shot capture; writing resets the ring
+#define OSC_FPGA_RING_PROD_OFFSET    0x00104 // number of pulses captured into the ring since it was reset (read-only)
+#define OSC_FPGA_RING_CONS_OFFSET    0x00108 // number of pulses software has copied out of the ring
+#define OSC_FPGA_RING_DROPPED_OFFSET 0x0010C // number of pulses dropped because the ring was full (read-only)
+/** Maximum number of slots in the pulse ring */
+#define OSC_FPGA_RING_MAX_SLOTS  64
+
+/** Offsets to the DMA registers.
+    Must match OFFSET_Dma* in red_pitaya_digdar.v from FPGA project
+ */
+#define OSC_FPGA_DMA_CTRL_OFFSET        0x00110 // bit 0 enables DMA of each pulse to DDR; writing restarts the DMA engine
+#define OSC_FPGA_DMA_DATA_BASE_OFFSET   0x00114 // physical address of the pulse slot ring
+#define OSC_FPGA_DMA_STRIDE_OFFSET      0x00118 // bytes per pulse slot; a multiple of 8
+#define OSC_FPGA_DMA_CHUNK_SIZE_OFFSET  0x0011C // pulse slots per chunk
+#define OSC_FPGA_DMA_NUM_CHUNKS_OFFSET  0x00120 // chunks in the pulse slot ring
+#define OSC_FPGA_DMA_CHUNK_BYTES_OFFSET 0x00124 // chunk size * stride
+#define OSC_FPGA_DMA_READ_CHUNK_OFFSET  0x00128 // chunk being read by software, which the DMA engine skips
+#define OSC_FPGA_DMA_HDR_BASE_OFFSET    0x0012C // physical address of the header record ring
+#define OSC_FPGA_DMA_HDR_MASK_OFFSET    0x00130 // header record slots - 1
+#define OSC_FPGA_DMA_PROD_OFFSET        0x00134 // pulses completely written to DDR since restart (read-only)
+#define OSC_FPGA_DMA_DROPPED_OFFSET     0x00138 // pulses dropped because the previous one was still being written (read-only)
+#define OSC_FPGA_DMA_ERRORS_OFFSET      0x0013C // AXI write errors and FIFO overflows (read-only)
+#define OSC_FPGA_DMA_CHUNK_OFFSET       0x00140 // chunk the DMA engine is writing, or last wrote (read-only)
+/** Number of records in the DMA header ring; must be a power of 2 */
+#define OSC_FPGA_DMA_HDR_SLOTS  1024
+/** Bytes of software metadata at the start of each DMA pulse slot; must match META in red_pitaya_digdar_dma.v */
+#define OSC_FPGA_DMA_META       24
+
+
+/** Offsets and descriptors of the registers in the digdar FPGA block
+    (which starts at OSC_FPGA_BASE_ADDR), generated from the FPGA project
+    by gen_regmap.sh
+ */
+#include "generated_regmap.h"
 
 /** Hysteresis register default setting */
 
@@ -243,293 +256,49 @@ typedef struct osc_fpga_reg_mem_s {
      * 0x20000 and are each 16k samples long */
 } osc_fpga_reg_mem_t;
 
-typedef struct digdar_fpga_reg_mem_s {
-
-  // --------------- TRIG -----------------
-
-    /** @brief  trig_thresh_excite: trigger excitation threshold
-     *          Trigger is raised for one FPGA clock after trigger channel
-     *          ADC value meets or exceeds this value (in direction away
-     *          from trig_thresh_relax).
-     * bits [13: 0] - threshold, signed
-     * bit  [31:14] - reserved
-     */
-    uint32_t trig_thresh_excite;
-
-    /** @brief  trig_thresh_relax: trigger relaxation threshold
-     *          After a trigger has been raised, the trigger channel ADC value
-     *          must meet or exceeds this value (in direction away
-     *          from trig_thresh_excite) before a trigger will be raised again.
-     *          (Serves to debounce signal in schmitt-trigger style).
-     * bits [13: 0] - threshold, signed
-     * bit  [31:14] - reserved
-     */
-  uint32_t trig_thresh_relax;
-
-    /** @brief  trig_delay: (traditional) trigger delay.
-     *          How long to wait after trigger is raised
-     *          before starting to capture samples from Video channel.
-     *          Note: this usage of 'delay' is traditional for radar digitizing
-     *          but differs from the red pitaya scope usage, which means
-     *          "number of decimated ADC samples to acquire after trigger is raised"
-     * bits [31: 0] - unsigned wait time, in ADC clocks.
-     */
-  uint32_t trig_delay;
-
-    /** @brief  trig_latency: how long to wait after trigger relaxation before
-     *          allowing next excitation.
-     *          To further debounce the trigger signal, we can specify a minimum
-     *          wait time between relaxation and excitation.
-     * bits [31: 0] - unsigned latency time, in ADC clocks.
-     */
-  uint32_t trig_latency;
-
-    /** @brief  trig_count: number of trigger pulses detected since last reset
-     * bits [31: 0] - unsigned count of trigger pulses detected
-     */
-  uint32_t trig_count;
-
-    /** @brief  trig_clock_low: ADC clock count at last trigger pulse
-     * bits [31: 0] - unsigned (low 32 bits) of ADC clock count
-     */
-  uint32_t trig_clock_low;
-
-    /** @brief  trig_clock_high: ADC clock count at last trigger pulse
-     * bits [31: 0] - unsigned (high 32 bits) of ADC clock count
-     */
-  uint32_t trig_clock_high;
-
-    /** @brief  trig_prev_clock_low: ADC clock count at previous trigger pulse,
-     *          so we can calculate trigger rate, regardless of capture rate
-     * bits [31: 0] - unsigned (low 32 bits) of ADC clock count
-     */
-  uint32_t trig_prev_clock_low;
-
-    /** @brief  trig_prev_clock_high: ADC clock count at previous trigger pulse
-     * bits [31: 0] - unsigned (high 32 bits) of ADC clock count
-     */
-  uint32_t trig_prev_clock_high;
-
-  // --------------- ACP -----------------
-
-    /** @brief  acp_thresh_excite: acp excitation threshold
-     *          the acp pulse is detected and counted when the ACP slow ADC
-     *          channel meets or exceeds this value in the direction away
-     *          from acp_thresh_relax
-     * bits [11: 0] - threshold, signed
-     * bit  [31:14] - reserved
-     */
-
-    uint32_t acp_thresh_excite;
-
-    /** @brief  acp_thresh_relax: acp relaxation threshold
-     *          After an acp has been detected, the acp channel ADC value
-     *          must meet or exceeds this value (in direction away
-     *          from acp_thresh_excite) before a acp will be detected again.
-     *          (Serves to debounce signal in schmitt-acp style).
-     * bits [11: 0] - threshold, signed
-     * bit  [31:14] - reserved
-     */
-  uint32_t acp_thresh_relax;
-
-    /** @brief  acp_latency: how long to wait after acp relaxation before
-     *          allowing next excitation.
-     *          To further debounce the acp signal, we can specify a minimum
-     *          wait time between relaxation and excitation.
-     * bits [31: 0] - unsigned latency time, in ADC clocks.
-     */
-  uint32_t acp_latency;
-
-    /** @brief  acp_count: number of acp pulses detected since last reset
-     * bits [31: 0] - unsigned count of acp pulses detected
-     */
-  uint32_t acp_count;
-
-    /** @brief  acp_clock_low: ADC clock count at last acp pulse
-     * bits [31: 0] - unsigned (low 32 bits) of ADC clock count
-     */
-  uint32_t acp_clock_low;
-
-    /** @brief  acp_clock_high: ADC clock count at last acp pulse
-     * bits [31: 0] - unsigned (high 32 bits) of ADC clock count
-     */
-  uint32_t acp_clock_high;
-
-    /** @brief  acp_prev_clock_low: ADC clock count at previous acp pulse,
-     *          so we can calculate acp rate, regardless of capture rate
-     * bits [31: 0] - unsigned (low 32 bits) of ADC clock count
-     */
-  uint32_t acp_prev_clock_low;
-
-    /** @brief  acp_prev_clock_high: ADC clock count at previous acp pulse
-     * bits [31: 0] - unsigned (high 32 bits) of ADC clock count
-     */
-  uint32_t acp_prev_clock_high;
-
-  // --------------- ARP -----------------
-
-    /** @brief  arp_thresh_excite: arp excitation threshold
-     *          the arp pulse is detected and counted when the ARP slow ADC
-     *          channel meets or exceeds this value in the direction away
-     *          from arp_thresh_relax
-     * bits [11: 0] - threshold, signed
-     * bit  [31:14] - reserved
-     */
-
-    uint32_t arp_thresh_excite;
-
-    /** @brief  arp_thresh_relax: arp relaxation threshold
-     *          After an arp has been detected, the arp channel ADC value
-     *          must meet or exceeds this value (in direction away
-     *          from arp_thresh_excite) before a arp will be detected again.
-     *          (Serves to debounce signal in schmitt-arp style).
-     * bits [11: 0] - threshold, signed
-     * bit  [31:14] - reserved
-     */
-  uint32_t arp_thresh_relax;
-
-    /** @brief  arp_latency: how long to wait after arp relaxation before
-     *          allowing next excitation.
-     *          To further debounce the arp signal, we can specify a minimum
-     *          wait time between relaxation and excitation.
-     * bits [31: 0] - unsigned latency time, in ADC clocks.
-     */
-  uint32_t arp_latency;
-
-    /** @brief  arp_count: number of arp pulses detected since last reset
-     * bits [31: 0] - unsigned count of arp pulses detected
-     */
-  uint32_t arp_count;
-
-    /** @brief  arp_clock_low: ADC clock count at last arp pulse
-     * bits [31: 0] - unsigned (low 32 bits) of ADC clock count
-     */
-  uint32_t arp_clock_low;
-
-    /** @brief  arp_clock_high: ADC clock count at last arp pulse
-     * bits [31: 0] - unsigned (high 32 bits) of ADC clock count
-     */
-  uint32_t arp_clock_high;
-
-    /** @brief  arp_prev_clock_low: ADC clock count at previous arp pulse,
-     *          so we can calculate arp rate, regardless of capture rate
-     * bits [31: 0] - unsigned (low 32 bits) of ADC clock count
-     */
-  uint32_t arp_prev_clock_low;
-
-    /** @brief  arp_prev_clock_high: ADC clock count at previous arp pulse
-     * bits [31: 0] - unsigned (high 32 bits) of ADC clock count
-     */
-  uint32_t arp_prev_clock_high;
-
-    /** @brief  acp_per_arp: count of ACP pulses between two most recent ARP pulses
-     * bits [31: 0] - unsigned count of ACP pulses
-     */
-  uint32_t acp_per_arp;
-
-  // --------------------- SAVED COPIES ----------------------------------------
-  // For these metadata, we want to record the values at the time of the
-  // most recently *captured* pulse.  So if the capture thread is not keeping up
-  // with the radar, we still have correct values of these metadata for each
-  // captured pulse (e.g. the value of the ACP count at each captured radar pulse).
-  // The FPGA knows at trigger detection time whether or not
-  // the pulse will be captured, and if so, copies the live metadata values to
-  // these saved locations.
-
-    /** @brief  saved_trig_count:  value at start of most recently captured pulse
-     */
-  uint32_t saved_trig_count;
-
-    /** @brief  saved_trig_clock_low:  value at start of most recently captured pulse
-     */
-  uint32_t saved_trig_clock_low;
-
-    /** @brief  saved_trig_clock_high:  value at start of most recently captured pulse
-     */
-  uint32_t saved_trig_clock_high;
-
-    /** @brief  saved_trig_prev_clock_low:  value at start of most recently captured pulse
-     */
-  uint32_t saved_trig_prev_clock_low;
-
-    /** @brief  saved_trig_prev_clock_high:  value at start of most recently captured pulse
-     */
-  uint32_t saved_trig_prev_clock_high;
-
-    /** @brief  saved_acp_count:  value at start of most recently captured pulse
-     */
-  uint32_t saved_acp_count;
-
-    /** @brief  saved_acp_clock_low:  value at start of most recently captured pulse
-     */
-  uint32_t saved_acp_clock_low;
-
-    /** @brief  saved_acp_clock_high:  value at start of most recently captured pulse
-     */
-  uint32_t saved_acp_clock_high;
-
-    /** @brief  saved_acp_prev_clock_low:  value at start of most recently captured pulse
-     */
-  uint32_t saved_acp_prev_clock_low;
-
-    /** @brief  saved_acp_prev_clock_high:  value at start of most recently captured pulse
-     */
-  uint32_t saved_acp_prev_clock_high;
-
-    /** @brief  saved_arp_count:  value at start of most recently captured pulse
-     */
-  uint32_t saved_arp_count;
-
-    /** @brief  saved_arp_clock_low:  value at start of most recently captured pulse
-     */
-  uint32_t saved_arp_clock_low;
-
-    /** @brief  saved_arp_clock_high:  value at start of most recently captured pulse
-     */
-  uint32_t saved_arp_clock_high;
-
-    /** @brief  saved_arp_prev_clock_low:  value at start of most recently captured pulse
-     */
-  uint32_t saved_arp_prev_clock_low;
-
-    /** @brief  saved_arp_prev_clock_high:  value at start of most recently captured pulse
-     */
-  uint32_t saved_arp_prev_clock_high;
-
-    /** @brief  saved_acp_per_arp:  value at start of most recently captured pulse
-     */
-  uint32_t saved_acp_per_arp;
-
-    /** @brief  clocks: 64-bit count of ADC clock ticks since reset
-     */
-  uint64_t clocks;
-
-  /** @brief  most recent slow ADC value from ACP
-     */
-
-  uint32_t acp_raw;
-  /** @brief  most recent slow ADC value from ARP
-     */
-
-  uint32_t arp_raw;
-
-    /** @brief  acp_at_arp:  value of acp count at most recent arp pulse
-     */
-  uint32_t acp_at_arp;
-
-    /** @brief  saved_acp_at_arp:  value at start of most recently captured pulse
-     */
-  uint32_t saved_acp_at_arp;
-
-    /** @brief  trig_at_arp:  value of trig count at most recent arp pulse
-     */
-  uint32_t trig_at_arp;
-
-    /** @brief  saved_trig_at_arp:  value at start of most recently captured pulse
-     */
-  uint32_t saved_trig_at_arp;
-
-} digdar_fpga_reg_mem_t;
+/** @brief Pulse header block.
+ *
+ * When a trigger is detected while armed, the FPGA latches the metadata
+ * for that pulse into this block, in a single clock, at the same time as
+ * the saved_* registers.  Reading the whole block at once (one burst)
+ * gives values which all belong to the captured pulse, and takes one
+ * pass over the bus instead of a separate uncached read per register.
+ * If seq and seq_end differ, another trigger was latched during the read.
+ * Layout must match the HDR_* word indexes in red_pitaya_digdar.v
+ */
+typedef struct digdar_pulse_hdr_s {
+  uint32_t seq;                // capture sequence number; incremented at each latch
+  uint32_t trig_count;         // trigger count since reset
+  uint32_t trig_at_arp;        // trigger count at most recent ARP
+  uint32_t trig_clock_low;     // ADC clock at this trigger (low 32 bits)
+  uint32_t trig_clock_high;    // ADC clock at this trigger (high 32 bits)
+  uint32_t trig_prev_clock_low;  // ADC clock at previous trigger (low 32 bits)
+  uint32_t trig_prev_clock_high; // ADC clock at previous trigger (high 32 bits)
+  uint32_t acp_count;          // ACP count since reset
+  uint32_t acp_at_arp;         // ACP count at most recent ARP
+  uint32_t acp_clock_low;      // ADC clock at most recent ACP (low 32 bits)
+  uint32_t acp_clock_high;     // ADC clock at most recent ACP (high 32 bits)
+  uint32_t arp_count;          // ARP count since reset
+  uint32_t arp_clock_low;      // ADC clock at most recent ARP (low 32 bits)
+  uint32_t arp_clock_high;     // ADC clock at most recent ARP (high 32 bits)
+  uint32_t acp_per_arp;        // count of ACP pulses between two most recent ARP pulses
+  uint32_t seq_end;            // copy of seq
+} digdar_pulse_hdr_t;
+
+/** @brief DMA header record.
+ *
+ * For each pulse written to DDR, the DMA engine writes one of these into
+ * the header ring, after the pulse's samples have been written, giving its
+ * pulse header and the chunk and slot its samples went to.
+ * Layout must match the header record in red_pitaya_digdar_dma.v
+ */
+typedef struct digdar_dma_hdr_s {
+  digdar_pulse_hdr_t pulse;    // pulse header, as latched when the capture began
+  uint32_t chunk;              // chunk holding the pulse
+  uint32_t slot;               // slot within the chunk
+  uint32_t n_samples;          // samples in the pulse
+  uint32_t unused[13];         // pads the record to 128 bytes
+} digdar_dma_hdr_t;
 
 /** @} */
 
@@ -558,6 +327,24 @@ int   osc_fpga_set_decim(uint32_t decim_factor);
 int   osc_fpga_triggered(void);
 int   osc_fpga_get_sig_ptr(int **cha_signal, int **chb_signal, int **xcha_signal, int **xchb_signal);
 int   osc_fpga_get_wr_ptr(int *wr_ptr_curr, int *wr_ptr_trig);
+int   osc_fpga_get_pulse_hdr(digdar_pulse_hdr_t *hdr);
+int   osc_fpga_ring_init(uint32_t slots);
+uint32_t osc_fpga_ring_get_produced(void);
+int   osc_fpga_ring_set_consumed(uint32_t consumed);
+uint32_t osc_fpga_ring_get_dropped(void);
+int   osc_fpga_ring_get_slot_hdr(uint32_t slot, digdar_pulse_hdr_t *hdr);
+volatile uint32_t *osc_fpga_reg(uint32_t offset);
+uint64_t osc_fpga_get_reg(const digdar_reg_t *reg);
+int   osc_fpga_set_reg(const digdar_reg_t *reg, uint32_t value);
+void *osc_fpga_dma_map(uint32_t phys, uint32_t bytes);
+int   osc_fpga_dma_init(uint32_t stride, uint32_t chunk_size, uint32_t num_chunks);
+int   osc_fpga_dma_stop(void);
+uint32_t osc_fpga_dma_get_produced(void);
+uint32_t osc_fpga_dma_get_dropped(void);
+uint32_t osc_fpga_dma_get_errors(void);
+int16_t osc_fpga_dma_get_chunk(void);
+int   osc_fpga_dma_set_read_chunk(int16_t chunk);
+const volatile digdar_dma_hdr_t *osc_fpga_dma_get_hdr(uint32_t n);
 
 
 float osc_fpga_calc_adc_max_v(uint32_t fe_gain_fs, int probe_att);
@@ -0,0 +1,201 @@
+#!/bin/sh
+#
+# Generate generated_regmap.h, the C/C++ view of the digdar FPGA register
+# map, from the files gen_verilog.go writes for the FPGA build, so the
+# offsets used by software always match those in the bitstream.
+#
+# usage: gen_regmap.sh RTL_DIR > generated_regmap.h
+#
+# RTL_DIR holds generated_mmap.v, generated_regdefs.v, generated_setters.v
+# and generated_pulsers.v.  Registers are described in generated_regdefs.v
+# in the same order as their offsets in generated_mmap.v; a 64-bit register
+# has a _LO and a _HI offset.
+#
+# Copyright 2011-2019 John Brzustowski
+#
+# This file is part of digdar.
+
+RTL=${1:-../../FPGA/release1/fpga/code/rtl}
+
+awk -v hash_size=512 '
+function die(msg) {
+  print "gen_regmap.sh: " msg > "/dev/stderr"
+  failed = 1
+  exit 1
+}
+
+# hash of a register name; must match digdar_reg_hash() below
+function hash(s, seed,    h, i) {
+  h = seed
+  for (i = 1; i <= length(s); ++i)
+    h = (h * 131 + ord[substr(s, i, 1)]) % 1048573
+  return h % hash_size
+}
+
+function hex(s,    v, i) {
+  v = 0
+  for (i = 1; i <= length(s); ++i)
+    v = v * 16 + index("0123456789abcdef", tolower(substr(s, i, 1))) - 1
+  return v
+}
+
+function add(name, offset, width, access, comment) {
+  names[n] = name; offsets[n] = offset; widths[n] = width; access_of[n] = access; comments[n] = comment
+  ++n
+}
+
+BEGIN {
+  n = nm = nr = 0
+  for (i = 32; i < 127; ++i)
+    ord[sprintf("%c", i)] = i
+}
+
+FILENAME ~ /generated_mmap/ && /^`define OFFSET_/ {
+  sub(/^`define OFFSET_/, "")
+  mmap_name[nm] = $1
+  v = $2; sub(/^.*h/, "", v)
+  mmap_off[nm] = v
+  ++nm
+  next
+}
+
+FILENAME ~ /generated_setters/ && /OFFSET_/ { rw[$3] = 1; next }
+
+FILENAME ~ /generated_pulsers/ && /OFFSET_/ { wo[$1] = 1; next }
+
+FILENAME ~ /generated_regdefs/ && /^ *(reg|wire) / {
+  w = $2; sub(/^\[/, "", w); sub(/-.*$/, "", w)
+  reg_name[nr] = $4
+  reg_width[nr] = w
+  c = $0; sub(/^[^\/]*\/\/ */, "", c)
+  reg_comment[nr] = c
+  ++nr
+  next
+}
+
+END {
+  if (failed)
+    exit 1
+  # pair registers with their offsets
+  j = 0
+  for (i = 0; i < nr; ++i) {
+    name = reg_name[i]
+    access = rw[name] ? "DIGDAR_REG_RW" : wo[name] ? "DIGDAR_REG_WO" : "DIGDAR_REG_RO"
+    if (j >= nm)
+      die("more registers than offsets")
+    if (reg_width[i] == 64) {
+      if (mmap_name[j] !~ /_LO$/ || mmap_name[j + 1] !~ /_HI$/)
+        die("expected _LO and _HI offsets for " name)
+      add(name,           mmap_off[j],     64, access, reg_comment[i])
+      add(name "_low",    mmap_off[j],     32, access, "low 32 bits of " name)
+      add(name "_high",   mmap_off[j + 1], 32, access, "high 32 bits of " name)
+      defs[j] = "OFFSET_" mmap_name[j]; defs[j + 1] = "OFFSET_" mmap_name[j + 1]
+      j += 2
+    } else {
+      if (mmap_name[j] ~ /_(LO|HI)$/)
+        die("unexpected 64-bit offset for " name)
+      add(name, mmap_off[j], reg_width[i], access, reg_comment[i])
+      defs[j] = "OFFSET_" mmap_name[j]
+      ++j
+    }
+  }
+  if (j != nm)
+    die("more offsets than registers")
+
+  # find a seed giving a collision-free hash of all names
+  for (seed = 0; seed < 100000; ++seed) {
+    split("", used)
+    ok = 1
+    for (i = 0; ok && i < n; ++i) {
+      h = hash(names[i], seed)
+      if (h in used)
+        ok = 0
+      used[h] = i
+    }
+    if (ok)
+      break
+  }
+  if (! ok)
+    die("no collision-free hash seed found")
+
+  print "/*"
+  print " * digdar FPGA register map - generated by gen_regmap.sh from the"
+  print " * register files generated by gen_verilog.go.  Do not edit."
+  print " */"
+  print ""
+  print "#ifndef __GENERATED_REGMAP_H"
+  print "#define __GENERATED_REGMAP_H"
+  print ""
+  print "#include <stdint.h>"
+  print ""
+  print "/** Offsets of registers from the start of the digdar FPGA block; same names as in generated_mmap.v */"
+  for (j = 0; j < nm; ++j)
+    printf "#define %-38s 0x%05x\n", defs[j], hex(mmap_off[j])
+  print ""
+  print "/** Register access modes */"
+  print "#define DIGDAR_REG_RO 1 // read-only"
+  print "#define DIGDAR_REG_WO 2 // write-only; reads as 0"
+  print "#define DIGDAR_REG_RW 3 // read-write"
+  print ""
+  print "/** @brief Register descriptor. */"
+  print "typedef struct digdar_reg_s {"
+  print "  const char *name;    // register name, as in generated_regdefs.v; 64-bit registers also have name_low and name_high halves"
+  print "  uint32_t    offset;  // byte offset from the start of the digdar FPGA block"
+  print "  uint8_t     width;   // bits: 32 or 64"
+  print "  uint8_t     access;  // DIGDAR_REG_RO, DIGDAR_REG_WO, or DIGDAR_REG_RW"
+  print "} digdar_reg_t;"
+  print ""
+  print "#ifdef __cplusplus"
+  print "#define DIGDAR_REGMAP_CONST constexpr"
+  print "#else"
+  print "#define DIGDAR_REGMAP_CONST static const __attribute__((unused))"
+  print "#endif"
+  print ""
+  printf "#define DIGDAR_NUM_REGS %d\n", n
+  print ""
+  print "DIGDAR_REGMAP_CONST digdar_reg_t digdar_regs[DIGDAR_NUM_REGS] = {"
+  for (i = 0; i < n; ++i)
+    printf "  {%-32s 0x%05x, %2d, %s}, // %s\n", "\"" names[i] "\",", hex(offsets[i]), widths[i], access_of[i], comments[i]
+  print "};"
+  print ""
+  print "/** Perfect hash of register names: digdar_regs index by digdar_reg_hash(name), or -1 */"
+  printf "#define DIGDAR_REG_HASH_SEED %d\n", seed
+  printf "#define DIGDAR_REG_HASH_SIZE %d\n", hash_size
+  print ""
+  print "DIGDAR_REGMAP_CONST int8_t digdar_reg_hash_table[DIGDAR_REG_HASH_SIZE] = {"
+  for (h = 0; h < hash_size; h += 16) {
+    line = " "
+    for (k = h; k < h + 16; ++k)
+      line = line sprintf(" %3d,", (k in used) ? used[k] : -1)
+    print line
+  }
+  print "};"
+  print ""
+  print "#ifdef __cplusplus"
+  print ""
+  print "/** @brief Hash of a register name, in 0..DIGDAR_REG_HASH_SIZE-1. */"
+  print "constexpr uint32_t digdar_reg_hash(const char *s, uint32_t h = DIGDAR_REG_HASH_SEED) {"
+  print "  return *s ? digdar_reg_hash(s + 1, (h * 131 + (unsigned char) *s) % 1048573) : h % DIGDAR_REG_HASH_SIZE;"
+  print "}"
+  print ""
+  print "constexpr bool digdar_reg_name_is(const char *a, const char *b) {"
+  print "  return *a == *b && (*a == 0 || digdar_reg_name_is(a + 1, b + 1));"
+  print "}"
+  print ""
+  print "constexpr int digdar_reg_check(const char *name, int i) {"
+  print "  return i >= 0 && digdar_reg_name_is(digdar_regs[i].name, name) ? i : -1;"
+  print "}"
+  print ""
+  print "/** @brief Index in digdar_regs of the named register, or -1 if there is none."
+  print " *"
+  print " * Usable in constant expressions, e.g. digdar_regs[digdar_reg_find(\"num_samp\")].offset"
+  print " */"
+  print "constexpr int digdar_reg_find(const char *name) {"
+  print "  return digdar_reg_check(name, digdar_reg_hash_table[digdar_reg_hash(name)]);"
+  print "}"
+  print ""
+  print "#endif /* __cplusplus */"
+  print ""
+  print "#endif /* __GENERATED_REGMAP_H */"
+}
+' "$RTL/generated_mmap.v" "$RTL/generated_setters.v" "$RTL/generated_pulsers.v" "$RTL/generated_regdefs.v"
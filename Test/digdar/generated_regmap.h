@@ -0,0 +1,232 @@
+/*
+ * digdar FPGA register map - generated by gen_regmap.sh from the
+ * register files generated by gen_verilog.go.  Do not edit.
+ */
+
+#ifndef __GENERATED_REGMAP_H
+#define __GENERATED_REGMAP_H
+
+#include <stdint.h>
+
+/** Offsets of registers from the start of the digdar FPGA block; same names as in generated_mmap.v */
+#define OFFSET_Command                         0x00000
+#define OFFSET_TrigSource                      0x00004
+#define OFFSET_NumSamp                         0x00008
+#define OFFSET_DecRate                         0x0000c
+#define OFFSET_Options                         0x00010
+#define OFFSET_TrigThreshExcite                0x00014
+#define OFFSET_TrigThreshRelax                 0x00018
+#define OFFSET_TrigDelay                       0x0001c
+#define OFFSET_TrigLatency                     0x00020
+#define OFFSET_TrigCount                       0x00024
+#define OFFSET_ACPThreshExcite                 0x00028
+#define OFFSET_ACPThreshRelax                  0x0002c
+#define OFFSET_ACPLatency                      0x00030
+#define OFFSET_ARPThreshExcite                 0x00034
+#define OFFSET_ARPThreshRelax                  0x00038
+#define OFFSET_ARPLatency                      0x0003c
+#define OFFSET_TrigClock_LO                    0x00040
+#define OFFSET_TrigClock_HI                    0x00044
+#define OFFSET_TrigPrevClock_LO                0x00048
+#define OFFSET_TrigPrevClock_HI                0x0004c
+#define OFFSET_ACPClock_LO                     0x00050
+#define OFFSET_ACPClock_HI                     0x00054
+#define OFFSET_ACPPrevClock_LO                 0x00058
+#define OFFSET_ACPPrevClock_HI                 0x0005c
+#define OFFSET_ARPClock_LO                     0x00060
+#define OFFSET_ARPClock_HI                     0x00064
+#define OFFSET_ARPPrevClock_LO                 0x00068
+#define OFFSET_ARPPrevClock_HI                 0x0006c
+#define OFFSET_ACPCount                        0x00070
+#define OFFSET_ARPCount                        0x00074
+#define OFFSET_ACPPerARP                       0x00078
+#define OFFSET_ACPAtARP                        0x0007c
+#define OFFSET_ClockSinceACPAtARP              0x00080
+#define OFFSET_TrigAtARP                       0x00084
+#define OFFSET_Clocks_LO                       0x00088
+#define OFFSET_Clocks_HI                       0x0008c
+#define OFFSET_SavedTrigClock_LO               0x00090
+#define OFFSET_SavedTrigClock_HI               0x00094
+#define OFFSET_SavedTrigPrevClock_LO           0x00098
+#define OFFSET_SavedTrigPrevClock_HI           0x0009c
+#define OFFSET_SavedACPClock_LO                0x000a0
+#define OFFSET_SavedACPClock_HI                0x000a4
+#define OFFSET_SavedACPPrevClock_LO            0x000a8
+#define OFFSET_SavedACPPrevClock_HI            0x000ac
+#define OFFSET_SavedARPClock_LO                0x000b0
+#define OFFSET_SavedARPClock_HI                0x000b4
+#define OFFSET_SavedARPPrevClock_LO            0x000b8
+#define OFFSET_SavedARPPrevClock_HI            0x000bc
+#define OFFSET_SavedTrigCount                  0x000c0
+#define OFFSET_SavedACPCount                   0x000c4
+#define OFFSET_SavedARPCount                   0x000c8
+#define OFFSET_SavedACPPerARP                  0x000cc
+#define OFFSET_SavedACPAtARP                   0x000d0
+#define OFFSET_SavedClockSinceACPAtARP         0x000d4
+#define OFFSET_SavedTrigAtARP                  0x000d8
+#define OFFSET_ADCCounter                      0x000dc
+#define OFFSET_ACPRaw                          0x000e0
+#define OFFSET_ARPRaw                          0x000e4
+#define OFFSET_Status                          0x000e8
+
+/** Register access modes */
+#define DIGDAR_REG_RO 1 // read-only
+#define DIGDAR_REG_WO 2 // write-only; reads as 0
+#define DIGDAR_REG_RW 3 // read-write
+
+/** @brief Register descriptor. */
+typedef struct digdar_reg_s {
+  const char *name;    // register name, as in generated_regdefs.v; 64-bit registers also have name_low and name_high halves
+  uint32_t    offset;  // byte offset from the start of the digdar FPGA block
+  uint8_t     width;   // bits: 32 or 64
+  uint8_t     access;  // DIGDAR_REG_RO, DIGDAR_REG_WO, or DIGDAR_REG_RW
+} digdar_reg_t;
+
+#ifdef __cplusplus
+#define DIGDAR_REGMAP_CONST constexpr
+#else
+#define DIGDAR_REGMAP_CONST static const __attribute__((unused))
+#endif
+
+#define DIGDAR_NUM_REGS 72
+
+DIGDAR_REGMAP_CONST digdar_reg_t digdar_regs[DIGDAR_NUM_REGS] = {
+  {"command",                       0x00000, 32, DIGDAR_REG_WO}, // Command Register: bit[0]: arm trigger; bit[1]: reset
+  {"trig_source",                   0x00004, 32, DIGDAR_REG_RW}, // Trigger source: 0: don't trigger; 1: trigger immediately upon arming; 2: radar trigger pulse; 3: ACP pulse; 4: ARP pulse
+  {"num_samp",                      0x00008, 32, DIGDAR_REG_RW}, // Number of Samples: number of samples to write after being triggered.  Must be even and in the range 2...16384.
+  {"dec_rate",                      0x0000c, 32, DIGDAR_REG_RW}, // Decimation Rate: number of input samples to consume for one output sample. 0...65536.  For rates 1, 2, 3 and 4, samples can be summed instead of decimated.  For rates 1, 2, 4, 8, 64, 1024, 8192 and 65536, samples can be averaged instead of decimated bits [31:17] - reserved
+  {"options",                       0x00010, 32, DIGDAR_REG_RW}, // Options: digdar-specific options; see type DigdarOption bit[0]: Average samples; bit[1]: Sum samples; bit[2]: Negate video; bit[3]: Counting mode
+  {"trig_thresh_excite",            0x00014, 32, DIGDAR_REG_RW}, // Trigger Excite Threshold: Trigger pulse is detected after trigger channel ADC value meets or exceeds this value (in direction away from the Trigger Relax Threshold).  -8192...8191
+  {"trig_thresh_relax",             0x00018, 32, DIGDAR_REG_RW}, // Trigger Relax Threshold: After a trigger pulse has been detected, the trigger channel ADC value must meet or exceed this value (in direction away from the Trigger Excite Threshold) before a trigger will be detected again.  (Serves to debounce signal in Schmitt trigger style).  -8192...8191
+  {"trig_delay",                    0x0001c, 32, DIGDAR_REG_RW}, // Trigger Delay: How long to wait after trigger is detected before starting to capture samples from the video channel.  The delay is in units of ADC clocks; i.e. the value is multiplied by 8 nanoseconds.
+  {"trig_latency",                  0x00020, 32, DIGDAR_REG_RW}, // Trigger Latency: how long to wait after trigger relaxation before allowing next excitation.  To further debounce the trigger signal, we can specify a minimum wait time between relaxation and excitation.  0...65535 (which gets multiplied by 8 nanoseconds)
+  {"trig_count",                    0x00024, 32, DIGDAR_REG_RO}, // Trigger Count: number of trigger pulses detected since last reset
+  {"acp_thresh_excite",             0x00028, 32, DIGDAR_REG_RW}, // ACP Excite Threshold: the AC Pulse is detected when the ACP channel value meets or exceeds this value (in direction away from the ACP Relax Threshold).  -2048...2047
+  {"acp_thresh_relax",              0x0002c, 32, DIGDAR_REG_RW}, // ACP Relax Threshold: After an ACP has been detected, the acp channel ADC value must meet or exceed this value (in direction away from acp_thresh_excite) before an ACP will be detected again.  (Serves to debounce signal in Schmitt trigger style).  -2048...2047
+  {"acp_latency",                   0x00030, 32, DIGDAR_REG_RW}, // ACP Latency: how long to wait after ACP relaxation before allowing next excitation.  To further debounce the acp signal, we can specify a minimum wait time between relaxation and excitation.  0...1000000 (which gets multiplied by 8 nanoseconds)
+  {"arp_thresh_excite",             0x00034, 32, DIGDAR_REG_RW}, // ARP Excite Threshold: the AR Pulse is detected when the ARP channel value meets or exceeds this value (in direction away from the ARP Relax Threshold).  -2048..2047
+  {"arp_thresh_relax",              0x00038, 32, DIGDAR_REG_RW}, // ARP Relax Threshold: After an ARP has been detected, the acp channel ADC value must meet or exceed this value (in direction away from arp_thresh_excite) before an ARP will be detected again.  (Serves to debounce signal in Schmitt trigger style).  -2048..2047
+  {"arp_latency",                   0x0003c, 32, DIGDAR_REG_RW}, // ARP Latency: how long to wait after ARP relaxation before allowing next excitation.  To further debounce the acp signal, we can specify a minimum wait time between relaxation and excitation.  0...1000000 (which gets multiplied by 8 nanoseconds)
+  {"trig_clock",                    0x00040, 64, DIGDAR_REG_RO}, // Trigger Clock: ADC clock count at last trigger pulse
+  {"trig_clock_low",                0x00040, 32, DIGDAR_REG_RO}, // low 32 bits of trig_clock
+  {"trig_clock_high",               0x00044, 32, DIGDAR_REG_RO}, // high 32 bits of trig_clock
+  {"trig_prev_clock",               0x00048, 64, DIGDAR_REG_RO}, // Previous Trigger Clock: ADC clock count at previous trigger pulse
+  {"trig_prev_clock_low",           0x00048, 32, DIGDAR_REG_RO}, // low 32 bits of trig_prev_clock
+  {"trig_prev_clock_high",          0x0004c, 32, DIGDAR_REG_RO}, // high 32 bits of trig_prev_clock
+  {"acp_clock",                     0x00050, 64, DIGDAR_REG_RO}, // ACP Clock: ADC clock count at last ACP
+  {"acp_clock_low",                 0x00050, 32, DIGDAR_REG_RO}, // low 32 bits of acp_clock
+  {"acp_clock_high",                0x00054, 32, DIGDAR_REG_RO}, // high 32 bits of acp_clock
+  {"acp_prev_clock",                0x00058, 64, DIGDAR_REG_RO}, // Previous ACP Clock: ADC clock count at previous ACP
+  {"acp_prev_clock_low",            0x00058, 32, DIGDAR_REG_RO}, // low 32 bits of acp_prev_clock
+  {"acp_prev_clock_high",           0x0005c, 32, DIGDAR_REG_RO}, // high 32 bits of acp_prev_clock
+  {"arp_clock",                     0x00060, 64, DIGDAR_REG_RO}, // ARP Clock: ADC clock count at last ARP
+  {"arp_clock_low",                 0x00060, 32, DIGDAR_REG_RO}, // low 32 bits of arp_clock
+  {"arp_clock_high",                0x00064, 32, DIGDAR_REG_RO}, // high 32 bits of arp_clock
+  {"arp_prev_clock",                0x00068, 64, DIGDAR_REG_RO}, // Previous ARP Clock: ADC clock count at previous ARP
+  {"arp_prev_clock_low",            0x00068, 32, DIGDAR_REG_RO}, // low 32 bits of arp_prev_clock
+  {"arp_prev_clock_high",           0x0006c, 32, DIGDAR_REG_RO}, // high 32 bits of arp_prev_clock
+  {"acp_count",                     0x00070, 32, DIGDAR_REG_RO}, // ACP Count: number of Azimuth Count Pulses detected since last reset
+  {"arp_count",                     0x00074, 32, DIGDAR_REG_RO}, // ARP Count: number of Azimuth Return Pulses (rotations) detected since last reset
+  {"acp_per_arp",                   0x00078, 32, DIGDAR_REG_RO}, // count of ACP between two most recent ARP
+  {"acp_at_arp",                    0x0007c, 32, DIGDAR_REG_RO}, // ACP at ARP: ACP count at most recent ARP
+  {"clock_since_acp_at_arp",        0x00080, 32, DIGDAR_REG_RO}, // ACP Offset at ARP: count of ADC clocks since last ACP, at last ARP
+  {"trig_at_arp",                   0x00084, 32, DIGDAR_REG_RO}, // Trig at ARP: Trigger count at most recent ARP
+  {"clocks",                        0x00088, 64, DIGDAR_REG_RO}, // clocks: 64-bit count of ADC clock ticks since reset
+  {"clocks_low",                    0x00088, 32, DIGDAR_REG_RO}, // low 32 bits of clocks
+  {"clocks_high",                   0x0008c, 32, DIGDAR_REG_RO}, // high 32 bits of clocks
+  {"saved_trig_clock",              0x00090, 64, DIGDAR_REG_RO}, // Trigger Clock: ADC clock count at last trigger pulse
+  {"saved_trig_clock_low",          0x00090, 32, DIGDAR_REG_RO}, // low 32 bits of saved_trig_clock
+  {"saved_trig_clock_high",         0x00094, 32, DIGDAR_REG_RO}, // high 32 bits of saved_trig_clock
+  {"saved_trig_prev_clock",         0x00098, 64, DIGDAR_REG_RO}, // Previous Trigger Clock: ADC clock count at previous trigger pulse
+  {"saved_trig_prev_clock_low",     0x00098, 32, DIGDAR_REG_RO}, // low 32 bits of saved_trig_prev_clock
+  {"saved_trig_prev_clock_high",    0x0009c, 32, DIGDAR_REG_RO}, // high 32 bits of saved_trig_prev_clock
+  {"saved_acp_clock",               0x000a0, 64, DIGDAR_REG_RO}, // ACP Clock: ADC clock count at last ACP
+  {"saved_acp_clock_low",           0x000a0, 32, DIGDAR_REG_RO}, // low 32 bits of saved_acp_clock
+  {"saved_acp_clock_high",          0x000a4, 32, DIGDAR_REG_RO}, // high 32 bits of saved_acp_clock
+  {"saved_acp_prev_clock",          0x000a8, 64, DIGDAR_REG_RO}, // Previous ACP Clock: ADC clock count at previous ACP
+  {"saved_acp_prev_clock_low",      0x000a8, 32, DIGDAR_REG_RO}, // low 32 bits of saved_acp_prev_clock
+  {"saved_acp_prev_clock_high",     0x000ac, 32, DIGDAR_REG_RO}, // high 32 bits of saved_acp_prev_clock
+  {"saved_arp_clock",               0x000b0, 64, DIGDAR_REG_RO}, // ARP Clock: ADC clock count at last ARP
+  {"saved_arp_clock_low",           0x000b0, 32, DIGDAR_REG_RO}, // low 32 bits of saved_arp_clock
+  {"saved_arp_clock_high",          0x000b4, 32, DIGDAR_REG_RO}, // high 32 bits of saved_arp_clock
+  {"saved_arp_prev_clock",          0x000b8, 64, DIGDAR_REG_RO}, // Previous ARP Clock: ADC clock count at previous ARP
+  {"saved_arp_prev_clock_low",      0x000b8, 32, DIGDAR_REG_RO}, // low 32 bits of saved_arp_prev_clock
+  {"saved_arp_prev_clock_high",     0x000bc, 32, DIGDAR_REG_RO}, // high 32 bits of saved_arp_prev_clock
+  {"saved_trig_count",              0x000c0, 32, DIGDAR_REG_RO}, // Trigger Count: number of trigger pulses detected since last reset
+  {"saved_acp_count",               0x000c4, 32, DIGDAR_REG_RO}, // ACP Count: number of Azimuth Count Pulses detected since last reset
+  {"saved_arp_count",               0x000c8, 32, DIGDAR_REG_RO}, // ARP Count: number of Azimuth Return Pulses (rotations) detected since last reset
+  {"saved_acp_per_arp",             0x000cc, 32, DIGDAR_REG_RO}, // count of ACP between two most recent ARP
+  {"saved_acp_at_arp",              0x000d0, 32, DIGDAR_REG_RO}, // ACP at ARP: ACP count at most recent ARP
+  {"saved_clock_since_acp_at_arp",  0x000d4, 32, DIGDAR_REG_RO}, // ACP Offset at ARP: count of ADC clocks since last ACP, at last ARP
+  {"saved_trig_at_arp",             0x000d8, 32, DIGDAR_REG_RO}, // Trig at ARP: Trigger count at most recent ARP
+  {"adc_counter",                   0x000dc, 32, DIGDAR_REG_RO}, // ADC Counter: 14-bit ADC counter used in counting mode; starts at 0 upon triggering, and increments at each ADC clock
+  {"acp_raw",                       0x000e0, 32, DIGDAR_REG_RO}, // most recent slow ADC value from ACP
+  {"arp_raw",                       0x000e4, 32, DIGDAR_REG_RO}, // most recent slow ADC value from ARP
+  {"status",                        0x000e8, 32, DIGDAR_REG_RO}, // Status: 0 = idle; 1 = armed; 2 = capturing; 3 = fired (finished capturing)
+};
+
+/** Perfect hash of register names: digdar_regs index by digdar_reg_hash(name), or -1 */
+#define DIGDAR_REG_HASH_SEED 21
+#define DIGDAR_REG_HASH_SIZE 512
+
+DIGDAR_REGMAP_CONST int8_t digdar_reg_hash_table[DIGDAR_REG_HASH_SIZE] = {
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  26,  14,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  64,  -1,
+   12,  -1,  -1,  38,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,   8,  -1,  -1,  13,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  69,  -1,  40,  68,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,   1,   0,  -1,  61,  20,  -1,  -1,  -1,
+   -1,  -1,  37,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   15,  -1,  -1,  -1,  -1,  -1,  42,  67,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  19,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  18,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  44,  -1,  47,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  16,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  71,  -1,  -1,  -1,  -1,  -1,  59,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,   7,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  32,  -1,  -1,  -1,  -1,  -1,  -1,   4,  55,  -1,   6,  49,
+   21,  -1,  -1,  -1,  28,  -1,  -1,  22,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  29,  -1,  -1,  -1,  -1,  -1,  58,  -1,   3,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  57,  17,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  52,  -1,  -1,  -1,  66,  -1,  -1,  36,  46,  -1,
+   -1,  51,  -1,  -1,  -1,  41,  45,  -1,  -1,  -1,  -1,  48,  -1,  65,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  56,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  27,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  70,  23,  -1,  -1,  -1,  -1,
+   -1,  10,  -1,  -1,  -1,  33,  -1,  -1,   2,  31,  -1,  -1,  -1,  -1,  -1,  -1,
+    9,  -1,  -1,   5,  30,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  43,  -1,  -1,  25,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   24,  -1,  54,  -1,  -1,  -1,  39,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   50,  -1,  63,  -1,  -1,  62,  -1,  35,  -1,  -1,  34,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  60,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  11,  -1,  -1,  -1,  -1,  -1,  53,  -1,
+};
+
+#ifdef __cplusplus
+
+/** @brief Hash of a register name, in 0..DIGDAR_REG_HASH_SIZE-1. */
+constexpr uint32_t digdar_reg_hash(const char *s, uint32_t h = DIGDAR_REG_HASH_SEED) {
+  return *s ? digdar_reg_hash(s + 1, (h * 131 + (unsigned char) *s) % 1048573) : h % DIGDAR_REG_HASH_SIZE;
+}
+
+constexpr bool digdar_reg_name_is(const char *a, const char *b) {
+  return *a == *b && (*a == 0 || digdar_reg_name_is(a + 1, b + 1));
+}
+
+constexpr int digdar_reg_check(const char *name, int i) {
+  return i >= 0 && digdar_reg_name_is(digdar_regs[i].name, name) ? i : -1;
+}
+
+/** @brief Index in digdar_regs of the named register, or -1 if there is none.
+ *
+ * Usable in constant expressions, e.g. digdar_regs[digdar_reg_find("num_samp")].offset
+ */
+constexpr int digdar_reg_find(const char *name) {
+  return digdar_reg_check(name, digdar_reg_hash_table[digdar_reg_hash(name)]);
+}
+
+#endif /* __cplusplus */
+
+#endif /* __GENERATED_REGMAP_H */
@@ -0,0 +1,494 @@
+/*
+ * libdigdar - capture radar pulses into the pulse buffer, and hand them
+ * to in-process consumers.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/param.h>
+#include <math.h>
+
+#include "libdigdar.h"
+#include "main_digdar.h"
+#include "fpga_digdar.h"
+#include "worker.h"
+#include "replay.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * The capture machinery - the FPGA driver, the worker thread which fills
+ * the pulse buffer, and the replay thread which can stand in for it - is
+ * set up here from a digdar::config, and the chunks it fills are handed
+ * to callbacks as const views into the pulse buffer.  The digdar program
+ * is one client, which writes what it is handed to a socket; detection or
+ * tracking code linked against libdigdar.a can instead consume pulses
+ * without the copy and parse that reading digdar's output entails.
+ *
+ * The capture settings are kept in the globals shared with worker.c and
+ * replay.c, which is why there can be only one capture per process.
+ */
+
+/** Oscilloscope module parameters as defined in main module
+ * @see rp_main_params
+ */
+float t_params[PARAMS_NUM] = { 0, 1e6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+uint16_t n_samples = 3000;  // samples to grab per radar pulse
+uint16_t n_samples_out = 0; // samples stored per radar pulse; set below
+uint16_t n_channels = 1; // channels captured per radar pulse
+uint16_t channel_layout = CHANNEL_LAYOUT_PLANAR; // how samples from two channels are arranged in a pulse record
+uint32_t decim = 1; // decimation: 1, 2, 8, etc.
+uint32_t pulse_buff_size = 0; // number of pulses to maintain in ring buffer (filled by worker thread); default 0 means as many as fit in max memory
+uint32_t psize = 0; // actual size of each pulse's storage (metadata + data) - will be set below
+uint16_t acps = 450; // number of ACPs per sweep; used in calculating removal
+uint16_t ring_slots = 0; // slots in the FPGA pulse ring; 0 means re-arm for each pulse
+uint32_t dma_bytes = 0; // size of the DDR region the FPGA writes pulses into; 0 means no DMA
+uint16_t chunk_size = 256; // maximum number of pulses in each chunk of the pulse buffer
+uint16_t num_chunks = 0; // number of chunks in the pulse buffer; set below
+uint16_t *pulses_in_chunk = 0; // number of pulses written to each chunk
+pulse_metadata *pulse_buffer = 0;
+
+sector removals[MAX_REMOVALS];
+uint16_t num_removals = 0;
+
+range_segment range_profile[MAX_RANGE_SEGMENTS];
+uint16_t num_range_segments = 0;
+
+namespace digdar {
+
+static bool replaying = false; // true if pulses come from a recording rather than the FPGA
+static bool replay_fast = false; // if true, replay as fast as possible instead of at recorded timing
+static bool capturing = false; // true once the worker or replay thread has been started
+static int capture_cpu = -1; // core the worker or replay thread is pinned to; -1 means any
+static int reader_cpu = -1; // core the thread started by start() is pinned to; -1 means any
+
+static pulse_callback pulse_cb = 0;
+static void *pulse_cb_data = 0;
+static sweep_callback sweep_cb = 0;
+static void *sweep_cb_data = 0;
+
+static volatile bool stop_requested = false;
+static volatile bool delivering = false;
+static bool have_thread = false;
+static pthread_t reader_thread;
+
+static bool parse_range_profile(char *spec) {
+  // parse a range profile of the form SPAN:FACTOR[,SPAN:FACTOR...]
+  // and fit it to n_samples.  Returns false on error.
+  // range covered by one FPGA sample, in metres
+  double sample_range = VELOCITY_OF_LIGHT / 2 * decim / 125.0e6;
+  uint32_t used = 0;
+  for (char *seg = strtok(spec, ","); seg; seg = strtok(0, ",")) {
+    if (num_range_segments == MAX_RANGE_SEGMENTS) {
+      fprintf(stderr, "Too many range profile segments; max is %d\n", MAX_RANGE_SEGMENTS);
+      return false;
+    }
+    char *split = strchr(seg, ':');
+    if (! split)
+      return false;
+    *split = '\0';
+    char *end;
+    double span = strtod(seg, &end);
+    if (*end == 'm')
+      span = round(span / sample_range);
+    int factor = atoi(split + 1);
+    if (span < 0 || factor < 1 || factor > 1024) {
+      fprintf(stderr, "bad range profile segment %s:%s\n", seg, split + 1);
+      return false;
+    }
+    uint32_t n_in = (uint32_t) span;
+    if (used + n_in > n_samples)
+      n_in = n_samples - used;
+    // keep whole groups of samples, so the next segment starts where the
+    // decimated samples of this one end; leftovers go to the next segment
+    if (n_in % factor) {
+      fprintf(stderr, "warning: range profile segment %s:%d rounded down to %u samples, a multiple of %d\n",
+              seg, factor, n_in - n_in % factor, factor);
+      n_in -= n_in % factor;
+    }
+    range_profile[num_range_segments].n_in = n_in;
+    range_profile[num_range_segments].factor = factor;
+    used += n_in;
+    ++num_range_segments;
+  }
+  if (num_range_segments == 0)
+    return false;
+  // final segment extends to end of pulse; samples which don't fill a
+  // group there are dropped
+  range_segment *last = &range_profile[num_range_segments - 1];
+  last->n_in += n_samples - used;
+  if (last->n_in % last->factor)
+    fprintf(stderr, "warning: the last %u samples of each pulse don't fill a group of %u, and are dropped\n",
+            last->n_in % last->factor, last->factor);
+  return true;
+};
+
+static int read_param_file(const char *param_file) {
+  // set FPGA registers from a file of NAME VALUE lines; '#' begins a comment
+  FILE *pin = fopen(param_file, "r");
+  if (! pin) {
+    fprintf(stderr, "couldn't open param file %s\n", param_file);
+    return -1;
+  }
+  char name[64];
+  uint32_t val;
+  while (fscanf(pin, "%63s", name) == 1) {
+    if (name[0] == '#') {
+      // comment: skip rest of line
+      if (fscanf(pin, "%*[^\n]") < 0)
+        break;
+      continue;
+    }
+    if (fscanf(pin, "%u", &val) != 1)
+      break;
+    if (set_param(name, val) < 0)
+      fprintf(stderr, "ignoring unknown or read-only parameter %s\n", name);
+  };
+  fclose(pin);
+  return 0;
+};
+
+int open(const config &cfg) {
+  n_samples = cfg.n_samples;
+  decim = cfg.decim;
+  n_channels = cfg.n_channels;
+  channel_layout = cfg.channel_layout;
+  ring_slots = cfg.ring_slots;
+  dma_bytes = cfg.dma_bytes;
+  pulse_buff_size = cfg.pulses;
+  acps = cfg.acps;
+  num_removals = MIN(cfg.num_removals, MAX_REMOVALS);
+  memcpy(removals, cfg.removals, num_removals * sizeof(sector));
+  replaying = cfg.replay_filename != 0;
+  replay_fast = cfg.replay_fast;
+  bool use_sum = cfg.use_sum;
+
+  switch(decim) {
+  case 1:
+  case 2:
+  case 3:
+  case 4:
+  case 8:
+  case 64:
+  case 1024:
+  case 8192:
+  case 65536:
+    break;
+  default:
+    fprintf(stderr, "incorrect value (%d) for decimation; must be 1, 2, 3, 4, 8, 64, 1024, 8192, or 65536\n", decim);
+    return -1;
+  }
+
+  t_params[DECIM_FACTOR_PARAM] = decim;
+
+  if (n_samples > 16384) {
+    fprintf(stderr, "incorrect value (%d) for samples per pulse; must be 0..16384\n", n_samples);
+    return -1;
+  }
+
+  if (ring_slots) {
+    if (ring_slots > OSC_FPGA_RING_MAX_SLOTS || (uint32_t) ring_slots * n_samples > OSC_FPGA_SIG_LEN) {
+      fprintf(stderr, "incorrect value (%d) for ring slots; must be at most %d, with slots * samples at most %d\n",
+              ring_slots, OSC_FPGA_RING_MAX_SLOTS, OSC_FPGA_SIG_LEN);
+      return -1;
+    }
+    // the FPGA copies each slot's header while the next pulse is captured
+    if (n_samples < 16 || (n_samples & 1)) {
+      fprintf(stderr, "incorrect value (%d) for samples per pulse with --ring; must be even and at least 16\n", n_samples);
+      return -1;
+    }
+  }
+
+  if (dma_bytes) {
+    if (ring_slots || replaying || cfg.profile_spec || n_channels == 2 || num_removals) {
+      fprintf(stderr, "--dma can't be used with --ring, --replay, --profile, --both, or --remove\n");
+      return -1;
+    }
+    // the FPGA writes whole 64-bit words into each pulse slot
+    if (n_samples < 16 || (n_samples & 3)) {
+      fprintf(stderr, "incorrect value (%d) for samples per pulse with --dma; must be a multiple of 4 and at least 16\n", n_samples);
+      return -1;
+    }
+  }
+
+  n_samples_out = n_samples;
+  num_range_segments = 0;
+  if (cfg.profile_spec) {
+    // strtok() modifies the spec
+    char *spec = strdup(cfg.profile_spec);
+    bool ok = spec && parse_range_profile(spec);
+    free(spec);
+    if (! ok) {
+      fprintf(stderr, "bad range profile %s\n", cfg.profile_spec);
+      return -1;
+    }
+    n_samples_out = 0;
+    for (int i = 0; i < num_range_segments; ++i)
+      n_samples_out += range_profile[i].n_in / range_profile[i].factor;
+  }
+
+  // a recording's stream header overrides the capture settings
+  if (replaying && rp_replay_open(cfg.replay_filename) < 0)
+    return -1;
+
+  if (use_sum && decim > 4) {
+    fprintf(stderr, "warning cannot specify --sum when decimation rate is > 4; ignoring\n");
+    use_sum = false;
+  }
+
+  /* Standard radar triggering mode */
+  t_params[TRIG_MODE_PARAM] = 1;
+  t_params[TRIG_SRC_PARAM] = 10;
+
+  if (! replaying) {
+    /* Initialization of Oscilloscope application */
+    if(rp_app_init() < 0) {
+      fprintf(stderr, "rp_app_init() failed!\n");
+      return -1;
+    }
+
+    if (cfg.param_file && read_param_file(cfg.param_file) < 0)
+      return -1;
+
+    /* Setting of parameters in Oscilloscope main module */
+    if(rp_set_params((float *)&t_params, PARAMS_NUM) < 0) {
+      fprintf(stderr, "rp_set_params() failed!\n");
+      return -1;
+    }
+  }
+
+  /* storage for one pulse, in bytes */
+  psize = sizeof(pulse_metadata) + sizeof(uint16_t) * (n_samples_out * n_channels - 1);
+
+  /* maximum number of pulses allowed for pulse buffer */
+  uint32_t max_pulses = cfg.max_memory / psize;
+  // with DMA, the pulse buffer is the DMA region after its header ring
+  if (dma_bytes)
+    max_pulses = (dma_bytes - MIN(dma_bytes, OSC_FPGA_DMA_HDR_SLOTS * sizeof(digdar_dma_hdr_t))) / psize;
+  if (pulse_buff_size == 0 || pulse_buff_size > max_pulses)
+    pulse_buff_size = max_pulses;
+  // the ring of chunks below needs at least one pulse per chunk
+  if (pulse_buff_size < 3) {
+    fprintf(stderr, "pulse buffer must hold at least 3 pulses; got %u (--pulses, or memory available)\n", pulse_buff_size);
+    return -1;
+  }
+
+  if (dma_bytes)
+    pulse_buffer = (pulse_metadata *) osc_fpga_dma_map(cfg.dma_phys, dma_bytes);
+  else
+    pulse_buffer = (pulse_metadata *) calloc(pulse_buff_size, psize);
+  if (!pulse_buffer) {
+    fprintf(stderr, "couldn't allocate pulse buffer\n");
+    return -1;
+  }
+
+  // divide the pulse buffer into a ring of at least 3 chunks, so the
+  // reader and writer each have one, with one to spare
+  if (pulse_buff_size / chunk_size < 3)
+    chunk_size = pulse_buff_size / 3;
+  num_chunks = MIN(pulse_buff_size / chunk_size, 32767);
+  pulses_in_chunk = (uint16_t *) calloc(num_chunks, sizeof(uint16_t));
+  if (!pulses_in_chunk) {
+    fprintf(stderr, "couldn't allocate chunk buffers\n");
+    return -1;
+  }
+
+  if (dma_bytes) {
+    if (osc_fpga_dma_init(psize, chunk_size, num_chunks) < 0) {
+      fprintf(stderr, "couldn't start DMA\n");
+      return -1;
+    }
+  } else {
+    // a previous run may have left DMA enabled, writing into memory it no longer owns
+    osc_fpga_dma_stop();
+  }
+  return 0;
+};
+
+void set_pulse_callback(pulse_callback f, void *user_data) {
+  pulse_cb = f;
+  pulse_cb_data = user_data;
+};
+
+void set_sweep_callback(sweep_callback f, void *user_data) {
+  sweep_cb = f;
+  sweep_cb_data = user_data;
+};
+
+static int start_capture() {
+  // start worker thread which captures to pulse buffer, or the replay
+  // thread which fills it from a recording
+  if (capturing)
+    return 0;
+  if (replaying) {
+    if (rp_replay_start(! replay_fast) < 0)
+      return -1;
+    if (capture_cpu >= 0)
+      rp_replay_set_cpu(capture_cpu);
+  } else {
+    rp_osc_worker_change_state(rp_osc_start_state);
+  }
+  capturing = true;
+  return 0;
+};
+
+static int deliver() {
+  // the reader loop shared by run() and the thread started by start();
+  // returns when stop_requested is set, a callback stops delivery, or a
+  // replay has been fully delivered
+  uint32_t cur_pulse = 0; // index of first chunk pulse in ring buffer
+  uint32_t num_pulses = 0; // number of pulses available in the chunk
+  uint32_t sweep_arp = 0; // ARP count of the sweep being delivered
+  bool have_sweep = false; // false until the first view has been delivered
+
+  delivering = true;
+  while (! stop_requested) {
+    // check before looking for a chunk, so the final chunk isn't missed
+    bool replay_finished = replaying && rp_replay_finished();
+    if (! rp_osc_get_chunk_for_reader(& cur_pulse, & num_pulses)) {
+      if (replay_finished)
+        break;
+      usleep(20);
+      sched_yield();
+      continue;
+    }
+    if (num_pulses == 0) {
+      rp_osc_release_empty_chunks(); // in case chunks are being held
+      continue;
+    }
+    sweep_view v;
+    v.first = (const pulse_metadata *) (((char *) pulse_buffer) + cur_pulse * psize);
+    v.n_pulses = num_pulses;
+    v.psize = psize;
+    v.num_arp = v.first->num_arp;
+    v.new_sweep = ! have_sweep || v.num_arp != sweep_arp;
+    sweep_arp = v.num_arp;
+    have_sweep = true;
+    if (pulse_cb) {
+      uint32_t i;
+      for (i = 0; i < num_pulses && pulse_cb(v.pulse(i), pulse_cb_data) >= 0; ++i)
+        ;
+      if (i < num_pulses)
+        break;
+    }
+    if (sweep_cb && sweep_cb(v, sweep_cb_data) < 0)
+      break;
+  }
+  delivering = false;
+  if (replaying)
+    rp_replay_report();
+  return 0;
+};
+
+int run() {
+  // cleared here, and by start(), but never by stop(), so a stop() from
+  // another thread isn't lost however soon it comes
+  stop_requested = false;
+  if (start_capture() < 0)
+    return -1;
+  return deliver();
+};
+
+int set_capture_cpu(int cpu) {
+  capture_cpu = cpu;
+  if (replaying)
+    return capturing ? rp_replay_set_cpu(cpu) : 0;
+  return rp_osc_worker_set_cpu(cpu);
+};
+
+int set_reader_cpu(int cpu) {
+  reader_cpu = cpu;
+  return have_thread ? rp_set_thread_cpu(reader_thread, cpu) : 0;
+};
+
+static void *reader_thread_fun(void *) {
+  deliver();
+  return 0;
+};
+
+int start() {
+  if (have_thread)
+    return 0;
+  stop_requested = false;
+  if (start_capture() < 0)
+    return -1;
+  delivering = true;
+  if (pthread_create(&reader_thread, NULL, reader_thread_fun, NULL) != 0) {
+    delivering = false;
+    fprintf(stderr, "couldn't start reader thread\n");
+    return -1;
+  }
+  have_thread = true;
+  if (reader_cpu >= 0)
+    rp_set_thread_cpu(reader_thread, reader_cpu);
+  return 0;
+};
+
+void stop() {
+  stop_requested = true;
+  if (have_thread) {
+    pthread_join(reader_thread, NULL);
+    have_thread = false;
+  }
+  if (capturing) {
+    if (replaying)
+      rp_replay_stop();
+    else
+      rp_osc_worker_change_state(rp_osc_idle_state);
+  }
+  capturing = false;
+};
+
+bool running() {
+  return delivering;
+};
+
+void get_stream_header(digdar_stream_header *hdr) {
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->magic = DIGDAR_STREAM_MAGIC;
+  hdr->version = DIGDAR_STREAM_VERSION;
+  hdr->header_size = sizeof(*hdr);
+  hdr->decim = decim;
+  hdr->n_samples = n_samples;
+  hdr->n_samples_out = n_samples_out;
+  hdr->psize = psize;
+  hdr->num_range_segments = num_range_segments;
+  memcpy(hdr->range_profile, range_profile, sizeof(range_profile));
+  hdr->n_channels = n_channels;
+  hdr->channel_layout = channel_layout;
+};
+
+int set_param(const char *name, uint32_t value) {
+  // set the FPGA register given by name to the specified value
+  // Only writable 32-bit registers can be set.
+  int i = digdar_reg_find(name);
+  return i < 0 ? -1 : osc_fpga_set_reg(& digdar_regs[i], value);
+};
+
+uint64_t get_param(const char *name) {
+  int i = digdar_reg_find(name);
+  return i < 0 ? 0 : osc_fpga_get_reg(& digdar_regs[i]);
+};
+
+int chunks_pending() {
+  return rp_osc_chunks_pending();
+};
+
+uint32_t latest_arp() {
+  return latest_arp_count;
+};
+
+uint16_t max_view_pulses() {
+  return chunk_size;
+};
+
+} // namespace digdar
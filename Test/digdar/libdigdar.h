@@ -0,0 +1,174 @@
+/* -*- c++ -*- */
+/*
+ * libdigdar - capture radar pulses into the pulse buffer, and hand them
+ * to in-process consumers.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#ifndef INCLUDED_LIBDIGDAR_H
+#define INCLUDED_LIBDIGDAR_H
+
+#include <stdint.h>
+#include "pulse_metadata.h"
+#include "stream_header.h"
+#include "worker.h"
+
+/*
+ * The FPGA, and so the pulse buffer, exists once per process, so the
+ * library has no instances: open() sets up capture from a config, and
+ * the other functions act on that single capture.
+ *
+ * Consumers register callbacks, which are called on the thread running
+ * run() (or the one started by start()) as chunks of the pulse buffer
+ * are filled.  Callbacks are given const views into the pulse buffer,
+ * without copying; a view is valid only until the callback returns.
+ */
+
+namespace digdar {
+
+/*!
+ * \brief capture settings; the defaults are those of the digdar program
+ */
+struct config {
+  uint16_t    n_samples       = 3000;  /**< samples to grab per radar pulse; up to 16384 */
+  uint32_t    decim           = 1;     /**< decimation: 1, 2, 3, 4, 8, 64, 1024, 8192, or 65536 */
+  bool        use_sum         = false; /**< return the sum of samples in each decimation period, rather than their average; decim must be <= 4 */
+  uint16_t    n_channels      = 1;     /**< 1 (channel A) or 2 (channels A and B) */
+  uint16_t    channel_layout  = CHANNEL_LAYOUT_PLANAR; /**< how two channels' samples are arranged in a pulse */
+  uint16_t    ring_slots      = 0;     /**< slots in the FPGA pulse ring; 0 means re-arm for each pulse */
+  uint32_t    dma_phys        = 0;     /**< physical address of the DDR region the FPGA writes pulses into */
+  uint32_t    dma_bytes       = 0;     /**< size of that region; 0 means no DMA */
+  uint32_t    pulses          = 0;     /**< pulses to hold in the pulse buffer; 0 means as many as fit in max_memory */
+  uint32_t    max_memory      = 150000000; /**< maximum bytes of pulse buffer */
+  uint16_t    acps            = 450;   /**< ACPs per sweep; used to locate removed sectors */
+  sector      removals[MAX_REMOVALS];  /**< sectors, in ACPs, whose pulses are dropped */
+  uint16_t    num_removals    = 0;     /**< number of valid entries in removals */
+  const char *profile_spec    = 0;     /**< range profile SPAN:FACTOR[,SPAN:FACTOR...], or 0 to keep all samples */
+  const char *param_file      = 0;     /**< file of NAME VALUE lines for FPGA registers, or 0 */
+  const char *replay_filename = 0;     /**< replay pulses from this digdar output file instead of capturing, or 0 */
+  bool        replay_fast     = false; /**< replay as fast as consumers accept pulses, rather than at recorded timing */
+};
+
+/*!
+ * \brief a const view of consecutive pulses from one sweep, in the pulse buffer
+ *
+ * Chunks of the pulse buffer never span sweeps, so a sweep is delivered
+ * as one or more views, in order; new_sweep marks the first of a sweep.
+ */
+struct sweep_view {
+  uint32_t              num_arp;   /**< ARP count of the sweep */
+  bool                  new_sweep; /**< true if these are the first pulses delivered from the sweep */
+  const pulse_metadata *first;     /**< first pulse */
+  uint32_t              n_pulses;  /**< number of pulses */
+  uint32_t              psize;     /**< bytes per pulse */
+
+  /*!
+   * \brief return the i'th pulse in the view
+   */
+  const pulse_metadata *pulse(uint32_t i) const {
+    return (const pulse_metadata *) (((const char *) first) + i * psize);
+  };
+};
+
+/*!
+ * \brief called for each pulse; return a negative value to stop delivery
+ */
+typedef int (*pulse_callback)(const pulse_metadata *pulse, void *user_data);
+
+/*!
+ * \brief called for each run of pulses from one sweep; return a negative value to stop delivery
+ */
+typedef int (*sweep_callback)(const sweep_view &sweep, void *user_data);
+
+/*!
+ * \brief validate settings, set up the FPGA (or the replay), and allocate the pulse buffer
+ *
+ * Errors are printed to stderr.  Returns 0 on success, -1 on failure.
+ */
+int open(const config &cfg);
+
+/*!
+ * \brief set a pulse callback, or 0 to remove it
+ */
+void set_pulse_callback(pulse_callback f, void *user_data);
+
+/*!
+ * \brief set a sweep callback, or 0 to remove it
+ */
+void set_sweep_callback(sweep_callback f, void *user_data);
+
+/*!
+ * \brief start capturing, and deliver pulses to the callbacks on the calling thread
+ *
+ * Returns when stop() is called, a callback returns a negative value, or a
+ * replay has been completely delivered.  Returns 0 on success, -1 on failure.
+ */
+int run();
+
+/*!
+ * \brief start capturing, and deliver pulses to the callbacks on a new thread
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int start();
+
+/*!
+ * \brief stop delivering pulses, and wait for the thread started by start(), if any
+ */
+void stop();
+
+/*!
+ * \brief return true if pulses are still being delivered
+ */
+bool running();
+
+/*!
+ * \brief pin the thread which fills the pulse buffer (the worker, or the replay thread) to a core
+ *
+ * A negative cpu means any core.  Must be called after open().  Returns 0 on success, -1 on failure.
+ */
+int set_capture_cpu(int cpu);
+
+/*!
+ * \brief pin the thread started by start(), which calls the callbacks, to a core
+ *
+ * A negative cpu means any core.  Returns 0 on success, -1 on failure.
+ */
+int set_reader_cpu(int cpu);
+
+/*!
+ * \brief fill in a stream header describing the pulses delivered
+ */
+void get_stream_header(digdar_stream_header *hdr);
+
+/*!
+ * \brief set the named FPGA register; returns 0 on success, -1 if it is unknown or read-only
+ */
+int set_param(const char *name, uint32_t value);
+
+/*!
+ * \brief return the value of the named FPGA register, or 0 if it is unknown
+ */
+uint64_t get_param(const char *name);
+
+/*!
+ * \brief return the number of filled chunks not yet delivered; i.e. how far consumers are behind
+ */
+int chunks_pending();
+
+/*!
+ * \brief return the ARP count at the most recently captured pulse
+ */
+uint32_t latest_arp();
+
+/*!
+ * \brief return the largest number of pulses delivered in one sweep_view
+ */
+uint16_t max_view_pulses();
+
+} // namespace digdar
+
+#endif /* INCLUDED_LIBDIGDAR_H */
@@ -0,0 +1,285 @@
+/*
+ * pipeline - run processing stages on chunks of the pulse buffer, each
+ * on its own thread, connected by bounded lock-free queues.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "pipeline.h"
+#include "worker.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * The Zynq has two cores: one is mostly taken by the worker thread, which
+ * polls the FPGA and copies pulses into the pulse buffer; the other runs
+ * whatever consumes them.  Rather than each consumer (filter, detector,
+ * codec, output) growing its own threads and locks, consumers are written
+ * as stage functions and strung together here.
+ *
+ * Chunks are held by the worker from the time libdigdar's reader hands
+ * them to the pipeline until the last stage has processed them, so every
+ * stage sees them intact.  Since stages are a chain, chunks leave the
+ * pipeline in the order they entered it, which is the order they are
+ * released in.
+ *
+ * Idle stages wait the same way libdigdar's reader does, with a short
+ * sleep and a yield, since on two cores a stage spinning would starve
+ * the worker.
+ */
+
+namespace digdar {
+
+/** Time an idle stage sleeps before checking its queue again, in microseconds */
+#define PIPELINE_IDLE_USEC 20
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * (uint64_t) 1000000000 + ts.tv_nsec;
+};
+
+static void idle() {
+  usleep(PIPELINE_IDLE_USEC);
+  sched_yield();
+};
+
+pipeline::pipeline(uint32_t queue_len) :
+  queue_len(queue_len),
+  fill_cpu(-1),
+  reader_cpu(-1),
+  started(false),
+  stop_requested(false),
+  captured(0),
+  blocked_ns(0),
+  prev_captured(0),
+  prev_blocked_ns(0),
+  prev_dropped(0),
+  prev_report(0)
+{
+};
+
+pipeline::~pipeline() {
+  stop();
+  for (uint32_t i = 0; i < stages.size(); ++i) {
+    spsc_queue<chunk_handle>::destroy(stages[i]->in);
+    delete stages[i];
+  }
+};
+
+int pipeline::add_stage(const char *name, stage_function f, void *user_data, int cpu, uint32_t batch) {
+  if (started || ! f || batch == 0)
+    return -1;
+  spsc_queue<chunk_handle> *q = spsc_queue<chunk_handle>::create(queue_len);
+  if (! q)
+    return -1;
+  stage *s = new stage;
+  s->name = name;
+  s->f = f;
+  s->user_data = user_data;
+  s->cpu = cpu;
+  s->batch = batch;
+  s->in = q;
+  s->owner = this;
+  s->index = stages.size();
+  s->done = false;
+  s->chunks = s->pulses = s->batches = s->busy_ns = 0;
+  s->max_queued = 0;
+  s->prev_chunks = s->prev_pulses = s->prev_batches = s->prev_busy_ns = 0;
+  stages.push_back(s);
+  return 0;
+};
+
+void pipeline::set_capture_cpus(int fill_cpu, int reader_cpu) {
+  this->fill_cpu = fill_cpu;
+  this->reader_cpu = reader_cpu;
+};
+
+int pipeline::capture_sweep(const sweep_view &v, void *user_data) {
+  // libdigdar sweep callback: queue a chunk for the first stage,
+  // waiting if that stage is behind
+  pipeline *p = (pipeline *) user_data;
+  stage *s = p->stages[0];
+  chunk_handle h;
+  h.view = v;
+  h.data = 0;
+  h.len = 0;
+  if (! s->in->push(h)) {
+    uint64_t t0 = now_ns();
+    do {
+      if (p->stop_requested)
+        return -1;
+      idle();
+    } while (! s->in->push(h));
+    p->blocked_ns += now_ns() - t0;
+  }
+  ++p->captured;
+  return p->stop_requested ? -1 : 0;
+};
+
+void pipeline::pass_on(stage *s, chunk_handle *batch, uint32_t n) {
+  // hand a processed batch to the next stage, or release its chunks
+  // if this is the last stage
+  if (s->index + 1 == stages.size()) {
+    for (uint32_t i = 0; i < n; ++i)
+      rp_osc_release_chunk();
+    return;
+  }
+  spsc_queue<chunk_handle> *out = stages[s->index + 1]->in;
+  for (uint32_t i = 0; i < n; ++i)
+    while (! out->push(batch[i])) {
+      if (stop_requested)
+        return;
+      idle();
+    }
+};
+
+void pipeline::run_stage(stage *s) {
+  std::vector<chunk_handle> batch(s->batch);
+  for (;;) {
+    if (stop_requested)
+      break;
+    // check before popping, so the final chunks aren't missed
+    bool upstream_done = s->index == 0 ? ! digdar::running() : (bool) stages[s->index - 1]->done;
+    uint32_t queued = s->in->size();
+    uint32_t n = s->in->pop(&batch[0], s->batch);
+    if (n == 0) {
+      if (upstream_done)
+        break;
+      idle();
+      continue;
+    }
+    if (queued > s->max_queued)
+      s->max_queued = queued;
+    uint64_t t0 = now_ns();
+    int rv = s->f(&batch[0], n, s->user_data);
+    s->busy_ns += now_ns() - t0;
+    ++s->batches;
+    s->chunks += n;
+    uint64_t pulses = 0;
+    for (uint32_t i = 0; i < n; ++i)
+      pulses += batch[i].view.n_pulses;
+    s->pulses += pulses;
+    if (rv < 0)
+      stop_requested = true;
+    pass_on(s, &batch[0], n);
+  }
+  s->done = true;
+};
+
+void *pipeline::stage_thread(void *arg) {
+  stage *s = (stage *) arg;
+  s->owner->run_stage(s);
+  return 0;
+};
+
+int pipeline::start() {
+  if (started)
+    return 0;
+  if (stages.empty()) {
+    fprintf(stderr, "pipeline has no stages\n");
+    return -1;
+  }
+  // the worker needs a free chunk to write to, besides those in the pipeline
+  uint32_t in_flight = 1;
+  for (uint32_t i = 0; i < stages.size(); ++i)
+    in_flight += stages[i]->in->capacity() + stages[i]->batch;
+  if (in_flight + 2 > num_chunks)
+    fprintf(stderr, "Warning: pipeline can hold %u chunks, but the pulse buffer has only %u;\n"
+            "capture will drop chunks if the pipeline falls behind.\n", in_flight, num_chunks);
+
+  stop_requested = false;
+  if (rp_osc_hold_chunks(1) < 0) {
+    fprintf(stderr, "a pipeline can't be used with --dma, since the DMA engine can only skip the one chunk being read\n");
+    return -1;
+  }
+  if (fill_cpu >= 0)
+    set_capture_cpu(fill_cpu);
+  set_reader_cpu(reader_cpu);
+  prev_report = now_ns() / 1.0e9;
+  prev_dropped = rp_osc_chunks_dropped();
+  // start capture first, since the first stage quits once capture isn't running
+  set_sweep_callback(capture_sweep, this);
+  if (digdar::start() < 0) {
+    set_sweep_callback(0, 0);
+    rp_osc_hold_chunks(0);
+    return -1;
+  }
+  for (uint32_t i = 0; i < stages.size(); ++i) {
+    stage *s = stages[i];
+    s->done = false;
+    if (pthread_create(&s->thread, NULL, stage_thread, s) != 0) {
+      fprintf(stderr, "couldn't start thread for pipeline stage %s\n", s->name);
+      stop_requested = true;
+      digdar::stop();
+      while (i-- > 0)
+        pthread_join(stages[i]->thread, NULL);
+      set_sweep_callback(0, 0);
+      rp_osc_hold_chunks(0);
+      return -1;
+    }
+    if (s->cpu >= 0)
+      rp_set_thread_cpu(s->thread, s->cpu);
+  }
+  started = true;
+  return 0;
+};
+
+void pipeline::stop() {
+  if (! started)
+    return;
+  digdar::stop();
+  set_sweep_callback(0, 0);
+  // stages finish what is already queued, then see their upstream is done
+  for (uint32_t i = 0; i < stages.size(); ++i)
+    pthread_join(stages[i]->thread, NULL);
+  rp_osc_hold_chunks(0);
+  started = false;
+};
+
+bool pipeline::running() {
+  return started && ! stages.back()->done;
+};
+
+uint32_t pipeline::chunks_queued() {
+  return captured - stages.back()->chunks;
+};
+
+void pipeline::report(FILE *f) {
+  double t = now_ns() / 1.0e9;
+  double dt = t - prev_report;
+  if (dt <= 0)
+    return;
+  prev_report = t;
+
+  uint64_t c = captured, b = blocked_ns;
+  uint32_t d = rp_osc_chunks_dropped();
+  fprintf(f, "pipeline: capture %.1f chunks/s, blocked %.1f%%, %u chunks dropped, %u queued\n",
+          (c - prev_captured) / dt, (b - prev_blocked_ns) / 1.0e7 / dt, d - prev_dropped, chunks_queued());
+  prev_captured = c;
+  prev_blocked_ns = b;
+  prev_dropped = d;
+
+  for (uint32_t i = 0; i < stages.size(); ++i) {
+    stage *s = stages[i];
+    uint64_t chunks = s->chunks, pulses = s->pulses, batches = s->batches, busy = s->busy_ns;
+    uint32_t max_queued = s->max_queued.exchange(0);
+    fprintf(f, "  %-12s cpu %2d: %8.1f chunks/s %10.0f pulses/s %5.2f chunks/batch (max %u), busy %5.1f%%, queue max %u/%u\n",
+            s->name, s->cpu, (chunks - s->prev_chunks) / dt, (pulses - s->prev_pulses) / dt,
+            batches > s->prev_batches ? (chunks - s->prev_chunks) / (double) (batches - s->prev_batches) : 0.0,
+            s->batch, (busy - s->prev_busy_ns) / 1.0e7 / dt, max_queued, s->in->capacity());
+    s->prev_chunks = chunks;
+    s->prev_pulses = pulses;
+    s->prev_batches = batches;
+    s->prev_busy_ns = busy;
+  }
+};
+
+} // namespace digdar
@@ -0,0 +1,241 @@
+/* -*- c++ -*- */
+/*
+ * pipeline - run processing stages on chunks of the pulse buffer, each
+ * on its own thread, connected by bounded lock-free queues.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#ifndef INCLUDED_PIPELINE_H
+#define INCLUDED_PIPELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <atomic>
+#include <new>
+#include <vector>
+#include "libdigdar.h"
+
+/*
+ * A pipeline is a chain of stages, e.g. capture -> filters -> codecs ->
+ * sinks.  Capture is libdigdar's reader, which hands each filled chunk of
+ * the pulse buffer to the first stage; each stage hands what it has
+ * processed to the next, and the last stage releases the chunks back to
+ * the worker.  Chunks are passed by handle, not copied; the worker
+ * skips over chunks still in the pipeline, and drops a chunk of pulses
+ * (counted in the report) if the pipeline holds all the others.
+ *
+ * Each stage runs on its own thread, which can be pinned to a core, and is
+ * given up to its batch size of handles at once.  Stages only see handles
+ * in the order chunks were filled, so a stage needs no locking of its own.
+ *
+ * As with libdigdar, there is one capture per process, so only one
+ * pipeline can be running at a time.
+ */
+
+namespace digdar {
+
+/*!
+ * \brief a chunk of pulses passed along the pipeline
+ */
+struct chunk_handle {
+  sweep_view view;   /**< the pulses, in the pulse buffer; stages may modify them in place */
+  void      *data;   /**< for a stage to pass what it made from the pulses (e.g. encoded bytes) to later stages; 0 from capture */
+  uint32_t   len;    /**< bytes at data */
+};
+
+/*!
+ * \brief process a batch of n chunks; return a negative value to stop the pipeline
+ */
+typedef int (*stage_function)(chunk_handle *batch, uint32_t n, void *user_data);
+
+/*!
+ * \brief bounded single-producer, single-consumer queue
+ *
+ * Capacity is rounded up to a power of two.  push() and pop() never block.
+ */
+template <typename T>
+class spsc_queue {
+public:
+  /*!
+   * \brief add an item; returns false if the queue is full
+   */
+  bool push(const T &item) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) > mask)
+      return false;
+    slots[t & mask] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  };
+
+  /*!
+   * \brief remove up to max items into out; returns the number removed
+   */
+  uint32_t pop(T *out, uint32_t max) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    uint32_t n = tail.load(std::memory_order_acquire) - h;
+    if (n > max)
+      n = max;
+    for (uint32_t i = 0; i < n; ++i)
+      out[i] = slots[(h + i) & mask];
+    head.store(h + n, std::memory_order_release);
+    return n;
+  };
+
+  /*!
+   * \brief number of items in the queue; exact only when called by the producer or consumer
+   */
+  uint32_t size() const {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+  };
+
+  uint32_t capacity() const {
+    return mask + 1;
+  };
+
+  /*!
+   * \brief allocate a queue; use this rather than new
+   *
+   * Before C++17, new doesn't honour the alignment of head and tail, so
+   * they could still share a cache line.  Returns 0 on failure.
+   */
+  static spsc_queue *create(uint32_t capacity) {
+    void *p;
+    if (posix_memalign(&p, alignof(spsc_queue), sizeof(spsc_queue)) != 0)
+      return 0;
+    return new (p) spsc_queue(capacity);
+  };
+
+  /*!
+   * \brief free a queue allocated by create()
+   */
+  static void destroy(spsc_queue *q) {
+    if (! q)
+      return;
+    q->~spsc_queue();
+    free(q);
+  };
+
+private:
+  spsc_queue(uint32_t capacity) : head(0), tail(0) {
+    uint32_t n = 1;
+    while (n < capacity)
+      n <<= 1;
+    slots.resize(n);
+    mask = n - 1;
+  };
+
+  std::vector<T> slots;
+  uint32_t mask;
+  // head and tail are written by different threads, so keep them on different cache lines
+  alignas(64) std::atomic<uint32_t> head; // index of next item to pop; written by the consumer
+  alignas(64) std::atomic<uint32_t> tail; // index of next item to push; written by the producer
+};
+
+class pipeline {
+public:
+  /*!
+   * \brief create an empty pipeline whose queues hold up to queue_len chunks each
+   */
+  pipeline(uint32_t queue_len = 8);
+  ~pipeline();
+
+  /*!
+   * \brief append a stage
+   *
+   * \param name used in the report
+   * \param f called with batches of chunks
+   * \param user_data passed to f
+   * \param cpu core to pin the stage's thread to, or -1 for any
+   * \param batch largest number of chunks to pass to f at once
+   *
+   * Stages can only be added before start().  Returns 0 on success, -1 on failure.
+   */
+  int add_stage(const char *name, stage_function f, void *user_data, int cpu = -1, uint32_t batch = 1);
+
+  /*!
+   * \brief pin capture to cores: the thread which fills the pulse buffer, and the one which hands chunks to the first stage
+   *
+   * -1 means any core.  Must be called before start().
+   */
+  void set_capture_cpus(int fill_cpu, int reader_cpu);
+
+  /*!
+   * \brief start the stage threads, and capture into them
+   *
+   * digdar::open() must have been called.  Returns 0 on success, -1 on failure.
+   */
+  int start();
+
+  /*!
+   * \brief stop capture, let the stages finish the chunks already in the pipeline, and wait for their threads
+   */
+  void stop();
+
+  /*!
+   * \brief return true until capture has ended (e.g. a replay is finished, or a stage stopped the pipeline) and all stages are idle
+   */
+  bool running();
+
+  /*!
+   * \brief return the number of chunks captured but not yet through the pipeline
+   */
+  uint32_t chunks_queued();
+
+  /*!
+   * \brief print each stage's throughput and utilization since the previous report (or start()) to f
+   */
+  void report(FILE *f);
+
+private:
+  struct stage {
+    const char *name;
+    stage_function f;
+    void *user_data;
+    int cpu;
+    uint32_t batch;
+    spsc_queue<chunk_handle> *in;  // chunks waiting for this stage
+    pthread_t thread;
+    pipeline *owner;
+    uint32_t index;                // position in the pipeline
+    std::atomic<bool> done;        // true once the stage has processed everything it will be given
+
+    // counts, updated by the stage's thread
+    std::atomic<uint64_t> chunks;
+    std::atomic<uint64_t> pulses;
+    std::atomic<uint64_t> batches;
+    std::atomic<uint64_t> busy_ns;  // time spent in f
+    std::atomic<uint32_t> max_queued; // deepest the input queue has been
+
+    // counts at the previous report
+    uint64_t prev_chunks, prev_pulses, prev_batches, prev_busy_ns;
+  };
+
+  static int capture_sweep(const sweep_view &v, void *user_data);
+  static void *stage_thread(void *arg);
+  void run_stage(stage *s);
+  void pass_on(stage *s, chunk_handle *batch, uint32_t n);
+
+  uint32_t queue_len;
+  std::vector<stage *> stages;
+  int fill_cpu;
+  int reader_cpu;
+  bool started;
+  std::atomic<bool> stop_requested; // true once a stage has asked the pipeline to stop
+
+  // capture counts, updated by the reader thread
+  std::atomic<uint64_t> captured;   // chunks handed to the first stage
+  std::atomic<uint64_t> blocked_ns; // time the reader waited because the first stage's queue was full
+  uint64_t prev_captured, prev_blocked_ns;
+  uint32_t prev_dropped;
+  double prev_report; // time of the previous report
+};
+
+} // namespace digdar
+
+#endif /* INCLUDED_PIPELINE_H */
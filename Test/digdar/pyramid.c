@@ -0,0 +1,210 @@
+/*
+ * Multi-resolution sweep pyramid for zoomed-out viewers.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "pyramid.h"
+#include "worker.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * A viewer zoomed out to the full range of the radar can show only a
+ * fraction of the range bins and bearings of a sweep, so the pyramid
+ * keeps sweeps at 2x, 4x and 8x reduced resolution, from which viewers
+ * choose.  Each pulse at level L is the element-wise maximum of a pair of
+ * consecutive pulses at level L - 1, each first reduced by taking the
+ * maximum of each pair of consecutive samples.  Taking maxima rather than
+ * averages keeps small, bright targets visible at every level.
+ *
+ * The pyramid is updated incrementally, one chunk at a time, as chunks
+ * are sent: level 1 is built from the chunk's pulses, level 2 from the
+ * pulses level 1 completed, and so on.  A pulse whose partner hasn't yet
+ * arrived is kept until the next chunk; at the end of a sweep it is sent
+ * alone, so that no pulse is lost.
+ */
+
+typedef struct {
+  uint16_t ns;       // samples per channel
+  uint32_t psize;    // bytes per pulse record
+  char *out;         // pulses completed by the current update, then the pulse being built
+  uint32_t n_out;    // number of completed pulses in out
+  int building;      // true if out holds a pulse awaiting its partner, after the completed ones
+} pyramid_level;
+
+static pyramid_level levels[PYRAMID_LEVELS + 1]; // [0] is unused
+
+/** @brief Returns the number of samples per channel at a pyramid level. */
+uint16_t pyramid_samples(uint16_t level)
+{
+  return n_samples_out >> level;
+};
+
+/** @brief Returns the size of a pulse record at a pyramid level. */
+uint32_t pyramid_psize(uint16_t level)
+{
+  return offsetof(pulse_metadata, data) + pyramid_samples(level) * n_channels * sizeof(uint16_t);
+};
+
+/** @brief Allocates the pyramid.
+ *
+ * @param [in] max_pulses largest number of pulses passed to one pyramid_update
+ *
+ * @retval -1 Failure
+ * @retval 0 Success
+ */
+int pyramid_init(uint32_t max_pulses)
+{
+  for (int l = 1; l <= PYRAMID_LEVELS; ++l) {
+    pyramid_level *lv = &levels[l];
+    lv->ns = pyramid_samples(l);
+    if (lv->ns == 0) {
+      fprintf(stderr, "too few samples per pulse for the sweep pyramid\n");
+      return -1;
+    }
+    lv->psize = pyramid_psize(l);
+    lv->n_out = 0;
+    lv->building = 0;
+    // completed pulses, plus the one being built
+    lv->out = malloc(((max_pulses >> l) + 2) * lv->psize);
+    if (! lv->out) {
+      fprintf(stderr, "couldn't allocate sweep pyramid\n");
+      return -1;
+    }
+  }
+  return 0;
+};
+
+/** @brief Pools pairs of samples: dst[j] = max(src[2j], src[2j+1]), or
+ * with the existing dst[j] too, unless first.
+ */
+static inline void pool_pairs(int16_t *dst, const int16_t *src, uint32_t ns, int first)
+{
+  uint32_t j = 0;
+#ifdef __ARM_NEON__
+  if (first) {
+    for (; j + 8 <= ns; j += 8) {
+      int16x8x2_t v = vld2q_s16(src + 2 * j);
+      vst1q_s16(dst + j, vmaxq_s16(v.val[0], v.val[1]));
+    }
+  } else {
+    for (; j + 8 <= ns; j += 8) {
+      int16x8x2_t v = vld2q_s16(src + 2 * j);
+      vst1q_s16(dst + j, vmaxq_s16(vld1q_s16(dst + j), vmaxq_s16(v.val[0], v.val[1])));
+    }
+  }
+#endif
+  for (; j < ns; ++j) {
+    int16_t a = src[2 * j], b = src[2 * j + 1];
+    int16_t m = a > b ? a : b;
+    if (first || m > dst[j])
+      dst[j] = m;
+  }
+};
+
+/** @brief Pools one pulse record at half the range resolution into another,
+ * which is started from it if first.
+ */
+static void pool_pulse(char *dst, const char *src, uint32_t in_ns, uint32_t ns, int first)
+{
+  uint32_t meta = offsetof(pulse_metadata, data);
+  if (first)
+    memcpy(dst, src, meta);
+  int16_t *d = (int16_t *) (dst + meta);
+  const int16_t *s = (const int16_t *) (src + meta);
+  if (n_channels == 1 || channel_layout == CHANNEL_LAYOUT_PLANAR) {
+    for (uint16_t c = 0; c < n_channels; ++c)
+      pool_pairs(d + c * ns, s + c * in_ns, ns, first);
+    return;
+  }
+  // interleaved channels: pair each sample with the next of the same channel
+  for (uint32_t j = 0; j < ns; ++j) {
+    for (uint16_t c = 0; c < n_channels; ++c) {
+      int16_t a = s[2 * j * n_channels + c], b = s[(2 * j + 1) * n_channels + c];
+      int16_t m = a > b ? a : b;
+      if (first || m > d[j * n_channels + c])
+        d[j * n_channels + c] = m;
+    }
+  }
+};
+
+static void emit_level(uint16_t level, const char *pulses, uint32_t n, uint32_t ns, uint32_t psize,
+                       pyramid_emit_fn emit, void *ctx)
+{
+  if (n == 0)
+    return;
+  sweep_header hdr;
+  hdr.magic = DIGDAR_SWEEP_MAGIC;
+  hdr.num_arp = ((const pulse_metadata *) pulses)->num_arp;
+  hdr.level = level;
+  hdr.flags = level ? DEGRADE_PYRAMID : 0;
+  hdr.n_pulses = n;
+  hdr.n_samples = ns;
+  hdr.psize = psize;
+  emit(&hdr, pulses, ctx);
+};
+
+static void update_levels(const char *in, uint32_t n, int finish, pyramid_emit_fn emit, void *ctx)
+{
+  // feed n pulses of level 0 to level 1, its completed pulses to level 2, and
+  // so on, emitting the completed pulses of each level.  If finish, the
+  // pulse being built at each level is completed without its partner.
+  uint32_t in_ns = n_samples_out;
+  uint32_t in_psize = psize;
+  for (int l = 1; l <= PYRAMID_LEVELS; ++l) {
+    pyramid_level *lv = &levels[l];
+    lv->n_out = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+      char *dst = lv->out + lv->n_out * lv->psize;
+      pool_pulse(dst, in + i * in_psize, in_ns, lv->ns, ! lv->building);
+      if (lv->building)
+        ++lv->n_out;
+      lv->building = ! lv->building;
+    }
+    if (finish && lv->building) {
+      ++lv->n_out;
+      lv->building = 0;
+    }
+    emit_level(l, lv->out, lv->n_out, lv->ns, lv->psize, emit, ctx);
+    in = lv->out;
+    n = lv->n_out;
+    in_ns = lv->ns;
+    in_psize = lv->psize;
+  }
+  // now that the next level has used them, drop completed pulses, keeping the one being built
+  for (int l = 1; l <= PYRAMID_LEVELS; ++l) {
+    pyramid_level *lv = &levels[l];
+    if (lv->building && lv->n_out > 0)
+      memmove(lv->out, lv->out + lv->n_out * lv->psize, lv->psize);
+  }
+};
+
+/** @brief Adds a run of pulses from one sweep to the pyramid.
+ *
+ * Blocks of pulses completed at each level, including the pulses
+ * themselves at level 0, are passed to emit, lowest level first.
+ *
+ * @param [in] src n pulse records of psize bytes each, all from one sweep
+ * @param [in] n number of pulse records in src
+ * @param [in] new_sweep true if src begins a sweep
+ * @param [in] emit function called with each block produced
+ * @param [in] ctx passed to emit
+ */
+void pyramid_update(const char *src, uint32_t n, int new_sweep, pyramid_emit_fn emit, void *ctx)
+{
+  if (new_sweep)
+    update_levels(0, 0, 1, emit, ctx); // finish the previous sweep
+  emit_level(0, src, n, n_samples_out, psize, emit, ctx);
+  update_levels(src, n, 0, emit, ctx);
+};
@@ -0,0 +1,34 @@
+/*
+ * Multi-resolution sweep pyramid for zoomed-out viewers.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#ifndef _PYRAMID_H_
+#define _PYRAMID_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pulse_metadata.h"
+#include "stream_header.h"
+
+/** Number of reduced levels above full resolution: 2x, 4x and 8x in range and azimuth */
+#define PYRAMID_LEVELS 3
+
+/** Called with each block of pulses produced at a level; level 0 is full resolution */
+typedef void (*pyramid_emit_fn)(const sweep_header *hdr, const char *pulses, void *ctx);
+
+int pyramid_init(uint32_t max_pulses);
+void pyramid_update(const char *src, uint32_t n, int new_sweep, pyramid_emit_fn emit, void *ctx);
+uint16_t pyramid_samples(uint16_t level);
+uint32_t pyramid_psize(uint16_t level);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _PYRAMID_H_ */
@@ -0,0 +1,275 @@
+/*
+ * Replay of recorded digdar output through the pulse buffer.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "replay.h"
+#include "worker.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * To benchmark and regression-test the stages downstream of capture, a
+ * recording of digdar's output can be fed back into the pulse buffer in
+ * place of the FPGA worker thread.  The replay thread fills chunks exactly
+ * as the worker does (a new chunk at each ARP, or when a chunk is full),
+ * so the reader in digdar.cc, and everything after it, sees the same
+ * stream it would have seen from the radar.
+ *
+ * The recording can be raw pulse records (as written by default), or a
+ * stream beginning with a digdar_stream_header (as written with --header),
+ * in which case the header sets the sample counts, range profile and
+ * channels.  Degraded blocks in a recording can't be replayed, and are
+ * skipped.
+ *
+ * Pulses are replayed either at the recorded timing, paced by each
+ * pulse's ARP timestamp and trigger clock, or as fast as the reader will
+ * accept them.  In the latter case, the replay thread waits for the reader
+ * rather than overwriting unread chunks, so that every pulse is delivered.
+ */
+
+static FILE *replay_file = 0;
+static int replay_version = 0;   // stream format version; 0 means raw pulse records
+static int replay_realtime = 1;  // non-zero means pace pulses by their recorded times
+static pthread_t replay_thread;
+
+static volatile int replay_done = 0;
+static volatile int replay_stop = 0;        // set to make the replay thread quit before the end of the recording
+static int replay_running = 0;              // non-zero from rp_replay_start() until the thread is joined
+static uint64_t replay_pulses = 0;          // pulses written to the pulse buffer
+static uint32_t replay_skipped_blocks = 0;  // degraded blocks which couldn't be replayed
+static double replay_start = 0;             // monotonic time at which replay began
+
+static double replay_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+};
+
+/** @brief Opens a recording, and reads its stream header, if any.
+ *
+ * If the recording begins with a stream header, n_samples, n_samples_out,
+ * decim, the range profile and the channel settings are set from it.
+ * Otherwise, it is assumed to consist of raw pulse records with the
+ * sample count given on the command line.
+ *
+ * @param [in] filename path to the recording
+ *
+ * @retval -1 Failure
+ * @retval 0 Success
+ */
+int rp_replay_open(const char *filename)
+{
+  replay_file = fopen(filename, "rb");
+  if (!replay_file) {
+    fprintf(stderr, "couldn't open replay file %s\n", filename);
+    return -1;
+  }
+  setvbuf(replay_file, 0, _IOFBF, REPLAY_READ_BUF);
+
+  digdar_stream_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  uint32_t fixed = offsetof(digdar_stream_header, decim);
+  if (fread(&hdr, fixed, 1, replay_file) != 1 || hdr.magic != DIGDAR_STREAM_MAGIC) {
+    // no header, so raw pulse records
+    rewind(replay_file);
+    replay_version = 0;
+    return 0;
+  }
+  if (hdr.version > DIGDAR_STREAM_VERSION || hdr.header_size < fixed) {
+    fprintf(stderr, "replay file %s has unknown stream version %d\n", filename, hdr.version);
+    return -1;
+  }
+  // earlier versions of the header are a prefix of this one
+  uint32_t len = hdr.header_size < sizeof(hdr) ? hdr.header_size : sizeof(hdr);
+  if (fread(((char *) &hdr) + fixed, len - fixed, 1, replay_file) != 1
+      || fseek(replay_file, hdr.header_size - len, SEEK_CUR) < 0) {
+    fprintf(stderr, "replay file %s has a truncated stream header\n", filename);
+    return -1;
+  }
+  replay_version = hdr.version;
+  decim = hdr.decim;
+  n_samples = hdr.n_samples;
+  n_samples_out = hdr.n_samples_out;
+  num_range_segments = hdr.num_range_segments;
+  memcpy(range_profile, hdr.range_profile, sizeof(range_profile));
+  n_channels = hdr.n_channels ? hdr.n_channels : 1;
+  channel_layout = hdr.channel_layout;
+  return 0;
+};
+
+/** @brief Waits, if replaying at recorded timing, until a pulse is due.
+ *
+ * The wall clock is pinned to the recording at the first pulse, and again
+ * whenever the recording jumps backwards or skips ahead by more than
+ * REPLAY_MAX_GAP, e.g. between concatenated recordings.
+ */
+static void rp_replay_pace(const pulse_metadata *p)
+{
+  static double offset = 0; // wall clock minus recorded time
+  static double prev_t = -1;
+
+  double t = p->arp_clock_sec + p->arp_clock_nsec / 1.0e9 + p->trig_clock / 125.0e6;
+  double w = replay_now();
+  if (prev_t < 0 || t < prev_t || t - prev_t > REPLAY_MAX_GAP)
+    offset = w - t;
+  prev_t = t;
+  double ahead = t + offset - w;
+  if (ahead > REPLAY_MIN_SLEEP)
+    usleep(ahead * 1.0e6);
+};
+
+/** @brief Hands the current chunk to the reader, and returns the first pulse of the next.
+ *
+ * When replaying as fast as possible, waits until the next chunk has been
+ * read (and released, if held), rather than overwriting it.
+ */
+static uint32_t rp_replay_next_chunk(uint16_t n)
+{
+  if (! replay_realtime)
+    while (rp_osc_chunks_free() <= 0 && ! replay_stop)
+      usleep(100);
+  return rp_osc_finish_writer_chunk(n);
+};
+
+static void *rp_replay_worker_thread(void *args)
+{
+  uint16_t n = 0;              // number of pulses written to chunk
+  uint32_t cur_pulse = 0;      // index of current pulse in ring buffer
+  uint32_t in_block = 0;       // pulses remaining in the current sweep block
+  uint32_t prev_arp = 0;       // ARP count of previous pulse; used to detect new ARP
+  int have_arp = 0;            // non-zero once a pulse has been replayed
+  uint32_t meta = offsetof(pulse_metadata, data);
+
+  replay_start = replay_now();
+
+  while (! replay_stop) {
+    if (replay_version >= 2 && in_block == 0) {
+      sweep_header sh;
+      if (fread(&sh, sizeof(sh), 1, replay_file) != 1)
+        break;
+      if (sh.magic != DIGDAR_SWEEP_MAGIC) {
+        fprintf(stderr, "replay: bad sweep header at offset %ld; stopping\n", ftell(replay_file) - (long) sizeof(sh));
+        break;
+      }
+      if (sh.flags || sh.psize != psize) {
+        // degraded pulses can't be turned back into full ones
+        if (fseek(replay_file, (long) sh.n_pulses * sh.psize, SEEK_CUR) < 0)
+          break;
+        ++replay_skipped_blocks;
+        continue;
+      }
+      in_block = sh.n_pulses;
+      continue;
+    }
+
+    // read the metadata first, so we know whether the pulse begins a new chunk
+    pulse_metadata pm;
+    if (fread(&pm, meta, 1, replay_file) != 1)
+      break;
+    if (in_block)
+      --in_block;
+
+    if (replay_realtime)
+      rp_replay_pace(&pm);
+
+    if (n == chunk_size || ! have_arp || pm.num_arp != prev_arp) {
+      // same chunking as the capture worker: never span two sweeps
+      cur_pulse = rp_replay_next_chunk(n);
+      n = 0;
+      prev_arp = pm.num_arp;
+      have_arp = 1;
+    }
+    latest_arp_count = pm.num_arp;
+
+    pulse_metadata *pbm = (pulse_metadata *) (((char *) pulse_buffer) + cur_pulse * psize);
+    memcpy(pbm, &pm, meta);
+    if (fread(((char *) pbm) + meta, psize - meta, 1, replay_file) != 1)
+      break;
+    ++cur_pulse;
+    ++n;
+    ++replay_pulses;
+  }
+  // hand over the final, partial chunk
+  rp_replay_next_chunk(n);
+  replay_done = 1;
+  return 0;
+};
+
+/** @brief Starts the replay thread.
+ *
+ * Must be called after the pulse buffer and its chunks have been allocated.
+ *
+ * @param [in] realtime non-zero to pace pulses at their recorded times;
+ *             zero to replay as fast as the reader accepts them
+ *
+ * @retval -1 Failure
+ * @retval 0 Success
+ */
+int rp_replay_start(int realtime)
+{
+  replay_realtime = realtime;
+  replay_done = 0;
+  replay_stop = 0;
+  if (pthread_create(&replay_thread, NULL, rp_replay_worker_thread, NULL)) {
+    fprintf(stderr, "pthread_create() failed: %s\n", strerror(errno));
+    return -1;
+  }
+  replay_running = 1;
+  return 0;
+};
+
+/** @brief Stops the replay thread, if it is running, and waits for it.
+ *
+ * Pulses already in the pulse buffer are handed to the reader; a later
+ * rp_replay_start() carries on from where the recording was left.
+ */
+void rp_replay_stop(void)
+{
+  if (! replay_running)
+    return;
+  replay_stop = 1;
+  pthread_join(replay_thread, NULL);
+  replay_running = 0;
+};
+
+/** @brief Pins the replay thread to a core; a negative cpu means any core.
+ *
+ * Must be called after rp_replay_start().
+ */
+int rp_replay_set_cpu(int cpu)
+{
+  return rp_set_thread_cpu(replay_thread, cpu);
+};
+
+/** @brief Returns non-zero once every pulse in the recording has been handed to the reader. */
+int rp_replay_finished(void)
+{
+  return replay_done;
+};
+
+/** @brief Prints replay throughput to stderr. */
+void rp_replay_report(void)
+{
+  double secs = replay_now() - replay_start;
+  double mb = replay_pulses * (double) psize / 1.0e6;
+  if (secs <= 0)
+    secs = 1e-9;
+  fprintf(stderr, "replayed %llu pulses (%.1f MB) in %.3f s: %.0f pulses/s, %.2f MB/s\n",
+          (unsigned long long) replay_pulses, mb, secs, replay_pulses / secs, mb / secs);
+  if (replay_skipped_blocks)
+    fprintf(stderr, "skipped %u degraded sweep blocks\n", replay_skipped_blocks);
+};
@@ -0,0 +1,36 @@
+/*
+ * Replay of recorded digdar output through the pulse buffer.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Size of the stdio buffer used to read the recording, in bytes */
+#define REPLAY_READ_BUF (4 * 1024 * 1024)
+
+/** Don't bother sleeping when fewer than this many seconds ahead of the recording */
+#define REPLAY_MIN_SLEEP 0.001
+
+/** Gaps in the recording longer than this many seconds are skipped over */
+#define REPLAY_MAX_GAP 5.0
+
+int rp_replay_open(const char *filename);
+int rp_replay_start(int realtime);
+void rp_replay_stop(void);
+int rp_replay_set_cpu(int cpu);
+int rp_replay_finished(void);
+void rp_replay_report(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _REPLAY_H_ */
@@ -0,0 +1,97 @@
+/*
+ * Header written once at the start of a digdar output stream.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#ifndef _STREAM_HEADER_H_
+#define _STREAM_HEADER_H_
+
+#include <stdint.h>
+
+#define DIGDAR_STREAM_MAGIC   0x52444744  // "DGDR" when read as bytes on a little-endian host
+#define DIGDAR_STREAM_VERSION 2
+#define DIGDAR_SWEEP_MAGIC    0x50455753  // "SWEP" when read as bytes on a little-endian host
+
+#define MAX_RANGE_SEGMENTS 8
+
+#ifndef VELOCITY_OF_LIGHT
+#define VELOCITY_OF_LIGHT 2.99792458E8
+#endif
+
+// A range sampling profile is a list of segments, applied in order from
+// the start of the pulse.  Each segment consumes n_in samples from the
+// FPGA and stores n_in / factor samples, each the average of factor
+// consecutive FPGA samples.  A profile with a single segment of factor 1
+// is the same as no profile.
+
+typedef struct {
+  uint16_t n_in;    // number of FPGA samples consumed by this segment
+  uint16_t factor;  // number of FPGA samples averaged into each stored sample
+}   __attribute__((packed)) range_segment;
+
+// Layout of samples within a pulse record when two channels are captured.
+
+#define CHANNEL_LAYOUT_PLANAR      0  // n_samples_out samples from channel A, then n_samples_out from channel B
+#define CHANNEL_LAYOUT_INTERLEAVED 1  // A[0], B[0], A[1], B[1], ...
+
+typedef struct {
+  uint32_t magic;              // DIGDAR_STREAM_MAGIC
+  uint16_t version;            // DIGDAR_STREAM_VERSION
+  uint16_t header_size;        // size of this header, in bytes; the first sweep_header begins immediately after it
+  uint32_t decim;              // FPGA decimation rate; each FPGA sample spans decim ADC clocks (8 ns each)
+  uint16_t n_samples;          // number of FPGA samples digitized per pulse
+  uint16_t n_samples_out;      // number of samples stored per pulse per channel, after applying the range profile
+  uint32_t psize;              // size of each undegraded pulse record, in bytes (metadata + samples)
+  uint16_t num_range_segments; // number of valid entries in range_profile; 0 means every FPGA sample is stored
+  range_segment range_profile[MAX_RANGE_SEGMENTS];
+  uint16_t n_channels;         // number of channels captured per pulse: 1 (A only) or 2 (A and B)
+  uint16_t channel_layout;     // CHANNEL_LAYOUT_PLANAR or CHANNEL_LAYOUT_INTERLEAVED; only meaningful if n_channels is 2
+}   __attribute__((packed)) digdar_stream_header;
+
+
+// After the stream header, the stream consists of blocks, each being a
+// sweep_header followed by n_pulses pulse records of psize bytes, all
+// from the same sweep.  A sweep may be sent as several blocks.
+//
+// When the output link can't keep up, digdar degrades the data it sends,
+// one level at a time, at sweep boundaries.  Each level adds one of these
+// reductions to those of the previous levels; which reductions are used,
+// and in which order, is configurable.  The flags in effect for a block
+// are given in its header.
+
+#define DEGRADE_DROP_ALTERNATE  0x0001  // only every second pulse is sent
+#define DEGRADE_AVERAGE_RANGE   0x0002  // each pair of consecutive samples is replaced by their average
+#define DEGRADE_8BIT_VIDEO      0x0004  // samples are divided by 64, clipped to -128...127, and sent as int8
+#define DEGRADE_DETECTIONS_ONLY 0x0008  // samples are replaced by a list of detections; see below
+#define DEGRADE_PYRAMID         0x0010  // a pyramid level; see below
+
+// With DEGRADE_DETECTIONS_ONLY, the sample area of each pulse record
+// (channel A only) holds a uint16 count of detections, followed by
+// MAX_DETECTIONS pairs of uint16 (sample index, sample value), of which
+// the first count are valid.  A detection is a sample whose value meets
+// or exceeds the detection threshold.
+
+#define MAX_DETECTIONS 64
+
+// Viewers of the sweep pyramid (digdar --pyramid) can instead ask for
+// sweeps reduced by 2, 4 or 8 times in both range and azimuth.  Blocks
+// of such a stream have DEGRADE_PYRAMID set, and level holds the pyramid
+// level L.  Each pulse record is the maximum, sample by sample, of 2^L
+// consecutive pulses and of 2^L consecutive samples in range, so that
+// small targets remain visible; its metadata are those of the first of
+// those pulses.  n_samples gives the samples per channel remaining.
+
+typedef struct {
+  uint32_t magic;              // DIGDAR_SWEEP_MAGIC
+  uint32_t num_arp;            // ARP count for all pulses in this block
+  uint16_t level;              // degradation level in effect, or pyramid level with DEGRADE_PYRAMID; 0 means full data
+  uint16_t flags;              // DEGRADE_... reductions in effect
+  uint16_t n_pulses;           // number of pulse records following this header
+  uint16_t n_samples;          // samples per channel in each pulse record (before any DEGRADE_DETECTIONS_ONLY)
+  uint32_t psize;              // size of each pulse record following this header, in bytes
+}   __attribute__((packed)) sweep_header;
+
+#endif /* _STREAM_HEADER_H_ */
@@ -16,10 +16,13 @@
  * http://en.wikipedia.org/wiki/POSIX_Threads
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <pthread.h>
+#include <sched.h>
 #include <errno.h>
 #include <string.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <math.h>
 #include <stdlib.h>
@@ -179,7 +182,19 @@ int rp_osc_worker_change_state(rp_osc_worker_state_t new_state)
 static int16_t reader_chunk_index = -1; // which chunk is currently being read by the export thread
 static int16_t writer_chunk_index = 0;  // which chunk is currently being written by the capture thread
 
-int rp_osc_get_chunk_for_reader(uint16_t * cur_pulse, uint16_t * num_pulses) {
+/* Normally a chunk is released by the reader when it asks for the next one.
+ * A pipeline keeps several chunks in flight, so it asks for chunks to be
+ * held once read, and releases them, oldest first, when it is done with them.
+ * Held chunks are always consecutive, ending at the reader's chunk.
+ */
+static int hold_chunks = 0;            // if non-zero, chunks stay held after being read, until released
+static int16_t held_chunk_index = 0;   // oldest held chunk
+static uint16_t num_held_chunks = 0;   // number of held chunks
+static uint32_t chunks_dropped = 0;    // chunks overwritten by the writer because all others were held
+
+volatile uint32_t latest_arp_count = 0;
+
+int rp_osc_get_chunk_for_reader(uint32_t * cur_pulse, uint32_t * num_pulses) {
   // return the index of the first pulse in a chunk, and the number of pulses in the chunk
   // It must already have been filled by writer.
   // These values are returned in the passed pointers; the function returns
@@ -191,8 +206,21 @@ int rp_osc_get_chunk_for_reader(uint16_t * cur_pulse, uint16_t * num_pulses) {
   // if it's the writer's chunk, we fail
   if (ci == writer_chunk_index)
     ci = -1;
-  else
+  // the DMA engine chooses chunks itself, and writer_chunk_index only
+  // follows the header records it has finished, so tell the engine not to
+  // enter ci, then make sure it hadn't already; it can only be told one
+  // chunk, which is why chunks aren't held with DMA
+  if (dma_bytes && ci >= 0) {
+    osc_fpga_dma_set_read_chunk(ci);
+    if (osc_fpga_dma_get_chunk() == ci) {
+      osc_fpga_dma_set_read_chunk(reader_chunk_index);
+      ci = -1;
+    }
+  }
+  if (ci >= 0)
     reader_chunk_index = ci;
+  if (hold_chunks && ci >= 0 && num_held_chunks++ == 0)
+    held_chunk_index = ci;
   // Note: it's possible the writer has passed us,
   // in which case it makes more sense to skip the
   // as-yet unwritten chunks, because otherwise we'll
@@ -208,21 +236,381 @@ int rp_osc_get_chunk_for_reader(uint16_t * cur_pulse, uint16_t * num_pulses) {
   return 1;
 };
 
+/** @brief Adaptive trigger polling
+ *
+ * Rather than polling the FPGA every few microseconds regardless of the
+ * radar's pulse rate, the worker tracks the trigger interval, using the
+ * saved trigger clocks for each captured pulse, and once that interval has
+ * been stable for a few pulses it sleeps until shortly before the next pulse
+ * is expected to have been captured, then spins on the FPGA status.
+ * Any change in the pulse train (e.g. a range scale or stagger change, or
+ * the transmitter going to standby) drops it back to conservative polling.
+ *
+ * All clock quantities here are in ADC clock ticks (8 ns @ 125 MHz) and are
+ * only the low-order 32 bits, which is fine since intervals are compared
+ * using unsigned subtraction.
+ */
+
+/** Conservative polling interval, used until the PRF is known, in microseconds */
+#define PRF_TRACK_POLL_USEC      10
+/** Number of consecutive consistent trigger intervals before we trust the estimate */
+#define PRF_TRACK_MIN_STABLE      8
+/** An interval is consistent if it lies within 1/PRF_TRACK_TOLERANCE of the estimate */
+#define PRF_TRACK_TOLERANCE      16
+/** Wake up this many ADC clocks (40 us) before the next capture should complete */
+#define PRF_TRACK_WAKE_EARLY   5000
+/** Don't bother sleeping for less than this many ADC clocks (20 us) */
+#define PRF_TRACK_MIN_SLEEP    2500
+/** Give up on the estimate if no pulse is seen in this many expected periods */
+#define PRF_TRACK_MAX_MISSED      4
+
+typedef struct {
+  uint32_t period;          // smoothed trigger interval; 0 means unknown
+  uint32_t stable;          // number of consecutive intervals consistent with period
+  uint32_t last_trig_clock; // ADC clock at most recently captured trigger
+  uint32_t capture_clocks;  // ADC clocks from trigger until capture of n_samples is complete
+} prf_tracker;
+
+static prf_tracker prf_track = {0, 0, 0, 0};
+
+/** @brief Updates the PRF estimate with the metadata for a newly captured pulse.
+ *
+ * @param [in] t the tracker
+ * @param [in] trig_clock ADC clock at the captured trigger
+ * @param [in] interval ADC clocks since the trigger preceding it, whether or not that one was captured
+ */
+static void prf_track_update(prf_tracker *t, uint32_t trig_clock, uint32_t interval)
+{
+  t->last_trig_clock = trig_clock;
+  if (t->period) {
+    int32_t diff = (int32_t) (interval - t->period);
+    if ((uint32_t) abs(diff) <= t->period / PRF_TRACK_TOLERANCE) {
+      t->period += diff / 8; // smooth out jitter in trigger detection
+      if (t->stable < PRF_TRACK_MIN_STABLE)
+        ++t->stable;
+      return;
+    }
+  }
+  // first interval, or the pulse train has changed: start over
+  t->period = interval;
+  t->stable = 0;
+};
+
+/** @brief Returns how long the worker should sleep before next checking for a trigger.
+ *
+ * @param [in] t the tracker
+ *
+ * @retval 0 the next pulse is imminent; poll again immediately
+ * @retval otherwise number of microseconds to sleep
+ */
+static uint32_t prf_track_wait_usec(prf_tracker *t)
+{
+  if (t->stable < PRF_TRACK_MIN_STABLE)
+    return PRF_TRACK_POLL_USEC;
+
+  uint32_t since = *osc_fpga_reg(OFFSET_Clocks_LO) - t->last_trig_clock;
+  if (since > PRF_TRACK_MAX_MISSED * t->period + t->capture_clocks) {
+    // radar has stopped or slowed down drastically
+    t->stable = 0;
+    return PRF_TRACK_POLL_USEC;
+  }
+
+  // the capture for the next trigger completes capture_clocks after it; the
+  // FPGA captures the first trigger after re-arming, which might be
+  // several periods after the last one we saw if copying was slow.
+  uint32_t phase = (since + t->period - t->capture_clocks % t->period) % t->period;
+  uint32_t until = t->period - phase;
+  if (until <= PRF_TRACK_WAKE_EARLY + PRF_TRACK_MIN_SLEEP)
+    return 0;
+  return (until - PRF_TRACK_WAKE_EARLY) / 125; // 125 ADC clocks per microsecond
+};
+
+int rp_osc_chunks_pending(void) {
+  // return the number of chunks which have been filled by the writer
+  // but not yet claimed by the reader; i.e. the depth of the output queue.
+  int rv;
+  pthread_mutex_lock(&rp_osc_ctrl_mutex);
+  rv = (writer_chunk_index - reader_chunk_index - 1 + num_chunks) % num_chunks;
+  pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+  return rv;
+};
+
+static int rp_osc_chunk_is_held(int16_t ci) {
+  // return non-zero if the writer must not write to chunk ci;
+  // caller must hold rp_osc_ctrl_mutex
+  return ci == reader_chunk_index
+    || (num_held_chunks && (ci - held_chunk_index + num_chunks) % num_chunks < num_held_chunks);
+};
+
 int16_t rp_osc_get_chunk_index_for_writer() {
   // return the index of a chunk which the writer can write to.
   // Normally, it's the next chunk in the ring, except that
-  // we skip over the reader's current chunk.
+  // we skip over the reader's current chunk, and any held chunks.
+  // If every other chunk is held, the writer's own chunk is
+  // written again, dropping the pulses in it.
 
   int16_t rv;
   pthread_mutex_lock(&rp_osc_ctrl_mutex);
   rv = (1 + writer_chunk_index) % num_chunks;
-  if (rv == reader_chunk_index)
+  while (rv != writer_chunk_index && rp_osc_chunk_is_held(rv))
     rv = (1 + rv) % num_chunks;
+  if (rv == writer_chunk_index)
+    ++chunks_dropped;
   writer_chunk_index = rv;
   pthread_mutex_unlock(&rp_osc_ctrl_mutex);
   return(rv);
 };
 
+uint32_t rp_osc_finish_writer_chunk(uint16_t n) {
+  // record that the writer's current chunk holds n pulses, making
+  // it available to the reader, and return the index of the first
+  // pulse in the next chunk the writer can write to.
+  pulses_in_chunk[writer_chunk_index] = n;
+  return rp_osc_get_chunk_index_for_writer() * chunk_size;
+};
+
+int rp_osc_hold_chunks(int hold) {
+  // if hold is non-zero, keep chunks held once read, until released by
+  // rp_osc_release_chunk(); otherwise, release all held chunks, and
+  // go back to releasing each chunk when the next is read.
+  // The DMA engine can only be told to skip one chunk, so chunks can't
+  // be held with DMA; returns -1 if asked to, 0 otherwise.
+  if (hold && dma_bytes)
+    return -1;
+  pthread_mutex_lock(&rp_osc_ctrl_mutex);
+  hold_chunks = hold;
+  num_held_chunks = 0;
+  pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+  return 0;
+};
+
+static void rp_osc_release_held_chunks(int n) {
+  // release the n oldest held chunks, then any empty chunks now oldest;
+  // caller must hold rp_osc_ctrl_mutex
+  while (num_held_chunks && (n > 0 || pulses_in_chunk[held_chunk_index] == 0)) {
+    if (pulses_in_chunk[held_chunk_index])
+      --n;
+    held_chunk_index = (1 + held_chunk_index) % num_chunks;
+    --num_held_chunks;
+  }
+};
+
+void rp_osc_release_chunk(void) {
+  // release the oldest held chunk with pulses, so the writer can reuse it.
+  // Empty chunks are never handed on, so they are released along with
+  // the chunks around them, keeping releases in step with the chunks.
+  pthread_mutex_lock(&rp_osc_ctrl_mutex);
+  rp_osc_release_held_chunks(1);
+  pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+};
+
+void rp_osc_release_empty_chunks(void) {
+  // release any empty chunks at the old end of the held chunks; the
+  // reader calls this after reading an empty chunk, which is released
+  // at once if nothing older is still held
+  pthread_mutex_lock(&rp_osc_ctrl_mutex);
+  rp_osc_release_held_chunks(0);
+  pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+};
+
+int rp_osc_chunks_free(void) {
+  // return the number of chunks the writer could move through before
+  // it would have to overwrite a filled chunk not yet released
+  int rv;
+  pthread_mutex_lock(&rp_osc_ctrl_mutex);
+  rv = (writer_chunk_index - reader_chunk_index - 1 + num_chunks) % num_chunks;
+  rv = num_chunks - 1 - rv - (num_held_chunks ? num_held_chunks : 1);
+  pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+  return rv;
+};
+
+uint32_t rp_osc_chunks_dropped(void) {
+  return chunks_dropped;
+};
+
+int rp_set_thread_cpu(pthread_t thread, int cpu) {
+  // pin thread to core cpu; a negative cpu means any core.
+  // Returns 0 on success, -1 on failure.
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (int i = 0; i < CPU_SETSIZE; ++i)
+    if (cpu < 0 || i == cpu)
+      CPU_SET(i, &cpus);
+  if (pthread_setaffinity_np(thread, sizeof(cpus), &cpus) != 0) {
+    fprintf(stderr, "couldn't set affinity of thread to cpu %d\n", cpu);
+    return -1;
+  }
+  return 0;
+};
+
+int rp_osc_worker_set_cpu(int cpu) {
+  return rp_set_thread_cpu(rp_osc_thread_handler, cpu);
+};
+
+static void rp_osc_follow_writer_chunk(int16_t chunk, uint16_t n) {
+  // with DMA, the FPGA has already chosen the chunk it is writing to;
+  // record that the writer's current chunk holds n pulses, making it
+  // available to the reader, and move the writer to the FPGA's chunk.
+  pthread_mutex_lock(&rp_osc_ctrl_mutex);
+  pulses_in_chunk[writer_chunk_index] = n;
+  writer_chunk_index = chunk;
+  pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+};
+
+/** Staging buffers for samples copied from the FPGA before a range profile is applied */
+static uint16_t profile_buf[OSC_FPGA_SIG_LEN];
+static uint16_t profile_buf_b[OSC_FPGA_SIG_LEN];
+
+/** Channel B sample from its FPGA buffer word, which holds the 14-bit ADC
+ *  value zero-extended; sign-extended here to match channel A. */
+#define CHB_SAMPLE(WORD) ((uint16_t) ((int32_t) (((WORD) & 0x3fff) ^ 0x2000) - 0x2000))
+
+/** @brief Copies one pulse's worth of samples out of the FPGA signal buffers.
+ *
+ * Channel A, and optionally channel B, are copied in a single pass, so
+ * that the (slow, uncached) reads from both BRAM buffers are interleaved
+ * and the loop overhead is shared.  Each channel A word holds two
+ * samples, while each channel B word holds one.  The FPGA buffers are
+ * rings, so the pulse wraps around to the start of the buffers if it
+ * began close enough to the end.
+ *
+ * @param [out] da destination for channel A samples
+ * @param [out] db destination for channel B samples, or NULL to skip channel B
+ * @param [in] stride distance between consecutive samples in da and db;
+ *             2 for interleaved channels, 1 otherwise
+ * @param [in] tr_ptr trigger write pointer, i.e. index of the first sample
+ */
+static void rp_osc_copy_samples(uint16_t *da, uint16_t *db, int stride, int32_t tr_ptr)
+{
+  int32_t *src_a = & rp_fpga_cha_signal[tr_ptr];
+  int32_t *src_b = & rp_fpga_chb_signal[tr_ptr];
+  uint16_t n1 = OSC_FPGA_SIG_LEN - tr_ptr;
+  uint16_t n2;
+  if (n1 >= n_samples) {
+    n1 = n_samples;
+    n2 = 0;
+  } else {
+    n2 = n_samples - n1;
+  }
+  uint16_t i=0;
+  // double-width reads from channel A, as this is the rate-limiting step
+  uint32_t tmp_a;
+  // when tr_ptr is odd, we need to start with the higher-order word
+  if (tr_ptr & 1) {
+    tmp_a = src_a[i];
+    da[0] = tmp_a >> 16;
+    if (db)
+      db[0] = CHB_SAMPLE(src_b[i]);
+    ++i;
+  }
+  for (/**/ ; i < n1; ++i) {
+    tmp_a = src_a[i];
+    da[i * stride] = tmp_a & 0xffff;
+    if (db)
+      db[i * stride] = CHB_SAMPLE(src_b[i]);
+    if (++i < n1) {
+      da[i * stride] = tmp_a >> 16;
+      if (db)
+        db[i * stride] = CHB_SAMPLE(src_b[i]);
+    }
+  }
+  if (n2) {
+    src_a = & rp_fpga_cha_signal[0];
+    src_b = & rp_fpga_chb_signal[0];
+    da = &da[i * stride];
+    if (db)
+      db = &db[i * stride];
+    for (i = 0; i < n2; ++i) {
+      tmp_a = src_a[i];
+      da[i * stride] = tmp_a & 0xffff;
+      if (db)
+        db[i * stride] = CHB_SAMPLE(src_b[i]);
+      if (++i < n2) {
+        da[i * stride] = tmp_a >> 16;
+        if (db)
+          db[i * stride] = CHB_SAMPLE(src_b[i]);
+      }
+    }
+  }
+};
+
+/** @brief Reduces a pulse's samples according to the range sampling profile.
+ *
+ * Each segment of the profile averages groups of factor consecutive samples,
+ * so that far ranges can be stored at lower resolution than near ones.
+ * Samples are treated as signed, since the FPGA sign-extends the ADC value.
+ *
+ * @param [out] dst destination; must have room for n_samples_out values
+ * @param [in] stride distance between consecutive samples in dst
+ * @param [in] src n_samples values, as copied from the FPGA
+ */
+static void rp_osc_apply_range_profile(uint16_t *dst, int stride, const uint16_t *src)
+{
+  for (int s = 0; s < num_range_segments; ++s) {
+    uint16_t f = range_profile[s].factor;
+    uint16_t m = range_profile[s].n_in / f;
+    if (f == 1 && stride == 1) {
+      memcpy(dst, src, m * sizeof(uint16_t));
+      dst += m;
+      src += m;
+      continue;
+    }
+    for (uint16_t i = 0; i < m; ++i) {
+      int32_t sum = 0;
+      for (uint16_t j = 0; j < f; ++j)
+        sum += (int16_t) *src++;
+      *dst = (uint16_t) (int16_t) (sum / f);
+      dst += stride;
+    }
+    src += range_profile[s].n_in - m * f; // only possible in the final segment
+  }
+};
+
+/** @brief Copies one pulse's samples from the FPGA into a pulse record.
+ *
+ * Handles the channel layout and range profile.
+ *
+ * @param [out] data the pulse record's sample area
+ * @param [in] tr_ptr trigger write pointer, i.e. index of the first sample
+ */
+static void rp_osc_store_pulse(uint16_t *data, int32_t tr_ptr)
+{
+  uint16_t *db = 0;
+  int stride = 1;
+  if (n_channels == 2) {
+    if (channel_layout == CHANNEL_LAYOUT_INTERLEAVED) {
+      db = data + 1;
+      stride = 2;
+    } else {
+      db = data + n_samples_out;
+    }
+  }
+  if (! num_range_segments) {
+    rp_osc_copy_samples(data, db, stride, tr_ptr);
+    return;
+  }
+  rp_osc_copy_samples(profile_buf, db ? profile_buf_b : 0, 1, tr_ptr);
+  rp_osc_apply_range_profile(data, stride, profile_buf);
+  if (db)
+    rp_osc_apply_range_profile(db, stride, profile_buf_b);
+};
+
+/** Longest the worker sleeps between checks of the FPGA pulse ring, in microseconds */
+#define RING_MAX_SLEEP_USEC 10000
+
+/** @brief Returns how long the worker should sleep after draining the FPGA pulse ring.
+ *
+ * Once the PRF is known, sleep until the ring is about half full;
+ * otherwise, poll conservatively.
+ */
+static uint32_t rp_osc_ring_wait_usec(void)
+{
+  if (prf_track.stable < PRF_TRACK_MIN_STABLE)
+    return PRF_TRACK_POLL_USEC;
+  uint32_t wait = (uint64_t) prf_track.period * ((dma_bytes ? chunk_size : ring_slots) / 2) / 125; // 125 ADC clocks per microsecond
+  return wait > RING_MAX_SLEEP_USEC ? RING_MAX_SLEEP_USEC : wait;
+};
+
 void *rp_osc_worker_thread(void *args)
 {
     rp_osc_worker_state_t state = rp_osc_idle_state;
@@ -236,12 +624,26 @@ void *rp_osc_worker_thread(void *args)
 
     osc_fpga_set_decim(decim);
 
-    int did_first_arm = 0;
+    prf_track.capture_clocks = (uint32_t) n_samples * decim;
+
+    // with the FPGA pulse ring, pulses are captured without re-arming,
+    // and drained a batch at a time
+    osc_fpga_ring_init(ring_slots);
+    uint32_t ring_prod = 0;    // pulses captured by the FPGA into the ring
+    uint32_t ring_cons = 0;    // pulses copied out of the ring
+    uint32_t ring_dropped = 0; // pulses dropped by the FPGA because the ring was full
+    uint32_t hdr_dropped = 0;  // pulses dropped because their header couldn't be read whole
 
-    int32_t *max_data = & rp_fpga_cha_signal[16384];
+    // with DMA, the FPGA writes samples straight into the pulse buffer, and
+    // only the metadata are filled in here; these are used in place of
+    // the pulse ring counts
+    uint32_t dma_errors = 0;    // AXI write errors seen by the DMA engine
+    const volatile digdar_dma_hdr_t *dma_hdr = NULL;
+
+    int did_first_arm = 0;
 
     int16_t n = 0;  // number of pulses written to chunk
-    int16_t cur_pulse = 0; // index of current pulse in ring buffer
+    uint32_t cur_pulse = 0; // index of current pulse in ring buffer
 
     struct timespec rtc = {0, 0}; // realtime clock for start of pulse digitizing
     uint32_t prev_arp_clock_low = 0;   // saved arp clock (125 MHz digitizing clock); used to detect new ARP
@@ -272,26 +674,116 @@ void *rp_osc_worker_thread(void *args)
         did_first_arm = 1;
       }
 
-      if( ! osc_fpga_triggered()) {
-        usleep(10);
-        continue;
-      }
-
-      // get trigger write pointer (i.e. where do data start?)
       int32_t tr_ptr;
-      int32_t wr_ptr;
-      osc_fpga_get_wr_ptr(&wr_ptr, &tr_ptr);
+      uint32_t trig_count, arp_clock_low, trig_clock_low, trig_prev_clock_low;
+      uint32_t acp_clock_low, acp_at_arp, acp_count, arp_count;
+
+      if (dma_bytes) {
+        if (ring_cons == ring_prod) {
+          ring_prod = osc_fpga_dma_get_produced();
+          if (ring_prod - ring_cons > OSC_FPGA_DMA_HDR_SLOTS) {
+            fprintf(stderr, "digdar: DMA header ring overran; %u pulses lost\n", ring_prod - ring_cons - OSC_FPGA_DMA_HDR_SLOTS);
+            ring_cons = ring_prod - OSC_FPGA_DMA_HDR_SLOTS;
+          }
+          if (ring_cons == ring_prod) {
+            uint32_t dropped = osc_fpga_dma_get_dropped();
+            uint32_t errors = osc_fpga_dma_get_errors();
+            if (dropped != ring_dropped) {
+              fprintf(stderr, "digdar: DMA engine busy; %u pulses dropped\n", dropped - ring_dropped);
+              ring_dropped = dropped;
+            }
+            if (errors != dma_errors) {
+              fprintf(stderr, "digdar: %u DMA write errors\n", errors - dma_errors);
+              dma_errors = errors;
+            }
+            usleep(rp_osc_ring_wait_usec());
+            continue;
+          }
+        }
+        // header records are written after the pulse's samples, so once
+        // counted in produced, both are in memory
+        dma_hdr = osc_fpga_dma_get_hdr(ring_cons);
+        tr_ptr = 0;
+        trig_count = dma_hdr->pulse.trig_count - dma_hdr->pulse.trig_at_arp;
+        arp_clock_low = dma_hdr->pulse.arp_clock_low;
+        trig_clock_low = dma_hdr->pulse.trig_clock_low;
+        trig_prev_clock_low = dma_hdr->pulse.trig_prev_clock_low;
+        acp_clock_low = dma_hdr->pulse.acp_clock_low;
+        acp_at_arp = dma_hdr->pulse.acp_at_arp;
+        acp_count = dma_hdr->pulse.acp_count;
+        arp_count = dma_hdr->pulse.arp_count;
+        ++ring_cons;
+      } else if (ring_slots) {
+        if (ring_cons == ring_prod) {
+          // previous batch fully drained: free its slots, and see what's new
+          osc_fpga_ring_set_consumed(ring_cons);
+          ring_prod = osc_fpga_ring_get_produced();
+          if (ring_cons == ring_prod) {
+            uint32_t dropped = osc_fpga_ring_get_dropped();
+            if (dropped != ring_dropped) {
+              fprintf(stderr, "digdar: FPGA pulse ring overflowed; %u pulses dropped\n", dropped - ring_dropped);
+              ring_dropped = dropped;
+            }
+            usleep(rp_osc_ring_wait_usec());
+            continue;
+          }
+        }
+        // metadata come from the slot's pulse header, latched with the pulse
+        uint32_t slot = ring_cons % ring_slots;
+        digdar_pulse_hdr_t hdr;
+        int tries;
+        for (tries = 0; tries < 3; ++tries)
+          if (osc_fpga_ring_get_slot_hdr(slot, &hdr) == 0)
+            break;
+        if (tries == 3) {
+          fprintf(stderr, "digdar: pulse header kept changing; %u pulses dropped\n", ++hdr_dropped);
+          ++ring_cons;
+          continue;
+        }
+        tr_ptr = slot * n_samples;
+        trig_count = hdr.trig_count - hdr.trig_at_arp;
+        arp_clock_low = hdr.arp_clock_low;
+        trig_clock_low = hdr.trig_clock_low;
+        trig_prev_clock_low = hdr.trig_prev_clock_low;
+        acp_clock_low = hdr.acp_clock_low;
+        acp_at_arp = hdr.acp_at_arp;
+        acp_count = hdr.acp_count;
+        arp_count = hdr.arp_count;
+        ++ring_cons;
+      } else {
+        if( ! osc_fpga_triggered()) {
+          uint32_t wait = prf_track_wait_usec(&prf_track);
+          if (wait)
+            usleep(wait);
+          continue;
+        }
 
+        // get trigger write pointer (i.e. where do data start?)
+        int32_t wr_ptr;
+        osc_fpga_get_wr_ptr(&wr_ptr, &tr_ptr);
+
+        // metadata come from the header block latched with the pulse,
+        // rather than from the saved_* registers one at a time
+        digdar_pulse_hdr_t hdr;
+        if (osc_fpga_get_pulse_hdr(&hdr) < 0) {
+          fprintf(stderr, "digdar: pulse header kept changing; %u pulses dropped\n", ++hdr_dropped);
+          osc_fpga_arm_trigger();
+          osc_fpga_set_trigger(10);
+          continue;
+        }
+        trig_count = hdr.trig_count - hdr.trig_at_arp;
+        arp_clock_low = hdr.arp_clock_low;
+        trig_clock_low = hdr.trig_clock_low;
+        trig_prev_clock_low = hdr.trig_prev_clock_low;
+        acp_clock_low = hdr.acp_clock_low;
+        acp_at_arp = hdr.acp_at_arp;
+        acp_count = hdr.acp_count;
+        arp_count = hdr.arp_count;
+      }
 
-      // read ARP registers
+      latest_arp_count = arp_count;
 
-      uint32_t trig_count = g_digdar_fpga_reg_mem->saved_trig_count - g_digdar_fpga_reg_mem->saved_trig_at_arp;
-      uint32_t arp_clock_low = g_digdar_fpga_reg_mem->saved_arp_clock_low;
-      uint32_t trig_clock_low = g_digdar_fpga_reg_mem->saved_trig_clock_low;
-      uint32_t acp_clock_low = g_digdar_fpga_reg_mem->saved_acp_clock_low;
-      uint32_t acp_at_arp = g_digdar_fpga_reg_mem->saved_acp_at_arp;
-      uint32_t acp_count = g_digdar_fpga_reg_mem->saved_acp_count;
-      uint32_t arp_count = g_digdar_fpga_reg_mem->saved_arp_count;
+      prf_track_update(&prf_track, trig_clock_low, trig_clock_low - trig_prev_clock_low);
 
       // FIXME: do the ADC / RTC time pinning in the writer thread, not here,
       // so that we don't do a mode switch.
@@ -310,7 +802,7 @@ void *rp_osc_worker_thread(void *args)
         // has come some time after the ARP.
 
         // First, pin the ADC clock to the red pitaya's RTC
-        uint32_t adc_clock = (uint32_t) g_digdar_fpga_reg_mem->clocks; // lower order ADC clocks
+        uint32_t adc_clock = *osc_fpga_reg(OFFSET_Clocks_LO); // lower order ADC clocks
         clock_gettime(CLOCK_REALTIME, &rtc);
 
         // back-calculate to time of ARP pulse
@@ -323,16 +815,21 @@ void *rp_osc_worker_thread(void *args)
         need_new_chunk = 1;
       }
 
-      if (n == chunk_size || need_new_chunk) {
+      if (dma_bytes) {
+        // the FPGA has already placed the pulse, using the same chunking rule
+        if (dma_hdr->chunk != (uint32_t) writer_chunk_index)
+          rp_osc_follow_writer_chunk(dma_hdr->chunk, n);
+        n = dma_hdr->slot;
+        cur_pulse = dma_hdr->chunk * chunk_size + n;
+      } else if (n == chunk_size || need_new_chunk) {
         // a new chunk is begun each time the count of pulses digitized has reached
         // the chunk size, or when the ARP has increased.  This aligns chunks so
         // that the reader thread can grab an entire sweep at a time, in situations
         // such as retention of only a sector of the image, where it is beneficial
         // to write out pulse data to clients during the dead portion of the sweep.
 
-        pulses_in_chunk[writer_chunk_index] = n;
+        cur_pulse = rp_osc_finish_writer_chunk(n);
         n = 0;
-        cur_pulse = rp_osc_get_chunk_index_for_writer() * chunk_size;
       }
 
       pulse_metadata *pbm = (pulse_metadata *) (((char *) pulse_buffer) + cur_pulse * psize);
@@ -366,12 +863,14 @@ void *rp_osc_worker_thread(void *args)
       pbm->num_arp = arp_count;
 
       // arm to allow acquisition of next pulse while we copy data from the BRAM buffer
-      // for this one.
+      // for this one.  (The FPGA re-arms itself when using the pulse ring.)
 
-      osc_fpga_arm_trigger();
+      if (! ring_slots && ! dma_bytes) {
+        osc_fpga_arm_trigger();
 
-      /* Start the trigger: 10 is the digdar trigger source on TRIG line; FIXME: find the .H file where this is defined */
-      osc_fpga_set_trigger(10);
+        /* Start the trigger: 10 is the digdar trigger source on TRIG line; FIXME: find the .H file where this is defined */
+        osc_fpga_set_trigger(10);
+      }
 
       /* check whether this pulse is in a removal segment */
       if (num_removals) {
@@ -389,40 +888,10 @@ void *rp_osc_worker_thread(void *args)
           continue;
       }
 
-      uint16_t * data = & pbm->data[0];
-      int32_t *src_data = & rp_fpga_cha_signal[tr_ptr];
-      uint16_t n1 = max_data - src_data;
-      uint16_t n2;
-      if (n1 >= n_samples) {
-        n1 = n_samples;
-        n2 = 0;
-      } else {
-        n2 = n_samples - n1;
-      }
-      uint16_t i=0;
-      // when tr_ptr is odd, we need to start with the higher-order word
-      uint32_t tmp;
-      if (tr_ptr & 1) {
-        tmp = src_data[i]; // double-width read from the FPGA, as this is the rate-limiting step
-        data[0] = tmp >> 16;
-        ++i;
-      }
-      for (/**/ ; i < n1; ++i) {
-        tmp = src_data[i]; // double-width read from the FPGA, as this is the rate-limiting step
-        data[i] = tmp & 0xffff;
-        if (++i < n1)
-          data[i] = tmp >> 16;
-      }
-      if (n2) {
-        src_data = & rp_fpga_cha_signal[0];
-        data = &data[i];
-        for (i = 0; i < n2; ++i) {
-          tmp = src_data[i]; // double-width read from the FPGA, as this is the rate-limiting step
-          data[i] = tmp & 0xffff;
-          if (++i < n2)
-            data[i] = tmp >> 16;
-        }
-      }
+      if (! dma_bytes)
+        // pbm is packed, so take the samples' address from the buffer; it is
+        // 16-bit aligned, since the metadata and psize are even sizes
+        rp_osc_store_pulse((uint16_t *) (((char *) pbm) + offsetof(pulse_metadata, data)), tr_ptr);
       ++cur_pulse;
       ++n;
     }
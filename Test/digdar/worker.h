@@ -19,11 +19,11 @@
 extern "C" {
 #endif
 
+#include <pthread.h>
 #include "pulse_metadata.h"
 #include "digdar.h"
 
 #include "fpga_digdar.h"
-extern digdar_fpga_reg_mem_t *g_digdar_fpga_reg_mem;
 
 /** @defgroup digdar_h digdar_h
  * @{
@@ -54,10 +54,15 @@ int rp_osc_worker_exit(void);
 int rp_osc_worker_change_state(rp_osc_worker_state_t new_state);
 
 extern uint16_t n_samples;  // samples to grab per radar pulse
+extern uint16_t n_samples_out;  // samples stored per radar pulse, after applying range profile
+extern uint16_t n_channels; // channels captured per radar pulse: 1 (A) or 2 (A and B)
+extern uint16_t channel_layout; // CHANNEL_LAYOUT_PLANAR or CHANNEL_LAYOUT_INTERLEAVED
 extern uint32_t decim; // decimation: 1, 2, or 8
 extern uint16_t num_pulses; // pulses to maintain in ring buffer (filled by worker thread)
 extern uint32_t psize; // size of each pulse's storage
 extern uint16_t acps; // acp pulses per sweep as specified by user
+extern uint16_t ring_slots; // slots in the FPGA pulse ring; 0 means re-arm for each pulse
+extern uint32_t dma_bytes; // size of the DDR region the FPGA writes pulses into; 0 means no DMA
 
 typedef struct {
   uint16_t begin;
@@ -68,8 +73,32 @@ typedef struct {
 extern sector removals[MAX_REMOVALS];
 extern uint16_t num_removals;
 
+extern range_segment range_profile[MAX_RANGE_SEGMENTS];
+extern uint16_t num_range_segments;
+
 extern pulse_metadata *pulse_buffer;
 extern uint32_t pulse_buff_size;
+
+/* The pulse buffer is a ring of chunks.  The worker thread fills one chunk at
+ * a time, starting a new chunk at each ARP, so a chunk never spans two sweeps.
+ */
+extern uint16_t chunk_size; // maximum number of pulses in a chunk
+extern uint16_t num_chunks; // number of chunks in the pulse buffer
+extern uint16_t *pulses_in_chunk; // number of pulses written to each chunk
+
+extern volatile uint32_t latest_arp_count; // ARP count at most recently captured pulse
+
+int rp_osc_get_chunk_for_reader(uint32_t * cur_pulse, uint32_t * num_pulses);
+int rp_osc_chunks_pending(void);
+uint32_t rp_osc_finish_writer_chunk(uint16_t n);
+int rp_osc_hold_chunks(int hold);
+void rp_osc_release_chunk(void);
+void rp_osc_release_empty_chunks(void);
+int rp_osc_chunks_free(void);
+uint32_t rp_osc_chunks_dropped(void);
+
+int rp_set_thread_cpu(pthread_t thread, int cpu);
+int rp_osc_worker_set_cpu(int cpu);
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
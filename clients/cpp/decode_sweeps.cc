@@ -0,0 +1,122 @@
+/*
+ * decode_sweeps - summarize the sweeps in a digdar stream, and report
+ * how fast they were decoded.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "digdar_decoder.h"
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "\n"
+          "Usage: %s [OPTION] [FILE]\n"
+          "\n"
+          "Read digdar output from FILE (default: stdin) and print one line per sweep:\n"
+          "ARP count, pulses, bearing and UTC of the first and last pulse, and mean sample value.\n"
+          "Decoding throughput is printed to stderr at the end.\n"
+          "\n"
+          "  --acps -a NACP  ACPs per sweep, for computing bearings; default: 450\n"
+          "  --listen -l PORT  Instead of reading FILE, wait for digdar --tcp to connect to PORT\n"
+          "  --no-mmap -m  Read FILE rather than memory-mapping it\n"
+          "  --quiet -q  Don't print sweeps; only report throughput\n"
+          "  --raw -W SAMPLES  The input is raw pulse records (digdar without --header) with SAMPLES samples each\n"
+          "  --help -h  Print this message.\n"
+          "\n", argv0);
+};
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+};
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"acps",    required_argument, 0, 'a'},
+    {"help",    no_argument,       0, 'h'},
+    {"listen",  required_argument, 0, 'l'},
+    {"no-mmap", no_argument,       0, 'm'},
+    {"quiet",   no_argument,       0, 'q'},
+    {"raw",     required_argument, 0, 'W'},
+    {0, 0, 0, 0}
+  };
+  uint16_t acps = 450;
+  int port = 0;
+  bool use_mmap = true;
+  bool quiet = false;
+  int raw_samples = 0;
+
+  int ch;
+  while ((ch = getopt_long(argc, argv, "a:hl:mqW:", long_options, 0)) != -1) {
+    switch (ch) {
+    case 'a':
+      acps = atoi(optarg);
+      break;
+    case 'l':
+      port = atoi(optarg);
+      break;
+    case 'm':
+      use_mmap = false;
+      break;
+    case 'q':
+      quiet = true;
+      break;
+    case 'W':
+      raw_samples = atoi(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  digdar::decoder dec(acps);
+  if (raw_samples > 0)
+    dec.set_raw(raw_samples);
+  int rv;
+  if (port)
+    rv = dec.listen_tcp(port);
+  else if (optind < argc)
+    rv = dec.open_file(argv[optind], use_mmap);
+  else
+    rv = dec.open_fd(0);
+  if (rv < 0)
+    exit(EXIT_FAILURE);
+
+  digdar::sweep s;
+  uint64_t sweeps = 0, pulses = 0;
+  double t0 = now();
+  while ((rv = dec.next(s)) > 0) {
+    ++sweeps;
+    pulses += s.n_pulses;
+    if (quiet)
+      continue;
+    double sum = 0;
+    for (uint32_t i = 0; i < s.n_pulses; ++i) {
+      const float *r = s.row(i);
+      for (uint16_t j = 0; j < s.n_samples; ++j)
+        sum += r[j];
+    }
+    const digdar::pulse_info &first = s.pulses.front(), &last = s.pulses.back();
+    printf("%u %u %.2f %.2f %.6f %.6f %.2f%s\n", s.num_arp, s.n_pulses, first.bearing, last.bearing,
+           first.utc, last.utc, s.n_pulses ? sum / ((double) s.n_pulses * s.n_samples) : 0.0,
+           s.flags ? " degraded" : "");
+  }
+  double secs = now() - t0;
+  if (secs > 0)
+    fprintf(stderr, "decoded %llu sweeps, %llu pulses (%.1f MB) in %.3f s: %.0f pulses/s, %.1f MB/s\n",
+            (unsigned long long) sweeps, (unsigned long long) pulses, dec.bytes_read() / 1.0e6, secs,
+            pulses / secs, dec.bytes_read() / 1.0e6 / secs);
+  return rv < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,808 @@
+/*
+ * digdar_aggregate - accept digdar streams from several digitizers, and
+ * republish them as one time-ordered stream tagged with source IDs.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pulse_metadata.h"
+#include "stream_header.h"
+#include "merged_stream.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * Each digitizer runs digdar --header --tcp HOST:PORT, pointed at this
+ * server's source port.  Source connections are spread over one epoll
+ * loop per core, which read each block of the stream directly into a
+ * buffer that already has room for its merged_block_header, so a block is
+ * never copied after it is received: the same buffer is queued, by
+ * reference, to every consumer, and written to each with writev.
+ *
+ * A single merge thread takes blocks from the sources' queues in order
+ * of the time of their first pulse.  A block is only released once every
+ * other source has either sent a later block, or been silent for
+ * --max-wait seconds, so a stalled digitizer delays the merged stream by
+ * at most that much.
+ *
+ * Memory is bounded per source: once a source has --source-mem bytes
+ * waiting to be merged, its socket isn't read until the backlog halves,
+ * so TCP pushes back on that digitizer (where digdar --degrade can shed
+ * data) without affecting the others.  A consumer with more than
+ * --client-mem bytes unsent is disconnected.
+ */
+
+/** Default port digdar --tcp connects to */
+#define AGG_SOURCE_PORT 10001
+/** Default port consumers of the merged stream connect to */
+#define AGG_OUTPUT_PORT 10002
+/** Default bytes of received blocks each source may have waiting to be merged */
+#define AGG_SOURCE_MEM (64 * 1024 * 1024)
+/** Default bytes a consumer may have waiting to be sent before it is disconnected */
+#define AGG_CLIENT_MEM (256 * 1024 * 1024)
+/** Default seconds to wait for a silent source before merging without it */
+#define AGG_MAX_WAIT 0.5
+/** Default seconds between reports */
+#define AGG_REPORT_SECS 10
+/** Largest block accepted from a source, in bytes */
+#define AGG_MAX_BLOCK (64 * 1024 * 1024)
+/** Largest number of bytes read from one source before serving the others */
+#define AGG_MAX_READ (4 * 1024 * 1024)
+/** Largest number of blocks written to a consumer in one writev */
+#define AGG_MAX_IOV 64
+/** Events handled per epoll_wait */
+#define AGG_MAX_EVENTS 64
+
+static size_t source_mem = AGG_SOURCE_MEM;
+static size_t client_mem = AGG_CLIENT_MEM;
+static double max_wait = AGG_MAX_WAIT;
+static volatile sig_atomic_t quit = 0;
+
+static double mono_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+};
+
+static double utc_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+};
+
+/*
+ * A block of the merged stream: its header, then its payload, as one
+ * contiguous buffer, shared by reference among the consumers sending it.
+ */
+struct block {
+  std::atomic<int> refs;
+  uint32_t size;  // bytes at data
+  char data[1];   // merged_block_header, then payload
+
+  merged_block_header *hdr() {
+    return (merged_block_header *) data;
+  };
+  char *payload() {
+    return data + sizeof(merged_block_header);
+  };
+};
+
+static block *block_new(uint16_t type, uint16_t source, uint32_t len) {
+  block *b = (block *) malloc(offsetof(block, data) + sizeof(merged_block_header) + len);
+  if (! b)
+    return 0;
+  new (&b->refs) std::atomic<int>(1);
+  b->size = sizeof(merged_block_header) + len;
+  merged_block_header *h = b->hdr();
+  h->magic = DIGDAR_MERGED_MAGIC;
+  h->type = type;
+  h->source = source;
+  h->seq = 0;
+  h->time = 0;
+  h->len = len;
+  return b;
+};
+
+static void block_unref(block *b) {
+  if (--b->refs == 0)
+    free(b);
+};
+
+struct source {
+  uint16_t id;
+  int fd;
+  std::string peer;
+  int epfd;          // epoll loop reading this source
+
+  // stream parsing; used only by the source's epoll loop
+  enum { READ_STREAM_HEADER, READ_BLOCK_HEADER, READ_BLOCK_BODY } state;
+  char staging[sizeof(digdar_stream_header)]; // header being read
+  uint32_t have;     // bytes in staging, or in cur's payload
+  uint32_t need;     // bytes wanted in staging
+  block *cur;        // block being read
+  bool paused;       // true while not reading because too much is waiting to be merged
+
+  // shared with the merge thread
+  std::mutex lock;
+  std::deque<block *> queue;  // blocks waiting to be merged
+  std::atomic<uint64_t> queued_bytes;
+  std::atomic<bool> closed;        // set by the source's loop once it no longer uses the source
+  std::atomic<double> latest_time;  // time of the newest block received
+  std::atomic<double> last_arrival; // monotonic time at which it was received
+  std::atomic<uint64_t> blocks;     // blocks received
+  std::atomic<uint64_t> bytes;      // bytes received
+
+  // used only by the merge thread
+  block *header;     // the source's stream header block, for new consumers
+  uint64_t prev_bytes;
+};
+
+struct client {
+  int fd;
+  std::string peer;
+  std::deque<block *> queue; // blocks not yet completely sent
+  uint32_t offset;           // bytes of the first block already sent
+  uint64_t queued_bytes;
+  bool want_out;             // true while waiting for the socket to become writable
+};
+
+/** epoll loops reading sources; the first also accepts them */
+static std::vector<int> loops;
+static int source_listen_fd = -1;
+static std::atomic<int> next_loop(0);
+static std::atomic<int> next_source_id(0);
+
+/** sources accepted but not yet seen by the merge thread */
+static std::mutex new_sources_lock;
+static std::vector<source *> new_sources;
+
+/** wakes the merge thread */
+static int merge_event_fd = -1;
+
+static void wake_merger() {
+  uint64_t one = 1;
+  if (write(merge_event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    perror("eventfd write");
+};
+
+static std::string peer_name(const struct sockaddr_in &addr) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%s:%d", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+  return buf;
+};
+
+static int listen_on(uint16_t port) {
+  int s = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (s < 0)
+    return -1;
+  int on = 1;
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(s, 64) < 0) {
+    fprintf(stderr, "couldn't listen on port %d: %s\n", port, strerror(errno));
+    close(s);
+    return -1;
+  }
+  return s;
+};
+
+static void set_reading(source *s, bool on) {
+  struct epoll_event ev;
+  ev.events = on ? EPOLLIN : 0;
+  ev.data.ptr = s;
+  epoll_ctl(s->epfd, EPOLL_CTL_MOD, s->fd, &ev);
+  s->paused = ! on;
+};
+
+static void accept_sources() {
+  for (;;) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = accept4(source_listen_fd, (struct sockaddr *) &addr, &len, SOCK_NONBLOCK);
+    if (fd < 0)
+      return;
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    source *s = new source;
+    s->id = next_source_id++;
+    s->fd = fd;
+    s->peer = peer_name(addr);
+    s->epfd = loops[next_loop++ % loops.size()];
+    s->state = source::READ_STREAM_HEADER;
+    s->have = 0;
+    s->need = sizeof(digdar_stream_header);
+    s->cur = 0;
+    s->paused = false;
+    s->queued_bytes = 0;
+    s->closed = false;
+    s->latest_time = 0;
+    s->last_arrival = mono_now();
+    s->blocks = 0;
+    s->bytes = 0;
+    s->header = 0;
+    s->prev_bytes = 0;
+    fprintf(stderr, "source %d connected from %s\n", s->id, s->peer.c_str());
+    {
+      std::lock_guard<std::mutex> g(new_sources_lock);
+      new_sources.push_back(s);
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = s;
+    epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev);
+    wake_merger();
+  }
+};
+
+static void close_source(source *s, const char *why) {
+  // the source's loop marks it closed once it is done with it, since
+  // from then on the merge thread can delete it
+  if (why)
+    fprintf(stderr, "source %d (%s): %s; closing\n", s->id, s->peer.c_str(), why);
+  epoll_ctl(s->epfd, EPOLL_CTL_DEL, s->fd, 0);
+  close(s->fd);
+  s->fd = -1;
+  if (s->cur)
+    block_unref(s->cur);
+  s->cur = 0;
+};
+
+static void finish_block(source *s) {
+  // queue a completely received block for merging
+  block *b = s->cur;
+  s->cur = 0;
+  if (b->hdr()->type == MERGED_SWEEP_BLOCK) {
+    pulse_metadata p;
+    memcpy(&p, b->payload() + sizeof(sweep_header), offsetof(pulse_metadata, data));
+    double t = p.arp_clock_sec + p.arp_clock_nsec / 1.0e9 + p.trig_clock / 125.0e6;
+    b->hdr()->time = t;
+    s->latest_time = t;
+  }
+  s->last_arrival = mono_now();
+  s->queued_bytes += b->size;
+  ++s->blocks;
+  {
+    std::lock_guard<std::mutex> g(s->lock);
+    s->queue.push_back(b);
+  }
+  wake_merger();
+  s->state = source::READ_BLOCK_HEADER;
+  s->have = 0;
+  s->need = sizeof(sweep_header);
+};
+
+static bool start_block(source *s) {
+  // the staging buffer holds a complete header; start reading what follows it.
+  // Returns false if the stream is bad.
+  if (s->state == source::READ_STREAM_HEADER) {
+    digdar_stream_header h;
+    memcpy(&h, s->staging, sizeof(h));
+    if (h.magic != DIGDAR_STREAM_MAGIC || h.header_size < sizeof(h)) {
+      close_source(s, "not a digdar stream with a stream header (was digdar run without --header?)");
+      return false;
+    }
+    s->cur = block_new(MERGED_STREAM_HEADER, s->id, h.header_size);
+  } else {
+    sweep_header h;
+    memcpy(&h, s->staging, sizeof(h));
+    uint64_t len = sizeof(h) + (uint64_t) h.n_pulses * h.psize;
+    if (h.magic != DIGDAR_SWEEP_MAGIC || len > AGG_MAX_BLOCK || h.psize < offsetof(pulse_metadata, data)) {
+      close_source(s, "bad sweep header");
+      return false;
+    }
+    if (h.n_pulses == 0) {
+      s->have = 0;
+      return true;
+    }
+    s->cur = block_new(MERGED_SWEEP_BLOCK, s->id, len);
+  }
+  if (! s->cur) {
+    close_source(s, "out of memory");
+    return false;
+  }
+  memcpy(s->cur->payload(), s->staging, s->need);
+  s->have = s->need;
+  s->state = source::READ_BLOCK_BODY;
+  if (s->have == s->cur->hdr()->len)
+    finish_block(s);
+  return true;
+};
+
+static void read_source(source *s) {
+  // read what is available from a source, straight into the blocks it fills
+  uint32_t total = 0;
+  while (total < AGG_MAX_READ) {
+    if (s->queued_bytes >= source_mem) {
+      set_reading(s, false);
+      return;
+    }
+    char *dst;
+    uint32_t want;
+    if (s->state == source::READ_BLOCK_BODY) {
+      dst = s->cur->payload() + s->have;
+      want = s->cur->hdr()->len - s->have;
+    } else {
+      dst = s->staging + s->have;
+      want = s->need - s->have;
+    }
+    ssize_t m = read(s->fd, dst, want);
+    if (m < 0 && errno == EINTR)
+      continue;
+    if (m < 0 && errno == EAGAIN)
+      return;
+    if (m <= 0) {
+      close_source(s, m == 0 ? "disconnected" : strerror(errno));
+      return;
+    }
+    total += m;
+    s->bytes += m;
+    s->have += m;
+    if (s->state == source::READ_BLOCK_BODY) {
+      if (s->have == s->cur->hdr()->len)
+        finish_block(s);
+    } else if (s->have == s->need) {
+      if (! start_block(s))
+        return;
+    }
+  }
+};
+
+static void source_loop(int index) {
+  // one epoll loop reading sources; loop 0 also accepts them
+  int epfd = loops[index];
+  std::vector<source *> mine;  // sources of this loop which have been paused
+  struct epoll_event evs[AGG_MAX_EVENTS];
+  while (! quit) {
+    int n = epoll_wait(epfd, evs, AGG_MAX_EVENTS, 10);
+    for (int i = 0; i < n; ++i) {
+      if (evs[i].data.ptr == 0) {
+        accept_sources();
+        continue;
+      }
+      source *s = (source *) evs[i].data.ptr;
+      if (s->fd < 0)
+        continue;
+      bool was_paused = s->paused;
+      read_source(s);
+      if (s->fd < 0) {
+        // hand it over to the merge thread, which may delete it at once,
+        // so it mustn't be touched after this
+        mine.erase(std::remove(mine.begin(), mine.end(), s), mine.end());
+        s->closed = true;
+        wake_merger();
+      } else if (s->paused && ! was_paused) {
+        mine.push_back(s);
+      }
+    }
+    // resume paused sources once their backlog has halved
+    for (size_t i = 0; i < mine.size(); ) {
+      source *s = mine[i];
+      if (s->queued_bytes < source_mem / 2) {
+        set_reading(s, true);
+        mine[i] = mine.back();
+        mine.pop_back();
+      } else {
+        ++i;
+      }
+    }
+  }
+};
+
+/*
+ * The merge thread: everything from here on is used only by it.
+ */
+
+static std::vector<source *> sources;
+static std::vector<client *> clients;
+static int merge_epfd = -1;
+static int output_listen_fd = -1;
+static uint64_t seq = 0;
+static bool any_source = false;
+
+static void drop_client(client *c, const char *why) {
+  fprintf(stderr, "consumer %s: %s; closing\n", c->peer.c_str(), why);
+  epoll_ctl(merge_epfd, EPOLL_CTL_DEL, c->fd, 0);
+  close(c->fd);
+  for (size_t i = 0; i < c->queue.size(); ++i)
+    block_unref(c->queue[i]);
+  c->queue.clear();
+  c->fd = -1;
+};
+
+static void flush_client(client *c) {
+  // write as much of the consumer's queue as the socket will take
+  while (! c->queue.empty()) {
+    struct iovec iov[AGG_MAX_IOV];
+    int n = 0;
+    for (size_t i = 0; i < c->queue.size() && n < AGG_MAX_IOV; ++i, ++n) {
+      uint32_t off = i == 0 ? c->offset : 0;
+      iov[n].iov_base = c->queue[i]->data + off;
+      iov[n].iov_len = c->queue[i]->size - off;
+    }
+    ssize_t m = writev(c->fd, iov, n);
+    if (m < 0 && errno == EINTR)
+      continue;
+    if (m < 0 && errno == EAGAIN)
+      break;
+    if (m < 0) {
+      drop_client(c, strerror(errno));
+      return;
+    }
+    c->queued_bytes -= m;
+    while (m > 0) {
+      block *b = c->queue.front();
+      uint32_t left = b->size - c->offset;
+      if ((size_t) m < left) {
+        c->offset += m;
+        break;
+      }
+      m -= left;
+      c->offset = 0;
+      c->queue.pop_front();
+      block_unref(b);
+    }
+  }
+  bool want = ! c->queue.empty();
+  if (want != c->want_out) {
+    struct epoll_event ev;
+    ev.events = want ? EPOLLOUT : 0;
+    ev.data.ptr = c;
+    epoll_ctl(merge_epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->want_out = want;
+  }
+};
+
+static void send_block(client *c, block *b) {
+  if (c->fd < 0)
+    return;
+  if (c->queued_bytes + b->size > client_mem) {
+    drop_client(c, "too far behind");
+    return;
+  }
+  ++b->refs;
+  c->queue.push_back(b);
+  c->queued_bytes += b->size;
+  if (! c->want_out)
+    flush_client(c);
+};
+
+static void publish(block *b) {
+  // number a block and queue it to every consumer
+  b->hdr()->seq = seq++;
+  for (size_t i = 0; i < clients.size(); ++i)
+    send_block(clients[i], b);
+};
+
+static void accept_clients() {
+  for (;;) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = accept4(output_listen_fd, (struct sockaddr *) &addr, &len, SOCK_NONBLOCK);
+    if (fd < 0)
+      return;
+    int sndbuf = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    client *c = new client;
+    c->fd = fd;
+    c->peer = peer_name(addr);
+    c->offset = 0;
+    c->queued_bytes = 0;
+    c->want_out = false;
+    struct epoll_event ev;
+    ev.events = 0;
+    ev.data.ptr = c;
+    epoll_ctl(merge_epfd, EPOLL_CTL_ADD, fd, &ev);
+    clients.push_back(c);
+    fprintf(stderr, "consumer connected from %s\n", c->peer.c_str());
+    // tell it about the sources already connected
+    for (size_t i = 0; i < sources.size(); ++i)
+      if (sources[i]->header)
+        send_block(c, sources[i]->header);
+  }
+};
+
+static block *peek(source *s) {
+  std::lock_guard<std::mutex> g(s->lock);
+  return s->queue.empty() ? 0 : s->queue.front();
+};
+
+static void pop(source *s) {
+  block *b;
+  {
+    std::lock_guard<std::mutex> g(s->lock);
+    b = s->queue.front();
+    s->queue.pop_front();
+  }
+  s->queued_bytes -= b->size;
+};
+
+static void merge() {
+  // release blocks in time order, for as long as no source might still
+  // send an earlier one
+  for (;;) {
+    double now = mono_now();
+    source *best = 0;
+    block *best_block = 0;
+    for (size_t i = 0; i < sources.size(); ++i) {
+      source *s = sources[i];
+      block *b = peek(s);
+      if (b && b->hdr()->type == MERGED_STREAM_HEADER) {
+        // stream headers go out at once, and are kept for later consumers
+        pop(s);
+        if (s->header)
+          block_unref(s->header);
+        s->header = b;
+        publish(b);
+        b = peek(s);
+      }
+      if (b && (! best_block || b->hdr()->time < best_block->hdr()->time)) {
+        best = s;
+        best_block = b;
+      }
+    }
+    if (! best)
+      return;
+    double t = best_block->hdr()->time;
+    for (size_t i = 0; i < sources.size(); ++i) {
+      source *s = sources[i];
+      if (s == best || s->closed || peek(s))
+        continue;
+      if (s->latest_time < t && now - s->last_arrival < max_wait)
+        return; // s might yet send an earlier block
+    }
+    pop(best);
+    publish(best_block);
+    block_unref(best_block);
+  }
+};
+
+static void remove_finished() {
+  // forget closed sources once their blocks have all been merged, and closed consumers
+  for (size_t i = 0; i < sources.size(); ) {
+    source *s = sources[i];
+    if (s->closed && ! peek(s)) {
+      fprintf(stderr, "source %d (%s) finished: %llu blocks, %.1f MB\n", s->id, s->peer.c_str(),
+              (unsigned long long) s->blocks.load(), s->bytes / 1.0e6);
+      if (s->header)
+        block_unref(s->header);
+      delete s;
+      sources[i] = sources.back();
+      sources.pop_back();
+    } else {
+      ++i;
+    }
+  }
+  for (size_t i = 0; i < clients.size(); ) {
+    if (clients[i]->fd < 0) {
+      delete clients[i];
+      clients[i] = clients.back();
+      clients.pop_back();
+    } else {
+      ++i;
+    }
+  }
+};
+
+static void report(double dt) {
+  double now = utc_now();
+  double newest = 0;
+  for (size_t i = 0; i < sources.size(); ++i)
+    if (sources[i]->latest_time > newest)
+      newest = sources[i]->latest_time;
+  fprintf(stderr, "aggregate: %u sources, %u consumers, %llu blocks merged\n",
+          (unsigned) sources.size(), (unsigned) clients.size(), (unsigned long long) seq);
+  for (size_t i = 0; i < sources.size(); ++i) {
+    source *s = sources[i];
+    double latest = s->latest_time;
+    uint64_t bytes = s->bytes;
+    fprintf(stderr, "  source %-3d %-21s %6.2f MB/s, %6.1f MB waiting%s, %7.3f s behind newest source, data %.3f s old\n",
+            s->id, s->peer.c_str(), (bytes - s->prev_bytes) / 1.0e6 / dt, s->queued_bytes / 1.0e6,
+            s->queued_bytes >= source_mem ? " (paused)" : "", latest ? newest - latest : 0.0,
+            latest ? now - latest : 0.0);
+    s->prev_bytes = bytes;
+  }
+};
+
+static void merge_loop(double report_secs, bool once) {
+  struct epoll_event evs[AGG_MAX_EVENTS];
+  double next_report = mono_now() + report_secs;
+  double prev_report = mono_now();
+  while (! quit) {
+    int n = epoll_wait(merge_epfd, evs, AGG_MAX_EVENTS, 10);
+    for (int i = 0; i < n; ++i) {
+      void *p = evs[i].data.ptr;
+      if (p == &merge_event_fd) {
+        uint64_t count;
+        if (read(merge_event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+          perror("eventfd read");
+      } else if (p == &output_listen_fd) {
+        accept_clients();
+      } else {
+        client *c = (client *) p;
+        if (c->fd < 0)
+          continue;
+        if (evs[i].events & (EPOLLERR | EPOLLHUP))
+          drop_client(c, "disconnected");
+        else
+          flush_client(c);
+      }
+    }
+    {
+      std::lock_guard<std::mutex> g(new_sources_lock);
+      sources.insert(sources.end(), new_sources.begin(), new_sources.end());
+      any_source = any_source || ! new_sources.empty();
+      new_sources.clear();
+    }
+    merge();
+    remove_finished();
+    double now = mono_now();
+    if (report_secs > 0 && now >= next_report) {
+      report(now - prev_report);
+      prev_report = now;
+      next_report += report_secs;
+    }
+    if (once && any_source && sources.empty()) {
+      // wait for consumers to take what has been sent
+      bool pending = false;
+      for (size_t i = 0; i < clients.size(); ++i)
+        pending = pending || ! clients[i]->queue.empty();
+      if (! pending)
+        break;
+    }
+  }
+};
+
+static void on_signal(int) {
+  quit = 1;
+};
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "\n"
+          "Usage: %s [OPTION]\n"
+          "\n"
+          "Accept digdar streams from several digitizers (each running digdar --header --tcp HOST:PORT with this\n"
+          "host and the source port), and publish them to consumers connecting to the output port as\n"
+          "one stream, in order of pulse time, with each block tagged by source; see merged_stream.h.\n"
+          "e.g. to try it on one machine with recordings:\n"
+          "  %s --once &\n"
+          "  digdar --header --replay A.dat --tcp localhost:%d & digdar --header --replay B.dat --tcp localhost:%d &\n"
+          "\n"
+          "  --client-mem -M BYTES  Disconnect consumers with more than BYTES unsent; default: %d\n"
+          "  --max-wait -w SECS  Merge without a source which has been silent for SECS; default: %g\n"
+          "  --once -1  Exit once sources have connected, all have disconnected, and their data have been sent.\n"
+          "  --output -o PORT  Port consumers connect to; default: %d\n"
+          "  --report -r SECS  Print per-source rate, backlog, and lag every SECS seconds; 0 means never;\n"
+          "                    default: %d\n"
+          "  --source-mem -m BYTES  Stop reading from a source with more than BYTES waiting to be merged;\n"
+          "                         default: %d\n"
+          "  --sources -s PORT  Port digdar connects to; default: %d\n"
+          "  --threads -j N  Number of epoll loops reading sources; default: number of cores\n"
+          "  --help -h  Print this message.\n"
+          "\n", argv0, argv0, AGG_SOURCE_PORT, AGG_SOURCE_PORT, AGG_CLIENT_MEM, AGG_MAX_WAIT,
+          AGG_OUTPUT_PORT, AGG_REPORT_SECS, AGG_SOURCE_MEM, AGG_SOURCE_PORT);
+};
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"client-mem", required_argument, 0, 'M'},
+    {"help",       no_argument,       0, 'h'},
+    {"max-wait",   required_argument, 0, 'w'},
+    {"once",       no_argument,       0, '1'},
+    {"output",     required_argument, 0, 'o'},
+    {"report",     required_argument, 0, 'r'},
+    {"source-mem", required_argument, 0, 'm'},
+    {"sources",    required_argument, 0, 's'},
+    {"threads",    required_argument, 0, 'j'},
+    {0, 0, 0, 0}
+  };
+  int source_port = AGG_SOURCE_PORT;
+  int output_port = AGG_OUTPUT_PORT;
+  unsigned threads = std::thread::hardware_concurrency();
+  double report_secs = AGG_REPORT_SECS;
+  bool once = false;
+
+  int ch;
+  while ((ch = getopt_long(argc, argv, "1hj:m:M:o:r:s:w:", long_options, 0)) != -1) {
+    switch (ch) {
+    case '1':
+      once = true;
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'm':
+      source_mem = strtoull(optarg, 0, 0);
+      break;
+    case 'M':
+      client_mem = strtoull(optarg, 0, 0);
+      break;
+    case 'o':
+      output_port = atoi(optarg);
+      break;
+    case 'r':
+      report_secs = atof(optarg);
+      break;
+    case 's':
+      source_port = atoi(optarg);
+      break;
+    case 'w':
+      max_wait = atof(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (threads < 1)
+    threads = 1;
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  source_listen_fd = listen_on(source_port);
+  output_listen_fd = listen_on(output_port);
+  merge_event_fd = eventfd(0, EFD_NONBLOCK);
+  merge_epfd = epoll_create1(0);
+  if (source_listen_fd < 0 || output_listen_fd < 0 || merge_event_fd < 0 || merge_epfd < 0)
+    exit(EXIT_FAILURE);
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = &merge_event_fd;
+  epoll_ctl(merge_epfd, EPOLL_CTL_ADD, merge_event_fd, &ev);
+  ev.data.ptr = &output_listen_fd;
+  epoll_ctl(merge_epfd, EPOLL_CTL_ADD, output_listen_fd, &ev);
+
+  for (unsigned i = 0; i < threads; ++i)
+    loops.push_back(epoll_create1(0));
+  ev.events = EPOLLIN;
+  ev.data.ptr = 0; // marks the listening socket
+  epoll_ctl(loops[0], EPOLL_CTL_ADD, source_listen_fd, &ev);
+
+  std::vector<std::thread> readers;
+  for (unsigned i = 0; i < threads; ++i)
+    readers.push_back(std::thread(source_loop, i));
+
+  merge_loop(report_secs, once);
+
+  quit = 1;
+  for (unsigned i = 0; i < threads; ++i)
+    readers[i].join();
+  return EXIT_SUCCESS;
+}
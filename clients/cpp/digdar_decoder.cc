@@ -0,0 +1,458 @@
+/*
+ * digdar_decoder - read the digdar output stream on a client PC, and
+ * reassemble it into sweeps of float sample matrices.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "digdar_decoder.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * The stream is a digdar_stream_header, then blocks of pulse records,
+ * each block preceded by a sweep_header giving the ARP count, degradation,
+ * and record size of its pulses.  Blocks for one sweep are consecutive, so
+ * a sweep is complete when a block for a different ARP count arrives.
+ *
+ * Pulse records are packed, and follow odd-sized headers, so their samples
+ * are only 2-byte aligned.  Full-resolution samples, which are nearly all
+ * of the data, are converted with unaligned SIMD loads into the aligned
+ * rows of the sweep; degraded pulses are rare and small, so are converted
+ * one sample at a time.
+ */
+
+namespace digdar {
+
+/** ADC clock rate, in Hz; trig_clock counts this */
+#define DECODER_ADC_HZ 125.0e6
+
+/** Value of one 8-bit sample, in FPGA units; see DEGRADE_8BIT_VIDEO */
+#define DECODER_8BIT_SCALE 64
+
+/** Rows allocated per channel for a new sweep; doubled as needed */
+#define DECODER_INITIAL_ROWS 1024
+
+static inline int16_t get_int16(const char *p) {
+  int16_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+};
+
+/** @brief Converts n contiguous little-endian int16 samples to float.
+ *
+ * @param [out] dst destination; must be 16-byte aligned
+ * @param [in] src samples; need only be 2-byte aligned
+ */
+static void convert_samples(float *dst, const char *src, uint32_t n)
+{
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i *) (src + 2 * i));
+    // sign-extend to 32 bits by placing each sample in the top half, then shifting down
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    _mm_store_ps(dst + i, _mm_cvtepi32_ps(lo));
+    _mm_store_ps(dst + i + 4, _mm_cvtepi32_ps(hi));
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t x = vreinterpretq_s16_u8(vld1q_u8((const uint8_t *) (src + 2 * i)));
+    vst1q_f32(dst + i, vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))));
+    vst1q_f32(dst + i + 4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))));
+  }
+#endif
+  for (; i < n; ++i)
+    dst[i] = get_int16(src + 2 * i);
+};
+
+/** @brief Converts n pairs of interleaved little-endian int16 samples A B A B ... to float.
+ *
+ * @param [out] a destination for channel A; must be 16-byte aligned
+ * @param [out] b destination for channel B; must be 16-byte aligned
+ * @param [in] src samples; need only be 2-byte aligned
+ */
+static void convert_interleaved(float *a, float *b, const char *src, uint32_t n)
+{
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= n; i += 4) {
+    // each 32-bit lane holds one pair: A in the low half, B in the high half
+    __m128i x = _mm_loadu_si128((const __m128i *) (src + 4 * i));
+    _mm_store_ps(a + i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(x, 16), 16)));
+    _mm_store_ps(b + i, _mm_cvtepi32_ps(_mm_srai_epi32(x, 16)));
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; i + 4 <= n; i += 4) {
+    int16x4x2_t x = vld2_s16((const int16_t *) (src + 4 * i));
+    vst1q_f32(a + i, vcvtq_f32_s32(vmovl_s16(x.val[0])));
+    vst1q_f32(b + i, vcvtq_f32_s32(vmovl_s16(x.val[1])));
+  }
+#endif
+  for (; i < n; ++i) {
+    a[i] = get_int16(src + 4 * i);
+    b[i] = get_int16(src + 4 * i + 2);
+  }
+};
+
+sweep::sweep() :
+  num_arp(0), n_pulses(0), n_samples(0), n_channels(0), stride(0), flags(0), max_level(0),
+  data(0), capacity(0)
+{
+};
+
+sweep::~sweep() {
+  free(data);
+};
+
+void sweep::reset(uint32_t num_arp, uint16_t n_samples, uint16_t n_channels) {
+  // empty the sweep, keeping its storage if the row shape is unchanged
+  const uint32_t per_align = DECODER_ROW_ALIGN / sizeof(float);
+  uint32_t new_stride = (n_samples + per_align - 1) / per_align * per_align;
+  if (new_stride != stride || n_channels != this->n_channels) {
+    free(data);
+    data = 0;
+    capacity = 0;
+  }
+  this->num_arp = num_arp;
+  this->n_samples = n_samples;
+  this->n_channels = n_channels;
+  stride = new_stride;
+  n_pulses = 0;
+  flags = 0;
+  max_level = 0;
+  pulses.clear();
+};
+
+void sweep::grow() {
+  // double the rows allocated per channel, keeping those already filled
+  uint32_t new_capacity = capacity ? 2 * capacity : DECODER_INITIAL_ROWS;
+  void *p = 0;
+  if (posix_memalign(&p, DECODER_ROW_ALIGN, (size_t) new_capacity * stride * n_channels * sizeof(float)) != 0)
+    throw std::bad_alloc();
+  float *new_data = (float *) p;
+  for (uint16_t c = 0; c < n_channels; ++c)
+    memcpy(new_data + c * new_capacity * stride, data + c * capacity * stride, (size_t) n_pulses * stride * sizeof(float));
+  free(data);
+  data = new_data;
+  capacity = new_capacity;
+};
+
+float *sweep::add_row(uint16_t channel) {
+  // return the row for the next pulse in a channel; the pulse is only
+  // counted once the caller increments n_pulses
+  if (n_pulses == capacity)
+    grow();
+  return data + (channel * capacity + n_pulses) * stride;
+};
+
+decoder::decoder(uint16_t acps) :
+  acps(acps), raw(false), started(false), block_left(0), have_pending(false), pending(0),
+  fd(-1), own_fd(false), map(0), map_len(0), pos(0), end(0), consumed(0)
+{
+  memset(&hdr, 0, sizeof(hdr));
+  memset(&block, 0, sizeof(block));
+};
+
+decoder::~decoder() {
+  close();
+};
+
+void decoder::close() {
+  if (map)
+    munmap((void *) map, map_len);
+  map = 0;
+  if (own_fd && fd >= 0)
+    ::close(fd);
+  fd = -1;
+  own_fd = false;
+  pos = end = 0;
+};
+
+int decoder::open_fd(int fd) {
+  close();
+  this->fd = fd;
+  buf.resize(DECODER_READ_BUF);
+  return 0;
+};
+
+int decoder::open_file(const char *path, bool use_mmap) {
+  close();
+  int f = ::open(path, O_RDONLY);
+  if (f < 0) {
+    fprintf(stderr, "couldn't open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  if (use_mmap && fstat(f, &st) == 0 && st.st_size > 0) {
+    void *m = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+    if (m != MAP_FAILED) {
+      ::close(f);
+      madvise(m, st.st_size, MADV_SEQUENTIAL);
+      map = (const char *) m;
+      map_len = end = st.st_size;
+      return 0;
+    }
+  }
+  // not mappable (e.g. a FIFO), so read it
+  open_fd(f);
+  own_fd = true;
+  return 0;
+};
+
+int decoder::listen_tcp(uint16_t port) {
+  close();
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  if (s < 0) {
+    fprintf(stderr, "couldn't create socket: %s\n", strerror(errno));
+    return -1;
+  }
+  int on = 1;
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(s, 1) < 0) {
+    fprintf(stderr, "couldn't listen on port %d: %s\n", port, strerror(errno));
+    ::close(s);
+    return -1;
+  }
+  int c = accept(s, 0, 0);
+  ::close(s);
+  if (c < 0) {
+    fprintf(stderr, "accept failed: %s\n", strerror(errno));
+    return -1;
+  }
+  int rcvbuf = DECODER_READ_BUF;
+  setsockopt(c, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  open_fd(c);
+  own_fd = true;
+  return 0;
+};
+
+void decoder::set_raw(uint16_t n_samples) {
+  raw = true;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = DIGDAR_STREAM_MAGIC;
+  hdr.decim = 1;
+  hdr.n_samples = hdr.n_samples_out = n_samples;
+  hdr.psize = offsetof(pulse_metadata, data) + n_samples * sizeof(uint16_t);
+  hdr.n_channels = 1;
+};
+
+const char *decoder::fetch(size_t n) {
+  // consume the next n bytes of the stream, and return a pointer to them,
+  // valid until the next call; returns 0 if the stream ends first.
+  if (end - pos < n && ! map) {
+    if (n > buf.size())
+      buf.resize(n);
+    memmove(&buf[0], &buf[pos], end - pos);
+    end -= pos;
+    pos = 0;
+    while (end < n) {
+      ssize_t m = read(fd, &buf[end], buf.size() - end);
+      if (m < 0 && errno == EINTR)
+        continue;
+      if (m <= 0)
+        break;
+      end += m;
+    }
+  }
+  if (end - pos < n)
+    return 0;
+  const char *p = (map ? map : &buf[0]) + pos;
+  pos += n;
+  consumed += n;
+  return p;
+};
+
+int decoder::read_stream_header() {
+  const char *p = fetch(sizeof(hdr));
+  if (! p)
+    return 0;
+  memcpy(&hdr, p, sizeof(hdr));
+  if (hdr.magic != DIGDAR_STREAM_MAGIC) {
+    fprintf(stderr, "stream doesn't begin with a digdar stream header; if it is raw pulse records, use set_raw()\n");
+    return -1;
+  }
+  if (hdr.header_size < sizeof(hdr) || hdr.n_channels < 1 || hdr.n_channels > 2) {
+    fprintf(stderr, "unsupported digdar stream header (version %d)\n", hdr.version);
+    return -1;
+  }
+  // skip fields added by later versions
+  if (hdr.header_size > sizeof(hdr) && ! fetch(hdr.header_size - sizeof(hdr)))
+    return 0;
+  return 1;
+};
+
+int decoder::read_block_header() {
+  // read the next block header; returns 1 on success, 0 at end of stream, -1 on error
+  const char *p = fetch(sizeof(block));
+  if (! p)
+    return 0;
+  memcpy(&block, p, sizeof(block));
+  if (block.magic != DIGDAR_SWEEP_MAGIC) {
+    fprintf(stderr, "bad sweep header at stream offset %llu\n", (unsigned long long) (consumed - sizeof(block)));
+    return -1;
+  }
+  uint32_t want = (block.flags & DEGRADE_DETECTIONS_ONLY)
+    ? offsetof(pulse_metadata, data) + sizeof(uint16_t) * (1 + 2 * MAX_DETECTIONS)
+    : offsetof(pulse_metadata, data) + block.n_samples * hdr.n_channels * ((block.flags & DEGRADE_8BIT_VIDEO) ? 1 : 2);
+  if (block.psize < want) {
+    fprintf(stderr, "sweep header at stream offset %llu has pulses too small for their samples\n",
+            (unsigned long long) (consumed - sizeof(block)));
+    return -1;
+  }
+  block_left = block.n_pulses;
+  return 1;
+};
+
+void decoder::decode_pulse(sweep &s, const char *p) {
+  // append a pulse record to the sweep
+  pulse_metadata m;
+  memcpy(&m, p, offsetof(pulse_metadata, data));
+  const char *d = p + offsetof(pulse_metadata, data);
+  uint16_t f = raw ? 0 : block.flags;
+  uint32_t ns = s.n_samples;
+  float *a = s.add_row(0);
+  float *b = s.n_channels == 2 ? s.add_row(1) : 0;
+
+  if (! (f & ~(DEGRADE_DROP_ALTERNATE | DEGRADE_PYRAMID))) {
+    // full resolution, or a pyramid level with the sweep sized to it
+    if (! b)
+      convert_samples(a, d, ns);
+    else if (hdr.channel_layout == CHANNEL_LAYOUT_INTERLEAVED)
+      convert_interleaved(a, b, d, ns);
+    else {
+      convert_samples(a, d, ns);
+      convert_samples(b, d + 2 * ns, ns);
+    }
+  } else if (f & DEGRADE_DETECTIONS_ONLY) {
+    memset(a, 0, ns * sizeof(float));
+    if (b)
+      memset(b, 0, ns * sizeof(float));
+    uint16_t nd = get_int16(d);
+    for (uint16_t i = 0; i < nd && i < MAX_DETECTIONS; ++i) {
+      uint16_t j = get_int16(d + 2 + 4 * i);
+      if (j < ns)
+        a[j] = get_int16(d + 4 + 4 * i);
+    }
+  } else {
+    // block.n_samples samples per channel, possibly averaged in pairs and/or 8-bit
+    uint32_t bn = block.n_samples;
+    uint32_t rep = (f & DEGRADE_AVERAGE_RANGE) ? 2 : 1;
+    uint32_t width = (f & DEGRADE_8BIT_VIDEO) ? 1 : 2;
+    for (uint16_t c = 0; c < s.n_channels; ++c) {
+      float *row = c ? b : a;
+      for (uint32_t j = 0; j < ns; ++j) {
+        uint32_t k = j / rep < bn ? j / rep : bn - 1;
+        uint32_t idx = hdr.channel_layout == CHANNEL_LAYOUT_INTERLEAVED ? k * s.n_channels + c : c * bn + k;
+        row[j] = width == 1 ? (float) ((int8_t) d[idx] * DECODER_8BIT_SCALE) : (float) get_int16(d + 2 * idx);
+      }
+    }
+  }
+
+  pulse_info info;
+  info.arp_clock_sec = m.arp_clock_sec;
+  info.arp_clock_nsec = m.arp_clock_nsec;
+  info.trig_clock = m.trig_clock;
+  info.acp_clock = m.acp_clock;
+  info.num_trig = m.num_trig;
+  info.bearing = acps ? fmodf(m.acp_clock, acps) * (360.0f / acps) : 0;
+  info.utc = m.arp_clock_sec + m.arp_clock_nsec / 1.0e9 + m.trig_clock / DECODER_ADC_HZ;
+  info.flags = f;
+  s.pulses.push_back(info);
+  s.flags |= f;
+  ++s.n_pulses;
+};
+
+int decoder::next(sweep &s) {
+  if (! started) {
+    if (fd < 0 && ! map) {
+      fprintf(stderr, "decoder has no input\n");
+      return -1;
+    }
+    if (! raw) {
+      int rv = read_stream_header();
+      if (rv <= 0)
+        return rv;
+    }
+    started = true;
+  }
+
+  bool have_sweep = false;
+
+  if (raw) {
+    for (;;) {
+      const char *p = have_pending ? pending : fetch(hdr.psize);
+      have_pending = false;
+      if (! p)
+        return have_sweep ? 1 : 0;
+      uint32_t arp;
+      memcpy(&arp, p + offsetof(pulse_metadata, num_arp), sizeof(arp));
+      if (! have_sweep) {
+        s.reset(arp, hdr.n_samples_out, 1);
+        have_sweep = true;
+      } else if (arp != s.num_arp) {
+        // first pulse of the next sweep; decode it on the next call
+        pending = p;
+        have_pending = true;
+        return 1;
+      }
+      decode_pulse(s, p);
+    }
+  }
+
+  for (;;) {
+    if (block_left == 0) {
+      int rv = read_block_header();
+      if (rv < 0)
+        return -1;
+      if (rv == 0)
+        return have_sweep ? 1 : 0;
+      if (block_left == 0)
+        continue;
+      if (have_sweep && block.num_arp != s.num_arp)
+        return 1; // block starts the next sweep; read it on the next call
+    }
+    if (! have_sweep) {
+      // pyramid sweeps are kept at their reduced size
+      s.reset(block.num_arp, (block.flags & DEGRADE_PYRAMID) ? block.n_samples : hdr.n_samples_out, hdr.n_channels);
+      have_sweep = true;
+    }
+    if (block.level > s.max_level)
+      s.max_level = block.level;
+    for (; block_left > 0; --block_left) {
+      const char *p = fetch(block.psize);
+      if (! p)
+        return 1; // stream ends mid-block; return what we have
+      decode_pulse(s, p);
+    }
+  }
+};
+
+} // namespace digdar
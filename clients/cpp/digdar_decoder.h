@@ -0,0 +1,192 @@
+/* -*- c++ -*- */
+/*
+ * digdar_decoder - read the digdar output stream on a client PC, and
+ * reassemble it into sweeps of float sample matrices.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#ifndef INCLUDED_DIGDAR_DECODER_H
+#define INCLUDED_DIGDAR_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "pulse_metadata.h"
+#include "stream_header.h"
+
+/*
+ * The stream is read from a socket or pipe, a file, or a memory-mapped
+ * file, and handed back a sweep at a time.  Each sweep holds a matrix
+ * of samples per channel, one row per pulse, with rows aligned for SIMD
+ * processing, plus each pulse's metadata, bearing and UTC time.
+ *
+ * Samples are converted to float in FPGA units, so rows from degraded
+ * blocks (see stream_header.h) are comparable with full ones: averaged
+ * samples are repeated to fill the full range, 8-bit samples are scaled
+ * back up, and detections-only pulses are zero except at detections.
+ *
+ * The stream is little-endian, as is the host this is expected to run on.
+ */
+
+namespace digdar {
+
+/** Alignment of sample rows, in bytes */
+#define DECODER_ROW_ALIGN 64
+
+/** Size of the buffer used to read from a socket, pipe, or unmapped file */
+#define DECODER_READ_BUF (4 * 1024 * 1024)
+
+/*!
+ * \brief what's known about one pulse of a sweep
+ */
+struct pulse_info {
+  uint32_t arp_clock_sec;  /**< as in pulse_metadata */
+  uint32_t arp_clock_nsec; /**< as in pulse_metadata */
+  uint32_t trig_clock;     /**< as in pulse_metadata */
+  float    acp_clock;      /**< as in pulse_metadata */
+  uint32_t num_trig;       /**< as in pulse_metadata */
+  float    bearing;        /**< degrees clockwise from heading, in [0, 360) */
+  double   utc;            /**< time of the trigger, in seconds since the epoch */
+  uint16_t flags;          /**< DEGRADE_... reductions applied to this pulse */
+};
+
+/*!
+ * \brief one sweep: all pulses received with the same ARP count
+ */
+class sweep {
+public:
+  sweep();
+  ~sweep();
+
+  uint32_t num_arp;    /**< ARP count of the sweep */
+  uint32_t n_pulses;   /**< number of pulses; rows in each matrix */
+  uint16_t n_samples;  /**< samples per pulse per channel; columns in each matrix */
+  uint16_t n_channels; /**< number of channels: 1 or 2 */
+  uint32_t stride;     /**< floats from the start of one row to the next */
+  uint16_t flags;      /**< DEGRADE_... reductions applied to any pulse of the sweep */
+  uint16_t max_level;  /**< highest degradation level of any block of the sweep */
+  std::vector<pulse_info> pulses; /**< metadata for each pulse */
+
+  /*!
+   * \brief return the sample matrix for a channel: n_pulses rows of n_samples, stride floats apart
+   */
+  const float *samples(uint16_t channel = 0) const {
+    return data + channel * capacity * stride;
+  };
+
+  /*!
+   * \brief return the samples of a channel for one pulse
+   */
+  const float *row(uint32_t pulse, uint16_t channel = 0) const {
+    return samples(channel) + pulse * stride;
+  };
+
+private:
+  friend class decoder;
+
+  sweep(const sweep &) = delete;
+  sweep &operator=(const sweep &) = delete;
+
+  void reset(uint32_t num_arp, uint16_t n_samples, uint16_t n_channels);
+  float *add_row(uint16_t channel);
+  void grow();
+
+  float *data;        // capacity rows per channel, each stride floats; aligned to DECODER_ROW_ALIGN
+  uint32_t capacity;  // rows allocated per channel
+};
+
+/*!
+ * \brief reads the digdar stream, one sweep at a time
+ */
+class decoder {
+public:
+  /*!
+   * \brief create a decoder for a radar with acps ACPs per sweep; used to compute bearings
+   */
+  decoder(uint16_t acps = 450);
+  ~decoder();
+
+  /*!
+   * \brief read the stream from a socket, pipe, or file descriptor; it is not closed by the decoder
+   */
+  int open_fd(int fd);
+
+  /*!
+   * \brief read the stream from a file, memory-mapped unless use_mmap is false
+   *
+   * Returns 0 on success, -1 on failure.
+   */
+  int open_file(const char *path, bool use_mmap = true);
+
+  /*!
+   * \brief wait for digdar --tcp to connect to port, and read the stream from that connection
+   *
+   * Returns 0 on success, -1 on failure.
+   */
+  int listen_tcp(uint16_t port);
+
+  /*!
+   * \brief treat the input as raw pulse records (as written by digdar without --header), which have no stream header
+   *
+   * Must be called before the first call to next().
+   */
+  void set_raw(uint16_t n_samples);
+
+  /*!
+   * \brief read the next complete sweep into s
+   *
+   * The final sweep in the stream is returned even if incomplete.
+   * Returns 1 if a sweep was read, 0 at the end of the stream, or -1 on error, which is printed to stderr.
+   */
+  int next(sweep &s);
+
+  /*!
+   * \brief return the stream header; valid once next() has been called
+   */
+  const digdar_stream_header &header() const {
+    return hdr;
+  };
+
+  /*!
+   * \brief return the number of bytes of stream consumed so far
+   */
+  uint64_t bytes_read() const {
+    return consumed;
+  };
+
+private:
+  decoder(const decoder &) = delete;
+  decoder &operator=(const decoder &) = delete;
+
+  const char *fetch(size_t n);
+  int read_stream_header();
+  int read_block_header();
+  void decode_pulse(sweep &s, const char *p);
+  void close();
+
+  uint16_t acps;
+  digdar_stream_header hdr;
+  bool raw;
+  bool started;         // true once the stream header has been read (or skipped, if raw)
+
+  sweep_header block;   // header of the block being read
+  uint32_t block_left;  // pulses not yet read from the block
+  bool have_pending;    // true if a pulse from the next sweep has been fetched but not decoded
+  const char *pending;  // that pulse
+
+  int fd;               // input, or -1 if memory-mapped
+  bool own_fd;          // true if fd was opened by the decoder
+  const char *map;      // memory-mapped file, or 0
+  size_t map_len;
+  std::vector<char> buf; // read buffer, when not memory-mapped
+  size_t pos;           // next unconsumed byte in map or buf
+  size_t end;           // end of valid bytes in map or buf
+  uint64_t consumed;
+};
+
+} // namespace digdar
+
+#endif /* INCLUDED_DIGDAR_DECODER_H */
@@ -0,0 +1,89 @@
+/*
+ * digdar_index - build sidecar indexes for raw digdar capture files, so
+ * that digdar_query can find sweeps in them without scanning.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "raw_index.h"
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "\n"
+          "Usage: %s [OPTION] FILE...\n"
+          "\n"
+          "Index each raw digdar capture FILE (as written by digdar without --header), writing FILE" DIGDAR_INDEX_SUFFIX ".\n"
+          "Files are indexed in parallel, each in one sequential pass.\n"
+          "\n"
+          "  --jobs -j N  Index up to N files at once; default: number of cores\n"
+          "  --samples -n SAMPLES  Samples per pulse record; default: 3000\n"
+          "  --help -h  Print this message.\n"
+          "\n", argv0);
+};
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"help",    no_argument,       0, 'h'},
+    {"jobs",    required_argument, 0, 'j'},
+    {"samples", required_argument, 0, 'n'},
+    {0, 0, 0, 0}
+  };
+  unsigned jobs = std::thread::hardware_concurrency();
+  uint16_t n_samples = 3000;
+
+  int ch;
+  while ((ch = getopt_long(argc, argv, "hj:n:", long_options, 0)) != -1) {
+    switch (ch) {
+    case 'j':
+      jobs = atoi(optarg);
+      break;
+    case 'n':
+      n_samples = atoi(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (optind == argc || n_samples == 0) {
+    usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  char **files = argv + optind;
+  unsigned n_files = argc - optind;
+  if (jobs < 1)
+    jobs = 1;
+  if (jobs > n_files)
+    jobs = n_files;
+
+  // each thread takes the next unindexed file until there are none left
+  std::atomic<unsigned> next_file(0);
+  std::atomic<unsigned> failures(0);
+  std::vector<std::thread> threads;
+  for (unsigned j = 0; j < jobs; ++j)
+    threads.push_back(std::thread([&]() {
+          unsigned i;
+          while ((i = next_file++) < n_files) {
+            int64_t n = digdar::raw_index_build(files[i], n_samples);
+            if (n < 0)
+              ++failures;
+            else
+              fprintf(stderr, "%s: %lld sweeps\n", files[i], (long long) n);
+          }
+        }));
+  for (unsigned j = 0; j < jobs; ++j)
+    threads[j].join();
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,262 @@
+/*
+ * digdar_query - extract sweeps, bearings and ranges from indexed raw
+ * digdar capture files, reading only the pulse records needed.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <math.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <vector>
+
+#include "raw_index.h"
+#include "pulse_metadata.h"
+
+/** Largest read of pulse records at once, in bytes */
+#define QUERY_READ_BYTES (4 * 1024 * 1024)
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "\n"
+          "Usage: %s [OPTION] FILE...\n"
+          "\n"
+          "Write to stdout the pulse records from raw digdar capture files which lie in the given\n"
+          "sweeps, times and bearings, keeping only the given range of samples.  Each FILE must\n"
+          "have been indexed by digdar_index.  Output is raw pulse records, like digdar without --header,\n"
+          "with END - START samples each.\n"
+          "\n"
+          "  --acps -a NACP  ACPs per sweep, for converting bearings; default: 450\n"
+          "  --bearings -b FROM:TO  Only pulses with bearing in [FROM, TO] degrees clockwise from heading;\n"
+          "                         if FROM > TO, the sector wraps through heading.\n"
+          "  --range -r START:END  Only samples START to END - 1 of each pulse\n"
+          "  --sweeps -s FIRST:LAST  Only sweeps with ARP count in [FIRST, LAST]\n"
+          "  --time -t FROM:TO  Only sweeps beginning in [FROM, TO] seconds since the epoch\n"
+          "  --help -h  Print this message.\n"
+          "\n", argv0);
+};
+
+static bool parse_pair(const char *s, double &a, double &b) {
+  char *end;
+  a = strtod(s, &end);
+  if (*end != ':')
+    return false;
+  b = strtod(end + 1, &end);
+  return *end == '\0';
+};
+
+struct query {
+  uint16_t acps = 450;
+  double sweep_first = 0, sweep_last = 4294967295.0;
+  double time_from = 0, time_to = INFINITY;
+  double bearing_from = 0, bearing_to = 360;
+  uint32_t range_start = 0, range_end = 0; // 0 end means all samples
+};
+
+static uint64_t records_written = 0;
+static uint64_t bytes_read = 0;
+
+static int read_fully(int fd, char *buf, size_t n, off_t offset) {
+  while (n > 0) {
+    ssize_t m = pread(fd, buf, n, offset);
+    if (m < 0 && errno == EINTR)
+      continue;
+    if (m <= 0)
+      return -1;
+    buf += m;
+    n -= m;
+    offset += m;
+    bytes_read += m;
+  }
+  return 0;
+};
+
+static int write_fully(int fd, const char *buf, size_t n) {
+  while (n > 0) {
+    ssize_t m = write(fd, buf, n);
+    if (m < 0 && errno == EINTR)
+      continue;
+    if (m <= 0)
+      return -1;
+    buf += m;
+    n -= m;
+  }
+  return 0;
+};
+
+static float acp_clock_at(int fd, uint64_t offset) {
+  // read just the acp_clock of the pulse record at offset
+  float acp = 0;
+  read_fully(fd, (char *) &acp, sizeof(acp), offset + offsetof(pulse_metadata, acp_clock));
+  return acp;
+};
+
+static uint32_t first_pulse_after(int fd, const digdar::raw_index_entry &e, uint32_t psize, float acp, bool inclusive) {
+  // binary search a run, whose pulses are in bearing order, for the first
+  // pulse with acp_clock >= acp (or > acp, if ! inclusive)
+  uint32_t lo = 0, hi = e.n_pulses;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    float a = acp_clock_at(fd, e.offset + (uint64_t) mid * psize);
+    if (inclusive ? a < acp : a <= acp)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+};
+
+static int copy_pulses(int fd, const digdar::raw_index_header &hdr, const query &q, uint64_t offset, uint32_t n,
+                       std::vector<char> &in, std::vector<char> &out) {
+  // read n consecutive pulse records starting at offset, and write them,
+  // trimmed to the range of samples wanted
+  const uint32_t meta = offsetof(pulse_metadata, data);
+  uint32_t keep = (q.range_end - q.range_start) * sizeof(uint16_t);
+  uint32_t per_read = QUERY_READ_BYTES / hdr.psize;
+  if (per_read == 0)
+    per_read = 1;
+  while (n > 0) {
+    uint32_t m = n < per_read ? n : per_read;
+    in.resize((size_t) m * hdr.psize);
+    if (read_fully(fd, &in[0], in.size(), offset) < 0)
+      return -1;
+    const char *src = &in[0];
+    if (keep + meta < hdr.psize) {
+      out.resize((size_t) m * (meta + keep));
+      for (uint32_t i = 0; i < m; ++i) {
+        const char *p = &in[0] + (size_t) i * hdr.psize;
+        char *o = &out[0] + (size_t) i * (meta + keep);
+        memcpy(o, p, meta);
+        memcpy(o + meta, p + meta + q.range_start * sizeof(uint16_t), keep);
+      }
+      src = &out[0];
+    }
+    if (write_fully(1, src, (size_t) m * (meta + keep)) < 0)
+      return -1;
+    records_written += m;
+    offset += (uint64_t) m * hdr.psize;
+    n -= m;
+  }
+  return 0;
+};
+
+static int query_file(const char *path, query q) {
+  digdar::raw_index_header hdr;
+  std::vector<digdar::raw_index_entry> entries;
+  if (digdar::raw_index_load(path, hdr, entries) < 0)
+    return -1;
+  if (q.range_end == 0 || q.range_end > hdr.n_samples)
+    q.range_end = hdr.n_samples;
+  if (q.range_start >= q.range_end) {
+    fprintf(stderr, "%s: range is empty; pulses have %d samples\n", path, hdr.n_samples);
+    return -1;
+  }
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "couldn't open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  float acp_from = q.bearing_from * q.acps / 360.0;
+  float acp_to = q.bearing_to * q.acps / 360.0;
+  bool all_bearings = q.bearing_from <= 0 && q.bearing_to >= 360;
+  std::vector<char> in, out;
+  int rv = 0;
+  for (size_t i = 0; rv == 0 && i < entries.size(); ++i) {
+    const digdar::raw_index_entry &e = entries[i];
+    double t = e.arp_clock_sec + e.arp_clock_nsec / 1.0e9;
+    if (e.num_arp < q.sweep_first || e.num_arp > q.sweep_last || t < q.time_from || t > q.time_to)
+      continue;
+    if (all_bearings) {
+      rv = copy_pulses(fd, hdr, q, e.offset, e.n_pulses, in, out);
+      continue;
+    }
+    uint32_t from = first_pulse_after(fd, e, hdr.psize, acp_from, true);
+    uint32_t to = first_pulse_after(fd, e, hdr.psize, acp_to, false);
+    if (acp_from <= acp_to) {
+      if (to > from)
+        rv = copy_pulses(fd, hdr, q, e.offset + (uint64_t) from * hdr.psize, to - from, in, out);
+    } else {
+      // sector wraps through heading; the pulses either side of it, in sweep order
+      rv = copy_pulses(fd, hdr, q, e.offset, to, in, out);
+      if (rv == 0 && from < e.n_pulses)
+        rv = copy_pulses(fd, hdr, q, e.offset + (uint64_t) from * hdr.psize, e.n_pulses - from, in, out);
+    }
+  }
+  if (rv < 0)
+    fprintf(stderr, "%s: error reading pulses or writing output: %s\n", path, strerror(errno));
+  close(fd);
+  return rv;
+};
+
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    {"acps",     required_argument, 0, 'a'},
+    {"bearings", required_argument, 0, 'b'},
+    {"help",     no_argument,       0, 'h'},
+    {"range",    required_argument, 0, 'r'},
+    {"sweeps",   required_argument, 0, 's'},
+    {"time",     required_argument, 0, 't'},
+    {0, 0, 0, 0}
+  };
+  query q;
+  double a, b;
+
+  int ch;
+  while ((ch = getopt_long(argc, argv, "a:b:hr:s:t:", long_options, 0)) != -1) {
+    switch (ch) {
+    case 'a':
+      q.acps = atoi(optarg);
+      break;
+    case 'b':
+      if (! parse_pair(optarg, q.bearing_from, q.bearing_to)) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'r':
+      if (! parse_pair(optarg, a, b) || a < 0 || b <= a) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      q.range_start = a;
+      q.range_end = b;
+      break;
+    case 's':
+      if (! parse_pair(optarg, q.sweep_first, q.sweep_last)) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 't':
+      if (! parse_pair(optarg, q.time_from, q.time_to)) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (optind == argc || q.acps == 0) {
+    usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  int rv = EXIT_SUCCESS;
+  for (int i = optind; i < argc; ++i)
+    if (query_file(argv[i], q) < 0)
+      rv = EXIT_FAILURE;
+  fprintf(stderr, "wrote %llu pulses, reading %.1f MB\n", (unsigned long long) records_written, bytes_read / 1.0e6);
+  return rv;
+}
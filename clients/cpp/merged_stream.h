@@ -0,0 +1,38 @@
+/*
+ * Format of the merged stream published by digdar_aggregate.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#ifndef _MERGED_STREAM_H_
+#define _MERGED_STREAM_H_
+
+#include <stdint.h>
+
+// The merged stream is a sequence of blocks, each a merged_block_header
+// followed by len bytes of payload taken unchanged from one source's
+// digdar stream: either that source's digdar_stream_header, sent when
+// the source connects (and to each consumer when it connects), or one
+// sweep_header and its pulse records.
+//
+// Sweep blocks from all sources are in order of the time of their first
+// pulse, as far as the sources' clocks agree, and are numbered in that
+// order by seq.
+
+#define DIGDAR_MERGED_MAGIC  0x4752454d  // "MERG" when read as bytes on a little-endian host
+
+#define MERGED_STREAM_HEADER 1  // payload is the source's digdar_stream_header
+#define MERGED_SWEEP_BLOCK   2  // payload is a sweep_header and its pulse records
+
+typedef struct {
+  uint32_t magic;   // DIGDAR_MERGED_MAGIC
+  uint16_t type;    // MERGED_STREAM_HEADER or MERGED_SWEEP_BLOCK
+  uint16_t source;  // source ID; sources are numbered from 0 in the order they connect
+  uint64_t seq;     // position of this block in the merged stream
+  double   time;    // UTC of the block's first pulse, in seconds since the epoch; 0 for stream headers
+  uint32_t len;     // bytes of payload following this header
+}   __attribute__((packed)) merged_block_header;
+
+#endif /* _MERGED_STREAM_H_ */
@@ -0,0 +1,150 @@
+/*
+ * raw_index - sidecar indexes of raw digdar capture files, for finding
+ * sweeps without scanning the whole file.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "raw_index.h"
+#include "pulse_metadata.h"
+
+namespace digdar {
+
+std::string raw_index_path(const char *capture) {
+  return std::string(capture) + DIGDAR_INDEX_SUFFIX;
+};
+
+static int write_fully(int fd, const void *buf, size_t n) {
+  // write n bytes from buf to fd, retrying after partial writes.
+  // Returns 0 on success, -1 on error.
+  const char *p = (const char *) buf;
+  while (n > 0) {
+    ssize_t m = write(fd, p, n);
+    if (m < 0 && errno == EINTR)
+      continue;
+    if (m <= 0)
+      return -1;
+    p += m;
+    n -= m;
+  }
+  return 0;
+};
+
+int64_t raw_index_build(const char *capture, uint16_t n_samples) {
+  int fd = open(capture, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "couldn't open %s: %s\n", capture, strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    fprintf(stderr, "couldn't stat %s: %s\n", capture, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  raw_index_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = DIGDAR_INDEX_MAGIC;
+  hdr.version = DIGDAR_INDEX_VERSION;
+  hdr.header_size = sizeof(hdr);
+  hdr.psize = offsetof(pulse_metadata, data) + n_samples * sizeof(uint16_t);
+  hdr.n_samples = n_samples;
+  hdr.file_size = st.st_size;
+
+  uint64_t n_pulses = st.st_size / hdr.psize;
+  if (n_pulses * hdr.psize != (uint64_t) st.st_size)
+    fprintf(stderr, "Warning: %s has a partial pulse record at the end, which won't be indexed;\n"
+            "is --samples %d correct?\n", capture, n_samples);
+
+  std::vector<raw_index_entry> entries;
+  if (n_pulses > 0) {
+    void *m = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) {
+      fprintf(stderr, "couldn't map %s: %s\n", capture, strerror(errno));
+      close(fd);
+      return -1;
+    }
+    madvise(m, st.st_size, MADV_SEQUENTIAL);
+    const char *base = (const char *) m;
+    raw_index_entry e;
+    memset(&e, 0, sizeof(e));
+    for (uint64_t i = 0; i < n_pulses; ++i) {
+      const char *p = base + i * hdr.psize;
+      uint32_t arp;
+      memcpy(&arp, p + offsetof(pulse_metadata, num_arp), sizeof(arp));
+      if (i == 0 || arp != e.num_arp) {
+        if (i > 0)
+          entries.push_back(e);
+        e.offset = i * hdr.psize;
+        e.num_arp = arp;
+        e.n_pulses = 0;
+        memcpy(&e.arp_clock_sec, p + offsetof(pulse_metadata, arp_clock_sec), sizeof(e.arp_clock_sec));
+        memcpy(&e.arp_clock_nsec, p + offsetof(pulse_metadata, arp_clock_nsec), sizeof(e.arp_clock_nsec));
+      }
+      ++e.n_pulses;
+    }
+    entries.push_back(e);
+    munmap(m, st.st_size);
+  }
+  close(fd);
+  hdr.n_entries = entries.size();
+
+  // write to a temporary file, then rename, so readers never see a partial index
+  std::string path = raw_index_path(capture);
+  std::string tmp = path + ".tmp";
+  int out = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    fprintf(stderr, "couldn't create %s: %s\n", tmp.c_str(), strerror(errno));
+    return -1;
+  }
+  if (write_fully(out, &hdr, sizeof(hdr)) < 0
+      || (! entries.empty() && write_fully(out, &entries[0], entries.size() * sizeof(entries[0])) < 0)
+      || close(out) < 0
+      || rename(tmp.c_str(), path.c_str()) < 0) {
+    fprintf(stderr, "couldn't write %s: %s\n", path.c_str(), strerror(errno));
+    unlink(tmp.c_str());
+    return -1;
+  }
+  return entries.size();
+};
+
+int raw_index_load(const char *capture, raw_index_header &hdr, std::vector<raw_index_entry> &entries) {
+  std::string path = raw_index_path(capture);
+  FILE *f = fopen(path.c_str(), "rb");
+  if (! f) {
+    fprintf(stderr, "couldn't open index %s: %s; run digdar_index first\n", path.c_str(), strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  int rv = -1;
+  if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != DIGDAR_INDEX_MAGIC || hdr.header_size < sizeof(hdr)) {
+    fprintf(stderr, "%s is not a digdar index\n", path.c_str());
+  } else if (hdr.version != DIGDAR_INDEX_VERSION) {
+    fprintf(stderr, "%s has unsupported version %d\n", path.c_str(), hdr.version);
+  } else if (stat(capture, &st) < 0 || (uint64_t) st.st_size != hdr.file_size) {
+    fprintf(stderr, "%s is out of date for %s; run digdar_index again\n", path.c_str(), capture);
+  } else if (fseek(f, hdr.header_size, SEEK_SET) < 0) {
+    fprintf(stderr, "couldn't read %s\n", path.c_str());
+  } else {
+    entries.resize(hdr.n_entries);
+    if (hdr.n_entries && fread(&entries[0], sizeof(entries[0]), hdr.n_entries, f) != hdr.n_entries)
+      fprintf(stderr, "%s is truncated\n", path.c_str());
+    else
+      rv = 0;
+  }
+  fclose(f);
+  return rv;
+};
+
+} // namespace digdar
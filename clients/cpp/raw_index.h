@@ -0,0 +1,77 @@
+/* -*- c++ -*- */
+/*
+ * raw_index - sidecar indexes of raw digdar capture files, for finding
+ * sweeps without scanning the whole file.
+ *
+ * Copyright 2011-2019 John Brzustowski
+ *
+ * This file is part of digdar.
+*/
+
+#ifndef INCLUDED_RAW_INDEX_H
+#define INCLUDED_RAW_INDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * A raw capture file (digdar without --header) is a sequence of fixed-size pulse
+ * records.  Its index, in FILE.ddidx, has one entry for each run of
+ * consecutive pulses from the same sweep, giving where the run starts,
+ * its ARP count and time, and how many pulses it has.  An hour of radar
+ * is a few thousand entries, so the index is read whole.
+ *
+ * The index records the size of the file it was made from, and is
+ * refused if that no longer matches (e.g. the file was still growing).
+ */
+
+namespace digdar {
+
+#define DIGDAR_INDEX_MAGIC   0x58444944  // "DIDX" when read as bytes on a little-endian host
+#define DIGDAR_INDEX_VERSION 1
+#define DIGDAR_INDEX_SUFFIX  ".ddidx"
+
+typedef struct {
+  uint32_t magic;        // DIGDAR_INDEX_MAGIC
+  uint16_t version;      // DIGDAR_INDEX_VERSION
+  uint16_t header_size;  // size of this header; entries begin immediately after it
+  uint32_t psize;        // size of each pulse record in the capture file
+  uint16_t n_samples;    // samples per pulse record
+  uint16_t reserved;
+  uint64_t file_size;    // size of the capture file when indexed
+  uint64_t n_entries;    // number of entries following this header
+}   __attribute__((packed)) raw_index_header;
+
+typedef struct {
+  uint64_t offset;          // byte offset in the capture file of the first pulse of the run
+  uint32_t num_arp;         // ARP count of the run's pulses
+  uint32_t n_pulses;        // number of consecutive pulses in the run
+  uint32_t arp_clock_sec;   // arp_clock_sec of the first pulse
+  uint32_t arp_clock_nsec;  // arp_clock_nsec of the first pulse
+}   __attribute__((packed)) raw_index_entry;
+
+/*!
+ * \brief return the name of the index for a capture file
+ */
+std::string raw_index_path(const char *capture);
+
+/*!
+ * \brief index a raw capture file with n_samples samples per pulse, writing the index beside it
+ *
+ * The file is read in one sequential pass through a memory map.  Errors
+ * are printed to stderr.  Returns the number of entries, or -1 on failure.
+ */
+int64_t raw_index_build(const char *capture, uint16_t n_samples);
+
+/*!
+ * \brief read the index of a capture file
+ *
+ * Fails if there is no index, or it doesn't match the file's current size.
+ * Errors are printed to stderr.  Returns 0 on success, -1 on failure.
+ */
+int raw_index_load(const char *capture, raw_index_header &hdr, std::vector<raw_index_entry> &entries);
+
+} // namespace digdar
+
+#endif /* INCLUDED_RAW_INDEX_H */